@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// 单调时钟（秒）
+static inline double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 生成一段类似固件初始化表的.elfc源码（注释密集、寄存器赋值密集），写入临时文件
+// 返回打开的文件（位置在开头），*out_size为字节数
+static inline FILE* bench_make_source(size_t target_bytes, size_t* out_size) {
+    FILE* fp = tmpfile();
+    if (!fp) {
+        perror("tmpfile");
+        exit(1);
+    }
+    static const char* regs[] = {"ax", "bx", "cx", "dx", "si", "di"};
+    size_t written = (size_t)fprintf(fp, "use x86_real;\n");
+    unsigned i = 0;
+    while (written < target_bytes) {
+        written += (size_t)fprintf(fp,
+            "// init table entry %u: configure controller register block\n"
+            "const ENTRY_%u = 0x%04x;\n"
+            "reg.%s = 0x%04x;  // value for slot %u\n"
+            "reg.%s = %u;\n",
+            i, i, i & 0xFFFF, regs[i % 6], (i * 7) & 0xFFFF, i, regs[(i + 1) % 6], i & 0x7FFF);
+        i++;
+    }
+    rewind(fp);
+    *out_size = written;
+    return fp;
+}
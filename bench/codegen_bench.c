@@ -0,0 +1,69 @@
+// Code emission benchmark: in-memory emitter vs. the old per-byte fputc path
+// Usage: ./bench/codegen_bench [statements]
+#include "../src/codegen/codegen.h"
+#include "bench_common.h"
+
+// -------------------------- Reference: per-byte fputc emission --------------------------
+// What codegen_reg_assign used to do: three fputc calls per instruction into a FILE*
+static size_t emit_fputc(AstNode* ast, FILE* out) {
+    size_t bytes = 0;
+    for (AstNode* node = ((BlockNode*)ast)->statements; node; node = node->next) {
+        if (node->type != AST_REG_ASSIGN) continue;
+        unsigned value = ((RegAssignNode*)node)->value.value.num_val;
+        fputc(0xB8, out);
+        fputc(value & 0xFF, out);
+        fputc((value >> 8) & 0xFF, out);
+        bytes += 3;
+    }
+    fflush(out);
+    return bytes;
+}
+
+int main(int argc, char* argv[]) {
+    size_t statements = argc > 1 ? (size_t)atol(argv[1]) : 1000000;
+    static const char stmt[] = "reg.ax = 0x1234;\n";
+    size_t len = (sizeof(stmt) - 1) * statements;
+    char* src = malloc(len);
+    for (size_t i = 0; i < statements; i++) memcpy(src + i * (sizeof(stmt) - 1), stmt, sizeof(stmt) - 1);
+
+    Lexer* lexer = lexer_init_buffer(src, len);
+    Parser* parser = parser_init(lexer);
+    AstNode* ast = parser_parse_file(parser);
+
+    double best_fputc = 1e30, best_emitter = 1e30;
+    size_t bytes = 0;
+    Emitter code;
+    emitter_init(&code, 0);
+    for (int rep = 0; rep < 5; rep++) {
+        FILE* out = tmpfile();
+        double t0 = bench_now();
+        emit_fputc(ast, out);
+        double dt = bench_now() - t0;
+        if (dt < best_fputc) best_fputc = dt;
+        fclose(out);
+
+        out = tmpfile();
+        emitter_reset(&code);
+        t0 = bench_now();
+        Codegen cg;
+        codegen_init(&cg, &code);
+        cg.optimize = 0;  // Same instructions as the fputc path, so the byte counts match
+        codegen_generate(&cg, ast);
+        codegen_cleanup(&cg);
+        emitter_write(&code, out);
+        dt = bench_now() - t0;
+        if (dt < best_emitter) best_emitter = dt;
+        bytes = code.len;
+        fclose(out);
+    }
+
+    printf("Code emission (%zu statements, %zu bytes, written to a temp file)\n", statements, bytes);
+    printf("  fputc per byte     : %8.1f MB/s\n", bytes / best_fputc / (1024.0 * 1024.0));
+    printf("  emitter + 1 write  : %8.1f MB/s (includes AST walk, IR and lowering)\n", bytes / best_emitter / (1024.0 * 1024.0));
+
+    emitter_free(&code);
+    parser_free(parser);
+    lexer_free(lexer);
+    free(src);
+    return 0;
+}
@@ -0,0 +1,129 @@
+// Keyword classification and register validation microbenchmark: compile-time perfect
+// hashes vs. the old strcmp chain / linear scan
+// Usage: ./bench/keyword_bench [millions of words]
+#include "../src/lexer/lexer.h"
+#include "../src/module/modules.h"
+#include "bench_common.h"
+
+// -------------------------- Reference: sequential strcmp chain --------------------------
+// Same order and shape as the original parse_identifier_or_keyword (NUL-terminated copy first)
+static TokenType strcmp_chain(const char* word, size_t len) {
+    char value[64];
+    if (len > 63) len = 63;
+    memcpy(value, word, len);
+    value[len] = '\0';
+    if (strcmp(value, "use") == 0) return TOKEN_USE;
+    if (strcmp(value, "const") == 0) return TOKEN_CONST;
+    if (strcmp(value, "var") == 0) return TOKEN_VAR;
+    if (strcmp(value, "func") == 0) return TOKEN_FUNC;
+    if (strcmp(value, "if") == 0) return TOKEN_IF;
+    if (strcmp(value, "else") == 0) return TOKEN_ELSE;
+    if (strcmp(value, "while") == 0) return TOKEN_WHILE;
+    if (strcmp(value, "for") == 0) return TOKEN_FOR;
+    if (strcmp(value, "in") == 0) return TOKEN_IN;
+    if (strcmp(value, "hlt") == 0) return TOKEN_ID;
+    return TOKEN_ID;
+}
+
+// Word mix typical of generated init sequences: mostly register and constant names
+static const char* words[] = {
+    "ax", "bx", "cx", "dx", "si", "di", "ENTRY_1024", "VIDEO_MEM", "const", "use",
+    "PIC_MASTER_CMD", "hlt", "for", "in", "ax", "bx", "UART_BASE", "while", "CTRL_REG_7", "di",
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+static volatile unsigned sink;
+
+// -------------------------- Reference: the old module_has_reg --------------------------
+// A fixed 64-entry array scanned with strcmp, on a NUL-terminated copy of the token
+typedef struct {
+    char name[32];
+    int bits;
+} LinearRegister;
+
+static const LinearRegister linear_regs[64] = {
+    {"ax", 16}, {"bx", 16}, {"cx", 16}, {"dx", 16}, {"sp", 16}, {"bp", 16}, {"si", 16}, {"di", 16},
+};
+
+static int linear_has_reg(const char* word, size_t len) {
+    char value[64];
+    if (len > 63) len = 63;
+    memcpy(value, word, len);
+    value[len] = '\0';
+    for (int i = 0; i < 8; i++) {
+        if (strcmp(value, linear_regs[i].name) == 0) return 1;
+    }
+    return 0;
+}
+
+// Register operands of reg.<name> = ...: valid names, plus the occasional typo
+static const char* reg_words[] = {"ax", "bx", "cx", "dx", "si", "di", "sp", "bp", "di", "ax", "bx", "eax"};
+#define REG_WORD_COUNT (sizeof(reg_words) / sizeof(reg_words[0]))
+
+static void bench_registers(size_t millions) {
+    const Module* module = module_load("x86_real");
+    size_t iterations = millions * 1000000 / REG_WORD_COUNT;
+    size_t lens[REG_WORD_COUNT];
+    for (size_t i = 0; i < REG_WORD_COUNT; i++) {
+        lens[i] = strlen(reg_words[i]);
+        if (linear_has_reg(reg_words[i], lens[i]) != (module_find_reg(module, reg_words[i], lens[i]) != NULL)) {
+            fprintf(stderr, "Register validation mismatch for '%s'\n", reg_words[i]);
+            exit(1);
+        }
+    }
+
+    unsigned acc = 0;
+    double t0 = bench_now();
+    for (size_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < REG_WORD_COUNT; i++) acc += linear_has_reg(reg_words[i], lens[i]);
+    }
+    double linear_dt = bench_now() - t0;
+
+    t0 = bench_now();
+    for (size_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < REG_WORD_COUNT; i++) acc += module_find_reg(module, reg_words[i], lens[i]) != NULL;
+    }
+    double hash_dt = bench_now() - t0;
+    sink = acc;
+
+    double total = (double)iterations * REG_WORD_COUNT;
+    printf("Register validation (%.0fM names)\n", total / 1e6);
+    printf("  linear strcmp: %7.2f ns/name\n", linear_dt / total * 1e9);
+    printf("  perfect hash : %7.2f ns/name\n", hash_dt / total * 1e9);
+    printf("  speedup      : %7.2fx\n", linear_dt / hash_dt);
+}
+
+int main(int argc, char* argv[]) {
+    size_t millions = argc > 1 ? (size_t)atoi(argv[1]) : 50;
+    size_t iterations = millions * 1000000 / WORD_COUNT;
+    size_t lens[WORD_COUNT];
+    for (size_t i = 0; i < WORD_COUNT; i++) {
+        lens[i] = strlen(words[i]);
+        if (strcmp_chain(words[i], lens[i]) != lexer_classify_word(NULL, words[i], lens[i])) {
+            fprintf(stderr, "Classification mismatch for '%s'\n", words[i]);
+            return 1;
+        }
+    }
+
+    unsigned acc = 0;
+    double t0 = bench_now();
+    for (size_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < WORD_COUNT; i++) acc += strcmp_chain(words[i], lens[i]);
+    }
+    double chain_dt = bench_now() - t0;
+
+    t0 = bench_now();
+    for (size_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < WORD_COUNT; i++) acc += lexer_classify_word(NULL, words[i], lens[i]);
+    }
+    double hash_dt = bench_now() - t0;
+    sink = acc;
+
+    double total = (double)iterations * WORD_COUNT;
+    printf("Keyword classification (%.0fM words)\n", total / 1e6);
+    printf("  strcmp chain : %7.2f ns/word\n", chain_dt / total * 1e9);
+    printf("  perfect hash : %7.2f ns/word\n", hash_dt / total * 1e9);
+    printf("  speedup      : %7.2fx\n", chain_dt / hash_dt);
+    bench_registers(millions);
+    return 0;
+}
@@ -0,0 +1,181 @@
+// Lexer throughput benchmark: mapped buffer lexer vs. the original fgetc-based lexer
+// Usage: ./bench/lexer_bench [megabytes]
+#include "../src/lexer/lexer.h"
+#include "../src/lexer/charclass.h"
+#include "../src/common/utils.h"
+#include "bench_common.h"
+#include <ctype.h>
+
+// -------------------------- Reference: original fgetc/fseek lexer --------------------------
+// Frozen copy of the stream-based scanner this benchmark measures against. Only the
+// comment/newline loop was fixed so it can get through commented sources at all; it
+// keeps its own 64-byte value-copying token layout.
+typedef struct {
+    TokenType type;
+    char value[64];
+    uint32_t line;
+} LegacyToken;
+
+typedef struct {
+    FILE* fp;
+    int line;
+    int current_char;
+} LegacyLexer;
+
+static void legacy_next_char(LegacyLexer* lexer) {
+    lexer->current_char = fgetc(lexer->fp);
+    if (lexer->current_char == '\n') lexer->line++;
+}
+
+static LegacyToken legacy_identifier(LegacyLexer* lexer) {
+    LegacyToken tok;
+    tok.line = lexer->line;
+    int i = 0;
+    while (lexer->current_char != EOF && (isalnum(lexer->current_char) || lexer->current_char == '_')) {
+        if (i < 63) tok.value[i++] = lexer->current_char;
+        legacy_next_char(lexer);
+    }
+    tok.value[i] = '\0';
+    static const struct { const char* word; TokenType type; } keywords[] = {
+        {"use", TOKEN_USE}, {"const", TOKEN_CONST}, {"var", TOKEN_VAR}, {"func", TOKEN_FUNC},
+        {"if", TOKEN_IF}, {"else", TOKEN_ELSE}, {"while", TOKEN_WHILE}, {"for", TOKEN_FOR},
+        {"in", TOKEN_IN}, {"hlt", TOKEN_ID},
+    };
+    tok.type = TOKEN_ID;
+    for (size_t k = 0; k < sizeof(keywords) / sizeof(keywords[0]); k++) {
+        if (strcmp(tok.value, keywords[k].word) == 0) {
+            tok.type = keywords[k].type;
+            break;
+        }
+    }
+    return tok;
+}
+
+static LegacyToken legacy_number(LegacyLexer* lexer) {
+    LegacyToken tok;
+    tok.line = lexer->line;
+    int i = 0;
+    if (lexer->current_char == '0' && (fpeek(lexer->fp) == 'x' || fpeek(lexer->fp) == 'X')) {
+        tok.type = TOKEN_NUM_HEX;
+        tok.value[i++] = '0';
+        legacy_next_char(lexer);
+        tok.value[i++] = tolower(lexer->current_char);
+        legacy_next_char(lexer);
+        while (lexer->current_char != EOF && isxdigit(lexer->current_char)) {
+            if (i < 63) tok.value[i++] = tolower(lexer->current_char);
+            legacy_next_char(lexer);
+        }
+    } else {
+        tok.type = TOKEN_NUM_DEC;
+        while (lexer->current_char != EOF && isdigit(lexer->current_char)) {
+            if (i < 63) tok.value[i++] = lexer->current_char;
+            legacy_next_char(lexer);
+        }
+    }
+    tok.value[i] = '\0';
+    return tok;
+}
+
+static LegacyToken legacy_prefixed(LegacyLexer* lexer, char c1, char c2, TokenType type, const char* text) {
+    long pos = ftell(lexer->fp);
+    char buffer[4];
+    if (fread(buffer, 1, 3, lexer->fp) == 3 && buffer[0] == c1 && buffer[1] == c2 && buffer[2] == '.') {
+        LegacyToken tok;
+        tok.type = type;
+        tok.line = lexer->line;
+        strcpy(tok.value, text);
+        legacy_next_char(lexer);
+        return tok;
+    }
+    fseek(lexer->fp, pos, SEEK_SET);
+    return legacy_identifier(lexer);
+}
+
+static LegacyToken legacy_next_token(LegacyLexer* lexer) {
+    while (lexer->current_char != EOF) {
+        while (lexer->current_char != EOF && isspace(lexer->current_char)) legacy_next_char(lexer);
+        if (lexer->current_char == '/' && fpeek(lexer->fp) == '/') {
+            while (lexer->current_char != EOF && lexer->current_char != '\n') legacy_next_char(lexer);
+            continue;
+        }
+        if (lexer->current_char == EOF) break;
+        if (lexer->current_char == 'r') return legacy_prefixed(lexer, 'e', 'g', TOKEN_REG, "reg.");
+        if (lexer->current_char == 'm') return legacy_prefixed(lexer, 'e', 'm', TOKEN_MEM, "mem.");
+        if (isalpha(lexer->current_char) || lexer->current_char == '_') return legacy_identifier(lexer);
+        if (isdigit(lexer->current_char)) return legacy_number(lexer);
+
+        LegacyToken tok;
+        tok.line = lexer->line;
+        tok.value[0] = (char)lexer->current_char;
+        tok.value[1] = '\0';
+        switch (lexer->current_char) {
+            case '=': tok.type = TOKEN_EQUALS; break;
+            case ';': tok.type = TOKEN_SEMICOLON; break;
+            default: error("Unknown character: %c (line: %d)", lexer->current_char, lexer->line);
+        }
+        legacy_next_char(lexer);
+        return tok;
+    }
+    LegacyToken eof_tok;
+    eof_tok.type = TOKEN_EOF;
+    eof_tok.line = lexer->line;
+    eof_tok.value[0] = '\0';
+    return eof_tok;
+}
+
+// -------------------------- Benchmark driver --------------------------
+static size_t run_legacy(FILE* fp) {
+    rewind(fp);
+    LegacyLexer lexer = {fp, 1, fgetc(fp)};
+    size_t count = 0;
+    while (legacy_next_token(&lexer).type != TOKEN_EOF) count++;
+    return count;
+}
+
+static size_t run_mapped(FILE* fp) {
+    rewind(fp);
+    Lexer* lexer = lexer_init(fp);
+    size_t count = 0;
+    while (lexer_next_token(lexer).type != TOKEN_EOF) count++;
+    lexer_free(lexer);
+    return count;
+}
+
+// Best of several runs, in MB/s
+static double measure(size_t (*run)(FILE*), FILE* fp, size_t bytes, size_t* tokens) {
+    double best = 1e30;
+    for (int rep = 0; rep < 5; rep++) {
+        double t0 = bench_now();
+        *tokens = run(fp);
+        double dt = bench_now() - t0;
+        if (dt < best) best = dt;
+    }
+    return bytes / best / (1024.0 * 1024.0);
+}
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = argc > 1 ? (size_t)atoi(argv[1]) : 16;
+    size_t bytes = 0;
+    FILE* fp = bench_make_source(megabytes * 1024 * 1024, &bytes);
+
+    size_t legacy_tokens = 0, mapped_tokens = 0;
+    double legacy_mbs = measure(run_legacy, fp, bytes, &legacy_tokens);
+    printf("Lexer throughput (%.1f MB input, %zu tokens)\n", bytes / (1024.0 * 1024.0), legacy_tokens);
+    printf("  fgetc/fseek lexer      : %8.1f MB/s\n", legacy_mbs);
+
+    // Mapped lexer once per character-scanning implementation the CPU supports
+    const char* default_impl = scan_impl_name();
+    static const char* impls[] = {"scalar", "sse2", "avx2"};
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (!scan_set_impl(impls[i])) continue;
+        double mapped_mbs = measure(run_mapped, fp, bytes, &mapped_tokens);
+        if (legacy_tokens != mapped_tokens) {
+            fprintf(stderr, "Token count mismatch: legacy %zu, mapped %zu\n", legacy_tokens, mapped_tokens);
+            return 1;
+        }
+        printf("  mapped lexer (%-6s)  : %8.1f MB/s  (%.2fx)\n", impls[i], mapped_mbs, mapped_mbs / legacy_mbs);
+    }
+    scan_set_impl(default_impl);
+    fclose(fp);
+    return 0;
+}
@@ -0,0 +1,113 @@
+// Compilations per second: libecc in process (warm and cold contexts) vs. fork/exec
+// of the command line compiler on a file, for a boot-image-sized source
+// Usage: ./bench/lib_bench [in-process compilations] [fork/exec compilations]
+#include "../src/lib/ecc.h"
+#include "bench_common.h"
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BENCH_COMPILER "./elfc-compiler"
+
+// A few hundred lines: constants, a leaf function and its calls, stores, a loop
+static char* bench_boot_source(size_t* len) {
+    size_t cap = 64 * 1024, used = 0;
+    char* src = malloc(cap);
+    used += snprintf(src + used, cap - used,
+                     "use x86_real;\nconst VGA = 0xB8000;\n"
+                     "func put(c, x) { mem.byte[VGA + x * 2] = c; mem.byte[VGA + x * 2 + 1] = 0x07; }\n");
+    for (unsigned i = 0; i < 120; i++) {
+        used += snprintf(src + used, cap - used,
+                         "const PORT_%u = 0x%x;\nreg.ax = PORT_%u;\nmem.word[0x%x] = 0x%x;\nput('%c', %u);\n",
+                         i, 0x3F8 + i, i, 0x500 + i * 2, i * 37 & 0xFFFF, 'A' + i % 26, i % 80);
+    }
+    used += snprintf(src + used, cap - used, "var n = 16; while n { n = n - 1; mem.word[0x7000] = n; }\n");
+    *len = used;
+    return src;
+}
+
+static double bench_in_process(const char* src, size_t len, int count, int warm, EccBuffer* out) {
+    EccContext* ctx = warm ? ecc_context_new(NULL) : NULL;
+    double t0 = bench_now();
+    for (int i = 0; i < count; i++) {
+        if (!warm) ctx = ecc_context_new(NULL);
+        if (ecc_compile(ctx, src, len, out) != 0) {
+            fprintf(stderr, "%s", ecc_diagnostics(ctx));
+            exit(1);
+        }
+        if (!warm) ecc_context_free(ctx);
+    }
+    double dt = bench_now() - t0;
+    if (warm) ecc_context_free(ctx);
+    return dt;
+}
+
+// What the build server does today: write the source, run the compiler, wait for it
+static double bench_fork_exec(const char* src, size_t len, int count, EccBuffer* expected) {
+    char in_path[] = "/tmp/lib_bench_XXXXXX";
+    int fd = mkstemp(in_path);
+    if (fd < 0 || write(fd, src, len) != (ssize_t)len) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+    char out_path[sizeof(in_path) + 4];
+    snprintf(out_path, sizeof(out_path), "%s.bin", in_path);
+
+    double t0 = bench_now();
+    for (int i = 0; i < count; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            execl(BENCH_COMPILER, BENCH_COMPILER, "compile", "-el", in_path, "-ma", out_path, (char*)NULL);
+            _exit(127);
+        }
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "%s failed\n", BENCH_COMPILER);
+            exit(1);
+        }
+    }
+    double dt = bench_now() - t0;
+
+    // Same machine code either way
+    FILE* fp = fopen(out_path, "rb");
+    uint8_t* bytes = malloc(expected->len + 1);
+    size_t got = fp ? fread(bytes, 1, expected->len + 1, fp) : 0;
+    if (got != expected->len || memcmp(bytes, expected->data, got) != 0) {
+        fprintf(stderr, "fork/exec output differs from ecc_compile\n");
+        exit(1);
+    }
+    if (fp) fclose(fp);
+    free(bytes);
+    unlink(in_path);
+    unlink(out_path);
+    return dt;
+}
+
+int main(int argc, char* argv[]) {
+    int in_process = argc > 1 ? atoi(argv[1]) : 5000;
+    int forked = argc > 2 ? atoi(argv[2]) : 300;
+    size_t len;
+    char* src = bench_boot_source(&len);
+    EccBuffer out = {0};
+
+    double best_warm = 1e30, best_cold = 1e30;
+    for (int rep = 0; rep < 3; rep++) {
+        double dt = bench_in_process(src, len, in_process, 1, &out);
+        if (dt < best_warm) best_warm = dt;
+        dt = bench_in_process(src, len, in_process, 0, &out);
+        if (dt < best_cold) best_cold = dt;
+    }
+    printf("In-process vs. fork/exec compilation (%zu source bytes, %zu code bytes)\n", len, out.len);
+    printf("  ecc_compile, warm context : %9.0f compilations/s\n", in_process / best_warm);
+    printf("  ecc_compile, new context  : %9.0f compilations/s\n", in_process / best_cold);
+    if (access(BENCH_COMPILER, X_OK) == 0) {
+        double dt = bench_fork_exec(src, len, forked, &out);
+        printf("  fork/exec %s : %9.0f compilations/s (warm context is %.1fx faster)\n", BENCH_COMPILER,
+               forked / dt, (forked / dt) > 0 ? (in_process / best_warm) / (forked / dt) : 0.0);
+    } else {
+        printf("  fork/exec %s : skipped (build it with make)\n", BENCH_COMPILER);
+    }
+    ecc_buffer_free(&out);
+    free(src);
+    return 0;
+}
@@ -1,43 +1,186 @@
 #include "cli.h"
 #include "../common/utils.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 
+#define CLI_USAGE \
+    "Usage:\n" \
+    "  Debug: %s debug -el <input.elfc> -ma <output.bin> [--stream | --incremental] [--max-errors <n>] [--stats[=json]]\n" \
+    "  Normal: %s compile -el <input.elfc> -ma <output.bin> [--stream | --incremental] [--max-errors <n>] [--stats[=json]]\n" \
+    "  Batch: %s batch [-j <threads>] [--manifest <list>] [-el <input.elfc> -ma <output.bin>]... [--stream | --incremental] [--max-errors <n>]\n" \
+    "  Serve (Linux only): %s serve <socket> [-j <threads>] [--max-errors <n>]\n" \
+    "  --incremental reuses the code of unchanged regions from <output>.ecccache. The output is about twice\n" \
+    "  the size of a normal build: top-level variables live in stack slots (a bp frame, reloaded and saved in\n" \
+    "  every region), DS is reloaded in every region, and constant folding and dead-code removal stop at\n" \
+    "  region boundaries."
+
+static EccFile* cli_add_file(EccConfig* cfg, size_t* cap) {
+    if (cfg->file_count == *cap) {
+        *cap = *cap ? *cap * 2 : 16;
+        cfg->files = realloc(cfg->files, *cap * sizeof(EccFile));
+        if (!cfg->files) error("Memory allocation failed (%zu batch files)", *cap);
+    }
+    EccFile* file = &cfg->files[cfg->file_count++];
+    file->input_file = file->output_file = NULL;
+    return file;
+}
+
+// Manifest: one "<input.elfc> <output.bin>" pair per line, blank lines and # comments
+// skipped. Paths are taken as given (relative to the working directory) and cannot
+// contain whitespace.
+static void cli_load_manifest(EccConfig* cfg, const char* path, size_t* cap) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) error("Cannot open manifest: %s", path);
+    size_t len = 0, size = 4096;
+    char* text = safe_malloc(size);
+    for (size_t n; (n = fread(text + len, 1, size - len - 1, fp)) > 0;) {
+        len += n;
+        if (size - len > 1) continue;
+        text = realloc(text, size *= 2);
+        if (!text) error("Memory allocation failed (manifest %s)", path);
+    }
+    fclose(fp);
+    text[len] = '\0';
+    cfg->manifest = text;
+
+    int line = 1;
+    for (char* p = text; *p;) {
+        char* end = strchr(p, '\n');
+        if (end) *end = '\0';
+        char* hash = strchr(p, '#');
+        if (hash) *hash = '\0';
+        char* fields[3];
+        int n = 0;
+        for (char* tok = p; n < 3;) {
+            tok += strspn(tok, " \t\r");
+            if (!*tok) break;
+            fields[n++] = tok;
+            tok += strcspn(tok, " \t\r");
+            if (*tok) *tok++ = '\0';
+        }
+        if (n == 1 || n == 3) error("%s:%d: expected \"<input.elfc> <output.bin>\"", path, line);
+        if (n == 2) {
+            EccFile* file = cli_add_file(cfg, cap);
+            file->input_file = fields[0];
+            file->output_file = fields[1];
+        }
+        if (!end) break;
+        p = end + 1;
+        line++;
+    }
+}
+
 // Parse command line arguments
 EccConfig cli_parse_args(int argc, char* argv[]) {
     EccConfig cfg = {0};
     cfg.is_debug = 0;
 
     // Check parameter format
-    if (argc != 6) {
-        error("Usage:\n"
-              "  Debug: %s debug -el <input.elfc> -ma <output.bin>\n"
-              "  Normal: %s compile -el <input.elfc> -ma <output.bin>", argv[0], argv[0]);
+    if (argc < 3 || (strcmp(argv[1], "batch") != 0 && strcmp(argv[1], "serve") != 0 && argc < 6)) {
+        error(CLI_USAGE, argv[0], argv[0], argv[0], argv[0]);
     }
 
     // Identify mode
     if (strcmp(argv[1], "debug") == 0) {
         cfg.is_debug = 1;
+    } else if (strcmp(argv[1], "batch") == 0) {
+        cfg.batch = 1;
+    } else if (strcmp(argv[1], "serve") == 0) {
+        cfg.serve = 1;
+        cfg.socket_path = argv[2];
     } else if (strcmp(argv[1], "compile") != 0) {
-        error("Unknown mode: %s (only debug/compile supported)", argv[1]);
+        error("Unknown mode: %s (only debug/compile/batch/serve supported)", argv[1]);
     }
 
-    // Parse file paths
-    for (int i = 2; i < argc; i += 2) {
-        if (strcmp(argv[i], "-el") == 0) cfg.input_file = argv[i+1];
-        else if (strcmp(argv[i], "-ma") == 0) cfg.output_file = argv[i+1];
-        else error("Unknown option: %s (only -el/-ma supported)", argv[i]);
+    // Parse file paths and options
+    size_t cap = 0;
+    const char* manifest = NULL;
+    for (int i = cfg.serve ? 3 : 2; i < argc; i++) {
+        if (cfg.serve) {
+            // Sources come over the socket; only the worker count and error limit apply
+            if (strcmp(argv[i], "-j") != 0 && strcmp(argv[i], "--max-errors") != 0) {
+                error("Unknown option: %s (only -j/--max-errors supported)", argv[i]);
+            }
+            if (i + 1 >= argc) error("Missing value after %s", argv[i]);
+            if (argv[i][1] == 'j') {
+                cfg.jobs = (int)str_to_dec(argv[++i]);
+            } else {
+                cfg.max_errors = (int)str_to_dec(argv[++i]);
+                if (cfg.max_errors < 1) error("--max-errors must be at least 1");
+            }
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            cfg.stream = 1;
+        } else if (strcmp(argv[i], "--incremental") == 0) {
+            cfg.incremental = 1;
+        } else if (!cfg.batch && (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=json") == 0)) {
+            cfg.stats = argv[i][7] == '=' ? 2 : 1;
+        } else if (strcmp(argv[i], "-el") == 0 || strcmp(argv[i], "-ma") == 0) {
+            if (i + 1 >= argc) error("Missing path after %s", argv[i]);
+            if (!cfg.batch) {
+                if (argv[i][1] == 'e') cfg.input_file = argv[i + 1];
+                else cfg.output_file = argv[i + 1];
+            } else if (argv[i][1] == 'e') {
+                // Batch: each -el starts a pair, the -ma after it completes it
+                if (cfg.file_count && !cfg.files[cfg.file_count - 1].output_file) {
+                    error("Missing -ma for %s", cfg.files[cfg.file_count - 1].input_file);
+                }
+                cli_add_file(&cfg, &cap)->input_file = argv[i + 1];
+            } else {
+                if (!cfg.file_count || cfg.files[cfg.file_count - 1].output_file) {
+                    error("-ma %s does not follow an -el input", argv[i + 1]);
+                }
+                cfg.files[cfg.file_count - 1].output_file = argv[i + 1];
+            }
+            i++;
+        } else if (strcmp(argv[i], "--max-errors") == 0) {
+            if (i + 1 >= argc) error("Missing value after %s", argv[i]);
+            cfg.max_errors = (int)str_to_dec(argv[++i]);
+            if (cfg.max_errors < 1) error("--max-errors must be at least 1");
+        } else if (cfg.batch && (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--manifest") == 0)) {
+            if (i + 1 >= argc) error("Missing value after %s", argv[i]);
+            if (argv[i][1] == 'j') cfg.jobs = (int)str_to_dec(argv[i + 1]);
+            else manifest = argv[i + 1];
+            i++;
+        } else {
+            error(cfg.batch ? "Unknown option: %s (only -el/-ma/-j/--manifest/--stream/--incremental/--max-errors supported)"
+                            : "Unknown option: %s (only -el/-ma/--stream/--incremental/--max-errors/--stats supported)", argv[i]);
+        }
     }
 
-    // Check if paths are empty
-    if (!cfg.input_file || !cfg.output_file) {
+    if (cfg.batch) {
+        if (cfg.file_count && !cfg.files[cfg.file_count - 1].output_file) {
+            error("Missing -ma for %s", cfg.files[cfg.file_count - 1].input_file);
+        }
+        if (manifest) cli_load_manifest(&cfg, manifest, &cap);
+        if (!cfg.file_count) error("Batch mode needs -el/-ma pairs or a --manifest");
+        // Two jobs writing one output (or one cache file) would race
+        for (size_t i = 0; i < cfg.file_count; i++) {
+            for (size_t j = 0; j < i; j++) {
+                if (strcmp(cfg.files[i].output_file, cfg.files[j].output_file) == 0) {
+                    error("Output file %s is given twice", cfg.files[i].output_file);
+                }
+            }
+        }
+    } else if (!cfg.serve && (!cfg.input_file || !cfg.output_file)) {
+        // Check if paths are empty
         error("Missing file paths (-el or -ma not specified)");
     }
+    // Incremental mode keeps the whole output in memory to splice cached code into it
+    if (cfg.stream && cfg.incremental) error("--stream and --incremental cannot be combined");
 
     return cfg;
 }
 
+void cli_free_config(EccConfig* cfg) {
+    free(cfg->files);
+    free(cfg->manifest);
+    cfg->files = NULL;
+    cfg->manifest = NULL;
+    cfg->file_count = 0;
+}
+
 // Print welcome message (debug mode only)
 void cli_print_welcome(const EccConfig* cfg) {
     if (!cfg->is_debug) return;
@@ -1,16 +1,38 @@
 #ifndef CLI_H
 #define CLI_H
 
+#include <stddef.h>
+
+// One input/output pair of a batch
+typedef struct {
+    char* input_file;
+    char* output_file;
+} EccFile;
+
 // Configuration structure: stores debug mode, file paths, etc.
 typedef struct {
     char* input_file;   // Input .elfc path
     char* output_file;  // Output .bin path
     int is_debug;       // 1=debug mode, 0=normal mode
+    int stream;         // 1=streaming parse-and-emit (--stream), 0=build the full AST first
+    int incremental;    // 1=reuse code of unchanged regions from <output>.ecccache (--incremental)
+    int max_errors;     // Stop after reporting this many errors (--max-errors), 0=ERROR_DEFAULT_MAX
+    int stats;          // Per-phase statistics after compiling: 0=off, 1=table (--stats), 2=JSON (--stats=json)
+    int batch;          // 1=batch mode: compile files[] concurrently
+    int jobs;           // Batch worker threads (-j), 0=one per CPU
+    EccFile* files;     // Batch: -el/-ma pairs in order, then the manifest entries
+    size_t file_count;
+    char* manifest;     // Batch: text of the --manifest file (files[] points into it)
+    int serve;          // 1=compile server mode: answer compile requests on socket_path
+    char* socket_path;  // Serve: Unix domain socket to listen on
 } EccConfig;
 
 // Parse command line arguments, return configuration (exit on failure)
 EccConfig cli_parse_args(int argc, char* argv[]);
 
+// Free what cli_parse_args allocated for batch mode
+void cli_free_config(EccConfig* cfg);
+
 // Print welcome message in debug mode
 void cli_print_welcome(const EccConfig* cfg);
 
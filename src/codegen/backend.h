@@ -0,0 +1,54 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include "../ir/ir.h"
+#include "emitter.h"
+#include <stdint.h>
+
+// Label addresses, kept by codegen across flushes. Offsets are absolute positions in
+// the image, so a call can reach a function that was lowered in an earlier flush.
+#define BACKEND_LABEL_UNBOUND UINT32_MAX
+
+typedef struct {
+    uint32_t* offset;  // Indexed by label number, BACKEND_LABEL_UNBOUND until lowered
+    size_t count;
+    size_t cap;
+    uint32_t base;     // Image offset of the next byte the backend appends
+} BackendLabels;
+
+// Target backend: instruction selection and encoding for one instruction set.
+// The front half of codegen only produces IR; everything target-specific goes here.
+typedef struct Backend {
+    const char* name;   // Module name (use x86_real;); register names and numbers are in the
+                        // module table (module/modules.def)
+    int reg_bits;       // Width of the general registers (immediates are checked against it)
+    uint32_t max_address;  // Highest address a memory store can reach
+    const char* (*reg_name)(int reg);
+    // Calling convention: the first arg_reg_count arguments are passed in these
+    // registers, the rest are pushed right to left and popped by the caller
+    const int* arg_regs;
+    int arg_reg_count;
+    int loop_reg;  // Counter register IR_LOOP decrements
+    // Register allocation: variables live in alloc_regs (preferred first) or in frame slots
+    // addressed from frame_reg, at most max_slots per function and at top level.
+    // Calls may change every allocatable register.
+    const int* alloc_regs;
+    int alloc_reg_count;
+    int frame_reg;
+    int max_slots;
+
+    // Lower optimized IR into machine code appended to out; optimize enables the
+    // target's own peephole pass. Binds the labels defined in ir and advances
+    // labels->base. Working memory comes from ir->scratch. Returns the bytes that pass saved.
+    size_t (*lower)(IrProgram* ir, BackendLabels* labels, Emitter* out, int optimize);
+} Backend;
+
+extern const Backend x86_real_backend;
+extern const Backend x86_pm32_backend;  // Flat 32-bit protected mode
+extern const Backend riscv32_backend;   // RV32I
+extern const Backend riscv32c_backend;  // RV32IC (compressed instructions)
+
+// Backend for a module name, NULL if there is none
+const Backend* backend_lookup(const char* name);
+
+#endif // BACKEND_H
@@ -1,97 +1,586 @@
 #include "codegen.h"
 #include "../common/utils.h"
-#include "../module/modules.h"  // 后续用于验证registerwhether属于currentmodule
 #include <string.h>
 
-// Global output file (code generator writes machine code here)
-static FILE* out_fp;
-
-// x86实moderegister与opcode的映射表（mov reg, imm16的opcode）
-typedef struct {
-    const char* reg_name;  // register名（ax、bx等）
-    unsigned char opcode;  // 对应的opcode
-} X86RegOpcode;
-
-static X86RegOpcode x86_reg_opcodes[] = {
-    {"ax", 0xB8},
-    {"bx", 0xBB},
-    {"cx", 0xB9},
-    {"dx", 0xBA},
-    {"sp", 0xBC},
-    {"bp", 0xBD},
-    {"si", 0xBE},
-    {"di", 0xBF},
-    {NULL, 0x00}  // End marker
-};
-
-// Helperfunction：根据register名查找opcode
-static unsigned char get_reg_opcode(const char* reg_name) {
-    for (int i = 0; x86_reg_opcodes[i].reg_name; i++) {
-        if (strcmp(reg_name, x86_reg_opcodes[i].reg_name) == 0) {
-            return x86_reg_opcodes[i].opcode;
+_Static_assert(IR_TOP_VARS == PARSER_MAX_BINDINGS, "top-level variables are numbered by binding slot");
+
+static IrOp codegen_ir_op(int token) {
+    switch (token) {
+        case TOKEN_PLUS:      return IR_ADD;
+        case TOKEN_MINUS:     return IR_SUB;
+        case TOKEN_ASTERISK:  return IR_MUL;
+        case TOKEN_SLASH:     return IR_DIV;
+        case TOKEN_AMPERSAND: return IR_AND;
+        default:              return IR_OR;
+    }
+}
+
+// Compile-time value of an expression, if every binding it uses is constant
+// (depth is bounded by the source's parentheses)
+static int codegen_eval(const Codegen* cg, const Expr* expr, uint32_t* out) {
+    switch (expr->kind) {
+        case EXPR_CONST:
+            *out = expr->value;
+            return 1;
+        case EXPR_PARAM:
+            *out = cg->bindings[expr->param].imm;
+            return cg->bindings[expr->param].is_const;
+        default: {
+            uint32_t a, b;
+            return codegen_eval(cg, expr->lhs, &a) && codegen_eval(cg, expr->rhs, &b) &&
+                   ir_fold(codegen_ir_op(expr->op), a, b, out);
+        }
+    }
+}
+
+static int codegen_const(const Codegen* cg, const ConstExpr* value, uint32_t* out) {
+    if (value->type != CONST_EXPR) {
+        *out = value->value.num_val;
+        return 1;
+    }
+    return codegen_eval(cg, value->value.expr, out);
+}
+
+// Helperfunction：表达式树生成IR（parameter/循环变量取当前作用域的绑定值）
+static IrValue codegen_expr(Codegen* cg, const Expr* expr) {
+    switch (expr->kind) {
+        case EXPR_CONST:
+            return ir_const(&cg->ir, expr->value);
+        case EXPR_PARAM: {
+            const CodegenBinding* binding = &cg->bindings[expr->param];
+            return binding->var >= 0 ? ir_get_var(&cg->ir, (uint32_t)binding->var) : binding->value;
+        }
+        default: {
+            IrValue a = codegen_expr(cg, expr->lhs);
+            IrValue b = codegen_expr(cg, expr->rhs);
+            return ir_binary(&cg->ir, codegen_ir_op(expr->op), a, b);
         }
     }
-    error("Unknownregister：%s（x86实mode不support）", reg_name);
-    return 0;  //  unreachable
 }
 
-// Helperfunction：生成registerassignment的机器码（AST_REG_ASSIGN节点）
-static void codegen_reg_assign(RegAssignNode* node) {
-    // 1. 获取register对应的opcode（如ax→0xB8）
-    unsigned char opcode = get_reg_opcode(node->reg_name);
-    fputc(opcode, out_fp);  // Write opcode
+static IrValue codegen_value(Codegen* cg, const ConstExpr* value) {
+    uint32_t imm;
+    if (codegen_const(cg, value, &imm)) return ir_const(&cg->ir, imm);
+    return codegen_expr(cg, value->value.expr);
+}
+
+// Helperfunction：生成registerassignment的IR（AST_REG_ASSIGN节点）
+static void codegen_reg_assign(Codegen* cg, RegAssignNode* node) {
+    // 1. register编号在解析时已经由module验证过（module表里就是backend的编号）
+    int reg = node->reg;
 
-    // 2. 处理16位立即数（小端序存储）
+    // 2. 检查立即数不超过register宽度（依赖运行时parameter的值这里还不知道）
     // Note: ELFCOST initially assumes 16-bit registers (common in x86 real mode)
-    unsigned int value = node->value.value.num_val;
-    if (value > 0xFFFF) {
-        error("Register assignment exceeds 16-bit range (value: 0x%x, line: %d)", value, node->base.line);
+    uint32_t value;
+    if (codegen_const(cg, &node->value, &value) && cg->backend->reg_bits < 32 && value >> cg->backend->reg_bits) {
+        error_report(cg->errors, "Register assignment exceeds %d-bit range (value: 0x%x, line: %d)",
+                     cg->backend->reg_bits, value, node->base.line);
+        return;  // Reported: the statement is left out, the ones after it are still checked
+    }
+
+    // vN = value; reg = vN
+    ir_set_reg(&cg->ir, reg, codegen_value(cg, &node->value));
+}
+
+// Helperfunction：生成memoryassignment的IR（AST_MEM_ASSIGN节点）
+static void codegen_mem_assign(Codegen* cg, MemAssignNode* node) {
+    uint32_t addr, value;
+    int width = node->width;
+
+    // 值必须放得进目标宽度，整个写入范围必须在backend可寻址的范围内
+    if (codegen_const(cg, &node->value, &value) && width < 4 && value >> (8 * width)) {
+        error_report(cg->errors, "Memory assignment exceeds %d-bit range (value: 0x%x, line: %d)", 8 * width, value,
+                     node->base.line);
+        return;
+    }
+    if (codegen_const(cg, &node->addr, &addr) &&
+        (addr > cg->backend->max_address || cg->backend->max_address - addr < (uint32_t)width - 1)) {
+        error_report(cg->errors, "Memory address out of range for %s (address: 0x%x, limit: 0x%x, line: %d)",
+                     cg->backend->name, addr, cg->backend->max_address, node->base.line);
+        return;
+    }
+
+    // memN[vA] = vB；backend把相邻的store合并
+    ir_store(&cg->ir, width, codegen_value(cg, &node->addr), codegen_value(cg, &node->value));
+}
+
+// IR variable for a source variable: top-level ones keep their binding slot, so they
+// can stay live across flushes
+static int codegen_new_var(Codegen* cg, const char* name, int slot) {
+    uint32_t var = cg->scope_depth == 0 && slot >= 0 ? (uint32_t)slot : cg->next_var++;
+    if (cg->alloc_log) {
+        if (var >= cg->var_name_cap) {
+            size_t cap = cg->var_name_cap * 2;
+            while (cap <= var) cap *= 2;
+            char** grown = realloc(cg->var_names, cap * sizeof(char*));
+            if (!grown) error("Memory allocation failed (variable names, %zu)", cap);
+            memset(grown + cg->var_name_cap, 0, (cap - cg->var_name_cap) * sizeof(char*));
+            cg->var_names = grown;
+            cg->var_name_cap = cap;
+        }
+        free(cg->var_names[var]);
+        cg->var_names[var] = strdup(name);  // The AST of a streamed statement is gone by the flush
+    }
+    return (int)var;
+}
+
+// Helperfunction：变量definition和assignment（AST_VAR_DEF / AST_VAR_ASSIGN节点）
+static void codegen_var_assign(Codegen* cg, VarAssignNode* node) {
+    uint32_t value;
+    int known = codegen_const(cg, &node->value, &value);
+    if (known && cg->backend->reg_bits < 32 && value >> cg->backend->reg_bits) {
+        error_report(cg->errors, "Variable assignment exceeds %d-bit range (value: 0x%x, line: %d)",
+                     cg->backend->reg_bits, value, node->base.line);
+        value &= (1u << cg->backend->reg_bits) - 1;  // The variable still needs a value for later statements
+    }
+    // Before the binding: var x = x is the outer x
+    IrValue v = known ? ir_const(&cg->ir, value) : codegen_expr(cg, node->value.value.expr);
+    CodegenBinding* binding = &cg->bindings[node->slot];
+    if (node->base.type == AST_VAR_DEF) {
+        if (cg->scope_depth == 0) cg->top_vars++;
+        *binding = (CodegenBinding){0, 0, 0, codegen_new_var(cg, node->var_name, node->slot)};
+    }
+    ir_set_var(&cg->ir, (uint32_t)binding->var, v);
+}
+
+static void codegen_flush_ir(Codegen* cg, int final);
+
+// Helperfunction：module选择（AST_USE节点）：之后的语句由这个module的backend生成
+static void codegen_use(Codegen* cg, UseNode* node) {
+    const Backend* backend = backend_lookup(node->module->name);
+    if (!backend) error("Module %s has no code generator (line: %d)", node->module->name, node->base.line);
+    if (backend == cg->backend) return;
+    // Variables live in the previous backend's registers and frame, and its functions
+    // use its calling convention: neither carries over
+    if (cg->top_vars) {
+        error("Cannot switch to module %s after defining top-level variables (line: %d)", backend->name,
+              node->base.line);
+    }
+    codegen_flush_ir(cg, 1);  // The pending IR belongs to the previous backend
+    ir_regalloc_free(&cg->alloc);
+    ir_regalloc_init(&cg->alloc);
+    cg->backend_label_base = cg->labels.count;
+    cg->backend = backend;
+}
+
+static int codegen_new_label(Codegen* cg) {
+    BackendLabels* labels = &cg->labels;
+    if (labels->count == labels->cap) {
+        size_t cap = labels->cap ? labels->cap * 2 : 64;
+        uint32_t* grown = realloc(labels->offset, cap * sizeof(uint32_t));
+        if (!grown) error("Memory allocation failed (labels, %zu)", cap);
+        labels->offset = grown;
+        labels->cap = cap;
+    }
+    labels->offset[labels->count] = BACKEND_LABEL_UNBOUND;
+    return (int)labels->count++;
+}
+
+// Small leaf functions never get a body of their own: every call is replaced by the statements
+static int codegen_inlines(const FuncDefNode* func) {
+    return func->is_leaf && func->stmt_count <= CODEGEN_INLINE_MAX_STMTS;
+}
+
+static void codegen_visit(AstVisitor* visitor, AstNode* node, int depth);
+static void codegen_leave(AstVisitor* visitor, AstNode* node, int depth);
+
+// Generate a statement list in the current scope (control flow nests this, so stack
+// depth follows the source's nesting, not its length)
+static void codegen_walk(Codegen* cg, AstNode* statements) {
+    if (!statements) return;
+    AstVisitor visitor = {codegen_visit, codegen_leave, cg};
+    cg->scope_depth++;
+    ast_walk(statements, &visitor);
+    cg->scope_depth--;
+}
+
+// Helperfunction：functiondefinition开始（AST_FUNC_DEF节点）
+// jmp over; entry: enter; parameter绑定到入口register/栈上的实参（enter在没有frame时什么都不生成）
+static void codegen_func_enter(Codegen* cg, AstVisitor* visitor, FuncDefNode* node) {
+    if (codegen_inlines(node)) {
+        visitor->skip_children = 1;
+        return;
+    }
+    node->label = codegen_new_label(cg);
+    cg->skip_label = codegen_new_label(cg);
+    ir_jmp(&cg->ir, cg->skip_label);
+    ir_label(&cg->ir, node->label);
+
+    // The register allocator reserves the function's frame slots in the enter
+    int in_regs = cg->backend->arg_reg_count;
+    ir_enter(&cg->ir, node->param_count > in_regs);
+    cg->scope_depth++;
+    for (int i = 0; i < node->param_count; i++) {
+        CodegenBinding* param = &cg->bindings[node->slot + i];
+        if (i < in_regs) {
+            // The argument register is the caller's to overwrite (register assignments,
+            // calls): the parameter lives in a variable the allocator keeps or spills
+            int var = codegen_new_var(cg, node->params[i], -1);
+            ir_set_var(&cg->ir, (uint32_t)var, ir_get_reg(&cg->ir, cg->backend->arg_regs[i]));
+            *param = (CodegenBinding){0, 0, 0, var};
+        } else {
+            *param = (CodegenBinding){ir_get_arg(&cg->ir, i - in_regs), 0, 0, -1};
+        }
+    }
+}
+
+static void codegen_func_leave(Codegen* cg, FuncDefNode* node) {
+    if (node->label < 0) return;  // Inlined
+    cg->scope_depth--;
+    ir_ret(&cg->ir, node->param_count > cg->backend->arg_reg_count);
+    ir_label(&cg->ir, cg->skip_label);
+}
+
+// Helperfunction：function调用（AST_FUNC_CALL节点）
+static void codegen_func_call(Codegen* cg, FuncCallNode* node) {
+    FuncDefNode* func = node->target;
+    int count = node->arg_count;
+
+    if (func->label >= 0 && (size_t)func->label < cg->backend_label_base) {
+        error("Function %s was compiled for another module (line: %d)", func->func_name, node->base.line);
+    }
+    if (func->label < 0) {
+        // Inline: the body runs in a scope of its own with the parameters bound to the
+        // argument values, so constant arguments fold straight into the statements
+        CodegenBinding* scope = safe_malloc(PARSER_MAX_BINDINGS * sizeof(CodegenBinding));
+        for (int i = 0; i < count; i++) {
+            CodegenBinding* param = &scope[func->slot + i];
+            param->is_const = codegen_const(cg, &node->args[i], &param->imm);  // In the caller's scope
+            param->value = codegen_value(cg, &node->args[i]);
+            param->var = -1;
+        }
+        CodegenBinding* saved = cg->bindings;
+        cg->bindings = scope;
+        codegen_walk(cg, func->body);
+        cg->bindings = saved;
+        free(scope);
+        return;
+    }
+
+    // Stack arguments right to left, then the register arguments. Values that live in
+    // registers go through the stack so no argument register is overwritten before it
+    // is read (ir_propagate cancels the push and pop of a parameter passed on in the
+    // register it arrived in); constants are loaded last.
+    // Computed arguments are evaluated into variables first: a push takes a register or a constant
+    IrValue* args = safe_malloc((count ? count : 1) * sizeof(IrValue));
+    for (int i = 0; i < count; i++) {
+        const ConstExpr* arg = &node->args[i];
+        uint32_t imm;
+        args[i] = codegen_value(cg, arg);
+        if (!codegen_const(cg, arg, &imm) && arg->value.expr->kind == EXPR_BINARY) {
+            int var = codegen_new_var(cg, func->params[i], -1);
+            ir_set_var(&cg->ir, (uint32_t)var, args[i]);
+            args[i] = ir_get_var(&cg->ir, (uint32_t)var);
+        }
+    }
+    int in_regs = count < cg->backend->arg_reg_count ? count : cg->backend->arg_reg_count;
+    uint8_t* shuffle = safe_malloc(in_regs ? in_regs : 1);
+    for (int i = 0; i < in_regs; i++) {
+        uint32_t imm;
+        shuffle[i] = !codegen_const(cg, &node->args[i], &imm);
+    }
+    for (int i = count; i-- > in_regs;) ir_push(&cg->ir, args[i]);
+    for (int i = 0; i < in_regs; i++) {
+        if (shuffle[i]) ir_push(&cg->ir, args[i]);
+    }
+    for (int i = in_regs; i-- > 0;) {
+        if (shuffle[i]) ir_pop(&cg->ir, cg->backend->arg_regs[i]);
+    }
+    for (int i = 0; i < in_regs; i++) {
+        if (!shuffle[i]) ir_set_reg(&cg->ir, cg->backend->arg_regs[i], args[i]);
+    }
+    free(shuffle);
+    ir_call(&cg->ir, func->label, count - in_regs);
+    free(args);
+}
+
+// Helperfunction：if（AST_IF节点）
+// 条件在编译期已知时只生成走到的分支，否则：jz else; then; jmp end; else: ...; end:
+static void codegen_if(Codegen* cg, IfNode* node) {
+    uint32_t cond;
+    if (codegen_const(cg, &node->cond, &cond)) {
+        BlockNode* taken = cond ? node->then_block : node->else_block;
+        if (taken) codegen_walk(cg, taken->statements);
+        return;
+    }
+    int else_label = codegen_new_label(cg);
+    ir_branch_zero(&cg->ir, codegen_value(cg, &node->cond), else_label);
+    codegen_walk(cg, node->then_block->statements);
+    if (!node->else_block) {
+        ir_label(&cg->ir, else_label);
+        return;
+    }
+    int end_label = codegen_new_label(cg);
+    ir_jmp(&cg->ir, end_label);
+    ir_label(&cg->ir, else_label);
+    codegen_walk(cg, node->else_block->statements);
+    ir_label(&cg->ir, end_label);
+}
+
+// Helperfunction：while（AST_WHILE节点）
+// top: [jz end]; body; jmp top; end:（条件恒为真时没有测试，恒为假时什么都不生成）
+static void codegen_while(Codegen* cg, WhileNode* node) {
+    uint32_t cond;
+    int known = codegen_const(cg, &node->cond, &cond);
+    if (known && !cond) return;
+    int top = codegen_new_label(cg);
+    int end = known ? -1 : codegen_new_label(cg);
+    ir_label(&cg->ir, top);
+    if (!known) ir_branch_zero(&cg->ir, codegen_value(cg, &node->cond), end);
+    codegen_walk(cg, node->body);
+    ir_jmp(&cg->ir, top);
+    if (!known) ir_label(&cg->ir, end);
+}
+
+// Helperfunction：for（AST_FOR节点）
+// 小的常量范围直接展开（循环变量在每份循环体里都是常量）；否则用backend的计数register：
+// mov cx, n; top: push cx; body; pop cx; loop top（循环体可以随便用cx）
+static void codegen_for(Codegen* cg, ForNode* node) {
+    uint32_t start, end;
+    if (!codegen_const(cg, &node->start, &start) || !codegen_const(cg, &node->end, &end)) {
+        error_report(cg->errors, "for range must be known at compile time (line: %d)", node->base.line);
+        return;
+    }
+    if (end <= start) return;
+    uint32_t count = end - start;
+    CodegenBinding* var = &cg->bindings[node->slot];
+    uint32_t stmts = node->stmt_count ? (uint32_t)node->stmt_count : 1;
+
+    if (cg->optimize && count <= CODEGEN_UNROLL_MAX_STMTS && count * stmts <= CODEGEN_UNROLL_MAX_STMTS) {
+        for (uint32_t i = start; i < end; i++) {
+            *var = (CodegenBinding){ir_const(&cg->ir, i), 1, i, -1};
+            codegen_walk(cg, node->body);
+        }
+        return;
     }
 
-    // 小端序：低bytes先写，高bytes后写
-    fputc((value & 0xFF), out_fp);         // 低8位
-    fputc(((value >> 8) & 0xFF), out_fp);  // 高8位
+    if (cg->backend->reg_bits < 32 && count >> cg->backend->reg_bits) {
+        error_report(cg->errors, "for loop runs %u times, more than a %d-bit counter holds (line: %d)",
+                     count, cg->backend->reg_bits, node->base.line);
+        return;
+    }
+    int counter_reg = cg->backend->loop_reg;
+    ir_set_reg(&cg->ir, counter_reg, ir_const(&cg->ir, count));
+    int top = codegen_new_label(cg);
+    ir_label(&cg->ir, top);
+    IrValue counter = ir_get_reg(&cg->ir, counter_reg);  // count - iteration
+    ir_push(&cg->ir, counter);
+    // The loop variable is a variable of the body: the body is free to change the counter
+    *var = (CodegenBinding){0, 0, 0, codegen_new_var(cg, node->var_name, -1)};
+    IrValue value = ir_binary(&cg->ir, IR_SUB, ir_const(&cg->ir, end), ir_get_reg(&cg->ir, counter_reg));
+    ir_set_var(&cg->ir, (uint32_t)var->var, value);
+    codegen_walk(cg, node->body);
+    ir_pop(&cg->ir, counter_reg);
+    ir_loop(&cg->ir, top);
 }
 
-// Recursively traverse AST and generate machine code
-static void codegen_traverse(AstNode* node) {
-    if (!node || node->type == AST_EOF) return;
+// Visitor callback: generate machine code for one node (ast_walk handles blocks and order)
+static void codegen_visit(AstVisitor* visitor, AstNode* node, int depth) {
+    Codegen* cg = visitor->ctx;
 
     // Generate corresponding machine code based on node type
     switch (node->type) {
         case AST_REG_ASSIGN:
-            codegen_reg_assign((RegAssignNode*)node);
+            codegen_reg_assign(cg, (RegAssignNode*)node);
+            break;
+        case AST_MEM_ASSIGN:
+            codegen_mem_assign(cg, (MemAssignNode*)node);
             break;
         case AST_CONST_DEF:
             // Constant definition processed at compile time, no machine code generated (only record value for later use)
             break;
-        case AST_BLOCK: {
-            BlockNode* block = (BlockNode*)node;
-            codegen_traverse(block->statements);  // 递归处理code block内的语句
+        case AST_VAR_DEF:
+        case AST_VAR_ASSIGN:
+            codegen_var_assign(cg, (VarAssignNode*)node);
+            break;
+        case AST_USE:
+            codegen_use(cg, (UseNode*)node);
+            break;
+        case AST_BLOCK:
+            // Statements inside the block are visited next by ast_walk
+            break;
+        case AST_FUNC_DEF:
+            codegen_func_enter(cg, visitor, (FuncDefNode*)node);
+            break;
+        case AST_FUNC_CALL:
+            codegen_func_call(cg, (FuncCallNode*)node);
+            break;
+        // Control flow generates its bodies itself (they may be skipped, repeated or jumped over)
+        case AST_IF:
+            visitor->skip_children = 1;
+            codegen_if(cg, (IfNode*)node);
+            break;
+        case AST_WHILE:
+            visitor->skip_children = 1;
+            codegen_while(cg, (WhileNode*)node);
+            break;
+        case AST_FOR:
+            visitor->skip_children = 1;
+            codegen_for(cg, (ForNode*)node);
             break;
-        }
-        // Other node types (memory operations, function calls, etc.) to be implemented later
         default:
             error("暂不support的AST节点type（%d，line：%d）", node->type, node->line);
     }
+}
+
+static void codegen_leave(AstVisitor* visitor, AstNode* node, int depth) {
+    if (node->type == AST_FUNC_DEF) codegen_func_leave(visitor->ctx, (FuncDefNode*)node);
+}
+
+// Initialize code generator (bind output buffer)
+void codegen_init(Codegen* cg, Emitter* out) {
+    if (!out) error("Code generator initialization failed: output buffer is null");
+    cg->out = out;
+    cg->backend = &x86_real_backend;
+    ir_init(&cg->ir);
+    cg->labels = (BackendLabels){NULL, 0, 0, 0};
+    cg->backend_label_base = 0;
+    cg->bindings = safe_malloc(PARSER_MAX_BINDINGS * sizeof(CodegenBinding));
+    cg->skip_label = -1;
+    cg->scope_depth = 0;
+    cg->next_var = IR_TOP_VARS;
+    ir_regalloc_init(&cg->alloc);
+    cg->top_vars = 0;
+    cg->var_names = calloc(IR_TOP_VARS * 2, sizeof(char*));
+    if (!cg->var_names) error("Memory allocation failed (variable names)");
+    cg->var_name_cap = IR_TOP_VARS * 2;
+    cg->alloc_log = NULL;
+    cg->errors = NULL;
+    cg->optimize = 1;
+    cg->stats = NULL;
+    cg->ir_insns = cg->ir_removed = cg->bytes_saved = 0;
+}
+
+// One line per variable: where it lives and over which instructions
+static void codegen_log_alloc(Codegen* cg) {
+    const IrRegAlloc* ra = &cg->alloc;
+    for (size_t i = 0; i < ra->loc_count; i++) {
+        const IrVarLoc* loc = &ra->locs[i];
+        const char* name = loc->var < cg->var_name_cap ? cg->var_names[loc->var] : NULL;
+        fprintf(cg->alloc_log, "[DEBUG] regalloc: %s -> ", name ? name : "?");
+        if (loc->reg >= 0) fprintf(cg->alloc_log, "%s", cg->backend->reg_name(loc->reg));
+        else fprintf(cg->alloc_log, "stack slot %d (spilled)", loc->slot);
+        fprintf(cg->alloc_log, ", live over IR %u-%u, %u use%s", loc->first, loc->last, loc->uses, loc->uses == 1 ? "" : "s");
+        if (loc->loop_depth) fprintf(cg->alloc_log, ", loop depth %d", loc->loop_depth);
+        fprintf(cg->alloc_log, "\n");
+    }
+}
+
+// Add the time since start to a phase and return the time now (only with cg->stats)
+static double codegen_time(Codegen* cg, StatsPhase phase, double start) {
+    double now = stats_now();
+    cg->stats->seconds[phase] += now - start;
+    return now;
+}
+
+// Time spent in flushes so far (the phases of codegen_flush_ir)
+static double codegen_flush_seconds(const CompileStats* stats) {
+    double seconds = 0;
+    for (int phase = STATS_REGALLOC; phase <= STATS_LOWER; phase++) seconds += stats->seconds[phase];
+    return seconds;
+}
+
+// Allocate, optimize and lower everything generated so far
+static void codegen_flush_ir(Codegen* cg, int final) {
+    const Backend* backend = cg->backend;
+    IrRegFile regs = {backend->alloc_regs, backend->alloc_reg_count, backend->frame_reg, backend->max_slots,
+                      backend->arg_regs, backend->arg_reg_count, backend->loop_reg};
+    cg->ir_insns += cg->ir.count;
+    double start = cg->stats ? stats_now() : 0;
+    ir_regalloc(&cg->ir, &regs, &cg->alloc, final);
+    if (cg->alloc_log) codegen_log_alloc(cg);
+    if (cg->stats) start = codegen_time(cg, STATS_REGALLOC, start);
+    if (cg->optimize) {
+        cg->ir_removed += ir_optimize(&cg->ir, cg->stats ? &cg->stats->seconds[STATS_IR_PROPAGATE] : NULL);
+        if (cg->stats) start = stats_now();
+    }
+    cg->bytes_saved += backend->lower(&cg->ir, &cg->labels, cg->out, cg->optimize);
+    if (cg->stats) codegen_time(cg, STATS_LOWER, start);
+    ir_reset(&cg->ir);
 
-    // Process next node in linked list
-    codegen_traverse(node->next);
+    // Variables of nested blocks end with their statement
+    for (size_t var = IR_TOP_VARS; var < cg->var_name_cap && var < cg->next_var; var++) {
+        free(cg->var_names[var]);
+        cg->var_names[var] = NULL;
+    }
+    cg->next_var = IR_TOP_VARS;
+}
+
+void codegen_flush(Codegen* cg) {
+    codegen_flush_ir(cg, 0);
+}
+
+void codegen_finish(Codegen* cg) {
+    codegen_flush_ir(cg, 1);
+}
+
+void codegen_splice(Codegen* cg, const uint8_t* code, size_t len) {
+    if (cg->ir.count) error("Cannot splice cached code while %zu IR instructions are pending", cg->ir.count);
+    emitter_bytes(cg->out, code, len);
+    cg->labels.base += (uint32_t)len;
 }
 
-// Initialize code generator (bind output file)
-void codegen_init(FILE* out_file) {
-    out_fp = out_file;
-    if (!out_fp) error("Code generator initialization failed: output file is null");
+// Top-level walk (iterative, stack use independent of statement count). Timed as IR
+// generation, without the flushes a module switch does in the middle of it
+static void codegen_walk_top(Codegen* cg, AstNode* ast) {
+    AstVisitor visitor = {codegen_visit, codegen_leave, cg};
+    if (!cg->stats) {
+        ast_walk(ast, &visitor);
+        return;
+    }
+    double flushed = codegen_flush_seconds(cg->stats);
+    double start = stats_now();
+    ast_walk(ast, &visitor);
+    cg->stats->seconds[STATS_IR_GEN] += stats_now() - start - (codegen_flush_seconds(cg->stats) - flushed);
 }
 
 // Machine code generation entry function
-void codegen_generate(AstNode* ast) {
+void codegen_generate(Codegen* cg, AstNode* ast) {
     if (!ast) error("Code generation failed: AST is null");
-    codegen_traverse(ast);  // Start traversing AST
+    codegen_walk_top(cg, ast);
+    error_context_check(cg->errors);
+    codegen_finish(cg);
+}
+
+// Single statement entry function (streaming mode)
+void codegen_statement(Codegen* cg, AstNode* stmt) {
+    AstNode* next = stmt->next;
+    stmt->next = NULL;  // Walk this statement only
+    codegen_walk_top(cg, stmt);
+    stmt->next = next;
 }
 
-// Cleanup function (flush file cache, ensure data written to disk)
-void codegen_cleanup() {
-    if (out_fp) fflush(out_fp);
-}
\ No newline at end of file
+void codegen_reset(Codegen* cg, Emitter* out) {
+    if (!out) error("Code generator reset failed: output buffer is null");
+    cg->out = out;
+    cg->backend = &x86_real_backend;
+    ir_reset(&cg->ir);
+    cg->labels.count = 0;
+    cg->labels.base = 0;
+    cg->backend_label_base = 0;
+    cg->skip_label = -1;
+    cg->scope_depth = 0;
+    cg->next_var = IR_TOP_VARS;
+    ir_regalloc_reset(&cg->alloc);
+    cg->top_vars = 0;
+    for (size_t var = 0; var < cg->var_name_cap; var++) {
+        free(cg->var_names[var]);
+        cg->var_names[var] = NULL;
+    }
+    cg->ir_insns = cg->ir_removed = cg->bytes_saved = 0;
+}
+
+// Cleanup function (the output buffer belongs to the caller, nothing is flushed here)
+void codegen_cleanup(Codegen* cg) {
+    ir_free(&cg->ir);
+    free(cg->labels.offset);
+    cg->labels = (BackendLabels){NULL, 0, 0, 0};
+    free(cg->bindings);
+    cg->bindings = NULL;
+    for (size_t var = 0; var < cg->var_name_cap; var++) free(cg->var_names[var]);
+    free(cg->var_names);
+    cg->var_names = NULL;
+    cg->var_name_cap = 0;
+    ir_regalloc_free(&cg->alloc);
+    cg->out = NULL;
+}
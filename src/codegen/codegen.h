@@ -4,13 +4,74 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "../common/utils.h"
+#include "../common/stats.h"
 #include "../lexer/lexer.h"
 #include "../parser/parser.h"
+#include "emitter.h"
+#include "../ir/ir.h"
+#include "backend.h"
+
+// Leaf functions with at most this many statements are inlined at every call
+#define CODEGEN_INLINE_MAX_STMTS 8
+// Constant-range for loops are unrolled when iterations * body statements stays within this
+#define CODEGEN_UNROLL_MAX_STMTS 32
+
+// Value of a parameter, loop variable or variable (Expr::param indexes these) in the scope being generated
+typedef struct {
+    IrValue value;
+    int is_const;   // Known at compile time (constant argument of an inlined call, unrolled loop)
+    uint32_t imm;
+    int var;        // IR variable read on every use (register parameter, var, runtime loop variable), -1 otherwise
+} CodegenBinding;
+
+// Code generator state: no globals, so several compilations can run side by side.
+// Statements are translated to IR; codegen_flush optimizes the IR and hands it to
+// the backend, which appends machine code to out.
+typedef struct {
+    Emitter* out;            // Machine code is appended here (owned by the caller)
+    const Backend* backend;  // Target: x86_real until a use statement selects another module
+    IrProgram ir;            // IR generated since the last flush
+    BackendLabels labels;    // Function entry points, kept across flushes
+    size_t backend_label_base;  // Labels below this were lowered by an earlier backend
+    CodegenBinding* bindings;  // PARSER_MAX_BINDINGS entries: top-level variables, parameters, then
+                               // loop variables and variables of nested blocks
+    int skip_label;          // Label after the function body being generated
+    int scope_depth;         // Nested blocks and function bodies around the statement being generated
+    uint32_t next_var;       // Next IR variable number for variables that are not top-level
+    IrRegAlloc alloc;        // Register allocator state (homes of top-level variables)
+    int top_vars;            // Top-level variables defined with the current backend
+    char** var_names;        // Source names by IR variable number, kept for alloc_log
+    size_t var_name_cap;
+    FILE* alloc_log;         // Where each flush reports its register allocation (NULL = silent)
+    ErrorContext* errors;    // Range checks report here and skip the statement (NULL = the first one is fatal);
+                             // other errors (module switches, lowering) end the compilation
+    int optimize;            // Run IR passes and the backend peephole (default 1)
+    CompileStats* stats;     // Phase times are added here (NULL = nothing is timed)
+    size_t ir_insns;         // Total IR instructions generated
+    size_t ir_removed;       // Total IR instructions removed by the IR passes
+    size_t bytes_saved;      // Total bytes removed by the backend peephole pass
+} Codegen;
 
 // Code generator function declarations
-void codegen_init(FILE* out_file);
-void codegen_generate(AstNode* ast);
-void codegen_cleanup();
+void codegen_init(Codegen* cg, Emitter* out);
+void codegen_generate(Codegen* cg, AstNode* ast);
+// Generate code for one statement (and its children) only, ignoring stmt->next (streaming mode)
+void codegen_statement(Codegen* cg, AstNode* stmt);
+// Optimize and lower the pending IR into cg->out (codegen_generate does this itself;
+// streaming callers flush before writing a chunk). Top-level variables stay live for
+// the statements that follow.
+void codegen_flush(Codegen* cg);
+// Last flush: nothing follows, so no variable is live at the end
+void codegen_finish(Codegen* cg);
+// Incremental mode: append machine code an earlier compilation generated for the same
+// statements in the same state, as if they had been generated and flushed here
+// (nothing may be pending; the caller restores the allocator state that followed them)
+void codegen_splice(Codegen* cg, const uint8_t* code, size_t len);
+// Start a new compilation into out with the buffers of the previous one (IR, labels,
+// bindings, allocator): the state is as after codegen_init, the options (optimize,
+// alloc_log, errors, stats) are kept and the statistics restart
+void codegen_reset(Codegen* cg, Emitter* out);
+void codegen_cleanup(Codegen* cg);
 
 #endif // CODEGEN_H
 
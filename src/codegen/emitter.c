@@ -0,0 +1,64 @@
+#include "emitter.h"
+#include "../common/utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define EMITTER_DEFAULT_CAP 4096
+
+void emitter_init(Emitter* em, size_t initial_cap) {
+    em->cap = initial_cap ? initial_cap : EMITTER_DEFAULT_CAP;
+    em->len = 0;
+    em->data = safe_malloc(em->cap);
+}
+
+void emitter_reset(Emitter* em) {
+    em->len = 0;
+}
+
+void emitter_free(Emitter* em) {
+    free(em->data);
+    em->data = NULL;
+    em->len = em->cap = 0;
+}
+
+void emitter_reserve(Emitter* em, size_t extra) {
+    if (em->cap - em->len >= extra) return;
+    size_t cap = em->cap ? em->cap : EMITTER_DEFAULT_CAP;
+    while (cap - em->len < extra) cap *= 2;
+    uint8_t* grown = realloc(em->data, cap);
+    if (!grown) error("Memory allocation failed (emitter, %zu bytes)", cap);
+    em->data = grown;
+    em->cap = cap;
+}
+
+void emitter_bytes(Emitter* em, const void* bytes, size_t len) {
+    emitter_reserve(em, len);
+    memcpy(em->data + em->len, bytes, len);
+    em->len += len;
+}
+
+void emitter_patch_u8(Emitter* em, size_t at, uint8_t byte) {
+    if (at >= em->len) error("Emitter patch out of range (offset %zu, size %zu)", at, em->len);
+    em->data[at] = byte;
+}
+
+void emitter_patch_u16(Emitter* em, size_t at, uint16_t value) {
+    if (at + 2 > em->len) error("Emitter patch out of range (offset %zu, size %zu)", at, em->len);
+    em->data[at] = (uint8_t)(value & 0xFF);
+    em->data[at + 1] = (uint8_t)(value >> 8);
+}
+
+int emitter_write(const Emitter* em, FILE* fp) {
+    // Bypass stdio buffering: anything already buffered goes first, then the image
+    // in one write(2) (looping only if the kernel accepts a partial write)
+    if (fflush(fp) != 0) return -1;
+    int fd = fileno(fp);
+    size_t done = 0;
+    while (done < em->len) {
+        ssize_t n = write(fd, em->data + done, em->len - done);
+        if (n <= 0) return -1;
+        done += (size_t)n;
+    }
+    return 0;
+}
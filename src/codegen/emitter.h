@@ -0,0 +1,61 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Growable in-memory machine code buffer. Codegen appends bytes here, may patch
+// already-emitted bytes (jump displacements etc.), and the whole image is written
+// out with one write at the end.
+typedef struct {
+    uint8_t* data;  // Emitted bytes
+    size_t len;     // Bytes emitted so far
+    size_t cap;     // Allocated capacity
+} Emitter;
+
+// Initialize an empty buffer (initial_cap 0 picks a default)
+void emitter_init(Emitter* em, size_t initial_cap);
+
+// Drop all emitted bytes, keep the allocation for reuse
+void emitter_reset(Emitter* em);
+
+// Release the buffer
+void emitter_free(Emitter* em);
+
+// Slow path: make room for at least `extra` more bytes
+void emitter_reserve(Emitter* em, size_t extra);
+
+static inline void emitter_u8(Emitter* em, uint8_t byte) {
+    if (em->len == em->cap) emitter_reserve(em, 1);
+    em->data[em->len++] = byte;
+}
+
+// Little-endian 16-bit value
+static inline void emitter_u16(Emitter* em, uint16_t value) {
+    if (em->cap - em->len < 2) emitter_reserve(em, 2);
+    em->data[em->len++] = (uint8_t)(value & 0xFF);
+    em->data[em->len++] = (uint8_t)(value >> 8);
+}
+
+// Little-endian 32-bit value
+static inline void emitter_u32(Emitter* em, uint32_t value) {
+    emitter_u16(em, (uint16_t)(value & 0xFFFF));
+    emitter_u16(em, (uint16_t)(value >> 16));
+}
+
+void emitter_bytes(Emitter* em, const void* bytes, size_t len);
+
+// Current offset (the address of the next emitted byte)
+static inline size_t emitter_pos(const Emitter* em) {
+    return em->len;
+}
+
+// Back-patching of already emitted bytes
+void emitter_patch_u8(Emitter* em, size_t at, uint8_t byte);
+void emitter_patch_u16(Emitter* em, size_t at, uint16_t value);
+
+// Write the whole image to an open file with a single write; returns 0 on success
+int emitter_write(const Emitter* em, FILE* fp);
+
+#endif // EMITTER_H
@@ -0,0 +1,170 @@
+#include "output_cache.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compiler build the cache belongs to: the Makefile passes a checksum of the sources
+#ifndef ECC_BUILD_ID
+#define ECC_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+#define OUTPUT_CACHE_MAGIC "ECCCACHE"
+#define OUTPUT_CACHE_FORMAT 1  // Bump when the file layout or the meaning of a field changes
+
+typedef struct {
+    char magic[8];
+    uint32_t format;
+    uint32_t entry_size;  // sizeof(OutputCacheEntry) of the writer
+    uint64_t build;       // Hash of ECC_BUILD_ID
+    uint64_t count;
+    uint64_t code_len;
+} OutputCacheHeader;
+
+static uint64_t output_cache_build(void) {
+    return hash_bytes64(HASH64_INIT, ECC_BUILD_ID, strlen(ECC_BUILD_ID));
+}
+
+void output_cache_init(OutputCache* cache) {
+    memset(cache, 0, sizeof(*cache));
+}
+
+void output_cache_free(OutputCache* cache) {
+    free(cache->entries);
+    free(cache->code);
+    free(cache->index);
+    output_cache_init(cache);
+}
+
+static size_t output_cache_slot(const OutputCache* cache, uint64_t state, uint64_t prefix) {
+    uint64_t key = (state ^ prefix * 0x9E3779B97F4A7C15ull);
+    return (size_t)(key ^ key >> 29) & (cache->index_cap - 1);
+}
+
+// Index at most half full, rebuilt when it grows
+static void output_cache_index(OutputCache* cache) {
+    if (cache->count * 2 < cache->index_cap) {
+        const OutputCacheEntry* e = &cache->entries[cache->count - 1];
+        size_t slot = output_cache_slot(cache, e->state, e->prefix);
+        while (cache->index[slot]) slot = (slot + 1) & (cache->index_cap - 1);
+        cache->index[slot] = (uint32_t)cache->count;
+        return;
+    }
+    free(cache->index);
+    cache->index_cap = cache->index_cap ? cache->index_cap * 2 : 64;
+    while (cache->count * 2 >= cache->index_cap) cache->index_cap *= 2;
+    cache->index = calloc(cache->index_cap, sizeof(uint32_t));
+    if (!cache->index) error("Memory allocation failed (output cache index, %zu)", cache->index_cap);
+    for (size_t i = 0; i < cache->count; i++) {
+        const OutputCacheEntry* e = &cache->entries[i];
+        size_t slot = output_cache_slot(cache, e->state, e->prefix);
+        while (cache->index[slot]) slot = (slot + 1) & (cache->index_cap - 1);
+        cache->index[slot] = (uint32_t)i + 1;
+    }
+}
+
+void output_cache_add(OutputCache* cache, const OutputCacheEntry* entry, const uint8_t* code) {
+    if (cache->count == cache->cap) {
+        cache->cap = cache->cap ? cache->cap * 2 : 64;
+        cache->entries = realloc(cache->entries, cache->cap * sizeof(OutputCacheEntry));
+        if (!cache->entries) error("Memory allocation failed (output cache, %zu entries)", cache->cap);
+    }
+    if (cache->code_len + entry->code_len > cache->code_cap) {
+        size_t cap = cache->code_cap ? cache->code_cap * 2 : 4096;
+        while (cap < cache->code_len + entry->code_len) cap *= 2;
+        cache->code = realloc(cache->code, cap);
+        if (!cache->code) error("Memory allocation failed (output cache, %zu bytes)", cap);
+        cache->code_cap = cap;
+    }
+    OutputCacheEntry* e = &cache->entries[cache->count++];
+    *e = *entry;
+    e->code_offset = (uint32_t)cache->code_len;
+    if (entry->code_len) memcpy(cache->code + cache->code_len, code, entry->code_len);  // A region may emit nothing
+    cache->code_len += entry->code_len;
+    output_cache_index(cache);
+}
+
+uint64_t output_cache_prefix(const char* src, size_t avail) {
+    return hash_bytes64(HASH64_INIT, src, avail < OUTPUT_CACHE_PREFIX_LEN ? avail : OUTPUT_CACHE_PREFIX_LEN);
+}
+
+const OutputCacheEntry* output_cache_find(const OutputCache* cache, uint64_t state, const char* src, size_t avail) {
+    if (cache->count == 0) return NULL;
+    uint64_t prefix = output_cache_prefix(src, avail);
+    for (size_t slot = output_cache_slot(cache, state, prefix); cache->index[slot];
+         slot = (slot + 1) & (cache->index_cap - 1)) {
+        const OutputCacheEntry* e = &cache->entries[cache->index[slot] - 1];
+        if (e->state != state || e->prefix != prefix || e->len > avail) continue;
+        if (hash_bytes64(HASH64_INIT, src, e->len) == e->text) return e;
+    }
+    return NULL;
+}
+
+int output_cache_load(OutputCache* cache, const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+    OutputCacheHeader header;
+    int ok = fread(&header, sizeof(header), 1, fp) == 1 && memcmp(header.magic, OUTPUT_CACHE_MAGIC, 8) == 0 &&
+             header.format == OUTPUT_CACHE_FORMAT && header.entry_size == sizeof(OutputCacheEntry) &&
+             header.build == output_cache_build() && header.count < UINT32_MAX && header.code_len < UINT32_MAX;
+    OutputCacheEntry* entries = NULL;
+    uint8_t* code = NULL;
+    if (ok) {
+        entries = malloc((header.count ? header.count : 1) * sizeof(OutputCacheEntry));
+        code = malloc(header.code_len ? header.code_len : 1);
+        if (!entries || !code) error("Memory allocation failed (output cache %s)", path);
+        ok = fread(entries, sizeof(OutputCacheEntry), header.count, fp) == header.count &&
+             fread(code, 1, header.code_len, fp) == header.code_len;
+        for (uint64_t i = 0; ok && i < header.count; i++) {
+            ok = entries[i].code_offset <= header.code_len && entries[i].code_len <= header.code_len - entries[i].code_offset;
+        }
+    }
+    fclose(fp);
+    if (!ok) {
+        free(entries);
+        free(code);
+        return -1;
+    }
+    for (uint64_t i = 0; i < header.count; i++) output_cache_add(cache, &entries[i], code + entries[i].code_offset);
+    free(entries);
+    free(code);
+    return 1;
+}
+
+int output_cache_save(const OutputCache* cache, const char* path) {
+    size_t len = strlen(path);
+    char* tmp = safe_malloc(len + 5);
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", 5);
+    FILE* fp = fopen(tmp, "wb");
+    if (!fp) {
+        free(tmp);
+        return -1;
+    }
+    OutputCacheHeader header = {OUTPUT_CACHE_MAGIC, OUTPUT_CACHE_FORMAT, sizeof(OutputCacheEntry),
+                                output_cache_build(), cache->count, cache->code_len};
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+             fwrite(cache->entries, sizeof(OutputCacheEntry), cache->count, fp) == cache->count &&
+             fwrite(cache->code, 1, cache->code_len, fp) == cache->code_len;
+    ok = fclose(fp) == 0 && ok;
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok) remove(tmp);
+    free(tmp);
+    return ok ? 0 : -1;
+}
+
+void output_cache_save_alloc(OutputCacheAlloc* out, const IrRegAlloc* ra) {
+    memset(out, 0, sizeof(*out));  // No padding bytes: the struct is hashed into the state
+    for (int v = 0; v < IR_TOP_VARS; v++) out->home[v] = ra->home[v];
+    out->homes = ra->homes;
+    out->top_slots = ra->top_slots;
+    out->written = ra->written;
+}
+
+void output_cache_restore_alloc(IrRegAlloc* ra, const OutputCacheAlloc* in) {
+    for (int v = 0; v < IR_TOP_VARS; v++) ra->home[v] = in->home[v];
+    ra->homes = in->homes;
+    ra->top_slots = in->top_slots;
+    ra->written = in->written;
+    ra->loc_count = 0;
+}
@@ -0,0 +1,67 @@
+#ifndef OUTPUT_CACHE_H
+#define OUTPUT_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../ir/ir.h"
+
+// Incremental compilation: machine code of source regions (runs of top-level statements
+// without definitions), kept on disk between compilations. A region is reused when its
+// text and everything its code depends on are unchanged: the definitions before it, the
+// backend, the allocator state, and for regions that call functions the code layout.
+// The file is tied to one compiler build; any other build starts from an empty cache.
+
+#define OUTPUT_CACHE_SUFFIX ".ecccache"
+#define OUTPUT_CACHE_PREFIX_LEN 16  // Source bytes hashed into the lookup key
+
+// Allocator state between flushes (the part of IrRegAlloc later code depends on)
+typedef struct {
+    int32_t home[IR_TOP_VARS];
+    int32_t homes;
+    int32_t top_slots;
+    uint32_t written;
+} OutputCacheAlloc;
+
+typedef struct {
+    uint64_t state;    // Definitions, backend, options and allocator state before the region
+    uint64_t prefix;   // First OUTPUT_CACHE_PREFIX_LEN bytes of the region (lookup key with state)
+    uint64_t text;     // Whole region text
+    uint64_t layout;   // Code offsets its calls depend on, 0 if position independent
+    uint32_t len;      // Source bytes, up to the first token of the next region
+    uint32_t lines;    // Newlines in them
+    uint32_t code_offset;
+    uint32_t code_len;
+    OutputCacheAlloc alloc;  // Allocator state after the region
+} OutputCacheEntry;
+
+typedef struct {
+    OutputCacheEntry* entries;
+    size_t count;
+    size_t cap;
+    uint8_t* code;      // Machine code of all entries
+    size_t code_len;
+    size_t code_cap;
+    uint32_t* index;    // Open addressing on (state, prefix): entry number + 1, 0 = empty
+    size_t index_cap;
+} OutputCache;
+
+void output_cache_init(OutputCache* cache);
+void output_cache_free(OutputCache* cache);
+
+// Load the cache file; returns 1 if loaded, 0 if there is none, -1 if it was written
+// by another compiler build or is damaged (the cache stays empty)
+int output_cache_load(OutputCache* cache, const char* path);
+// Write the cache file (through a temporary file, so a failed write keeps the old one)
+int output_cache_save(const OutputCache* cache, const char* path);
+
+// Lookup key of the source at src (avail bytes to the end of the input)
+uint64_t output_cache_prefix(const char* src, size_t avail);
+// Entry for a region starting at src in this state, NULL if none matches its text
+const OutputCacheEntry* output_cache_find(const OutputCache* cache, uint64_t state, const char* src, size_t avail);
+// Add an entry (code_offset is assigned here) with its machine code
+void output_cache_add(OutputCache* cache, const OutputCacheEntry* entry, const uint8_t* code);
+
+void output_cache_save_alloc(OutputCacheAlloc* out, const IrRegAlloc* ra);
+void output_cache_restore_alloc(IrRegAlloc* ra, const OutputCacheAlloc* in);
+
+#endif // OUTPUT_CACHE_H
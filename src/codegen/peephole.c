@@ -0,0 +1,98 @@
+#include "peephole.h"
+
+// Register holding `v` in its low `width` bytes (byte stores can only use al/cl/dl/bl), -1 if none
+static int peephole_find_value(const int* known, const uint32_t* value, uint32_t v, int width, int skip) {
+    int regs = width == 1 ? 4 : X86_REG_COUNT;
+    uint32_t mask = width == 1 ? 0xFF : width == 2 ? 0xFFFF : 0xFFFFFFFF;
+    // Prefer ax: it has the short moffs encoding for memory stores
+    for (int r = 0; r < regs; r++) {
+        if (r != skip && known[r] && (value[r] & mask) == v) return r;
+    }
+    return -1;
+}
+
+// -------------------------- Forward sweep: known register values --------------------------
+static void peephole_values(X86Code* code) {
+    int known[X86_REG_COUNT] = {0};  // 1 = value[r] is the register's current content
+    uint32_t value[X86_REG_COUNT];
+
+    for (size_t i = 0; i < code->count; i++) {
+        X86Insn* insn = &code->insns[i];
+        int dst = insn->dst;
+        switch (insn->op) {
+            case X86_MOV_IMM: {
+                uint32_t v = insn->imm & X86_WORD_MASK(code->bits);
+                if (known[dst] && value[dst] == v) {
+                    insn->op = X86_NOP;
+                    break;
+                }
+                int r;
+                if (v == 0) {
+                    *insn = (X86Insn){X86_XOR_REG, (uint8_t)dst, 0, 0, 0};
+                } else if ((r = peephole_find_value(known, value, v, code->bits / 8, dst)) >= 0) {
+                    *insn = (X86Insn){X86_MOV_REG, (uint8_t)dst, (uint8_t)r, 0, 0};
+                }
+                known[dst] = 1;
+                value[dst] = v;
+                break;
+            }
+            case X86_MOV_REG:
+                known[dst] = known[insn->src];
+                value[dst] = value[insn->src];
+                break;
+            case X86_XOR_REG:
+                known[dst] = 1;
+                value[dst] = 0;
+                break;
+            case X86_MOV_MEM_IMM:
+            case X86_MOV_IDX_IMM: {
+                if (insn->width * 8 > code->bits) break;  // Wider than the registers
+                int r = peephole_find_value(known, value, insn->imm, insn->width, -1);
+                if (r >= 0) {
+                    insn->op = insn->op == X86_MOV_MEM_IMM ? X86_MOV_MEM_REG : X86_MOV_IDX_REG;
+                    insn->src = (uint8_t)r;
+                    insn->imm = 0;
+                }
+                break;
+            }
+            default: {
+                unsigned reads, writes;
+                x86_insn_effects(insn, &reads, &writes);
+                for (int r = 0; r < X86_REG_COUNT; r++) {
+                    if (writes & X86_REG_BIT(r)) known[r] = 0;
+                }
+                break;
+            }
+        }
+    }
+}
+
+// -------------------------- Backward sweep: dead register stores --------------------------
+static void peephole_dead_stores(X86Code* code) {
+    unsigned live = (1u << X86_REG_COUNT) - 1;  // Live out of the image
+
+    for (size_t i = code->count; i-- > 0;) {
+        X86Insn* insn = &code->insns[i];
+        if (insn->op == X86_NOP) continue;
+        unsigned reads, writes;
+        int removable = x86_insn_effects(insn, &reads, &writes);
+        if (removable && !(live & writes)) {
+            insn->op = X86_NOP;
+            continue;
+        }
+        live = (live & ~writes) | reads;
+    }
+}
+
+size_t peephole_run(X86Code* code) {
+    size_t before = x86_code_size(code);
+    peephole_values(code);
+    peephole_dead_stores(code);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < code->count; i++) {
+        if (code->insns[i].op != X86_NOP) code->insns[kept++] = code->insns[i];
+    }
+    code->count = kept;
+    return before - x86_code_size(code);
+}
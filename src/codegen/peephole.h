@@ -0,0 +1,19 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "x86.h"
+
+// Size-oriented peephole pass over x86 code, two linear sweeps:
+//  - forward, tracking the constant each register holds:
+//      mov r, v   where r already holds v   -> deleted (redundant load)
+//      mov r, 0                             -> xor r, r      (2 bytes instead of 3)
+//      mov r, v   where another s holds v   -> mov r, s      (2 bytes instead of 3)
+//      mov [m], v where some s holds v      -> mov [m], s    (3-4 bytes instead of 5-6)
+//  - backward, tracking which registers are read later:
+//      a register write that is overwritten before being read -> deleted (dead store)
+// Every register is treated as live at the end of the list, since whatever runs
+// after the image can observe it. Deleted instructions are compacted out.
+// Returns the number of bytes saved.
+size_t peephole_run(X86Code* code);
+
+#endif // PEEPHOLE_H
@@ -0,0 +1,243 @@
+#include "riscv.h"
+#include "../common/utils.h"
+#include <stdlib.h>
+
+static const char* const riscv_reg_names[RV_REG_COUNT] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+};
+
+void riscv_code_init(RvCode* code, int rvc, Arena* arena) {
+    code->rvc = rvc;
+    code->arena = arena;
+    code->insns = NULL;
+    code->count = code->cap = 0;
+}
+
+void riscv_emit(RvCode* code, RvInsn insn) {
+    if (code->count == code->cap) {
+        size_t cap = code->cap ? code->cap * 2 : 256;
+        code->insns = arena_grow(code->arena, code->insns, code->cap * sizeof(RvInsn), cap * sizeof(RvInsn));
+        code->cap = cap;
+    }
+    code->insns[code->count++] = insn;
+}
+
+const char* riscv_reg_name(int reg) {
+    return (reg >= 0 && reg < RV_REG_COUNT) ? riscv_reg_names[reg] : "?";
+}
+
+// -------------------------- Compressed forms --------------------------
+// The registers the 3-bit rd'/rs1'/rs2' fields of CL/CS/CA/CB instructions reach: x8..x15
+static inline int rv_creg(int r) {
+    return r >= 8 && r <= 15;
+}
+
+static inline uint32_t rv_bit(int32_t value, int bit) {
+    return (uint32_t)(value >> bit) & 1;
+}
+
+static inline uint32_t rv_bits(int32_t value, int lo, int len) {
+    return ((uint32_t)value >> lo) & ((1u << len) - 1);
+}
+
+// CA format: c.sub / c.xor / c.or / c.and rd', rs2'
+static uint16_t rv_c_arith(int funct2, int rd, int rs2) {
+    return (uint16_t)(0x8C01 | (rd - 8) << 7 | funct2 << 5 | (rs2 - 8) << 2);
+}
+
+// 16-bit encoding of insn if it has one in RV32C; jumps use insn->disp
+static int rv_compress(const RvInsn* insn, int rvc, uint16_t* half) {
+    if (!rvc) return 0;
+    int32_t imm = (int32_t)insn->imm;
+    int32_t d = (int32_t)insn->disp;
+    int rd = insn->rd, rs1 = insn->rs1, rs2 = insn->rs2;
+    uint32_t h;
+    switch (insn->op) {
+        case RV_ADDI:
+            if (rd == RV_ZERO) return 0;
+            if (rs1 == RV_ZERO && riscv_fits(imm, 6)) {  // c.li
+                h = 0x4001 | rv_bit(imm, 5) << 12 | rd << 7 | rv_bits(imm, 0, 5) << 2;
+            } else if (rd == rs1 && imm != 0 && riscv_fits(imm, 6)) {  // c.addi
+                h = 0x0001 | rv_bit(imm, 5) << 12 | rd << 7 | rv_bits(imm, 0, 5) << 2;
+            } else if (rd == RV_SP && rs1 == RV_SP && imm != 0 && imm % 16 == 0 && riscv_fits(imm, 10)) {
+                h = 0x6101 | rv_bit(imm, 9) << 12 | rv_bit(imm, 4) << 6 | rv_bit(imm, 6) << 5 |  // c.addi16sp
+                    rv_bits(imm, 7, 2) << 3 | rv_bit(imm, 5) << 2;
+            } else if (imm == 0 && rs1 != RV_ZERO) {  // c.mv
+                h = 0x8002 | rd << 7 | rs1 << 2;
+            } else {
+                return 0;
+            }
+            break;
+        case RV_LUI: {
+            int32_t upper = (int32_t)(insn->imm << 12) >> 12;  // The 20-bit field, sign-extended
+            if (rd == RV_ZERO || rd == RV_SP || upper == 0 || !riscv_fits(upper, 6)) return 0;
+            h = 0x6001 | rv_bit(upper, 5) << 12 | rd << 7 | rv_bits(upper, 0, 5) << 2;  // c.lui
+            break;
+        }
+        case RV_ANDI:
+            if (rd != rs1 || !rv_creg(rd) || !riscv_fits(imm, 6)) return 0;
+            h = 0x8801 | rv_bit(imm, 5) << 12 | (rd - 8) << 7 | rv_bits(imm, 0, 5) << 2;  // c.andi
+            break;
+        case RV_SLLI:
+            if (rd != rs1 || rd == RV_ZERO || imm <= 0 || imm > 31) return 0;
+            h = 0x0002 | rd << 7 | imm << 2;  // c.slli
+            break;
+        case RV_SRLI:
+            if (rd != rs1 || !rv_creg(rd) || imm <= 0 || imm > 31) return 0;
+            h = 0x8001 | (rd - 8) << 7 | imm << 2;  // c.srli
+            break;
+        case RV_ADD:
+            if (rd == RV_ZERO) return 0;
+            if (rs1 == RV_ZERO && rs2 != RV_ZERO) h = 0x8002 | rd << 7 | rs2 << 2;             // c.mv
+            else if (rd == rs1 && rs2 != RV_ZERO) h = 0x9002 | rd << 7 | rs2 << 2;             // c.add
+            else if (rd == rs2 && rs1 != RV_ZERO) h = 0x9002 | rd << 7 | rs1 << 2;             // c.add, commuted
+            else return 0;
+            break;
+        case RV_SUB:
+        case RV_AND:
+        case RV_OR: {
+            int funct2 = insn->op == RV_SUB ? 0 : insn->op == RV_OR ? 2 : 3;
+            if (insn->op != RV_SUB && rd == rs2) rs2 = rs1;  // and / or commute
+            else if (rd != rs1) return 0;
+            if (!rv_creg(rd) || !rv_creg(rs2)) return 0;
+            h = rv_c_arith(funct2, rd, rs2);
+            break;
+        }
+        case RV_LW:
+            if (rd == RV_ZERO || imm < 0 || imm % 4) return 0;
+            if (rs1 == RV_SP && imm < 256) {  // c.lwsp
+                h = 0x4002 | rv_bit(imm, 5) << 12 | rd << 7 | rv_bits(imm, 2, 3) << 4 | rv_bits(imm, 6, 2) << 2;
+            } else if (rv_creg(rd) && rv_creg(rs1) && imm < 128) {  // c.lw
+                h = 0x4000 | rv_bits(imm, 3, 3) << 10 | (rs1 - 8) << 7 | rv_bit(imm, 2) << 6 | rv_bit(imm, 6) << 5 |
+                    (rd - 8) << 2;
+            } else {
+                return 0;
+            }
+            break;
+        case RV_SW:
+            if (imm < 0 || imm % 4) return 0;
+            if (rs1 == RV_SP && imm < 256) {  // c.swsp
+                h = 0xC002 | rv_bits(imm, 2, 4) << 9 | rv_bits(imm, 6, 2) << 7 | rs2 << 2;
+            } else if (rv_creg(rs1) && rv_creg(rs2) && imm < 128) {  // c.sw
+                h = 0xC000 | rv_bits(imm, 3, 3) << 10 | (rs1 - 8) << 7 | rv_bit(imm, 2) << 6 | rv_bit(imm, 6) << 5 |
+                    (rs2 - 8) << 2;
+            } else {
+                return 0;
+            }
+            break;
+        case RV_JALR:
+            if (imm != 0 || rs1 == RV_ZERO || rd > RV_RA) return 0;
+            h = (rd == RV_RA ? 0x9002 : 0x8002) | rs1 << 7;  // c.jalr / c.jr
+            break;
+        case RV_JAL:
+            if (insn->form != RV_SHORT || rd > RV_RA) return 0;
+            h = (rd == RV_RA ? 0x2001 : 0xA001) | rv_bit(d, 11) << 12 | rv_bit(d, 4) << 11 |  // c.jal / c.j
+                rv_bits(d, 8, 2) << 9 | rv_bit(d, 10) << 8 | rv_bit(d, 6) << 7 | rv_bit(d, 7) << 6 |
+                rv_bits(d, 1, 3) << 3 | rv_bit(d, 5) << 2;
+            break;
+        case RV_BEQ:
+        case RV_BNE:
+            if (insn->form != RV_SHORT || rs2 != RV_ZERO || !rv_creg(rs1)) return 0;
+            h = (insn->op == RV_BEQ ? 0xC001 : 0xE001) | rv_bit(d, 8) << 12 | rv_bits(d, 3, 2) << 10 |  // c.beqz / c.bnez
+                (rs1 - 8) << 7 | rv_bits(d, 6, 2) << 5 | rv_bits(d, 1, 2) << 3 | rv_bit(d, 5) << 2;
+            break;
+        default:
+            return 0;
+    }
+    *half = (uint16_t)h;
+    return 1;
+}
+
+size_t riscv_insn_size(const RvInsn* insn, int rvc) {
+    uint16_t half;
+    if (insn->op == RV_NOP || insn->op == RV_LABEL) return 0;
+    if (insn->form == RV_FAR) return 8;
+    return rv_compress(insn, rvc, &half) ? 2 : 4;
+}
+
+size_t riscv_code_size(const RvCode* code) {
+    size_t size = 0;
+    for (size_t i = 0; i < code->count; i++) size += riscv_insn_size(&code->insns[i], code->rvc);
+    return size;
+}
+
+int riscv_jump_reaches(const RvInsn* insn, int rvc, int32_t rel) {
+    size_t size = riscv_insn_size(insn, rvc);
+    if (insn->op == RV_JAL) return riscv_fits(rel, size == 2 ? 12 : 21);
+    if (size == 8) return riscv_fits(rel - 4, 21);  // The jal sits after the inverted branch
+    return riscv_fits(rel, size == 2 ? 9 : 13);
+}
+
+// -------------------------- 32-bit formats --------------------------
+static inline uint32_t rv_r(int funct7, int rs2, int rs1, int funct3, int rd, int opcode) {
+    return (uint32_t)funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+static inline uint32_t rv_i(int32_t imm, int rs1, int funct3, int rd, int opcode) {
+    return rv_bits(imm, 0, 12) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+static inline uint32_t rv_s(int32_t imm, int rs2, int rs1, int funct3) {
+    return rv_bits(imm, 5, 7) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rv_bits(imm, 0, 5) << 7 | 0x23;
+}
+
+static inline uint32_t rv_b(int32_t imm, int rs2, int rs1, int funct3) {
+    return rv_bit(imm, 12) << 31 | rv_bits(imm, 5, 6) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 |
+           rv_bits(imm, 1, 4) << 8 | rv_bit(imm, 11) << 7 | 0x63;
+}
+
+static inline uint32_t rv_j(int32_t imm, int rd) {
+    return rv_bit(imm, 20) << 31 | rv_bits(imm, 1, 10) << 21 | rv_bit(imm, 11) << 20 | rv_bits(imm, 12, 8) << 12 |
+           rd << 7 | 0x6F;
+}
+
+void riscv_encode(const RvCode* code, Emitter* out) {
+    emitter_reserve(out, riscv_code_size(code));
+    for (size_t i = 0; i < code->count; i++) {
+        const RvInsn* insn = &code->insns[i];
+        int32_t imm = (int32_t)insn->imm;
+        int32_t d = (int32_t)insn->disp;
+        uint16_t half;
+        uint32_t word;
+        if (insn->op == RV_NOP || insn->op == RV_LABEL) continue;
+        if (insn->form != RV_FAR && rv_compress(insn, code->rvc, &half)) {
+            emitter_u16(out, half);
+            continue;
+        }
+        switch (insn->op) {
+            case RV_LUI:  word = (insn->imm & 0xFFFFF) << 12 | insn->rd << 7 | 0x37; break;
+            case RV_ADDI: word = rv_i(imm, insn->rs1, 0, insn->rd, 0x13); break;
+            case RV_ANDI: word = rv_i(imm, insn->rs1, 7, insn->rd, 0x13); break;
+            case RV_ORI:  word = rv_i(imm, insn->rs1, 6, insn->rd, 0x13); break;
+            case RV_SLLI: word = rv_i(imm & 31, insn->rs1, 1, insn->rd, 0x13); break;
+            case RV_SRLI: word = rv_i(imm & 31, insn->rs1, 5, insn->rd, 0x13); break;
+            case RV_ADD:  word = rv_r(0x00, insn->rs2, insn->rs1, 0, insn->rd, 0x33); break;
+            case RV_SUB:  word = rv_r(0x20, insn->rs2, insn->rs1, 0, insn->rd, 0x33); break;
+            case RV_AND:  word = rv_r(0x00, insn->rs2, insn->rs1, 7, insn->rd, 0x33); break;
+            case RV_OR:   word = rv_r(0x00, insn->rs2, insn->rs1, 6, insn->rd, 0x33); break;
+            case RV_LW:   word = rv_i(imm, insn->rs1, 2, insn->rd, 0x03); break;
+            case RV_SB:   word = rv_s(imm, insn->rs2, insn->rs1, 0); break;
+            case RV_SH:   word = rv_s(imm, insn->rs2, insn->rs1, 1); break;
+            case RV_SW:   word = rv_s(imm, insn->rs2, insn->rs1, 2); break;
+            case RV_JALR: word = rv_i(imm, insn->rs1, 0, insn->rd, 0x67); break;
+            case RV_JAL:  word = rv_j(d, insn->rd); break;
+            case RV_BEQ:
+            case RV_BNE: {
+                int funct3 = insn->op == RV_BNE;
+                if (insn->form == RV_FAR) {
+                    // b<inverse> rs1, rs2, +8; jal zero, label
+                    emitter_u32(out, rv_b(8, insn->rs2, insn->rs1, funct3 ^ 1));
+                    word = rv_j(d - 4, RV_ZERO);
+                } else {
+                    word = rv_b(d, insn->rs2, insn->rs1, funct3);
+                }
+                break;
+            }
+            default:
+                error("Cannot encode RISC-V instruction (op %d)", insn->op);
+                return;
+        }
+        emitter_u32(out, word);
+    }
+}
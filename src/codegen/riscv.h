@@ -0,0 +1,97 @@
+#ifndef RISCV_H
+#define RISCV_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "emitter.h"
+#include "../common/arena.h"
+
+// Machine-level RV32I instructions. Like x86.h, the backend appends these to a list and
+// encodes them at the end; the encoder picks the 16-bit RVC form of an instruction
+// whenever the code allows compressed instructions and the operands fit one
+// (c.li / c.lui / c.addi / c.mv / c.lwsp / c.swsp / c.j / c.beqz ...).
+
+// Integer registers by number; the module table (module/modules.def) gives both the
+// xN and the ABI names
+typedef enum {
+    RV_ZERO = 0, RV_RA = 1, RV_SP = 2, RV_GP = 3, RV_TP = 4,
+    RV_T0 = 5, RV_T1 = 6, RV_T2 = 7,
+    RV_S0 = 8, RV_S1 = 9,  // s0 is the frame pointer
+    RV_A0 = 10, RV_A1, RV_A2, RV_A3, RV_A4, RV_A5, RV_A6, RV_A7,
+    RV_S2 = 18, RV_S3, RV_S4, RV_S5, RV_S6, RV_S7, RV_S8, RV_S9, RV_S10, RV_S11,
+    RV_T3 = 28, RV_T4, RV_T5, RV_T6,
+    RV_REG_COUNT
+} RvReg;
+
+typedef enum {
+    RV_NOP,    // Encodes to nothing
+    RV_LUI,    // lui rd, imm (imm = the upper 20 bits)
+    RV_ADDI,   // addi rd, rs1, imm (imm sign-extended from 12 bits)
+    RV_ANDI,   // andi rd, rs1, imm
+    RV_ORI,    // ori rd, rs1, imm
+    RV_SLLI,   // slli rd, rs1, imm
+    RV_SRLI,   // srli rd, rs1, imm
+    RV_ADD,    // add rd, rs1, rs2
+    RV_SUB,    // sub rd, rs1, rs2
+    RV_AND,    // and rd, rs1, rs2
+    RV_OR,     // or rd, rs1, rs2
+    RV_LW,     // lw rd, imm(rs1)
+    RV_SB,     // sb rs2, imm(rs1)
+    RV_SH,     // sh rs2, imm(rs1)
+    RV_SW,     // sw rs2, imm(rs1)
+    RV_JALR,   // jalr rd, imm(rs1)
+    RV_LABEL,  // Binds label imm here; encodes to nothing
+    RV_JAL,    // jal rd, label imm
+    RV_BEQ,    // beq rs1, rs2, label imm
+    RV_BNE,    // bne rs1, rs2, label imm
+} RvOp;
+
+// Jump forms (RvInsn::form of RV_JAL / RV_BEQ / RV_BNE)
+#define RV_SHORT 0  // Compressed when allowed and in range (c.j / c.jal ±2 KiB, c.beqz / c.bnez ±256 bytes)
+#define RV_NEAR  1  // jal ±1 MiB, branch ±4 KiB
+#define RV_FAR   2  // Branches only: the inverted branch skips a jal (8 bytes)
+
+typedef struct {
+    uint8_t op;     // RvOp
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    uint8_t form;   // Jump form
+    uint8_t pad[3];
+    uint32_t imm;   // Immediate, memory offset, or label number for jumps
+    uint32_t disp;  // Byte offset from the instruction to the label, once linked
+} RvInsn;
+
+_Static_assert(sizeof(RvInsn) == 16, "RvInsn should stay 16 bytes");
+
+// Growable instruction list in an arena (the lowering's scratch memory: nothing to free)
+typedef struct {
+    int rvc;  // Compressed instructions allowed (RV32IC)
+    Arena* arena;
+    RvInsn* insns;
+    size_t count;
+    size_t cap;
+} RvCode;
+
+void riscv_code_init(RvCode* code, int rvc, Arena* arena);
+void riscv_emit(RvCode* code, RvInsn insn);
+
+// ABI register names (zero, ra, sp, ..., t6)
+const char* riscv_reg_name(int reg);
+
+// Whether a signed value fits an n-bit immediate
+static inline int riscv_fits(int32_t value, int bits) {
+    return value >= -(1 << (bits - 1)) && value < (1 << (bits - 1));
+}
+
+// Encoded size of one instruction (0, 2, 4, or 8 for a far branch)
+size_t riscv_insn_size(const RvInsn* insn, int rvc);
+size_t riscv_code_size(const RvCode* code);
+
+// Whether a jump at its current form reaches a label rel bytes away
+int riscv_jump_reaches(const RvInsn* insn, int rvc, int32_t rel);
+
+// Encode the list (jumps must be linked) into out
+void riscv_encode(const RvCode* code, Emitter* out);
+
+#endif // RISCV_H
@@ -0,0 +1,631 @@
+#include "backend.h"
+#include "riscv.h"
+#include "store_run.h"
+#include "../common/utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+// -------------------------- RISC-V instruction selection --------------------------
+// riscv32 (RV32I) and riscv32c (RV32IC) share this lowering; the encoder picks the
+// compressed forms. Values are trees as in the x86 backend: leaves are constants,
+// registers and words in the frame, evaluated straight into the register that consumes
+// them. t5 and t6 belong to the backend (they are not in the module's register table):
+// t6 materializes leaves and the values of memory stores, t5 holds the upper part of
+// store addresses. Both are cached, so runs of stores reuse the base and the value.
+typedef struct {
+    uint8_t kind;      // IR_CONST, IR_GET_REG, IR_GET_ARG (a word in the frame) or a binary op
+                       // (0 = not lowerable)
+    uint8_t reg;       // Source register for IR_GET_REG
+    uint32_t imm;      // Constant for IR_CONST, s0 offset for IR_GET_ARG
+    uint32_t version;  // Write count of `reg` when it was read
+    IrValue a, b;      // Operands of a binary op
+} RvValueDef;
+
+// Calling convention: arguments in a0..a7; ra holds the return address and is saved on
+// the stack by functions that call others
+static const int rv_arg_regs[] = {RV_A0, RV_A1, RV_A2, RV_A3, RV_A4, RV_A5, RV_A6, RV_A7};
+
+// Variables go in the saved registers first, then the temporaries, then the argument
+// registers (a register parameter stays where it arrived). s1 is also the loop counter
+// (in x8..x15, so the loop branch compresses to c.bnez).
+static const int rv_alloc_regs[] = {RV_S1, RV_S2, RV_S3, RV_S4, RV_S5, RV_S6, RV_S7, RV_S8, RV_S9, RV_S10,
+                                    RV_S11, RV_T0, RV_T1, RV_T2, RV_T3, RV_T4, RV_A0, RV_A1,
+                                    RV_A2, RV_A3, RV_A4, RV_A5, RV_A6, RV_A7};
+
+#define RV_BASE RV_T5     // Upper address bits of memory stores
+#define RV_SCRATCH RV_T6  // Leaves, store values
+#define RV_FP RV_S0
+
+// Frame slots below s0; stack arguments above the saved s0 (and ra, when saved)
+#define RV_SLOT_DISP(slot) (-4 - 4 * (int32_t)(slot))
+#define RV_MAX_SLOTS 255
+
+// -------------------------- Machine state across control flow --------------------------
+// Register versions as in the x86 backend, plus the constants t5 / t6 hold
+typedef struct {
+    uint32_t version[RV_REG_COUNT];
+    int base_valid;
+    uint32_t base;     // t5 = base (a multiple of 4096)
+    int scratch_valid;
+    uint32_t scratch;  // t6 = scratch
+} RvState;
+
+typedef struct {
+    RvState state;
+    uint8_t seen;     // A predecessor has been merged into state
+    uint8_t unknown;  // Entered by a backward jump or a call
+    uint8_t entry;    // A function entry (followed by IR_ENTER)
+} RvLabelState;
+
+static void rv_state_unknown(RvState* st, uint32_t* next_version) {
+    for (int r = 0; r < RV_REG_COUNT; r++) st->version[r] = ++*next_version;
+    st->base_valid = st->scratch_valid = 0;
+}
+
+static void rv_state_merge(RvLabelState* label, const RvState* from, uint32_t* next_version) {
+    if (!label->seen) {
+        label->state = *from;
+        label->seen = 1;
+        return;
+    }
+    RvState* st = &label->state;
+    for (int r = 0; r < RV_REG_COUNT; r++) {
+        if (st->version[r] != from->version[r]) st->version[r] = ++*next_version;
+    }
+    if (!from->base_valid || from->base != st->base) st->base_valid = 0;
+    if (!from->scratch_valid || from->scratch != st->scratch) st->scratch_valid = 0;
+}
+
+// Mark the labels a call or a backward jump enters, and the function entries
+static RvLabelState* rv_label_states(IrProgram* ir, size_t label_count) {
+    RvLabelState* states = arena_calloc(&ir->scratch, (label_count ? label_count : 1) * sizeof(RvLabelState));
+    uint8_t* bound = arena_calloc(&ir->scratch, label_count ? label_count : 1);
+    for (size_t i = 0; i < ir->count; i++) {
+        const IrInsn* insn = &ir->insns[i];
+        switch (insn->op) {
+            case IR_LABEL:
+                bound[insn->a] = 1;
+                if (i + 1 < ir->count && ir->insns[i + 1].op == IR_ENTER) states[insn->a].entry = 1;
+                break;
+            case IR_CALL:         states[insn->a].unknown = 1; break;
+            case IR_JMP:
+            case IR_LOOP:         if (bound[insn->a]) states[insn->a].unknown = 1; break;
+            case IR_BRANCH_ZERO:  if (bound[insn->b]) states[insn->b].unknown = 1; break;
+            default:              break;
+        }
+    }
+    return states;
+}
+
+// A function saves ra if it calls anything. Its body runs from the IR_ENTER at `enter`
+// to the label codegen jumps to around it (*end), or to the next function.
+static int rv_function_calls(const IrProgram* ir, size_t enter, int* end) {
+    *end = -1;
+    if (enter >= 2 && ir->insns[enter - 1].op == IR_LABEL && ir->insns[enter - 2].op == IR_JMP) {
+        *end = (int)ir->insns[enter - 2].a;
+    }
+    for (size_t i = enter + 1; i < ir->count; i++) {
+        const IrInsn* insn = &ir->insns[i];
+        if (insn->op == IR_ENTER || (insn->op == IR_LABEL && (int)insn->a == *end)) break;
+        if (insn->op == IR_CALL) return 1;
+    }
+    return 0;
+}
+
+// -------------------------- Emission helpers --------------------------
+static void rv_emit(RvCode* code, int op, int rd, int rs1, int rs2, uint32_t imm) {
+    riscv_emit(code, (RvInsn){(uint8_t)op, (uint8_t)rd, (uint8_t)rs1, (uint8_t)rs2, 0, {0}, imm});
+}
+
+static void rv_mv(RvCode* code, int rd, int rs) {
+    if (rd != rs) rv_emit(code, RV_ADDI, rd, rs, 0, 0);
+}
+
+// rd = imm: addi from zero when it fits 12 bits, else lui plus an addi for the low part
+// (the low part is sign-extended, so the upper part is rounded up when bit 11 is set)
+static void rv_li(RvCode* code, int rd, uint32_t imm) {
+    if (riscv_fits((int32_t)imm, 12)) {
+        rv_emit(code, RV_ADDI, rd, RV_ZERO, 0, imm);
+        return;
+    }
+    uint32_t upper = (imm + 0x800) >> 12;
+    int32_t lower = (int32_t)(imm - (upper << 12));
+    rv_emit(code, RV_LUI, rd, 0, 0, upper & 0xFFFFF);
+    if (lower) rv_emit(code, RV_ADDI, rd, rd, 0, (uint32_t)lower);
+}
+
+static void rv_push(RvCode* code, int reg) {
+    rv_emit(code, RV_ADDI, RV_SP, RV_SP, 0, (uint32_t)-4);
+    rv_emit(code, RV_SW, 0, RV_SP, reg, 0);
+}
+
+static void rv_pop(RvCode* code, int reg) {
+    rv_emit(code, RV_LW, reg, RV_SP, 0, 0);
+    rv_emit(code, RV_ADDI, RV_SP, RV_SP, 0, 4);
+}
+
+// The backend's own registers lose their cached constants when used for anything else
+static void rv_clobber(RvState* st, int reg) {
+    if (reg == RV_BASE) st->base_valid = 0;
+    if (reg == RV_SCRATCH) st->scratch_valid = 0;
+}
+
+// Register holding the constant imm for a store: zero, or t6 (reused while it holds imm)
+static int rv_store_value(RvCode* code, RvState* st, uint32_t imm) {
+    if (imm == 0) return RV_ZERO;
+    if (!st->scratch_valid || st->scratch != imm) {
+        rv_li(code, RV_SCRATCH, imm);
+        st->scratch_valid = 1;
+        st->scratch = imm;
+    }
+    return RV_SCRATCH;
+}
+
+// Base register and 12-bit offset for addr: zero for the lowest and highest 2 KiB,
+// else t5, reloaded with lui only when addr leaves the window of the base it holds
+static int rv_store_base(RvCode* code, RvState* st, uint32_t addr, int32_t* offset) {
+    if (riscv_fits((int32_t)addr, 12)) {
+        *offset = (int32_t)addr;
+        return RV_ZERO;
+    }
+    if (!st->base_valid || !riscv_fits((int32_t)(addr - st->base), 12)) {
+        st->base = (addr + 0x800) & 0xFFFFF000u;
+        st->base_valid = 1;
+        rv_emit(code, RV_LUI, RV_BASE, 0, 0, st->base >> 12);
+    }
+    *offset = (int32_t)(addr - st->base);
+    return RV_BASE;
+}
+
+static void rv_store(RvCode* code, RvState* st, uint32_t addr, int width, int value_reg) {
+    static const uint8_t ops[] = {[1] = RV_SB, [2] = RV_SH, [4] = RV_SW};
+    int32_t offset;
+    int base = rv_store_base(code, st, addr, &offset);
+    rv_emit(code, ops[width], 0, base, value_reg, (uint32_t)offset);
+}
+
+// -------------------------- Memory store batching --------------------------
+// Constant stores are collected into a StoreRun like in the x86 backend; the run is
+// stored with the widest naturally aligned sw / sh / sb at every address (RV32I does
+// not guarantee misaligned accesses), zero bytes come from the zero register.
+static void rv_store_flush(StoreRun* run, RvCode* code, RvState* st) {
+    const uint8_t* b = run->bytes;
+    size_t n = run->count;
+    for (size_t i = 0; i < n;) {
+        uint32_t a = run->addr + (uint32_t)i;
+        int width = (a % 4 == 0 && n - i >= 4) ? 4 : (a % 2 == 0 && n - i >= 2) ? 2 : 1;
+        uint32_t value = 0;
+        for (int k = 0; k < width; k++) value |= (uint32_t)b[i + k] << (8 * k);
+        rv_store(code, st, a, width, rv_store_value(code, st, value));
+        i += (size_t)width;
+    }
+    run->count = 0;
+}
+
+// -------------------------- Labels and branch relaxation --------------------------
+// As in the x86 backend: jumps start short when optimizing and are widened until every
+// one reaches its label (compressed -> 32-bit -> inverted branch over a jal).
+static int rv_is_jump(int op) {
+    return op == RV_JAL || op == RV_BEQ || op == RV_BNE;
+}
+
+static void rv_bind_labels(const RvCode* code, BackendLabels* labels) {
+    uint32_t pos = labels->base;
+    for (size_t i = 0; i < code->count; i++) {
+        if (code->insns[i].op == RV_LABEL) labels->offset[code->insns[i].imm] = pos;
+        pos += (uint32_t)riscv_insn_size(&code->insns[i], code->rvc);
+    }
+}
+
+static void rv_link(RvCode* code, BackendLabels* labels) {
+    int changed;
+    uint32_t pos;
+    do {
+        changed = 0;
+        rv_bind_labels(code, labels);
+        pos = labels->base;
+        for (size_t i = 0; i < code->count; i++) {
+            RvInsn* insn = &code->insns[i];
+            uint32_t at = pos;
+            pos += (uint32_t)riscv_insn_size(insn, code->rvc);
+            if (!rv_is_jump(insn->op)) continue;
+            uint32_t target = labels->offset[insn->imm];
+            if (target == BACKEND_LABEL_UNBOUND) error("RISC-V backend: jump to unbound label L%u", insn->imm);
+            int32_t rel = (int32_t)(target - at);  // Relative to the jump itself
+            insn->disp = (uint32_t)rel;
+            if (!riscv_jump_reaches(insn, code->rvc, rel)) {
+                if (insn->form == RV_FAR || (insn->op == RV_JAL && insn->form == RV_NEAR)) {
+                    error("RISC-V backend: label L%u is out of jal range (%d bytes)", insn->imm, rel);
+                }
+                insn->form++;
+                changed = 1;
+            }
+        }
+    } while (changed);
+    labels->base = pos;
+}
+
+static void rv_jump(RvCode* code, int op, int rs1, uint8_t form, uint32_t label) {
+    riscv_emit(code, (RvInsn){(uint8_t)op, op == RV_JAL ? RV_ZERO : 0, (uint8_t)rs1, RV_ZERO, form, {0}, label});
+}
+
+// -------------------------- Value trees --------------------------
+static int rv_is_leaf(const RvValueDef* def) {
+    return def->kind == IR_CONST || def->kind == IR_GET_REG || def->kind == IR_GET_ARG;
+}
+
+// Registers a value reads (depth is bounded by the source's parentheses)
+static uint32_t rv_value_regs(const RvValueDef* defs, IrValue v) {
+    const RvValueDef* def = &defs[v];
+    switch (def->kind) {
+        case IR_GET_REG: return 1u << def->reg;
+        case IR_GET_ARG: return 1u << RV_FP;
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_AND: case IR_OR:
+            return rv_value_regs(defs, def->a) | rv_value_regs(defs, def->b);
+        default:
+            return 0;
+    }
+}
+
+// A register leaf must still hold the value it was read for
+static void rv_check_leaf(const RvValueDef* defs, const RvState* cur, IrValue v) {
+    const RvValueDef* def = &defs[v];
+    if (def->kind == IR_GET_REG && def->version != cur->version[def->reg]) {
+        error("RISC-V backend cannot lower v%u: %s changed after it was read", v, riscv_reg_name(def->reg));
+    }
+}
+
+// Register holding a leaf: its own register, zero, or tmp loaded with the constant or frame word
+static int rv_leaf_reg(RvCode* code, RvState* cur, const RvValueDef* leaf, int tmp) {
+    if (leaf->kind == IR_GET_REG) return leaf->reg;
+    if (leaf->kind == IR_CONST && leaf->imm == 0) return RV_ZERO;
+    rv_clobber(cur, tmp);
+    if (leaf->kind == IR_CONST) rv_li(code, tmp, leaf->imm);
+    else rv_emit(code, RV_LW, tmp, RV_FP, 0, leaf->imm);
+    return tmp;
+}
+
+static const uint8_t rv_alu_ops[] = {[IR_ADD] = RV_ADD, [IR_SUB] = RV_SUB, [IR_AND] = RV_AND, [IR_OR] = RV_OR};
+static const uint8_t rv_alu_imm_ops[] = {[IR_ADD] = RV_ADDI, [IR_SUB] = RV_ADDI, [IR_AND] = RV_ANDI, [IR_OR] = RV_ORI};
+
+// r = a <op> leaf; constants that fit 12 bits use the immediate form (sub adds the negation)
+static void rv_alu(RvCode* code, RvState* cur, int r, int a, int op, const RvValueDef* leaf) {
+    if (leaf->kind == IR_CONST) {
+        int32_t imm = op == IR_SUB ? -(int32_t)leaf->imm : (int32_t)leaf->imm;
+        if (riscv_fits(imm, 12)) {
+            rv_emit(code, rv_alu_imm_ops[op], r, a, 0, (uint32_t)imm);
+            return;
+        }
+    }
+    int tmp = (r == RV_SCRATCH || a == RV_SCRATCH) ? RV_BASE : RV_SCRATCH;
+    rv_emit(code, rv_alu_ops[op], r, a, rv_leaf_reg(code, cur, leaf, tmp), 0);
+}
+
+// Scratch register for evaluating part of a value, not one in avoid
+static int rv_scratch(uint32_t avoid, IrValue v) {
+    for (int i = 0; i < (int)(sizeof(rv_alloc_regs) / sizeof(rv_alloc_regs[0])); i++) {
+        if (!(avoid & (1u << rv_alloc_regs[i]))) return rv_alloc_regs[i];
+    }
+    error("RISC-V backend: no register left to evaluate v%u", v);
+    return -1;
+}
+
+// r = v. Only r (and t5 / t6) change: other scratch registers are saved around their use.
+static void rv_value(RvCode* code, const RvValueDef* defs, RvState* cur, int r, IrValue v) {
+    const RvValueDef* def = &defs[v];
+    rv_clobber(cur, r);
+    switch (def->kind) {
+        case IR_CONST:
+            rv_li(code, r, def->imm);
+            return;
+        case IR_GET_REG:
+            rv_check_leaf(defs, cur, v);
+            rv_mv(code, r, def->reg);
+            return;
+        case IR_GET_ARG:
+            rv_emit(code, RV_LW, r, RV_FP, 0, def->imm);
+            return;
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_AND: case IR_OR:
+            break;
+        default:
+            error("RISC-V backend cannot lower v%u into %s", v, riscv_reg_name(r));
+    }
+
+    IrValue lhs = def->a, rhs = def->b;
+    if (def->kind == IR_MUL || def->kind == IR_DIV) {
+        if (def->kind == IR_MUL && defs[lhs].kind == IR_CONST) lhs = def->b, rhs = def->a;
+        uint32_t factor = defs[rhs].imm;
+        if (defs[rhs].kind != IR_CONST || factor == 0 || (factor & (factor - 1))) {
+            error("RISC-V backend can only multiply or divide by a power of two at run time (v%u)", v);
+        }
+        int shift = 0;
+        while ((1u << shift) < factor) shift++;
+        int a = r;
+        if (defs[lhs].kind == IR_GET_REG) {
+            rv_check_leaf(defs, cur, lhs);
+            a = defs[lhs].reg;
+        } else {
+            rv_value(code, defs, cur, r, lhs);
+        }
+        if (shift) rv_emit(code, def->kind == IR_MUL ? RV_SLLI : RV_SRLI, r, a, 0, (uint32_t)shift);
+        else rv_mv(code, r, a);
+        return;
+    }
+
+    // r is written before rhs is read unless lhs is a register: then rhs must not read r.
+    // Commuting operands can fix that, and puts a leaf on the right where possible.
+    uint32_t r_bit = 1u << r;
+    int swap = (rv_value_regs(defs, rhs) & r_bit) || (!rv_is_leaf(&defs[rhs]) && rv_is_leaf(&defs[lhs]));
+    if (def->kind != IR_SUB && swap && !(rv_value_regs(defs, lhs) & r_bit)) {
+        IrValue t = lhs;
+        lhs = rhs;
+        rhs = t;
+    }
+    // Three-operand forms: a register lhs is read in place, any other leaf lhs goes to t6
+    // when rhs still needs r
+    int rhs_reads_r = (rv_value_regs(defs, rhs) & r_bit) != 0;
+    if (rv_is_leaf(&defs[rhs]) && (rv_is_leaf(&defs[lhs]) || !rhs_reads_r)) {
+        rv_check_leaf(defs, cur, rhs);
+        int a = r;
+        if (defs[lhs].kind == IR_GET_REG) {
+            rv_check_leaf(defs, cur, lhs);
+            a = defs[lhs].reg;
+        } else if (rhs_reads_r) {
+            a = rv_leaf_reg(code, cur, &defs[lhs], RV_SCRATCH);
+        } else {
+            rv_value(code, defs, cur, r, lhs);
+        }
+        rv_alu(code, cur, r, a, def->kind, &defs[rhs]);
+        return;
+    }
+    int t = rv_scratch(rv_value_regs(defs, v) | r_bit | 1u << RV_SP | 1u << RV_FP, v);
+    rv_push(code, t);
+    rv_value(code, defs, cur, t, rhs);
+    rv_value(code, defs, cur, r, lhs);
+    rv_emit(code, rv_alu_ops[def->kind], r, r, t, 0);
+    rv_pop(code, t);
+}
+
+// Register holding v for a store, a push or a branch: a leaf in place, anything else in t6
+static int rv_operand(RvCode* code, const RvValueDef* defs, RvState* cur, IrValue v) {
+    const RvValueDef* def = &defs[v];
+    if (def->kind == IR_GET_REG) {
+        rv_check_leaf(defs, cur, v);
+        return def->reg;
+    }
+    if (def->kind == IR_CONST) return rv_store_value(code, cur, def->imm);
+    rv_value(code, defs, cur, RV_SCRATCH, v);
+    return RV_SCRATCH;
+}
+
+// Store v to an address computed at run time: sb / sh / sw disp(base), with the address
+// less its added constants in base (the offset's own register, or a scratch register saved
+// around the store). A displacement beyond 12 bits is added to base in t5.
+static void rv_indexed_store(RvCode* code, const RvValueDef* defs, RvState* cur, IrValue addr, int width,
+                             IrValue v) {
+    static const uint8_t ops[] = {[1] = RV_SB, [2] = RV_SH, [4] = RV_SW};
+    IrValue offset = addr;
+    uint32_t disp = 0;
+    for (;;) {  // Peel constants off, as the x86 backend does
+        const RvValueDef* def = &defs[offset];
+        if (def->kind == IR_ADD && defs[def->a].kind == IR_CONST) disp += defs[def->a].imm, offset = def->b;
+        else if (def->kind == IR_ADD && defs[def->b].kind == IR_CONST) disp += defs[def->b].imm, offset = def->a;
+        else if (def->kind == IR_SUB && defs[def->b].kind == IR_CONST) disp -= defs[def->b].imm, offset = def->a;
+        else break;
+    }
+
+    // The offset goes first: evaluating the value afterwards may use t5 and t6
+    int base, saved = 0;
+    if (defs[offset].kind == IR_GET_REG) {
+        rv_check_leaf(defs, cur, offset);
+        base = defs[offset].reg;
+    } else {
+        uint32_t avoid = rv_value_regs(defs, v) | rv_value_regs(defs, offset) | 1u << RV_SP | 1u << RV_FP;
+        base = rv_scratch(avoid, addr);
+        rv_push(code, base);
+        rv_value(code, defs, cur, base, offset);
+        saved = 1;
+    }
+    int value_reg = rv_operand(code, defs, cur, v);
+    int reg = base;
+    if (!riscv_fits((int32_t)disp, 12)) {
+        uint32_t upper = (disp + 0x800) & 0xFFFFF000u;
+        rv_clobber(cur, RV_BASE);
+        rv_emit(code, RV_LUI, RV_BASE, 0, 0, upper >> 12);
+        rv_emit(code, RV_ADD, RV_BASE, RV_BASE, base, 0);
+        reg = RV_BASE;
+        disp -= upper;
+    }
+    rv_emit(code, ops[width], 0, reg, value_reg, disp);
+    if (saved) rv_pop(code, base);
+}
+
+// Everything lowering allocates is in ir->scratch: error() may longjmp out of the middle
+static size_t rv_lower(IrProgram* ir, BackendLabels* labels, Emitter* out, int optimize, int rvc) {
+    RvValueDef* defs = arena_calloc(&ir->scratch, ir->next_value * sizeof(RvValueDef));
+    RvLabelState* at = rv_label_states(ir, labels->count);
+    uint32_t next_version = 0;
+    RvState cur;
+    rv_state_unknown(&cur, &next_version);  // Registers, t5 and t6 are unknown on entry
+    int reachable = 1;  // The previous instruction can fall through
+    RvCode code;
+    riscv_code_init(&code, rvc, &ir->scratch);
+    StoreRun run = {&ir->scratch};
+    uint8_t jump_form = optimize ? RV_SHORT : RV_NEAR;  // Relaxed by rv_link
+    int saves_ra = 0;       // The function being lowered keeps ra on the stack
+    int function_end = -1;  // Label after its body
+
+    for (size_t i = 0; i < ir->count; i++) {
+        const IrInsn* insn = &ir->insns[i];
+        switch (insn->op) {
+            case IR_NOP:
+                break;
+            case IR_CONST:
+                defs[insn->dst] = (RvValueDef){IR_CONST, 0, insn->a, 0};
+                break;
+            case IR_GET_REG:
+                defs[insn->dst] = (RvValueDef){IR_GET_REG, insn->reg, 0, cur.version[insn->reg]};
+                break;
+            case IR_GET_ARG:
+                defs[insn->dst] = (RvValueDef){IR_GET_ARG, 0, (uint32_t)(4 * (1 + saves_ra) + 4 * insn->a), 0};
+                break;
+            case IR_GET_SLOT:
+                defs[insn->dst] = (RvValueDef){IR_GET_ARG, 0, (uint32_t)RV_SLOT_DISP(insn->a), 0};
+                break;
+            case IR_SET_REG: {
+                RvValueDef* def = &defs[insn->a];
+                if (def->kind == IR_CONST) rv_li(&code, insn->reg, def->imm);  // The common case
+                else rv_value(&code, defs, &cur, insn->reg, insn->a);
+                // A copy keeps the version, so the value stays usable from either register
+                cur.version[insn->reg] = def->kind == IR_GET_REG ? cur.version[def->reg] : ++next_version;
+                break;
+            }
+            case IR_SET_SLOT: {
+                int reg = rv_operand(&code, defs, &cur, insn->a);
+                rv_emit(&code, RV_SW, 0, RV_FP, reg, (uint32_t)RV_SLOT_DISP(insn->b));
+                break;
+            }
+            case IR_STORE: {
+                RvValueDef* value = &defs[insn->b];
+                if (defs[insn->a].kind != IR_CONST) {
+                    rv_store_flush(&run, &code, &cur);
+                    rv_indexed_store(&code, defs, &cur, insn->a, insn->reg, insn->b);
+                    break;
+                }
+                if (optimize && value->kind == IR_CONST) {
+                    if (!store_run_extends(&run, defs[insn->a].imm)) rv_store_flush(&run, &code, &cur);
+                    store_run_add(&run, defs[insn->a].imm, insn->reg, value->imm);
+                    break;
+                }
+                rv_store_flush(&run, &code, &cur);  // Earlier constant stores stay first
+                int reg = rv_operand(&code, defs, &cur, insn->b);
+                rv_store(&code, &cur, defs[insn->a].imm, insn->reg, reg);
+                break;
+            }
+            case IR_LABEL: {
+                rv_store_flush(&run, &code, &cur);
+                RvLabelState* label = &at[insn->a];
+                if (reachable) rv_state_merge(label, &cur, &next_version);
+                if (label->unknown || !label->seen) rv_state_unknown(&cur, &next_version);
+                else cur = label->state;
+                if ((int)insn->a == function_end) saves_ra = 0, function_end = -1;
+                reachable = 1;
+                riscv_emit(&code, (RvInsn){RV_LABEL, 0, 0, 0, 0, {0}, insn->a});
+                break;
+            }
+            case IR_JMP: {
+                rv_store_flush(&run, &code, &cur);
+                // A tail call (to a function entry, or to a label bound by an earlier flush,
+                // which only functions are) gives the caller's ra back first
+                int tail = at[insn->a].entry || labels->offset[insn->a] != BACKEND_LABEL_UNBOUND;
+                if (tail && saves_ra) rv_pop(&code, RV_RA);
+                rv_state_merge(&at[insn->a], &cur, &next_version);
+                rv_jump(&code, RV_JAL, 0, jump_form, insn->a);
+                reachable = 0;
+                break;
+            }
+            case IR_BRANCH_ZERO: {
+                RvValueDef* def = &defs[insn->a];
+                rv_store_flush(&run, &code, &cur);
+                if (def->kind == IR_CONST) {  // Unoptimized IR: the condition is known anyway
+                    if (def->imm == 0) {
+                        rv_state_merge(&at[insn->b], &cur, &next_version);
+                        rv_jump(&code, RV_JAL, 0, jump_form, insn->b);
+                        reachable = 0;
+                    }
+                    break;
+                }
+                int reg = rv_operand(&code, defs, &cur, insn->a);
+                rv_state_merge(&at[insn->b], &cur, &next_version);
+                rv_jump(&code, RV_BEQ, reg, jump_form, insn->b);
+                break;
+            }
+            case IR_LOOP:
+                rv_store_flush(&run, &code, &cur);
+                rv_emit(&code, RV_ADDI, RV_S1, RV_S1, 0, (uint32_t)-1);
+                rv_jump(&code, RV_BNE, RV_S1, jump_form, insn->a);
+                cur.version[RV_S1] = ++next_version;
+                break;
+            case IR_CALL:
+                rv_store_flush(&run, &code, &cur);
+                riscv_emit(&code, (RvInsn){RV_JAL, RV_RA, 0, 0, jump_form, {0}, insn->a});  // c.jal when in range
+                if (insn->b) rv_emit(&code, RV_ADDI, RV_SP, RV_SP, 0, 4 * insn->b);
+                rv_state_unknown(&cur, &next_version);  // The callee may change anything
+                break;
+            case IR_RET: {
+                rv_store_flush(&run, &code, &cur);
+                // Drop the slots, then pop the saved s0 and ra
+                uint32_t saved = 4 * (insn->a + (uint32_t)saves_ra);
+                if (insn->b) rv_mv(&code, RV_SP, RV_FP);
+                if (insn->a) rv_emit(&code, RV_LW, RV_FP, RV_SP, 0, 0);
+                if (saves_ra) rv_emit(&code, RV_LW, RV_RA, RV_SP, 0, 4 * insn->a);
+                if (saved) rv_emit(&code, RV_ADDI, RV_SP, RV_SP, 0, saved);
+                rv_emit(&code, RV_JALR, RV_ZERO, RV_RA, 0, 0);
+                reachable = 0;
+                break;
+            }
+            case IR_ENTER:
+            case IR_FRAME: {
+                // Function: push ra (if it calls anything) and s0 with one sp adjustment; mv s0, sp;
+                // then reserve the slots. Top level: only mv s0, sp and the slots.
+                uint32_t saved = 0;
+                if (insn->op == IR_ENTER) {
+                    saves_ra = rv_function_calls(ir, i, &function_end);
+                    saved = 4 * (insn->b + (uint32_t)saves_ra);
+                }
+                if (saved) rv_emit(&code, RV_ADDI, RV_SP, RV_SP, 0, -saved);
+                if (saves_ra) rv_emit(&code, RV_SW, 0, RV_SP, RV_RA, 4 * insn->b);
+                if (insn->b) {
+                    if (insn->op == IR_ENTER) rv_emit(&code, RV_SW, 0, RV_SP, RV_FP, 0);
+                    rv_mv(&code, RV_FP, RV_SP);
+                    cur.version[RV_FP] = ++next_version;
+                }
+                if (insn->a) rv_emit(&code, RV_ADDI, RV_SP, RV_SP, 0, -4 * insn->a);
+                break;
+            }
+            case IR_PUSH:
+                rv_push(&code, rv_operand(&code, defs, &cur, insn->a));
+                break;
+            case IR_POP:
+                rv_pop(&code, insn->reg);
+                cur.version[insn->reg] = ++next_version;
+                break;
+            default: {
+                // Arithmetic is evaluated where the value is used; unoptimized IR still folds
+                // constants here (inlined arguments)
+                uint32_t folded;
+                if (insn->op >= IR_ADD && insn->op <= IR_OR) {
+                    if (defs[insn->a].kind == IR_CONST && defs[insn->b].kind == IR_CONST &&
+                        ir_fold(insn->op, defs[insn->a].imm, defs[insn->b].imm, &folded)) {
+                        defs[insn->dst] = (RvValueDef){IR_CONST, 0, folded, 0};
+                    } else {
+                        defs[insn->dst] = (RvValueDef){insn->op, 0, 0, 0, insn->a, insn->b};
+                    }
+                    break;
+                }
+                error("RISC-V backend cannot lower IR op %d", insn->op);
+            }
+        }
+    }
+    rv_store_flush(&run, &code, &cur);
+
+    rv_link(&code, labels);
+    riscv_encode(&code, out);
+    return 0;
+}
+
+static size_t riscv32_lower(IrProgram* ir, BackendLabels* labels, Emitter* out, int optimize) {
+    return rv_lower(ir, labels, out, optimize, 0);
+}
+
+static size_t riscv32c_lower(IrProgram* ir, BackendLabels* labels, Emitter* out, int optimize) {
+    return rv_lower(ir, labels, out, optimize, 1);
+}
+
+const Backend riscv32_backend = {"riscv32", 32, 0xFFFFFFFF, riscv_reg_name,
+                                 rv_arg_regs, 8, RV_S1, rv_alloc_regs, 24, RV_FP, RV_MAX_SLOTS,
+                                 riscv32_lower};
+
+const Backend riscv32c_backend = {"riscv32c", 32, 0xFFFFFFFF, riscv_reg_name,
+                                  rv_arg_regs, 8, RV_S1, rv_alloc_regs, 24, RV_FP, RV_MAX_SLOTS,
+                                  riscv32c_lower};
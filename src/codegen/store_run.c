@@ -0,0 +1,15 @@
+#include "store_run.h"
+
+int store_run_extends(const StoreRun* run, uint32_t addr) {
+    return run->count == 0 || addr == run->addr + (uint32_t)run->count;
+}
+
+void store_run_add(StoreRun* run, uint32_t addr, int width, uint32_t value) {
+    if (run->cap - run->count < (size_t)width) {
+        size_t cap = run->cap ? run->cap * 2 : 256;
+        run->bytes = arena_grow(run->arena, run->bytes, run->cap, cap);
+        run->cap = cap;
+    }
+    if (run->count == 0) run->addr = addr;
+    for (int i = 0; i < width; i++) run->bytes[run->count++] = (uint8_t)(value >> (8 * i));
+}
@@ -0,0 +1,29 @@
+#ifndef STORE_RUN_H
+#define STORE_RUN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../common/arena.h"
+
+// Batching of constant memory stores, shared by the backends. A run is the bytes of
+// consecutive constant stores that each start where the previous one ended, so it covers
+// one contiguous range written in ascending order. Any other store (a gap, a lower
+// address, a byte the run already wrote) ends the run: stores are never reordered, and a
+// repeated write to one address (memory-mapped I/O) is emitted every time. The backend
+// then picks its own instructions for the run.
+typedef struct {
+    Arena* arena;   // Where bytes grows (the lowering's scratch memory: nothing to free)
+    uint32_t addr;  // Address of bytes[0]
+    uint8_t* bytes;
+    size_t count;
+    size_t cap;
+} StoreRun;
+
+// Whether a store at addr extends the run (the run is empty or ends at addr); otherwise
+// the backend flushes the run before adding the store
+int store_run_extends(const StoreRun* run, uint32_t addr);
+
+// Append a little-endian store of `width` bytes (store_run_extends must hold)
+void store_run_add(StoreRun* run, uint32_t addr, int width, uint32_t value);
+
+#endif // STORE_RUN_H
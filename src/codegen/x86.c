@@ -0,0 +1,437 @@
+#include "x86.h"
+#include "../common/utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* const x86_reg_names[X86_REG_COUNT] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di"};
+static const char* const x86_reg_names32[X86_REG_COUNT] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi"};
+
+void x86_code_init(X86Code* code, int bits, Arena* arena) {
+    code->bits = bits;
+    code->arena = arena;
+    code->insns = NULL;
+    code->count = code->cap = 0;
+    code->data = NULL;
+    code->data_len = code->data_cap = 0;
+}
+
+void x86_emit(X86Code* code, X86Insn insn) {
+    if (code->count == code->cap) {
+        size_t cap = code->cap ? code->cap * 2 : 256;
+        code->insns = arena_grow(code->arena, code->insns, code->cap * sizeof(X86Insn), cap * sizeof(X86Insn));
+        code->cap = cap;
+    }
+    code->insns[code->count++] = insn;
+}
+
+uint32_t x86_add_data(X86Code* code, const uint8_t* bytes, size_t len) {
+    if (code->data_cap - code->data_len < len) {
+        size_t cap = code->data_cap ? code->data_cap : 256;
+        while (cap - code->data_len < len) cap *= 2;
+        code->data = arena_grow(code->arena, code->data, code->data_cap, cap);
+        code->data_cap = cap;
+    }
+    uint32_t offset = (uint32_t)code->data_len;
+    memcpy(code->data + offset, bytes, len);
+    code->data_len += len;
+    return offset;
+}
+
+const char* x86_reg_name(int reg) {
+    return (reg >= 0 && reg < X86_REG_COUNT) ? x86_reg_names[reg] : "?";
+}
+
+const char* x86_reg_name32(int reg) {
+    return (reg >= 0 && reg < X86_REG_COUNT) ? x86_reg_names32[reg] : "?";
+}
+
+int x86_insn_effects(const X86Insn* insn, unsigned* reads, unsigned* writes) {
+    const unsigned all = (1u << X86_REG_COUNT) - 1, bp = X86_REG_BIT(X86_BP);
+    const unsigned sp = X86_REG_BIT(X86_SP), si = X86_REG_BIT(X86_SI), di = X86_REG_BIT(X86_DI);
+    const unsigned cx = X86_REG_BIT(X86_CX);
+    *reads = *writes = 0;
+    switch (insn->op) {
+        case X86_MOV_IMM:
+        case X86_XOR_REG:
+            *writes = X86_REG_BIT(insn->dst);
+            return 1;
+        case X86_MOV_REG:
+            *reads = X86_REG_BIT(insn->src);
+            *writes = X86_REG_BIT(insn->dst);
+            return 1;
+        case X86_MOV_MEM_REG:
+            *reads = X86_REG_BIT(insn->src);
+            return 0;
+        case X86_MOV_IDX_IMM:
+            *reads = X86_REG_BIT(insn->base);
+            return 0;
+        case X86_MOV_IDX_REG:
+            *reads = X86_REG_BIT(insn->base) | X86_REG_BIT(insn->src);
+            return 0;
+        case X86_PUSH:
+            *reads = X86_REG_BIT(insn->src) | sp;
+            *writes = sp;
+            return 0;
+        case X86_POP:
+            *reads = sp;
+            *writes = X86_REG_BIT(insn->dst) | sp;
+            return 0;
+        case X86_PUSH_IMM:
+        case X86_PUSH_SEG:
+        case X86_POP_SEG:
+        case X86_CALL_OVER:
+            *reads = *writes = sp;
+            return 0;
+        case X86_REP_STOS:
+            *reads = X86_REG_BIT(X86_AX) | cx | di;
+            *writes = cx | di;
+            return 0;
+        case X86_REP_MOVS:
+            *reads = *writes = cx | si | di;
+            return 0;
+        case X86_MOVSB:
+            *reads = *writes = si | di;
+            return 0;
+        case X86_LABEL:
+        case X86_JMP:
+        case X86_CALL:
+        case X86_RET:
+            *reads = *writes = all;  // Control transfer: any register may be read or changed
+            return 0;
+        case X86_JCC:
+            *reads = all;  // Registers are unchanged when the branch falls through
+            return 0;
+        case X86_LOOP:
+            *reads = all;
+            *writes = cx;
+            return 0;
+        case X86_TEST_REG:
+            *reads = X86_REG_BIT(insn->src);
+            return 0;
+        case X86_CMP_BP_ZERO:
+            *reads = bp;
+            return 0;
+        case X86_ADD_SP:
+            *reads = *writes = sp;
+            return 0;
+        case X86_MOV_REG_BP:
+            *reads = bp;
+            *writes = X86_REG_BIT(insn->dst);
+            return 1;
+        case X86_PUSH_BP_MEM:
+            *reads = bp | sp;
+            *writes = sp;
+            return 0;
+        case X86_ALU_IMM:
+        case X86_SHIFT:
+            *reads = *writes = X86_REG_BIT(insn->dst);
+            return insn->dst != X86_SP;
+        case X86_ALU_REG:
+            *reads = X86_REG_BIT(insn->dst) | X86_REG_BIT(insn->src);
+            *writes = X86_REG_BIT(insn->dst);
+            return 1;
+        case X86_ALU_BP:
+            *reads = X86_REG_BIT(insn->dst) | bp;
+            *writes = X86_REG_BIT(insn->dst);
+            return 1;
+        case X86_MOV_BP_REG:
+            *reads = X86_REG_BIT(insn->src) | bp;
+            return 0;
+        case X86_MOV_BP_IMM:
+            *reads = bp;
+            return 0;
+        default:  // X86_NOP, X86_MOV_MEM_IMM, X86_CLD: no general registers involved
+            return 0;
+    }
+}
+
+// Word immediate that the sign-extended imm8 form can encode
+static int x86_imm8(uint32_t imm, int bits) {
+    imm &= X86_WORD_MASK(bits);
+    return imm < 0x80 || imm >= (X86_WORD_MASK(bits) & ~0x7Fu);
+}
+
+// Operand-size prefix for a memory operand of width bytes (byte operands have their own opcodes)
+static size_t x86_opsize_prefix(int width, int bits) {
+    return width != 1 && width * 8 != bits;
+}
+
+// Displacement bytes of a [base+disp] operand: none for 0, disp8 when it sign-extends
+static size_t x86_idx_disp_size(uint32_t disp, int bits) {
+    if ((disp & X86_WORD_MASK(bits)) == 0) return 0;
+    return x86_imm8(disp, bits) ? 1 : (size_t)bits / 8;
+}
+
+size_t x86_insn_size(const X86Insn* insn, int bits) {
+    size_t prefix = insn->prefix != 0;
+    size_t word = (size_t)bits / 8;  // Bytes of a native immediate, displacement or relative target
+    switch (insn->op) {
+        case X86_MOV_IMM:      return 1 + word;
+        case X86_MOV_REG:      return 2;
+        case X86_XOR_REG:      return 2;
+        case X86_MOV_MEM_IMM:
+            return prefix + x86_opsize_prefix(insn->width, bits) + 2 + word + insn->width;
+        case X86_MOV_MEM_REG:
+            return prefix + x86_opsize_prefix(insn->width, bits) + (insn->src == X86_AX ? 1 : 2) + word;
+        case X86_MOV_IDX_IMM:
+            return prefix + x86_opsize_prefix(insn->width, bits) + 2 + x86_idx_disp_size(insn->disp, bits) + insn->width;
+        case X86_MOV_IDX_REG:
+            return prefix + x86_opsize_prefix(insn->width, bits) + 2 + x86_idx_disp_size(insn->disp, bits);
+        case X86_PUSH_IMM:     return x86_imm8(insn->imm, bits) ? 2 : 1 + word;
+        case X86_PUSH:
+        case X86_POP:
+        case X86_PUSH_SEG:
+        case X86_POP_SEG:
+        case X86_CLD:          return 1;
+        case X86_REP_STOS:     return 2;
+        case X86_REP_MOVS:     return prefix + 2;
+        case X86_MOVSB:        return prefix + 1;
+        case X86_CALL_OVER:    return 1 + word + insn->imm;
+        case X86_JMP:          return insn->width == X86_SHORT ? 2 : 1 + word;
+        case X86_JCC:          return insn->width == X86_SHORT ? 2 : 2 + word;
+        case X86_LOOP:         return insn->width == X86_SHORT ? 2 : 3 + word;
+        case X86_CALL:         return 1 + word;
+        case X86_TEST_REG:     return 2;
+        case X86_CMP_BP_ZERO:  return 4;
+        case X86_RET:          return 1;
+        case X86_ADD_SP:       return insn->imm < 0x80 ? 3 : 2 + word;
+        case X86_MOV_REG_BP:
+        case X86_PUSH_BP_MEM:  return 3;
+        case X86_ALU_IMM:      return x86_imm8(insn->imm, bits) ? 3 : 2 + word;
+        case X86_ALU_REG:      return 2;
+        case X86_ALU_BP:
+        case X86_MOV_BP_REG:   return 3;
+        case X86_MOV_BP_IMM:   return 3 + word;
+        case X86_SHIFT:        return 2;
+        default:               return 0;
+    }
+}
+
+size_t x86_code_size(const X86Code* code) {
+    size_t size = 0;
+    for (size_t i = 0; i < code->count; i++) size += x86_insn_size(&code->insns[i], code->bits);
+    return size;
+}
+
+// ModRM byte for a register-to-register operation (mod = 11)
+static inline uint8_t modrm_rr(int reg, int rm) {
+    return (uint8_t)(0xC0 | (reg << 3) | rm);
+}
+
+// ModRM byte for an absolute memory operand (mod = 00): rm = 110 is [disp16] in 16-bit
+// code, rm = 101 is [disp32] in 32-bit code
+static inline uint8_t modrm_abs(int reg, int bits) {
+    return (uint8_t)((bits == X86_CODE32 ? 0x05 : 0x06) | (reg << 3));
+}
+
+// ModRM byte for a [bp+disp8] memory operand (mod = 01): rm = 110 in 16-bit code,
+// rm = 101 ([ebp+disp8]) in 32-bit code
+static inline uint8_t modrm_bp(int reg, int bits) {
+    return (uint8_t)((bits == X86_CODE32 ? 0x45 : 0x46) | (reg << 3));
+}
+
+// ModRM byte for a [base+disp] memory operand (mod = 00 / 01 / 10 for no displacement,
+// disp8, disp16 or disp32): 16-bit code addresses through si (rm = 100), di (101) or bx
+// (111), 32-bit code through the register itself
+static inline uint8_t modrm_idx(int reg, int base, size_t disp_size, int bits) {
+    static const uint8_t rm16[X86_REG_COUNT] = {[X86_SI] = 4, [X86_DI] = 5, [X86_BX] = 7};
+    uint8_t mod = disp_size == 0 ? 0x00 : disp_size == 1 ? 0x40 : 0x80;
+    return (uint8_t)(mod | (reg << 3) | (bits == X86_CODE32 ? base : rm16[base]));
+}
+
+// Native-size immediate, displacement or relative target
+static inline void emit_word(Emitter* out, uint32_t value, int bits) {
+    if (bits == X86_CODE32) emitter_u32(out, value);
+    else emitter_u16(out, (uint16_t)value);
+}
+
+// ModRM and displacement of a [base+disp] operand
+static void emit_idx(Emitter* out, int reg, const X86Insn* insn, int bits) {
+    size_t disp_size = x86_idx_disp_size(insn->disp, bits);
+    emitter_u8(out, modrm_idx(reg, insn->base, disp_size, bits));
+    if (disp_size == 1) emitter_u8(out, (uint8_t)insn->disp);
+    else if (disp_size) emit_word(out, insn->disp, bits);
+}
+
+void x86_encode(const X86Code* code, Emitter* out) {
+    const int bits = code->bits;
+    emitter_reserve(out, x86_code_size(code));
+    for (size_t i = 0; i < code->count; i++) {
+        const X86Insn* insn = &code->insns[i];
+        switch (insn->op) {
+            case X86_NOP:
+                break;
+            case X86_MOV_IMM:
+                emitter_u8(out, (uint8_t)(0xB8 + insn->dst));
+                emit_word(out, insn->imm, bits);
+                break;
+            case X86_MOV_REG:
+                emitter_u8(out, 0x89);
+                emitter_u8(out, modrm_rr(insn->src, insn->dst));
+                break;
+            case X86_XOR_REG:
+                emitter_u8(out, 0x31);
+                emitter_u8(out, modrm_rr(insn->dst, insn->dst));
+                break;
+            case X86_MOV_MEM_IMM:
+                if (insn->prefix) emitter_u8(out, insn->prefix);
+                if (x86_opsize_prefix(insn->width, bits)) emitter_u8(out, 0x66);  // Operand-size prefix (386+)
+                emitter_u8(out, insn->width == 1 ? 0xC6 : 0xC7);
+                emitter_u8(out, modrm_abs(0, bits));
+                emit_word(out, insn->disp, bits);
+                if (insn->width == 1) emitter_u8(out, (uint8_t)insn->imm);
+                else if (insn->width == 2) emitter_u16(out, (uint16_t)insn->imm);
+                else emitter_u32(out, insn->imm);
+                break;
+            case X86_MOV_MEM_REG:
+                if (insn->prefix) emitter_u8(out, insn->prefix);
+                if (x86_opsize_prefix(insn->width, bits)) emitter_u8(out, 0x66);
+                if (insn->src == X86_AX) {
+                    emitter_u8(out, insn->width == 1 ? 0xA2 : 0xA3);  // moffs form
+                } else {
+                    emitter_u8(out, insn->width == 1 ? 0x88 : 0x89);
+                    emitter_u8(out, modrm_abs(insn->src, bits));
+                }
+                emit_word(out, insn->disp, bits);
+                break;
+            case X86_MOV_IDX_IMM:
+                if (insn->prefix) emitter_u8(out, insn->prefix);
+                if (x86_opsize_prefix(insn->width, bits)) emitter_u8(out, 0x66);
+                emitter_u8(out, insn->width == 1 ? 0xC6 : 0xC7);
+                emit_idx(out, 0, insn, bits);
+                if (insn->width == 1) emitter_u8(out, (uint8_t)insn->imm);
+                else if (insn->width == 2) emitter_u16(out, (uint16_t)insn->imm);
+                else emitter_u32(out, insn->imm);
+                break;
+            case X86_MOV_IDX_REG:
+                if (insn->prefix) emitter_u8(out, insn->prefix);
+                if (x86_opsize_prefix(insn->width, bits)) emitter_u8(out, 0x66);
+                emitter_u8(out, insn->width == 1 ? 0x88 : 0x89);
+                emit_idx(out, insn->src, insn, bits);
+                break;
+            case X86_PUSH:         emitter_u8(out, (uint8_t)(0x50 + insn->src)); break;
+            case X86_POP:          emitter_u8(out, (uint8_t)(0x58 + insn->dst)); break;
+            case X86_PUSH_IMM:
+                if (x86_imm8(insn->imm, bits)) {
+                    emitter_u8(out, 0x6A);  // Sign-extended to a word when pushed
+                    emitter_u8(out, (uint8_t)insn->imm);
+                } else {
+                    emitter_u8(out, 0x68);
+                    emit_word(out, insn->imm, bits);
+                }
+                break;
+            case X86_PUSH_SEG:     emitter_u8(out, (uint8_t)(0x06 | (insn->src << 3))); break;
+            case X86_POP_SEG:      emitter_u8(out, (uint8_t)(0x07 | (insn->dst << 3))); break;
+            case X86_CLD:          emitter_u8(out, 0xFC); break;
+            case X86_REP_STOS:     emitter_u16(out, 0xABF3); break;
+            case X86_REP_MOVS:
+                if (insn->prefix) emitter_u8(out, insn->prefix);
+                emitter_u16(out, 0xA5F3);
+                break;
+            case X86_MOVSB:
+                if (insn->prefix) emitter_u8(out, insn->prefix);
+                emitter_u8(out, 0xA4);
+                break;
+            case X86_CALL_OVER:
+                emitter_u8(out, 0xE8);
+                emit_word(out, insn->imm, bits);  // Relative: skip the blob
+                emitter_bytes(out, code->data + insn->disp, insn->imm);
+                break;
+            case X86_LABEL:
+                break;
+            case X86_JMP:
+                if (insn->width == X86_SHORT) {
+                    emitter_u8(out, 0xEB);
+                    emitter_u8(out, (uint8_t)insn->disp);
+                } else {
+                    emitter_u8(out, 0xE9);
+                    emit_word(out, insn->disp, bits);
+                }
+                break;
+            case X86_JCC:
+                if (insn->width == X86_SHORT) {
+                    emitter_u8(out, (uint8_t)(0x70 + insn->dst));
+                    emitter_u8(out, (uint8_t)insn->disp);
+                } else {
+                    emitter_u8(out, 0x0F);  // 386 jcc rel16 / rel32
+                    emitter_u8(out, (uint8_t)(0x80 + insn->dst));
+                    emit_word(out, insn->disp, bits);
+                }
+                break;
+            case X86_LOOP:
+                if (insn->width == X86_SHORT) {
+                    emitter_u8(out, 0xE2);
+                    emitter_u8(out, (uint8_t)insn->disp);
+                } else {
+                    emitter_u8(out, 0x49);  // dec cx / dec ecx
+                    emitter_u8(out, 0x0F);  // jnz rel16 / rel32
+                    emitter_u8(out, 0x80 + X86_CC_NZ);
+                    emit_word(out, insn->disp, bits);
+                }
+                break;
+            case X86_CALL:
+                emitter_u8(out, 0xE8);
+                emit_word(out, insn->disp, bits);
+                break;
+            case X86_TEST_REG:
+                emitter_u8(out, 0x85);
+                emitter_u8(out, modrm_rr(insn->src, insn->src));
+                break;
+            case X86_CMP_BP_ZERO:
+                emitter_u8(out, 0x83);
+                emitter_u8(out, modrm_bp(7, bits));  // /7 with [bp+disp8]
+                emitter_u8(out, (uint8_t)insn->disp);
+                emitter_u8(out, 0);
+                break;
+            case X86_RET:          emitter_u8(out, 0xC3); break;
+            case X86_ADD_SP:
+                emitter_u8(out, insn->imm < 0x80 ? 0x83 : 0x81);
+                emitter_u8(out, modrm_rr(0, X86_SP));
+                if (insn->imm < 0x80) emitter_u8(out, (uint8_t)insn->imm);
+                else emit_word(out, insn->imm, bits);
+                break;
+            case X86_MOV_REG_BP:
+                emitter_u8(out, 0x8B);
+                emitter_u8(out, modrm_bp(insn->dst, bits));
+                emitter_u8(out, (uint8_t)insn->disp);
+                break;
+            case X86_PUSH_BP_MEM:
+                emitter_u8(out, 0xFF);
+                emitter_u8(out, modrm_bp(6, bits));  // /6 with [bp+disp8]
+                emitter_u8(out, (uint8_t)insn->disp);
+                break;
+            case X86_ALU_IMM:
+                emitter_u8(out, x86_imm8(insn->imm, bits) ? 0x83 : 0x81);
+                emitter_u8(out, modrm_rr(insn->width, insn->dst));
+                if (x86_imm8(insn->imm, bits)) emitter_u8(out, (uint8_t)insn->imm);
+                else emit_word(out, insn->imm, bits);
+                break;
+            case X86_ALU_REG:
+                emitter_u8(out, (uint8_t)(insn->width << 3 | 0x01));
+                emitter_u8(out, modrm_rr(insn->src, insn->dst));
+                break;
+            case X86_ALU_BP:
+                emitter_u8(out, (uint8_t)(insn->width << 3 | 0x03));
+                emitter_u8(out, modrm_bp(insn->dst, bits));
+                emitter_u8(out, (uint8_t)insn->disp);
+                break;
+            case X86_MOV_BP_REG:
+                emitter_u8(out, 0x89);
+                emitter_u8(out, modrm_bp(insn->src, bits));
+                emitter_u8(out, (uint8_t)insn->disp);
+                break;
+            case X86_MOV_BP_IMM:
+                emitter_u8(out, 0xC7);
+                emitter_u8(out, modrm_bp(0, bits));
+                emitter_u8(out, (uint8_t)insn->disp);
+                emit_word(out, insn->imm, bits);
+                break;
+            case X86_SHIFT:
+                emitter_u8(out, 0xD1);
+                emitter_u8(out, modrm_rr(insn->width, insn->dst));
+                break;
+            default:
+                error("Cannot encode x86 instruction (op %d)", insn->op);
+        }
+    }
+}
@@ -0,0 +1,154 @@
+#ifndef X86_H
+#define X86_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "emitter.h"
+#include "../common/arena.h"
+
+// Machine-level x86 instructions. Codegen appends these to an X86Code list instead of
+// writing bytes directly, so passes like the peephole optimizer can rewrite or delete
+// instructions before they are encoded.
+//
+// The same list encodes for a 16-bit code segment (real mode) or a 32-bit one
+// (protected mode). "word" below is the segment's native operand size: ax/imm16/rel16
+// in 16-bit code, eax/imm32/rel32 in 32-bit code. Memory operands of the other size get
+// the 0x66 operand-size prefix; addresses always use the native size (disp16 / disp32),
+// so no 0x67 address-size prefix is ever needed.
+//
+// The baseline is the 386 in both modes: real-mode code uses push imm (186), 32-bit
+// stores with the 0x66 prefix and jcc rel16 (386), so it does not run on an 8086.
+
+// General registers, numbered as in the ModRM reg field (ax..di in 16-bit code, eax..edi
+// in 32-bit code; the same numbers select al/cl/dl/bl for byte operations)
+typedef enum {
+    X86_AX, X86_CX, X86_DX, X86_BX, X86_SP, X86_BP, X86_SI, X86_DI,
+    X86_REG_COUNT
+} X86Reg;
+
+// Segment registers, numbered as in the ModRM reg field
+typedef enum {
+    X86_ES, X86_CS, X86_SS, X86_DS
+} X86Seg;
+
+typedef enum {
+    X86_NOP,          // Deleted by an optimization pass; encodes to nothing
+    X86_MOV_IMM,      // mov dst, imm                    (B8+r iw/id)
+    X86_MOV_REG,      // mov dst, src                    (89 /r)
+    X86_XOR_REG,      // xor dst, dst                    (31 /r), used to load zero
+    X86_MOV_MEM_IMM,  // mov width [prefix:disp], imm    (C6/C7 06 in 16-bit code, C6/C7 05 in 32-bit code)
+    X86_MOV_MEM_REG,  // mov width [prefix:disp], src    (A2/A3 for al/ax, else 88/89 06+r / 05+r)
+    X86_MOV_IDX_IMM,  // mov width [prefix:base+disp], imm (C6/C7 with the shortest [base+disp] ModRM)
+    X86_MOV_IDX_REG,  // mov width [prefix:base+disp], src (88/89, the same ModRM)
+    X86_PUSH,         // push src                        (50+r)
+    X86_POP,          // pop dst                         (58+r)
+    X86_PUSH_IMM,     // push imm                        (6A ib when it sign-extends, else 68 iw/id)
+    X86_PUSH_SEG,     // push segment src                (06/0E/16/1E)
+    X86_POP_SEG,      // pop segment dst                 (07/17/1F)
+    X86_CLD,          // cld                             (FC)
+    X86_REP_STOS,     // rep stos word                   (F3 AB)
+    X86_REP_MOVS,     // [prefix:] rep movs word         (F3 A5)
+    X86_MOVSB,        // [prefix:] movsb                 (A4)
+    X86_CALL_OVER,    // call over an inline data blob   (E8 rel + blob); disp = blob offset
+                      // in X86Code::data, imm = blob length. Pushes the blob's address.
+    X86_LABEL,        // Binds label imm here; encodes to nothing
+    X86_JMP,          // jmp label imm                   (EB rel8 / E9 rel)
+    X86_JCC,          // j<cc> label imm, cc in dst      (70+cc rel8 / 0F 80+cc rel16 / rel32)
+    X86_LOOP,         // loop label imm                  (E2 rel8 / 49 0F 85 rel: dec cx; jnz)
+    X86_CALL,         // call label imm                  (E8 rel)
+    X86_RET,          // ret                             (C3)
+    X86_ADD_SP,       // add sp, imm                     (83 C4 ib, 81 C4 iw/id)
+    X86_MOV_REG_BP,   // mov dst, [bp+disp8]             (8B 46+r / 45+r disp8), stack arguments
+    X86_PUSH_BP_MEM,  // push word [bp+disp8]            (FF 76 / 75 disp8)
+    X86_TEST_REG,     // test src, src                   (85 /r)
+    X86_CMP_BP_ZERO,  // cmp word [bp+disp8], 0          (83 7E / 7D disp8 00)
+    X86_ALU_IMM,      // <alu> dst, imm                  (83 /alu ib when it sign-extends, 81 /alu iw/id)
+    X86_ALU_REG,      // <alu> dst, src                  (01/09/21/29 /r)
+    X86_ALU_BP,       // <alu> dst, [bp+disp8]           (03/0B/23/2B 46+r / 45+r disp8)
+    X86_MOV_BP_REG,   // mov [bp+disp8], src             (89 46+r / 45+r disp8), spilled variables
+    X86_MOV_BP_IMM,   // mov word [bp+disp8], imm        (C7 46 / 45 disp8 iw/id)
+    X86_SHIFT,        // shl/shr dst, 1                  (D1 E0+r / D1 E8+r), direction in width
+} X86Op;
+
+// Arithmetic operations (X86Insn::width of X86_ALU_*), numbered as the ModRM /digit
+#define X86_ALU_ADD 0
+#define X86_ALU_OR  1
+#define X86_ALU_AND 4
+#define X86_ALU_SUB 5
+
+// Shift directions (X86Insn::width of X86_SHIFT), numbered as the ModRM /digit
+#define X86_SHL 4
+#define X86_SHR 5
+
+// Condition codes (low nibble of the short jcc opcode)
+#define X86_CC_Z  0x4
+#define X86_CC_NZ 0x5
+
+// Jump forms (X86Insn::width of X86_JMP / X86_JCC / X86_LOOP)
+#define X86_SHORT 1  // rel8
+#define X86_NEAR  2  // rel16 / rel32
+
+typedef struct {
+    uint8_t op;     // X86Op
+    uint8_t dst;    // X86Reg / X86Seg written
+    uint8_t src;    // X86Reg / X86Seg read
+    uint8_t width;  // Memory operand width in bytes (1/2/4), jump form (X86_SHORT / X86_NEAR),
+                    // operation of X86_ALU_* / X86_SHIFT
+    uint32_t imm;   // Immediate
+    uint32_t disp;  // Memory displacement (blob offset for X86_CALL_OVER, displacement once linked for jumps)
+    uint8_t prefix; // Segment override prefix byte for the memory operand (0x26 = es:), 0 = DS / ES for
+                    // the destination of string instructions
+    uint8_t base;   // Base register of X86_MOV_IDX_* (bx, si or di: the ones 16-bit code can address with)
+    uint8_t pad[2];
+} X86Insn;
+
+_Static_assert(sizeof(X86Insn) == 16, "X86Insn should stay 16 bytes");
+
+// Segment override prefix bytes
+#define X86_PREFIX_ES 0x26
+#define X86_PREFIX_CS 0x2E
+
+// Code segment sizes (X86Code::bits)
+#define X86_CODE16 16  // Real mode
+#define X86_CODE32 32  // Protected mode
+
+// Growable instruction list plus the data blobs referenced by X86_CALL_OVER, in an arena
+// (the lowering's scratch memory: nothing to free)
+typedef struct {
+    int bits;  // X86_CODE16 / X86_CODE32: the native operand and address size
+    Arena* arena;
+    X86Insn* insns;
+    size_t count;
+    size_t cap;
+    uint8_t* data;
+    size_t data_len;
+    size_t data_cap;
+} X86Code;
+
+void x86_code_init(X86Code* code, int bits, Arena* arena);
+void x86_emit(X86Code* code, X86Insn insn);
+// Copy a blob into the data pool, returns its offset (for X86_CALL_OVER)
+uint32_t x86_add_data(X86Code* code, const uint8_t* bytes, size_t len);
+
+// Register names come from the module table (x86_real / x86_pm32 in module/modules.def)
+const char* x86_reg_name(int reg);
+const char* x86_reg_name32(int reg);
+
+// Mask of a native word (0xFFFF / 0xFFFFFFFF)
+#define X86_WORD_MASK(bits) ((bits) == X86_CODE32 ? 0xFFFFFFFFu : 0xFFFFu)
+
+// Registers an instruction reads / writes, as bit masks over X86Reg.
+// Returns 1 if the instruction only writes dst and can be deleted when dst is dead.
+#define X86_REG_BIT(r) (1u << (r))
+int x86_insn_effects(const X86Insn* insn, unsigned* reads, unsigned* writes);
+
+// Encoded size of one instruction in bytes, in a code segment of the given size
+size_t x86_insn_size(const X86Insn* insn, int bits);
+
+// Total encoded size of the list
+size_t x86_code_size(const X86Code* code);
+
+// Encode the list into the emitter (X86_NOP entries are skipped)
+void x86_encode(const X86Code* code, Emitter* out);
+
+#endif // X86_H
@@ -0,0 +1,793 @@
+#include "backend.h"
+#include "x86.h"
+#include "peephole.h"
+#include "store_run.h"
+#include "../common/utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+// -------------------------- x86 instruction selection --------------------------
+// One lowering serves real mode (x86_real, 16-bit code) and flat 32-bit protected mode
+// (x86_pm32): the code size picks the word size, the frame layout and the segment model.
+// Values are trees whose leaves are constants, registers (target registers and the ones
+// ir_regalloc gave to variables) and words in the frame (stack arguments, spilled
+// variables). A tree is evaluated where it is consumed, straight into the destination
+// register; an operand that is not a leaf goes through a scratch register saved on the
+// stack. Multiplication and division need a power-of-two constant (shifts).
+typedef struct {
+    uint8_t kind;      // IR_CONST, IR_GET_REG, IR_GET_ARG (a word in the frame) or a binary op
+                       // (0 = not lowerable)
+    uint8_t reg;       // Source register for IR_GET_REG
+    uint32_t imm;      // Constant for IR_CONST, bp displacement (disp8) for IR_GET_ARG
+    uint32_t version;  // Write count of `reg` when it was read
+    IrValue a, b;      // Operands of a binary op
+} X86ValueDef;
+
+// Calling convention: arguments in the order of x86_real_module's register table
+static const int x86_arg_regs[] = {X86_AX, X86_BX, X86_CX, X86_DX};
+
+// Variables go in the registers nothing else prefers first: si/di are not arguments and
+// not needed for byte stores. sp is the stack pointer and bp the frame pointer.
+static const int x86_alloc_regs[] = {X86_SI, X86_DI, X86_BX, X86_DX, X86_AX, X86_CX};
+
+// Stack arguments sit above the saved bp and the return address, frame slots below it
+// (word = 2 in 16-bit code, 4 in 32-bit code)
+#define X86_ARG_DISP(index, word) (2 * (word) + (word) * (index))
+#define X86_SLOT_DISP(slot, word) (uint8_t)(-(word) - (word) * (slot))
+#define X86_MAX_SLOTS 63       // bp-126 is the last word a disp8 reaches
+#define X86_PM32_MAX_SLOTS 31  // ebp-128 is the last dword
+
+// -------------------------- Segment lowering --------------------------
+// Store addresses are 20-bit linear addresses. Each one is lowered to segment:offset
+// through DS (no prefix) or ES (es: prefix, and the destination of string stores).
+// The compiler owns DS and ES: the segment loaded into each is cached, and a
+// register is reloaded (push imm16; pop seg, 4 bytes, no general register touched)
+// only when an address falls outside both cached 64 KiB windows. A new window
+// starts at the address itself (segment = addr >> 4), so ascending runs of stores
+// stay inside it as long as possible.
+// An address computed at run time is a constant part plus a 16-bit offset in bx, si or
+// di: the segment is the constant part's paragraph, so the store reaches the constant
+// part plus up to 64 KiB - 16 bytes.
+// 32-bit code assumes flat segments (base 0, 4 GiB limit): every address is its own
+// offset and the segment registers are never loaded.
+typedef struct {
+    int valid[2];        // Indexed by X86SegSlot
+    uint32_t value[2];   // Segment value loaded into DS / ES
+    int flat;            // 32-bit code: value stays 0 and every window covers everything
+} X86SegCache;
+
+typedef enum { X86_SLOT_DS, X86_SLOT_ES } X86SegSlot;
+
+#define X86_SEG_LOAD_COST 4
+#define X86_WINDOW 0x10000u
+
+// Bytes from addr to the end of the slot's window, 0 if addr is not inside it
+static uint32_t seg_remaining(const X86SegCache* cache, X86SegSlot slot, uint32_t addr) {
+    if (cache->flat) return UINT32_MAX;
+    if (!cache->valid[slot]) return 0;
+    uint32_t base = cache->value[slot] << 4;
+    if (addr < base || addr - base >= X86_WINDOW) return 0;
+    return X86_WINDOW - (addr - base);
+}
+
+// Window length when a segment is freshly loaded for addr
+static uint32_t seg_fresh_remaining(uint32_t addr) {
+    return X86_WINDOW - (addr & 0xF);
+}
+
+static void seg_load(X86Code* code, X86SegCache* cache, X86SegSlot slot, uint32_t addr) {
+    cache->value[slot] = addr >> 4;
+    cache->valid[slot] = 1;
+    x86_emit(code, (X86Insn){X86_PUSH_IMM, 0, 0, 0, cache->value[slot]});
+    x86_emit(code, (X86Insn){X86_POP_SEG, slot == X86_SLOT_DS ? X86_DS : X86_ES});
+}
+
+// -------------------------- Memory store batching --------------------------
+// Consecutive constant stores to ascending adjacent addresses (register moves in between
+// do not touch memory) are collected into a StoreRun, and the run gets the cheapest of:
+//  - direct stores, widest first (in 16-bit code dword 9 bytes, word 6, byte 5, +1 with es:)
+//  - rep stosw/stosd when the chunk repeats one word pattern (18 bytes in 16-bit code + tail)
+//  - rep movsw/movsd from a blob embedded in the code (20 bytes in 16-bit code + the data;
+//    cs: reads it in 16-bit code, flat 32-bit code needs no prefix)
+// Costs come from x86_insn_size, so they follow the code size.
+// The string sequences save every general register they touch, so the surrounding
+// code sees no difference except DF cleared by cld.
+static size_t direct_stores(size_t n) {
+    return n / 4 + (n % 4) / 2 + n % 2;
+}
+
+static size_t direct_cost(size_t n, int bits) {
+    X86Insn store = {X86_MOV_MEM_IMM};
+    size_t cost = 0;
+    for (int width = 4; width >= 1; width /= 2) {
+        store.width = (uint8_t)width;
+        cost += (n / width) * x86_insn_size(&store, bits);
+        n %= width;
+    }
+    return cost;
+}
+
+// Direct stores of b[0..n) at addr, which the slot's segment must cover
+static void emit_direct(X86Code* code, const X86SegCache* cache, X86SegSlot slot,
+                        uint32_t addr, const uint8_t* b, size_t n) {
+    uint32_t offset = addr - (cache->value[slot] << 4);
+    uint8_t prefix = slot == X86_SLOT_ES ? X86_PREFIX_ES : 0;
+    size_t i = 0;
+    while (i < n) {
+        int width = n - i >= 4 ? 4 : n - i >= 2 ? 2 : 1;
+        uint32_t value = 0;
+        for (int k = 0; k < width; k++) value |= (uint32_t)b[i + k] << (8 * k);
+        x86_emit(code, (X86Insn){X86_MOV_MEM_IMM, 0, 0, (uint8_t)width, value, offset + (uint32_t)i, prefix});
+        i += width;
+    }
+}
+
+static void emit_push(X86Code* code, int reg) { x86_emit(code, (X86Insn){X86_PUSH, 0, (uint8_t)reg}); }
+static void emit_pop(X86Code* code, int reg) { x86_emit(code, (X86Insn){X86_POP, (uint8_t)reg}); }
+static void emit_mov_imm(X86Code* code, int reg, uint32_t imm) {
+    x86_emit(code, (X86Insn){X86_MOV_IMM, (uint8_t)reg, 0, 0, imm});
+}
+
+// Sequence costs: push x3, mov x3, cld, rep stos, pop x3 / push x3, call over the blob,
+// pop si, mov x2, cld, rep movs, pop x3 (the movsb tail is added per byte)
+static size_t fill_cost(int bits) {
+    return 3 + 3 * (1 + bits / 8) + 1 + 2 + 3;
+}
+
+static size_t blob_cost(int bits) {
+    return 3 + (1 + bits / 8) + 1 + 2 * (1 + bits / 8) + 1 + (bits == X86_CODE16 ? 3 : 2) + 3;
+}
+
+// rep stos of a word pattern to ES:offset (ES must cover the chunk, n a multiple of the word)
+static void emit_fill(X86Code* code, uint32_t offset, const uint8_t* b, size_t n) {
+    size_t word = (size_t)code->bits / 8;
+    uint32_t pattern = 0;
+    for (size_t k = 0; k < word; k++) pattern |= (uint32_t)b[k] << (8 * k);
+    emit_push(code, X86_DI);
+    emit_push(code, X86_CX);
+    emit_push(code, X86_AX);
+    emit_mov_imm(code, X86_DI, offset);
+    emit_mov_imm(code, X86_CX, (uint32_t)(n / word));
+    emit_mov_imm(code, X86_AX, pattern);
+    x86_emit(code, (X86Insn){X86_CLD});
+    x86_emit(code, (X86Insn){X86_REP_STOS});
+    emit_pop(code, X86_AX);
+    emit_pop(code, X86_CX);
+    emit_pop(code, X86_DI);
+}
+
+// rep movs from an inline blob to ES:offset (ES must cover the chunk)
+static void emit_blob(X86Code* code, uint32_t offset, const uint8_t* b, size_t n) {
+    size_t word = (size_t)code->bits / 8;
+    uint8_t prefix = code->bits == X86_CODE16 ? X86_PREFIX_CS : 0;  // The blob is in the code segment
+    emit_push(code, X86_SI);
+    emit_push(code, X86_DI);
+    emit_push(code, X86_CX);
+    uint32_t data = x86_add_data(code, b, n);
+    x86_emit(code, (X86Insn){X86_CALL_OVER, 0, 0, 0, (uint32_t)n, data});
+    emit_pop(code, X86_SI);  // si = blob address (the call's return address)
+    emit_mov_imm(code, X86_DI, offset);
+    emit_mov_imm(code, X86_CX, (uint32_t)(n / word));
+    x86_emit(code, (X86Insn){X86_CLD});
+    x86_emit(code, (X86Insn){X86_REP_MOVS, 0, 0, 0, 0, 0, prefix});
+    for (size_t k = 0; k < n % word; k++) x86_emit(code, (X86Insn){X86_MOVSB, 0, 0, 0, 0, 0, prefix});
+    emit_pop(code, X86_CX);
+    emit_pop(code, X86_DI);
+    emit_pop(code, X86_SI);
+}
+
+static int is_fill_pattern(const uint8_t* b, size_t n, size_t word) {
+    if (n < 2 * word) return 0;
+    for (size_t i = word; i < n; i++) {
+        if (b[i] != b[i % word]) return 0;
+    }
+    return 1;
+}
+
+// Cost of a string sequence for n bytes, (size_t)-1 if neither applies
+static size_t string_cost(const uint8_t* b, size_t n, int bits, int* fill) {
+    size_t word = (size_t)bits / 8;
+    size_t movsb = bits == X86_CODE16 ? 2 : 1;
+    size_t fill_total = is_fill_pattern(b, n, word) ? fill_cost(bits) + direct_cost(n % word, bits) : (size_t)-1;
+    size_t blob_total = n < X86_WORD_MASK(bits) - blob_cost(bits) ? blob_cost(bits) + n + (n % word) * movsb
+                                                                   : (size_t)-1;
+    *fill = fill_total <= blob_total;
+    return *fill ? fill_total : blob_total;
+}
+
+// Lower one contiguous chunk, split wherever it leaves the segment window in use
+static void emit_chunk(X86Code* code, X86SegCache* cache, uint32_t addr, const uint8_t* b, size_t n) {
+    while (n > 0) {
+        // Direct stores: DS if it covers addr, else ES with a prefix, else reload DS
+        X86SegSlot direct_slot = X86_SLOT_DS;
+        uint32_t direct_window = seg_remaining(cache, X86_SLOT_DS, addr);
+        size_t direct_extra = 0;
+        if (!direct_window && (direct_window = seg_remaining(cache, X86_SLOT_ES, addr))) {
+            direct_slot = X86_SLOT_ES;
+        } else if (!direct_window) {
+            direct_window = seg_fresh_remaining(addr);
+            direct_extra = X86_SEG_LOAD_COST;
+        }
+        size_t direct_len = n < direct_window ? n : direct_window;
+        size_t direct = direct_cost(direct_len, code->bits) + direct_extra +
+                        (direct_slot == X86_SLOT_ES ? direct_stores(direct_len) : 0);
+
+        // String stores always write through ES
+        uint32_t string_window = seg_remaining(cache, X86_SLOT_ES, addr);
+        size_t string_extra = 0;
+        if (!string_window) {
+            string_window = seg_fresh_remaining(addr);
+            string_extra = X86_SEG_LOAD_COST;
+        }
+        size_t string_len = n < string_window ? n : string_window;
+        int fill;
+        size_t string = string_cost(b, string_len, code->bits, &fill);
+        if (string != (size_t)-1) string += string_extra;
+
+        // Compare cost per byte (the two windows can cover different lengths)
+        size_t len;
+        if (string != (size_t)-1 && string * direct_len < direct * string_len) {
+            if (string_extra) seg_load(code, cache, X86_SLOT_ES, addr);
+            uint32_t offset = addr - (cache->value[X86_SLOT_ES] << 4);
+            len = string_len;
+            if (fill) {
+                size_t tail = len % (size_t)(code->bits / 8);
+                emit_fill(code, offset, b, len - tail);
+                if (tail) {
+                    X86SegSlot slot = cache->flat ? X86_SLOT_DS : X86_SLOT_ES;  // No es: needed when flat
+                    emit_direct(code, cache, slot, addr + (uint32_t)(len - tail), b + len - tail, tail);
+                }
+            } else {
+                emit_blob(code, offset, b, len);
+            }
+        } else {
+            if (direct_extra) seg_load(code, cache, X86_SLOT_DS, addr);
+            len = direct_len;
+            emit_direct(code, cache, direct_slot, addr, b, len);
+        }
+        addr += (uint32_t)len;
+        b += len;
+        n -= len;
+    }
+}
+
+static void store_run_flush(StoreRun* run, X86Code* code, X86SegCache* cache) {
+    if (run->count == 0) return;
+    emit_chunk(code, cache, run->addr, run->bytes, run->count);
+    run->count = 0;
+}
+
+// Unbatched store of a constant (optimization off) or a register: still goes through the segment cache
+static void emit_store(X86Code* code, X86SegCache* cache, uint32_t addr, int width, const X86ValueDef* value) {
+    X86SegSlot slot = X86_SLOT_DS;
+    if ((uint32_t)width > seg_remaining(cache, X86_SLOT_DS, addr)) {
+        if ((uint32_t)width <= seg_remaining(cache, X86_SLOT_ES, addr)) slot = X86_SLOT_ES;
+        else seg_load(code, cache, X86_SLOT_DS, addr);
+    }
+    uint32_t offset = addr - (cache->value[slot] << 4);
+    uint8_t prefix = slot == X86_SLOT_ES ? X86_PREFIX_ES : 0;
+    if (value->kind == IR_CONST) {
+        x86_emit(code, (X86Insn){X86_MOV_MEM_IMM, 0, 0, (uint8_t)width, value->imm, offset, prefix});
+    } else {
+        x86_emit(code, (X86Insn){X86_MOV_MEM_REG, 0, value->reg, (uint8_t)width, 0, offset, prefix});
+    }
+}
+
+// -------------------------- Labels and branch relaxation --------------------------
+// When optimizing, jumps start in their short (rel8) form. Each sweep binds the labels
+// with the current sizes and widens every short jump whose target is out of rel8 range
+// to the near form; widening only pushes code further apart, so the sweeps reach a
+// fixpoint. Labels from earlier flushes are already bound. Calls are always near.
+static int x86_is_jump(int op) {
+    return op == X86_JMP || op == X86_JCC || op == X86_LOOP || op == X86_CALL;
+}
+
+// jmp to a label that directly follows it
+static void x86_drop_jumps_to_next(X86Code* code) {
+    for (size_t i = 0; i < code->count; i++) {
+        if (code->insns[i].op != X86_JMP) continue;
+        for (size_t j = i + 1; j < code->count; j++) {
+            const X86Insn* next = &code->insns[j];
+            if (next->op == X86_LABEL && next->imm == code->insns[i].imm) {
+                code->insns[i].op = X86_NOP;
+                break;
+            }
+            if (next->op != X86_LABEL && next->op != X86_NOP) break;
+        }
+    }
+}
+
+static void x86_bind_labels(const X86Code* code, BackendLabels* labels) {
+    uint32_t pos = labels->base;
+    for (size_t i = 0; i < code->count; i++) {
+        if (code->insns[i].op == X86_LABEL) labels->offset[code->insns[i].imm] = pos;
+        pos += (uint32_t)x86_insn_size(&code->insns[i], code->bits);
+    }
+}
+
+static void x86_link(X86Code* code, BackendLabels* labels) {
+    x86_drop_jumps_to_next(code);
+    int changed;
+    uint32_t pos;
+    do {
+        changed = 0;
+        x86_bind_labels(code, labels);
+        pos = labels->base;
+        for (size_t i = 0; i < code->count; i++) {
+            X86Insn* insn = &code->insns[i];
+            pos += (uint32_t)x86_insn_size(insn, code->bits);
+            if (!x86_is_jump(insn->op)) continue;
+            uint32_t target = labels->offset[insn->imm];
+            if (target == BACKEND_LABEL_UNBOUND) error("x86 backend: jump to unbound label L%u", insn->imm);
+            int32_t rel = (int32_t)(target - pos);
+            insn->disp = (uint32_t)rel & X86_WORD_MASK(code->bits);
+            if (insn->width == X86_SHORT && (rel < -128 || rel > 127)) {
+                insn->width = X86_NEAR;
+                changed = 1;
+            }
+        }
+    } while (changed);
+    labels->base = pos;
+}
+
+// -------------------------- Machine state across control flow --------------------------
+// A value read from a register stays usable while the register keeps its version. At a
+// label reached only by forward jumps (and possibly by falling into it) the state is the
+// merge of those predecessors: whatever they disagree on is unknown. Loop heads and call
+// targets are entered from code not lowered yet, so nothing is known there.
+typedef struct {
+    uint32_t version[X86_REG_COUNT];
+    X86SegCache segs;
+} X86State;
+
+typedef struct {
+    X86State state;
+    uint8_t seen;     // A predecessor has been merged into state
+    uint8_t unknown;  // Entered by a backward jump or a call
+} X86LabelState;
+
+static void x86_state_unknown(X86State* st, uint32_t* next_version) {
+    for (int r = 0; r < X86_REG_COUNT; r++) st->version[r] = ++*next_version;
+    st->segs = (X86SegCache){{0, 0}, {0, 0}, st->segs.flat};
+}
+
+static void x86_state_merge(X86LabelState* label, const X86State* from, uint32_t* next_version) {
+    if (!label->seen) {
+        label->state = *from;
+        label->seen = 1;
+        return;
+    }
+    for (int r = 0; r < X86_REG_COUNT; r++) {
+        if (label->state.version[r] != from->version[r]) label->state.version[r] = ++*next_version;
+    }
+    for (int slot = 0; slot < 2; slot++) {
+        if (!from->segs.valid[slot] || from->segs.value[slot] != label->state.segs.value[slot]) {
+            label->state.segs.valid[slot] = 0;
+        }
+    }
+}
+
+// Mark the labels a call or a backward jump enters
+static X86LabelState* x86_label_states(IrProgram* ir, size_t label_count) {
+    X86LabelState* states = arena_calloc(&ir->scratch, (label_count ? label_count : 1) * sizeof(X86LabelState));
+    uint8_t* bound = arena_calloc(&ir->scratch, label_count ? label_count : 1);
+    for (size_t i = 0; i < ir->count; i++) {
+        const IrInsn* insn = &ir->insns[i];
+        switch (insn->op) {
+            case IR_LABEL:        bound[insn->a] = 1; break;
+            case IR_CALL:         states[insn->a].unknown = 1; break;
+            case IR_JMP:
+            case IR_LOOP:         if (bound[insn->a]) states[insn->a].unknown = 1; break;
+            case IR_BRANCH_ZERO:  if (bound[insn->b]) states[insn->b].unknown = 1; break;
+            default:              break;
+        }
+    }
+    return states;
+}
+
+// -------------------------- Value trees --------------------------
+static int x86_is_leaf(const X86ValueDef* def) {
+    return def->kind == IR_CONST || def->kind == IR_GET_REG || def->kind == IR_GET_ARG;
+}
+
+// Registers a value reads (depth is bounded by the source's parentheses)
+static unsigned x86_value_regs(const X86ValueDef* defs, IrValue v) {
+    const X86ValueDef* def = &defs[v];
+    switch (def->kind) {
+        case IR_GET_REG: return X86_REG_BIT(def->reg);
+        case IR_GET_ARG: return X86_REG_BIT(X86_BP);
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_AND: case IR_OR:
+            return x86_value_regs(defs, def->a) | x86_value_regs(defs, def->b);
+        default:
+            return 0;
+    }
+}
+
+// A register leaf must still hold the value it was read for
+static void x86_check_leaf(const X86ValueDef* defs, const X86State* cur, IrValue v) {
+    const X86ValueDef* def = &defs[v];
+    if (def->kind == IR_GET_REG && def->version != cur->version[def->reg]) {
+        error("x86 backend cannot lower v%u: %s changed after it was read", v, x86_reg_name(def->reg));
+    }
+}
+
+static const uint8_t x86_alu_ops[] = {
+    [IR_ADD] = X86_ALU_ADD, [IR_SUB] = X86_ALU_SUB, [IR_AND] = X86_ALU_AND, [IR_OR] = X86_ALU_OR,
+};
+
+// <alu> r, leaf
+static void emit_alu(X86Code* code, int r, int alu, const X86ValueDef* leaf) {
+    if (leaf->kind == IR_CONST) {
+        x86_emit(code, (X86Insn){X86_ALU_IMM, (uint8_t)r, 0, (uint8_t)alu, leaf->imm & X86_WORD_MASK(code->bits)});
+    } else if (leaf->kind == IR_GET_REG) {
+        x86_emit(code, (X86Insn){X86_ALU_REG, (uint8_t)r, leaf->reg, (uint8_t)alu, 0});
+    } else {
+        x86_emit(code, (X86Insn){X86_ALU_BP, (uint8_t)r, 0, (uint8_t)alu, 0, leaf->imm});
+    }
+}
+
+// Scratch register for evaluating part of a value, not one in avoid
+static int x86_scratch(unsigned avoid, IrValue v) {
+    static const int order[] = {X86_AX, X86_CX, X86_DX, X86_BX, X86_SI, X86_DI};
+    for (int i = 0; i < 6; i++) {
+        if (!(avoid & X86_REG_BIT(order[i]))) return order[i];
+    }
+    error("x86 backend: no register left to evaluate v%u", v);
+    return -1;
+}
+
+// r = v. Only r changes: scratch registers are saved around their use.
+static void emit_value(X86Code* code, const X86ValueDef* defs, const X86State* cur, int r, IrValue v) {
+    const X86ValueDef* def = &defs[v];
+    switch (def->kind) {
+        case IR_CONST:
+            emit_mov_imm(code, r, def->imm & X86_WORD_MASK(code->bits));
+            return;
+        case IR_GET_REG:
+            x86_check_leaf(defs, cur, v);
+            if (def->reg != r) x86_emit(code, (X86Insn){X86_MOV_REG, (uint8_t)r, def->reg, 0, 0});
+            return;
+        case IR_GET_ARG:
+            x86_emit(code, (X86Insn){X86_MOV_REG_BP, (uint8_t)r, 0, 0, 0, def->imm});
+            return;
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_AND: case IR_OR:
+            break;
+        default:
+            error("x86 backend cannot lower v%u into %s", v, x86_reg_name(r));
+    }
+
+    IrValue lhs = def->a, rhs = def->b;
+    if (def->kind == IR_MUL || def->kind == IR_DIV) {
+        if (def->kind == IR_MUL && defs[lhs].kind == IR_CONST) lhs = def->b, rhs = def->a;
+        uint32_t factor = defs[rhs].imm;
+        if (defs[rhs].kind != IR_CONST || factor == 0 || (factor & (factor - 1))) {
+            error("x86 backend can only multiply or divide by a power of two at run time (v%u)", v);
+        }
+        emit_value(code, defs, cur, r, lhs);
+        for (; factor > 1; factor >>= 1) {
+            x86_emit(code, (X86Insn){X86_SHIFT, (uint8_t)r, 0, def->kind == IR_MUL ? X86_SHL : X86_SHR, 0});
+        }
+        return;
+    }
+
+    // r is written before rhs is read: rhs must not read r. Commuting operands can fix
+    // that, and puts a leaf on the right where possible.
+    unsigned r_bit = X86_REG_BIT(r);
+    int swap = (x86_value_regs(defs, rhs) & r_bit) || (!x86_is_leaf(&defs[rhs]) && x86_is_leaf(&defs[lhs]));
+    if (def->kind != IR_SUB && swap && !(x86_value_regs(defs, lhs) & r_bit)) {
+        IrValue t = lhs;
+        lhs = rhs;
+        rhs = t;
+    }
+    int alu = x86_alu_ops[def->kind];
+    if (x86_is_leaf(&defs[rhs]) && !(x86_value_regs(defs, rhs) & r_bit)) {
+        x86_check_leaf(defs, cur, rhs);
+        emit_value(code, defs, cur, r, lhs);
+        emit_alu(code, r, alu, &defs[rhs]);
+        return;
+    }
+    int t = x86_scratch(x86_value_regs(defs, v) | r_bit | X86_REG_BIT(X86_SP) | X86_REG_BIT(X86_BP), v);
+    emit_push(code, t);
+    emit_value(code, defs, cur, t, rhs);
+    emit_value(code, defs, cur, r, lhs);
+    x86_emit(code, (X86Insn){X86_ALU_REG, (uint8_t)r, (uint8_t)t, (uint8_t)alu, 0});
+    emit_pop(code, t);
+}
+
+// Sum of the constants an address adds up (through + and -), wrapping like the registers
+static uint32_t x86_addr_const(const X86ValueDef* defs, IrValue v) {
+    const X86ValueDef* def = &defs[v];
+    if (def->kind == IR_CONST) return def->imm;
+    if (def->kind == IR_ADD) return x86_addr_const(defs, def->a) + x86_addr_const(defs, def->b);
+    if (def->kind == IR_SUB) return x86_addr_const(defs, def->a) - x86_addr_const(defs, def->b);
+    return 0;
+}
+
+// Store v to an address computed at run time: mov [seg:base+disp], with the address
+// less its added constants in bx, si or di (evaluated into one saved around the store
+// unless it is already there). In 16-bit code the base register holds the address modulo
+// 64 KiB, and disp takes out the part the segment already adds.
+static void emit_indexed_store(X86Code* code, const X86ValueDef* defs, X86State* cur, IrValue addr, int width,
+                               IrValue v) {
+    static const int bases[] = {X86_BX, X86_SI, X86_DI};
+    IrValue offset = addr;
+    uint32_t disp = 0;
+    for (;;) {  // Peel constants off: (VGA + x*2) + 1 is x*2 with disp VGA+1
+        const X86ValueDef* def = &defs[offset];
+        if (def->kind == IR_ADD && defs[def->a].kind == IR_CONST) disp += defs[def->a].imm, offset = def->b;
+        else if (def->kind == IR_ADD && defs[def->b].kind == IR_CONST) disp += defs[def->b].imm, offset = def->a;
+        else if (def->kind == IR_SUB && defs[def->b].kind == IR_CONST) disp -= defs[def->b].imm, offset = def->a;
+        else break;
+    }
+
+    uint8_t prefix = 0;
+    if (!cur->segs.flat) {
+        uint32_t total = x86_addr_const(defs, addr);
+        uint32_t segment = (total >> 4) & 0xFFFF;
+        X86SegCache* segs = &cur->segs;
+        if (segs->valid[X86_SLOT_ES] && segs->value[X86_SLOT_ES] == segment &&
+            !(segs->valid[X86_SLOT_DS] && segs->value[X86_SLOT_DS] == segment)) {
+            prefix = X86_PREFIX_ES;
+        } else if (!segs->valid[X86_SLOT_DS] || segs->value[X86_SLOT_DS] != segment) {
+            seg_load(code, segs, X86_SLOT_DS, total);
+        }
+        disp = (disp - (segment << 4)) & 0xFFFF;
+    }
+
+    // The base register: the offset's own when it is bx/si/di, else one the value does not read
+    const X86ValueDef* value = &defs[v];
+    unsigned value_regs = value->kind == IR_CONST ? 0 : x86_value_regs(defs, v);
+    int base = -1, saved = 0;
+    if (defs[offset].kind == IR_GET_REG) {
+        for (int i = 0; i < 3; i++) {
+            if (defs[offset].reg == bases[i]) base = bases[i];
+        }
+    }
+    if (base >= 0) {
+        x86_check_leaf(defs, cur, offset);
+    } else {
+        for (int i = 0; i < 3 && base < 0; i++) {
+            if (!(value_regs & X86_REG_BIT(bases[i]))) base = bases[i];
+        }
+        if (base < 0) error("x86 backend: no base register left to store v%u to [v%u]", v, addr);
+        emit_push(code, base);
+        emit_value(code, defs, cur, base, offset);
+        saved = 1;
+    }
+
+    if (value->kind == IR_CONST) {
+        X86Insn store = {X86_MOV_IDX_IMM, 0, 0, (uint8_t)width, value->imm, disp, prefix, (uint8_t)base};
+        x86_emit(code, store);
+    } else if (value->kind == IR_GET_REG && (width > 1 || value->reg <= X86_BX)) {
+        x86_check_leaf(defs, cur, v);
+        x86_emit(code, (X86Insn){X86_MOV_IDX_REG, 0, value->reg, (uint8_t)width, 0, disp, prefix, (uint8_t)base});
+    } else {
+        emit_push(code, X86_AX);  // Computed, in the frame, or without a byte form: through ax
+        emit_value(code, defs, cur, X86_AX, v);
+        x86_emit(code, (X86Insn){X86_MOV_IDX_REG, 0, X86_AX, (uint8_t)width, 0, disp, prefix, (uint8_t)base});
+        emit_pop(code, X86_AX);
+    }
+    if (saved) emit_pop(code, base);
+}
+
+// Everything lowering allocates is in ir->scratch: error() may longjmp out of the middle
+static size_t x86_lower(IrProgram* ir, BackendLabels* labels, Emitter* out, int optimize, int bits) {
+    X86ValueDef* defs = arena_calloc(&ir->scratch, ir->next_value * sizeof(X86ValueDef));
+    X86LabelState* at = x86_label_states(ir, labels->count);
+    uint32_t next_version = 0;
+    X86State cur;
+    cur.segs.flat = bits == X86_CODE32;
+    x86_state_unknown(&cur, &next_version);  // Registers, DS and ES are unknown on entry
+    int reachable = 1;  // The previous instruction can fall through
+    X86Code code;
+    x86_code_init(&code, bits, &ir->scratch);
+    const int word = bits / 8;
+    const uint32_t mask = X86_WORD_MASK(bits);
+    StoreRun run = {&ir->scratch};
+    uint8_t jump_form = optimize ? X86_SHORT : X86_NEAR;  // Relaxed by x86_link
+
+    for (size_t i = 0; i < ir->count; i++) {
+        const IrInsn* insn = &ir->insns[i];
+        switch (insn->op) {
+            case IR_NOP:
+                break;
+            case IR_CONST:
+                defs[insn->dst] = (X86ValueDef){IR_CONST, 0, insn->a, 0};
+                break;
+            case IR_GET_REG:
+                defs[insn->dst] = (X86ValueDef){IR_GET_REG, insn->reg, 0, cur.version[insn->reg]};
+                break;
+            case IR_GET_ARG:
+                defs[insn->dst] = (X86ValueDef){IR_GET_ARG, 0, X86_ARG_DISP(insn->a, word), 0};
+                break;
+            case IR_GET_SLOT:
+                defs[insn->dst] = (X86ValueDef){IR_GET_ARG, 0, X86_SLOT_DISP(insn->a, word), 0};
+                break;
+            case IR_SET_REG: {
+                X86ValueDef* def = &defs[insn->a];
+                if (def->kind == IR_CONST) emit_mov_imm(&code, insn->reg, def->imm & mask);  // The common case
+                else emit_value(&code, defs, &cur, insn->reg, insn->a);
+                // A copy keeps the version, so the value stays usable from either register
+                cur.version[insn->reg] = def->kind == IR_GET_REG ? cur.version[def->reg] : ++next_version;
+                break;
+            }
+            case IR_SET_SLOT: {
+                X86ValueDef* def = &defs[insn->a];
+                uint8_t disp = X86_SLOT_DISP(insn->b, word);
+                if (def->kind == IR_CONST) {
+                    x86_emit(&code, (X86Insn){X86_MOV_BP_IMM, 0, 0, 0, def->imm & mask, disp});
+                } else if (def->kind == IR_GET_REG) {
+                    x86_check_leaf(defs, &cur, insn->a);
+                    x86_emit(&code, (X86Insn){X86_MOV_BP_REG, 0, def->reg, 0, 0, disp});
+                } else {
+                    emit_push(&code, X86_AX);
+                    emit_value(&code, defs, &cur, X86_AX, insn->a);
+                    x86_emit(&code, (X86Insn){X86_MOV_BP_REG, 0, X86_AX, 0, 0, disp});
+                    emit_pop(&code, X86_AX);
+                }
+                break;
+            }
+            case IR_STORE: {
+                X86ValueDef* value = &defs[insn->b];
+                if (value->kind != IR_CONST && insn->reg * 8 > bits) {
+                    error("x86 backend cannot store v%u as a 32-bit value (registers are 16-bit)", insn->b);
+                }
+                if (defs[insn->a].kind != IR_CONST) {
+                    store_run_flush(&run, &code, &cur.segs);
+                    emit_indexed_store(&code, defs, &cur, insn->a, insn->reg, insn->b);
+                    break;
+                }
+                if (optimize && value->kind == IR_CONST) {
+                    if (!store_run_extends(&run, defs[insn->a].imm)) store_run_flush(&run, &code, &cur.segs);
+                    store_run_add(&run, defs[insn->a].imm, insn->reg, value->imm);
+                    break;
+                }
+                store_run_flush(&run, &code, &cur.segs);  // Earlier constant stores stay first
+                if (value->kind == IR_CONST || (value->kind == IR_GET_REG && (insn->reg > 1 || value->reg <= X86_BX))) {
+                    x86_check_leaf(defs, &cur, insn->b);
+                    emit_store(&code, &cur.segs, defs[insn->a].imm, insn->reg, value);
+                } else {
+                    // Computed, in the frame, or in a register without a byte form: through ax
+                    X86ValueDef ax = {IR_GET_REG, X86_AX};
+                    emit_push(&code, X86_AX);
+                    emit_value(&code, defs, &cur, X86_AX, insn->b);
+                    emit_store(&code, &cur.segs, defs[insn->a].imm, insn->reg, &ax);
+                    emit_pop(&code, X86_AX);
+                }
+                break;
+            }
+            case IR_LABEL: {
+                store_run_flush(&run, &code, &cur.segs);
+                X86LabelState* label = &at[insn->a];
+                if (reachable) x86_state_merge(label, &cur, &next_version);
+                if (label->unknown || !label->seen) x86_state_unknown(&cur, &next_version);
+                else cur = label->state;
+                reachable = 1;
+                x86_emit(&code, (X86Insn){X86_LABEL, 0, 0, 0, insn->a});
+                break;
+            }
+            case IR_JMP:
+                store_run_flush(&run, &code, &cur.segs);
+                x86_state_merge(&at[insn->a], &cur, &next_version);
+                x86_emit(&code, (X86Insn){X86_JMP, 0, 0, jump_form, insn->a});
+                reachable = 0;
+                break;
+            case IR_BRANCH_ZERO: {
+                X86ValueDef* def = &defs[insn->a];
+                store_run_flush(&run, &code, &cur.segs);
+                if (def->kind == IR_CONST) {  // Unoptimized IR: the condition is known anyway
+                    if (def->imm == 0) {
+                        x86_state_merge(&at[insn->b], &cur, &next_version);
+                        x86_emit(&code, (X86Insn){X86_JMP, 0, 0, jump_form, insn->b});
+                        reachable = 0;
+                    }
+                    break;
+                } else if (def->kind == IR_GET_REG) {
+                    x86_check_leaf(defs, &cur, insn->a);
+                    x86_emit(&code, (X86Insn){X86_TEST_REG, 0, def->reg});
+                } else if (def->kind == IR_GET_ARG) {
+                    x86_emit(&code, (X86Insn){X86_CMP_BP_ZERO, 0, 0, 0, 0, def->imm});
+                } else {
+                    emit_push(&code, X86_AX);  // pop leaves the flags alone
+                    emit_value(&code, defs, &cur, X86_AX, insn->a);
+                    x86_emit(&code, (X86Insn){X86_TEST_REG, 0, X86_AX});
+                    emit_pop(&code, X86_AX);
+                }
+                x86_state_merge(&at[insn->b], &cur, &next_version);
+                x86_emit(&code, (X86Insn){X86_JCC, X86_CC_Z, 0, jump_form, insn->b});
+                break;
+            }
+            case IR_LOOP:
+                store_run_flush(&run, &code, &cur.segs);
+                x86_emit(&code, (X86Insn){X86_LOOP, 0, 0, jump_form, insn->a});
+                cur.version[X86_CX] = ++next_version;
+                break;
+            case IR_CALL:
+                store_run_flush(&run, &code, &cur.segs);
+                x86_emit(&code, (X86Insn){X86_CALL, 0, 0, X86_NEAR, insn->a});
+                if (insn->b) x86_emit(&code, (X86Insn){X86_ADD_SP, 0, 0, 0, (uint32_t)word * insn->b});
+                x86_state_unknown(&cur, &next_version);  // The callee may change anything
+                break;
+            case IR_RET:
+                store_run_flush(&run, &code, &cur.segs);
+                if (insn->b) x86_emit(&code, (X86Insn){X86_MOV_REG, X86_SP, X86_BP, 0, 0});  // Drop the slots
+                if (insn->a) emit_pop(&code, X86_BP);
+                x86_emit(&code, (X86Insn){X86_RET});
+                reachable = 0;
+                break;
+            case IR_ENTER:
+            case IR_FRAME:
+                // push bp; mov bp, sp (a function's own frame); sub sp, slots
+                if (insn->b) {
+                    if (insn->op == IR_ENTER) emit_push(&code, X86_BP);
+                    x86_emit(&code, (X86Insn){X86_MOV_REG, X86_BP, X86_SP, 0, 0});
+                    cur.version[X86_BP] = ++next_version;
+                }
+                if (insn->a) x86_emit(&code, (X86Insn){X86_ALU_IMM, X86_SP, 0, X86_ALU_SUB, (uint32_t)word * insn->a});
+                break;
+            case IR_PUSH: {
+                X86ValueDef* def = &defs[insn->a];
+                if (def->kind == IR_CONST) {
+                    x86_emit(&code, (X86Insn){X86_PUSH_IMM, 0, 0, 0, def->imm & mask});
+                } else if (def->kind == IR_GET_REG) {
+                    x86_check_leaf(defs, &cur, insn->a);
+                    emit_push(&code, def->reg);
+                } else if (def->kind == IR_GET_ARG) {
+                    x86_emit(&code, (X86Insn){X86_PUSH_BP_MEM, 0, 0, 0, 0, def->imm});
+                } else {
+                    error("x86 backend cannot push v%u (computed arguments go through a variable)", insn->a);
+                }
+                break;
+            }
+            case IR_POP:
+                emit_pop(&code, insn->reg);
+                cur.version[insn->reg] = ++next_version;
+                break;
+            default: {
+                // Arithmetic is evaluated where the value is used; unoptimized IR still folds
+                // constants here (inlined arguments)
+                uint32_t folded;
+                if (insn->op >= IR_ADD && insn->op <= IR_OR) {
+                    if (defs[insn->a].kind == IR_CONST && defs[insn->b].kind == IR_CONST &&
+                        ir_fold(insn->op, defs[insn->a].imm, defs[insn->b].imm, &folded)) {
+                        defs[insn->dst] = (X86ValueDef){IR_CONST, 0, folded, 0};
+                    } else {
+                        defs[insn->dst] = (X86ValueDef){insn->op, 0, 0, 0, insn->a, insn->b};
+                    }
+                    break;
+                }
+                error("x86 backend cannot lower IR op %d", insn->op);
+            }
+        }
+    }
+    store_run_flush(&run, &code, &cur.segs);
+
+    size_t saved = optimize ? peephole_run(&code) : 0;
+    x86_link(&code, labels);
+    x86_encode(&code, out);
+    return saved;
+}
+
+static size_t x86_real_lower(IrProgram* ir, BackendLabels* labels, Emitter* out, int optimize) {
+    return x86_lower(ir, labels, out, optimize, X86_CODE16);
+}
+
+static size_t x86_pm32_lower(IrProgram* ir, BackendLabels* labels, Emitter* out, int optimize) {
+    return x86_lower(ir, labels, out, optimize, X86_CODE32);
+}
+
+const Backend x86_real_backend = {"x86_real", 16, 0xFFFFF, x86_reg_name,
+                                  x86_arg_regs, 4, X86_CX, x86_alloc_regs, 6, X86_BP, X86_MAX_SLOTS,
+                                  x86_real_lower};
+
+const Backend x86_pm32_backend = {"x86_pm32", 32, 0xFFFFFFFF, x86_reg_name32,
+                                  x86_arg_regs, 4, X86_CX, x86_alloc_regs, 6, X86_BP, X86_PM32_MAX_SLOTS,
+                                  x86_pm32_lower};
+
+const Backend* backend_lookup(const char* name) {
+    if (strcmp(name, x86_real_backend.name) == 0) return &x86_real_backend;
+    if (strcmp(name, x86_pm32_backend.name) == 0) return &x86_pm32_backend;
+    if (strcmp(name, riscv32_backend.name) == 0) return &riscv32_backend;
+    if (strcmp(name, riscv32c_backend.name) == 0) return &riscv32c_backend;
+    return NULL;
+}
@@ -0,0 +1,126 @@
+#include "arena.h"
+#include "utils.h"
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_DEFAULT_BLOCK (64 * 1024)
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct ArenaBlock {
+    ArenaBlock* next;   // Next block in the chain (kept across resets for reuse)
+    size_t size;        // Usable bytes in data
+    size_t offset;      // Bump pointer
+    alignas(max_align_t) char data[];
+};
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static ArenaBlock* arena_new_block(Arena* arena, size_t min_size) {
+    size_t size = arena->block_size;
+    // Oversized requests get a block of their own; otherwise grow geometrically so a
+    // large compilation needs only a handful of blocks
+    if (arena->reserved >= size) size = arena->reserved;
+    if (size < min_size) size = min_size;
+    ArenaBlock* block = safe_malloc(sizeof(ArenaBlock) + size);
+    block->next = NULL;
+    block->size = size;
+    block->offset = 0;
+    arena->reserved += size;
+    return block;
+}
+
+void arena_init(Arena* arena, size_t block_size) {
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK;
+    arena->used = 0;
+    arena->peak = 0;
+    arena->reserved = 0;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = align_up(size ? size : 1);
+    ArenaBlock* block = arena->current;
+
+    if (!block || block->size - block->offset < size) {
+        // Move on to the next retained block that fits, or chain a new one after current
+        ArenaBlock* next = block ? block->next : arena->first;
+        while (next && next->size < size) next = next->next;
+        if (next) {
+            next->offset = 0;
+        } else {
+            next = arena_new_block(arena, size);
+            if (!block) {
+                next->next = arena->first;
+                arena->first = next;
+            } else {
+                next->next = block->next;
+                block->next = next;
+            }
+        }
+        arena->current = block = next;
+    }
+
+    void* ptr = block->data + block->offset;
+    block->offset += size;
+    arena->used += size;
+    if (arena->used > arena->peak) arena->peak = arena->used;
+    return ptr;
+}
+
+void* arena_calloc(Arena* arena, size_t size) {
+    void* ptr = arena_alloc(arena, size);
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+    ArenaBlock* block = arena->current;
+    size_t old_aligned = align_up(old_size ? old_size : 1), new_aligned = align_up(new_size ? new_size : 1);
+    if (ptr && block && (char*)ptr + old_aligned == block->data + block->offset &&
+        block->size - (block->offset - old_aligned) >= new_aligned) {
+        block->offset += new_aligned - old_aligned;
+        arena->used += new_aligned - old_aligned;
+        if (arena->used > arena->peak) arena->peak = arena->used;
+        return ptr;
+    }
+    void* grown = arena_alloc(arena, new_size);
+    if (ptr) memcpy(grown, ptr, old_size);
+    return grown;
+}
+
+char* arena_strndup(Arena* arena, const char* s, size_t len) {
+    char* copy = arena_alloc(arena, len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+ArenaMark arena_mark(const Arena* arena) {
+    ArenaMark mark = {arena->current, arena->current ? arena->current->offset : 0, arena->used};
+    return mark;
+}
+
+void arena_release(Arena* arena, ArenaMark mark) {
+    arena->current = mark.block;
+    if (mark.block) mark.block->offset = mark.offset;
+    arena->used = mark.used;
+}
+
+void arena_reset(Arena* arena) {
+    arena->current = NULL;  // The next allocation restarts at the first block
+    arena->used = 0;
+}
+
+void arena_destroy(Arena* arena) {
+    ArenaBlock* block = arena->first;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena_init(arena, arena->block_size);
+}
@@ -0,0 +1,54 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// -------------------------- bump-pointer arena --------------------------
+// 一个编译单元的AST节点、名字string等都从arena中分配：分配只是移动指针，
+// 释放时整体回收（不逐个free），block保留下来供下一次编译复用
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock* first;    // 第一个block（reset后从这里重新开始）
+    ArenaBlock* current;  // 当前分配所在的block
+    size_t block_size;    // 新block的默认大小
+    size_t used;          // 当前已分配的bytes（包括对齐填充）
+    size_t peak;          // 历史最大used
+    size_t reserved;      // 已向系统申请的block总bytes
+} Arena;
+
+// arena中的位置（用于arena_release回滚到某个时刻）
+typedef struct {
+    ArenaBlock* block;
+    size_t offset;
+    size_t used;
+} ArenaMark;
+
+// 初始化arena（block_size为0时使用默认大小64KB）；不会立即申请memory
+void arena_init(Arena* arena, size_t block_size);
+
+// 分配size bytes（按max_align_t对齐，内容未初始化）；memory不足时调用error报错
+void* arena_alloc(Arena* arena, size_t size);
+
+// 分配并清零
+void* arena_calloc(Arena* arena, size_t size);
+
+// 把ptr（同一arena里old_size bytes的一块，NULL=还没有）扩大到new_size bytes并返回新的位置：
+// ptr是最后一次分配且block放得下时原地扩大，否则复制到新分配的内存（旧的那块作废到reset为止）
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+
+// 复制一段string（不要求'\0'结尾），返回以'\0'结尾的副本
+char* arena_strndup(Arena* arena, const char* s, size_t len);
+
+// 记录当前位置 / 回滚到记录的位置（之后分配的memory全部作废，O(1)）
+ArenaMark arena_mark(const Arena* arena);
+void arena_release(Arena* arena, ArenaMark mark);
+
+// 作废全部分配（O(1)，block保留复用；peak保留）
+void arena_reset(Arena* arena);
+
+// 归还全部block给系统
+void arena_destroy(Arena* arena);
+
+#endif // ARENA_H
@@ -0,0 +1,108 @@
+#include "pool.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Jobs jobs[head..tail) of one worker: the owner takes from head, thieves from tail.
+// Jobs are coarse (whole files), so a mutex per deque costs nothing measurable.
+typedef struct {
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+} PoolDeque;
+
+typedef struct {
+    PoolDeque* deques;  // Worker w starts with jobs [w * count / threads, (w + 1) * count / threads)
+    int threads;
+    PoolTask task;
+    void* ctx;
+    size_t steals;      // Under steal_lock
+    pthread_mutex_t steal_lock;
+} Pool;
+
+typedef struct {
+    Pool* pool;
+    int id;
+} PoolWorker;
+
+int pool_cpu_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+static int pool_take(PoolDeque* deque, size_t* job) {
+    pthread_mutex_lock(&deque->lock);
+    int found = deque->head < deque->tail;
+    if (found) *job = deque->head++;
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static int pool_steal(PoolDeque* deque, size_t* job) {
+    pthread_mutex_lock(&deque->lock);
+    int found = deque->head < deque->tail;
+    if (found) *job = --deque->tail;
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static void* pool_worker(void* arg) {
+    PoolWorker* worker = arg;
+    Pool* pool = worker->pool;
+    size_t job, stolen = 0;
+    for (;;) {
+        if (pool_take(&pool->deques[worker->id], &job)) {
+            pool->task(pool->ctx, job, worker->id);
+            continue;
+        }
+        // Own deque empty: one sweep over the others, starting at the next worker
+        int found = 0;
+        for (int i = 1; i < pool->threads && !found; i++) {
+            found = pool_steal(&pool->deques[(worker->id + i) % pool->threads], &job);
+        }
+        if (!found) break;  // Nothing left anywhere, and jobs never create jobs
+        stolen++;
+        pool->task(pool->ctx, job, worker->id);
+    }
+    pthread_mutex_lock(&pool->steal_lock);
+    pool->steals += stolen;
+    pthread_mutex_unlock(&pool->steal_lock);
+    return NULL;
+}
+
+size_t pool_run(size_t count, int threads, PoolTask task, void* ctx) {
+    if (count == 0) return 0;
+    if (threads <= 0) threads = pool_cpu_count();
+    if ((size_t)threads > count) threads = (int)count;
+
+    Pool pool = {0};
+    pool.deques = safe_malloc(threads * sizeof(PoolDeque));
+    pool.threads = threads;
+    pool.task = task;
+    pool.ctx = ctx;
+    pthread_mutex_init(&pool.steal_lock, NULL);
+    PoolWorker* workers = safe_malloc(threads * sizeof(PoolWorker));
+    pthread_t* tids = safe_malloc(threads * sizeof(pthread_t));
+    for (int w = 0; w < threads; w++) {
+        pthread_mutex_init(&pool.deques[w].lock, NULL);
+        pool.deques[w].head = count * w / threads;
+        pool.deques[w].tail = count * (w + 1) / threads;
+        workers[w] = (PoolWorker){&pool, w};
+    }
+    // Worker 0 is the calling thread; if a thread cannot be started its jobs get stolen
+    int started = 1;
+    for (int w = 1; w < threads; w++) {
+        if (pthread_create(&tids[w], NULL, pool_worker, &workers[w]) != 0) break;
+        started++;
+    }
+    pool_worker(&workers[0]);
+    for (int w = 1; w < started; w++) pthread_join(tids[w], NULL);
+
+    for (int w = 0; w < threads; w++) pthread_mutex_destroy(&pool.deques[w].lock);
+    pthread_mutex_destroy(&pool.steal_lock);
+    free(tids);
+    free(workers);
+    free(pool.deques);
+    return pool.steals;
+}
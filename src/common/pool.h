@@ -0,0 +1,21 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+// -------------------------- work-stealing线程池 --------------------------
+// 批量编译用：job 0..count-1按编号分成连续的块，每个worker一个deque。worker从自己
+// deque的一端按编号顺序取job，做完了就从别的worker的另一端偷，大文件拖慢的worker
+// 剩下的job会被空闲的worker分走。job运行中不会产生新job，所以所有deque都空时即结束
+
+// job回调：worker为0..threads-1（0就是调用pool_run的线程），同一worker上的job串行
+typedef void (*PoolTask)(void* ctx, size_t job, int worker);
+
+// 在线CPU数（至少1）
+int pool_cpu_count(void);
+
+// 运行所有job，全部完成后返回；threads<=0时每个CPU一个worker，超过count时按count算
+// 返回被偷走（在别的worker上运行）的job数
+size_t pool_run(size_t count, int threads, PoolTask task, void* ctx);
+
+#endif // POOL_H
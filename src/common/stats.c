@@ -0,0 +1,87 @@
+#include "stats.h"
+#include <sys/resource.h>
+#include <time.h>
+
+static const struct {
+    const char* name;
+    const char* key;
+} stats_phases[STATS_PHASE_COUNT] = {
+    [STATS_LEX] = {"lex", "lex"},
+    [STATS_PARSE] = {"parse", "parse"},
+    [STATS_IR_GEN] = {"IR generation", "ir_gen"},
+    [STATS_REGALLOC] = {"register allocation", "regalloc"},
+    [STATS_IR_PROPAGATE] = {"IR: constant propagation", "ir_propagate"},
+    [STATS_IR_TAIL_CALLS] = {"IR: tail calls", "ir_tail_calls"},
+    [STATS_IR_UNREACHABLE] = {"IR: unreachable code", "ir_unreachable"},
+    [STATS_IR_DEAD_STORES] = {"IR: dead stores", "ir_dead_stores"},
+    [STATS_LOWER] = {"lowering and peephole", "lower"},
+    [STATS_WRITE] = {"write output", "write"},
+};
+
+double stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void stats_record_rss(CompileStats* stats) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) stats->peak_rss = (size_t)usage.ru_maxrss * 1024;  // Linux: KiB
+}
+
+// Time not spent in any phase: opening and mapping files, setting up the compiler
+static double stats_other(const CompileStats* stats) {
+    double other = stats->total;
+    for (int phase = 0; phase < STATS_PHASE_COUNT; phase++) other -= stats->seconds[phase];
+    return other > 0 ? other : 0;
+}
+
+void stats_print_table(const CompileStats* stats, const char* file, FILE* out) {
+    double total = stats->total > 0 ? stats->total : 1e-9;
+    fprintf(out, "Compilation statistics: %s\n", file);
+    fprintf(out, "  %-26s %12s %7s\n", "Phase", "Time (ms)", "Share");
+    for (int phase = 0; phase < STATS_PHASE_COUNT; phase++) {
+        fprintf(out, "  %-26s %12.3f %6.1f%%\n", stats_phases[phase].name, stats->seconds[phase] * 1e3,
+                100.0 * stats->seconds[phase] / total);
+    }
+    double other = stats_other(stats);
+    fprintf(out, "  %-26s %12.3f %6.1f%%\n", "other (files, setup)", other * 1e3, 100.0 * other / total);
+    fprintf(out, "  %-26s %12.3f %6.1f%%\n", "total", stats->total * 1e3, 100.0);
+    fprintf(out, "  %-26s %12zu (%zu lexed, %.1f MB/s)\n", "Source bytes", stats->source_bytes, stats->lexed_bytes,
+            stats->seconds[STATS_LEX] > 0 ? stats->lexed_bytes / stats->seconds[STATS_LEX] / 1e6 : 0.0);
+    fprintf(out, "  %-26s %12zu\n", "Tokens", stats->tokens);
+    fprintf(out, "  %-26s %12zu\n", "AST nodes", stats->ast_nodes);
+    fprintf(out, "  %-26s %12zu (%zu removed by IR passes)\n", "IR instructions", stats->ir_insns, stats->ir_removed);
+    fprintf(out, "  %-26s %12zu\n", "Peephole bytes saved", stats->peephole_saved);
+    fprintf(out, "  %-26s %12zu\n", "Bytes emitted", stats->bytes_emitted);
+    fprintf(out, "  %-26s %12zu (%zu reserved)\n", "AST arena peak bytes", stats->arena_peak, stats->arena_reserved);
+    fprintf(out, "  %-26s %12zu\n", "Peak RSS bytes", stats->peak_rss);
+}
+
+// File names are the only strings that need escaping
+static void stats_json_string(const char* s, FILE* out) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+void stats_print_json(const CompileStats* stats, const char* file, FILE* out) {
+    fprintf(out, "{\"file\":");
+    stats_json_string(file, out);
+    fprintf(out, ",\"phases_ms\":{");
+    for (int phase = 0; phase < STATS_PHASE_COUNT; phase++) {
+        fprintf(out, "%s\"%s\":%.6f", phase ? "," : "", stats_phases[phase].key, stats->seconds[phase] * 1e3);
+    }
+    fprintf(out, ",\"other\":%.6f},\"total_ms\":%.6f", stats_other(stats) * 1e3, stats->total * 1e3);
+    fprintf(out, ",\"source_bytes\":%zu,\"lexed_bytes\":%zu,\"tokens\":%zu,\"ast_nodes\":%zu", stats->source_bytes,
+            stats->lexed_bytes, stats->tokens, stats->ast_nodes);
+    fprintf(out, ",\"ir_insns\":%zu,\"ir_removed\":%zu,\"peephole_bytes_saved\":%zu,\"bytes_emitted\":%zu",
+            stats->ir_insns, stats->ir_removed, stats->peephole_saved, stats->bytes_emitted);
+    fprintf(out, ",\"arena_peak_bytes\":%zu,\"arena_reserved_bytes\":%zu,\"peak_rss_bytes\":%zu}\n",
+            stats->arena_peak, stats->arena_reserved, stats->peak_rss);
+}
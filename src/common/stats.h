@@ -0,0 +1,56 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// -------------------------- 编译统计（--stats） --------------------------
+// 各阶段的耗时和规模，用来跟踪编译器在大文件上的性能变化。计时只在给了统计结构时进行
+// （codegen的stats为NULL时不读时钟）。
+// lex：编译时parser成批向lexer要Token，每批计一次时（parser_time_lexer；逐个Token读时钟的
+// 开销比扫描本身还大）。增量模式下复用的区域没有扫描，lex和tokens都只算真正扫描的部分；
+// parse：从开始解析到代码生成完的时间减去其中lex、codegen各阶段和写文件的时间
+
+typedef enum {
+    STATS_LEX,
+    STATS_PARSE,
+    STATS_IR_GEN,         // 遍历AST生成IR
+    STATS_REGALLOC,
+    STATS_IR_PROPAGATE,   // 以下四个与ir_optimize的pass顺序相同（ir_opt.c）
+    STATS_IR_TAIL_CALLS,
+    STATS_IR_UNREACHABLE,
+    STATS_IR_DEAD_STORES, // 包括最后压缩掉IR_NOP
+    STATS_LOWER,          // 指令选择和peephole
+    STATS_WRITE,          // 写输出文件
+    STATS_PHASE_COUNT
+} StatsPhase;
+
+#define STATS_IR_PASS_COUNT (STATS_IR_DEAD_STORES - STATS_IR_PROPAGATE + 1)
+
+typedef struct {
+    double seconds[STATS_PHASE_COUNT];
+    double total;           // 整个编译（包括打开文件、映射等不属于任何阶段的时间）
+    size_t source_bytes;
+    size_t lexed_bytes;     // 实际扫描的源码（增量模式下复用的区域不算）
+    size_t tokens;
+    size_t ast_nodes;       // 语句和表达式节点
+    size_t ir_insns;
+    size_t ir_removed;
+    size_t peephole_saved;
+    size_t bytes_emitted;
+    size_t arena_peak;      // AST arena的最大使用量
+    size_t arena_reserved;  // AST arena和符号表arena向系统申请的bytes
+    size_t peak_rss;        // 进程的最大常驻内存（bytes）
+} CompileStats;
+
+// 单调时钟（秒）
+double stats_now(void);
+
+// 从getrusage取peak_rss
+void stats_record_rss(CompileStats* stats);
+
+// 打印一个文件的统计：对齐的表格，或一行JSON
+void stats_print_table(const CompileStats* stats, const char* file, FILE* out);
+void stats_print_json(const CompileStats* stats, const char* file, FILE* out);
+
+#endif // STATS_H
@@ -38,17 +38,24 @@ typedef enum {
     TOKEN_AMPERSAND,   // &（位与运算符）
     TOKEN_PIPE,        // |（位或运算符）
     TOKEN_DOTDOT,      // ..（范围运算符，如0..2）
+    TOKEN_COMMA,       // ,（function parameter/实参分隔符）
 } TokenType;
 
 // Token结构体（词法分析的输出单元）
+// Token不复制文本，只记录它在源码buffer中的位置（span），文本通过lexer_token_text获取；
+// number和字符constant在词法分析时就解码进num，parser不必再转换string
 typedef struct {
-    TokenType type;    // Tokentype（如TOKEN_REG、TOKEN_NUM_HEX）
-    char value[64];    // Token的文本值（如"ax"、"0x1234"、"reg."）
+    uint32_t offset;   // Token在源码buffer中的起始偏移
     uint32_t line;     // Token所在line（报错时定位用）
+    uint32_t num;      // 预解码的数值（TOKEN_NUM_DEC/TOKEN_NUM_HEX/TOKEN_CHAR有效）
+    uint16_t len;      // Token文本长度（bytes）
+    uint8_t type;      // Tokentype（TokenType，用uint8_t存储使Token保持16 bytes）
 } Token;
 
+_Static_assert(sizeof(Token) == 16, "Token should stay a 16-byte span");
+
 // -------------------------- 通用constant --------------------------
-#define MAX_TOKEN_LEN 64    // Token的最大长度（对应value数组）
+#define MAX_TOKEN_LEN 65535 // Token的最大长度（对应len字段）
 #define MAX_ID_LEN 32       // 标识符（变量名、register名）的最大长度
 
 #endif // TYPES_H
\ No newline at end of file
@@ -4,9 +4,28 @@
 #include <stdlib.h>
 
 // -------------------------- Error handling implementation --------------------------
+static _Thread_local ErrorTrap* error_trap;  // Per thread: batch workers trap their own errors
+
+void error_trap_set(ErrorTrap* trap) {
+    error_trap = trap;
+}
+
+ErrorTrap* error_trap_get(void) {
+    return error_trap;
+}
+
 void error(const char* format, ...) {
     va_list args;
     va_start(args, format);
+
+    // A trapping caller gets the message and decides what to do with the compilation
+    if (error_trap) {
+        ErrorTrap* trap = error_trap;
+        error_trap = NULL;
+        vsnprintf(trap->message, sizeof(trap->message), format, args);
+        va_end(args);
+        longjmp(trap->env, 1);
+    }
     
     // Unified error prefix for easy identification
     fprintf(stderr, "[ERROR] ");
@@ -16,6 +35,40 @@ void error(const char* format, ...) {
     va_end(args);
     exit(1);  // Exit directly after error to avoid subsequent errors
 }
+// -------------------------- Diagnostics context implementation --------------------------
+void error_context_init(ErrorContext* ctx, FILE* out, int max_errors) {
+    ctx->out = out;
+    ctx->max_errors = max_errors > 0 ? max_errors : ERROR_DEFAULT_MAX;
+    ctx->count = 0;
+}
+
+void error_report(ErrorContext* ctx, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    if (!ctx) {
+        char message[sizeof(((ErrorTrap*)0)->message)];
+        vsnprintf(message, sizeof(message), format, args);
+        va_end(args);
+        error("%s", message);
+    }
+    // Past the cap nothing is printed: every enclosing recovery point passes the stop on
+    if (ctx->count >= ctx->max_errors) {
+        va_end(args);
+        error("Too many errors (%d), compilation stopped", ctx->max_errors);
+    }
+    if (ctx->out) {
+        fprintf(ctx->out, "[ERROR] ");
+        vfprintf(ctx->out, format, args);
+        fprintf(ctx->out, "\n");
+    }
+    va_end(args);
+    if (++ctx->count == ctx->max_errors) error("Too many errors (%d), compilation stopped", ctx->max_errors);
+}
+
+void error_context_check(const ErrorContext* ctx) {
+    if (ctx && ctx->count) error("Compilation failed with %d error%s", ctx->count, ctx->count == 1 ? "" : "s");
+}
+
 // -------------------------- Error message with group information --------------------------
 void error_with_group(const char* id, const char* group) {
     error("E: cannot find '%s' in file, it's not in group '%s'", id, group);
@@ -122,10 +175,31 @@ const char* token_type_to_str(TokenType type) {
         case TOKEN_AMPERSAND:   return "TOKEN_AMPERSAND";
         case TOKEN_PIPE:        return "TOKEN_PIPE";
         case TOKEN_DOTDOT:      return "TOKEN_DOTDOT";
+        case TOKEN_COMMA:       return "TOKEN_COMMA";
         default:                return "TOKEN_UNKNOWN";
     }
 }
 
+// -------------------------- Hash implementation --------------------------
+uint32_t hash_bytes(const void* data, size_t len) {
+    const unsigned char* p = data;
+    uint32_t h = 2166136261u;  // FNV offset basis
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;        // FNV prime
+    }
+    return h;
+}
+
+uint64_t hash_bytes64(uint64_t h, const void* data, size_t len) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;  // FNV prime
+    }
+    return h;
+}
+
 // -------------------------- Memory operation implementation --------------------------
 void* safe_malloc(size_t size) {
     void* ptr = malloc(size);
@@ -4,6 +4,7 @@
 #include "types.h"  // 依赖TokenType等type
 #include <stdio.h>
 #include <stdarg.h>  // 用于可变parameter（错误处理function）
+#include <setjmp.h>  // 错误陷阱
 
 // -------------------------- 错误处理 --------------------------
 // 打印错误message并退出程序（support可变parameter，如error("line%d：%s", line, msg)）
@@ -15,6 +16,34 @@ void error_with_group(const char* id, const char* group);
 // 同理，也可以有其它的错误提示，可以在下面补充
 // 带文件名和line的错误提示
 void error_with_file_line(const char* filename, int line, const char* format, ...);
+// 错误陷阱：批量编译在worker线程里一个接一个地编译文件，一个文件出错不能结束整个进程。
+// 当前线程设置了陷阱时，error()不打印也不退出，而是把message存进陷阱并longjmp回来
+// （出错前分配的资源由设置陷阱的一方释放）。用法：
+//   ErrorTrap trap;
+//   if (setjmp(trap.env) == 0) { error_trap_set(&trap); ...; error_trap_set(NULL); }
+//   else { /* trap.message */ }
+// longjmp之前陷阱已被清除，出错后的清理代码里再报错会照常退出
+typedef struct {
+    jmp_buf env;
+    char message[512];
+} ErrorTrap;
+void error_trap_set(ErrorTrap* trap);  // 只影响当前线程，NULL=恢复打印后退出
+ErrorTrap* error_trap_get(void);       // 当前线程的陷阱（嵌套的陷阱处理完后恢复外层的）
+
+// 诊断上下文：一次编译的lexer、parser和codegen共用一个。能继续的错误（词法错误、一条
+// 语句里的语法错误、codegen的范围检查）用error_report记下来，编译跳过出错的部分继续，
+// 一次报告所有错误；结束时error_context_check让有错误的编译失败
+#define ERROR_DEFAULT_MAX 20  // 默认最多报告的条数
+typedef struct {
+    FILE* out;       // 每条诊断打印到这里（"[ERROR] ..."，NULL=不打印）
+    int max_errors;  // 报告满这么多条后停止编译
+    int count;       // 已报告的条数
+} ErrorContext;
+void error_context_init(ErrorContext* ctx, FILE* out, int max_errors);  // max_errors<=0时用默认值
+// 报告一条诊断并返回；ctx为NULL时等于error()。达到上限后调用error()停止编译
+void error_report(ErrorContext* ctx, const char* format, ...);
+// 报告过诊断时调用error()让编译失败（ctx为NULL时什么都不做）
+void error_context_check(const ErrorContext* ctx);
 // -------------------------- string转number --------------------------
 // string转十六basenumber（support0x前缀，如"0x1234"→4660）
 // 若string非法，调用error报错
@@ -29,6 +58,13 @@ uint32_t str_to_dec(const char* s);
 // 用于调试和报错时显示Tokentype
 const char* token_type_to_str(TokenType type);
 
+// -------------------------- 哈希 --------------------------
+// FNV-1a 32位哈希（关键字扩展表、符号表等共用）
+uint32_t hash_bytes(const void* data, size_t len);
+// FNV-1a 64位哈希，从h继续累加（第一段传HASH64_INIT），增量编译的cache用它识别源码和状态
+#define HASH64_INIT 14695981039346656037ull
+uint64_t hash_bytes64(uint64_t h, const void* data, size_t len);
+
 // -------------------------- memoryoperation --------------------------
 // 安全allocationmemory（若mallocfailed，调用error报错，避免返回NULL）
 void* safe_malloc(size_t size);
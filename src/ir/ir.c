@@ -0,0 +1,153 @@
+#include "ir.h"
+#include "../common/utils.h"
+#include <stdlib.h>
+
+void ir_init(IrProgram* ir) {
+    ir->insns = NULL;
+    ir->count = ir->cap = 0;
+    ir->next_value = 1;
+    arena_init(&ir->scratch, 0);
+}
+
+void ir_free(IrProgram* ir) {
+    free(ir->insns);
+    arena_destroy(&ir->scratch);
+    ir_init(ir);
+}
+
+void ir_reset(IrProgram* ir) {
+    ir->count = 0;
+    ir->next_value = 1;
+    arena_reset(&ir->scratch);
+}
+
+static void ir_append(IrProgram* ir, IrInsn insn) {
+    if (ir->count == ir->cap) {
+        size_t cap = ir->cap ? ir->cap * 2 : 256;
+        IrInsn* grown = realloc(ir->insns, cap * sizeof(IrInsn));
+        if (!grown) error("Memory allocation failed (IR, %zu instructions)", cap);
+        ir->insns = grown;
+        ir->cap = cap;
+    }
+    ir->insns[ir->count++] = insn;
+}
+
+IrValue ir_const(IrProgram* ir, uint32_t imm) {
+    IrValue dst = ir->next_value++;
+    ir_append(ir, (IrInsn){IR_CONST, 0, 0, dst, imm, 0});
+    return dst;
+}
+
+IrValue ir_copy(IrProgram* ir, IrValue a) {
+    IrValue dst = ir->next_value++;
+    ir_append(ir, (IrInsn){IR_COPY, 0, 0, dst, a, 0});
+    return dst;
+}
+
+IrValue ir_binary(IrProgram* ir, IrOp op, IrValue a, IrValue b) {
+    IrValue dst = ir->next_value++;
+    ir_append(ir, (IrInsn){(uint8_t)op, 0, 0, dst, a, b});
+    return dst;
+}
+
+IrValue ir_get_reg(IrProgram* ir, int reg) {
+    IrValue dst = ir->next_value++;
+    ir_append(ir, (IrInsn){IR_GET_REG, (uint8_t)reg, 0, dst, 0, 0});
+    return dst;
+}
+
+void ir_set_reg(IrProgram* ir, int reg, IrValue a) {
+    ir_append(ir, (IrInsn){IR_SET_REG, (uint8_t)reg, 0, 0, a, 0});
+}
+
+void ir_store(IrProgram* ir, int width, IrValue addr, IrValue value) {
+    ir_append(ir, (IrInsn){IR_STORE, (uint8_t)width, 0, 0, addr, value});
+}
+
+void ir_label(IrProgram* ir, int label) {
+    ir_append(ir, (IrInsn){IR_LABEL, 0, 0, 0, (uint32_t)label, 0});
+}
+
+void ir_jmp(IrProgram* ir, int label) {
+    ir_append(ir, (IrInsn){IR_JMP, 0, 0, 0, (uint32_t)label, 0});
+}
+
+void ir_branch_zero(IrProgram* ir, IrValue a, int label) {
+    ir_append(ir, (IrInsn){IR_BRANCH_ZERO, 0, 0, 0, a, (uint32_t)label});
+}
+
+void ir_loop(IrProgram* ir, int label) {
+    ir_append(ir, (IrInsn){IR_LOOP, 0, 0, 0, (uint32_t)label, 0});
+}
+
+void ir_call(IrProgram* ir, int label, int stack_args) {
+    ir_append(ir, (IrInsn){IR_CALL, 0, 0, 0, (uint32_t)label, (uint32_t)stack_args});
+}
+
+void ir_ret(IrProgram* ir, int has_frame) {
+    ir_append(ir, (IrInsn){IR_RET, 0, 0, 0, (uint32_t)has_frame, 0});
+}
+
+void ir_enter(IrProgram* ir, int has_frame) {
+    ir_append(ir, (IrInsn){IR_ENTER, 0, 0, 0, 0, (uint32_t)has_frame});
+}
+
+IrValue ir_get_arg(IrProgram* ir, int index) {
+    IrValue dst = ir->next_value++;
+    ir_append(ir, (IrInsn){IR_GET_ARG, 0, 0, dst, (uint32_t)index, 0});
+    return dst;
+}
+
+void ir_push(IrProgram* ir, IrValue a) {
+    ir_append(ir, (IrInsn){IR_PUSH, 0, 0, 0, a, 0});
+}
+
+void ir_pop(IrProgram* ir, int reg) {
+    ir_append(ir, (IrInsn){IR_POP, (uint8_t)reg, 0, 0, 0, 0});
+}
+
+IrValue ir_get_var(IrProgram* ir, uint32_t var) {
+    IrValue dst = ir->next_value++;
+    ir_append(ir, (IrInsn){IR_GET_VAR, 0, 0, dst, var, 0});
+    return dst;
+}
+
+void ir_set_var(IrProgram* ir, uint32_t var, IrValue a) {
+    ir_append(ir, (IrInsn){IR_SET_VAR, 0, 0, 0, a, var});
+}
+
+void ir_dump(const IrProgram* ir, FILE* fp, const char* (*reg_name)(int reg)) {
+    static const char* const binary_ops[] = {
+        [IR_ADD] = "+", [IR_SUB] = "-", [IR_MUL] = "*", [IR_DIV] = "/", [IR_AND] = "&", [IR_OR] = "|",
+    };
+    for (size_t i = 0; i < ir->count; i++) {
+        const IrInsn* insn = &ir->insns[i];
+        switch (insn->op) {
+            case IR_NOP:     break;
+            case IR_CONST:   fprintf(fp, "  v%u = 0x%x\n", insn->dst, insn->a); break;
+            case IR_COPY:    fprintf(fp, "  v%u = v%u\n", insn->dst, insn->a); break;
+            case IR_GET_REG: fprintf(fp, "  v%u = %s\n", insn->dst, reg_name(insn->reg)); break;
+            case IR_SET_REG:
+                fprintf(fp, "  %s = v%u%s\n", reg_name(insn->reg), insn->a, insn->pad & IR_VAR_REG ? " (var)" : "");
+                break;
+            case IR_STORE:   fprintf(fp, "  mem%d[v%u] = v%u\n", insn->reg * 8, insn->a, insn->b); break;
+            case IR_LABEL:   fprintf(fp, "L%u:\n", insn->a); break;
+            case IR_JMP:     fprintf(fp, "  jmp L%u\n", insn->a); break;
+            case IR_BRANCH_ZERO: fprintf(fp, "  if v%u == 0 jmp L%u\n", insn->a, insn->b); break;
+            case IR_LOOP:    fprintf(fp, "  loop L%u\n", insn->a); break;
+            case IR_CALL:    fprintf(fp, "  call L%u (%u on stack)\n", insn->a, insn->b); break;
+            case IR_RET:     fprintf(fp, "  ret%s\n", insn->a ? " (frame)" : ""); break;
+            case IR_ENTER:   fprintf(fp, "  enter%s, %u slots\n", insn->b ? " (frame)" : "", insn->a); break;
+            case IR_FRAME:   fprintf(fp, "  frame +%u slots\n", insn->a); break;
+            case IR_GET_ARG: fprintf(fp, "  v%u = arg%u\n", insn->dst, insn->a); break;
+            case IR_PUSH:    fprintf(fp, "  push v%u\n", insn->a); break;
+            case IR_POP:     fprintf(fp, "  pop %s\n", reg_name(insn->reg)); break;
+            case IR_GET_VAR: fprintf(fp, "  v%u = var%u\n", insn->dst, insn->a); break;
+            case IR_SET_VAR: fprintf(fp, "  var%u = v%u\n", insn->b, insn->a); break;
+            case IR_GET_SLOT: fprintf(fp, "  v%u = slot%u\n", insn->dst, insn->a); break;
+            case IR_SET_SLOT: fprintf(fp, "  slot%u = v%u\n", insn->b, insn->a); break;
+            default:
+                fprintf(fp, "  v%u = v%u %s v%u\n", insn->dst, insn->a, binary_ops[insn->op], insn->b);
+        }
+    }
+}
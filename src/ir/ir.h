@@ -0,0 +1,182 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "../common/arena.h"
+
+// Linear three-address IR between the AST and a target backend.
+// A program is one contiguous array of fixed-size instructions (array of structs),
+// so every pass is a linear sweep over memory instead of a walk over AST pointers.
+// Values live in virtual registers (vregs), each defined exactly once; target
+// registers named in the source (reg.ax) are only touched by IR_GET_REG/IR_SET_REG
+// and are identified by the backend's register number.
+// Functions add labels and control transfers; every one of them is a barrier for the
+// passes (target registers are unknown and live across it).
+// Source variables (var x) are read and written with IR_GET_VAR/IR_SET_VAR; ir_regalloc
+// gives each one a target register or a frame slot and rewrites them before the other
+// passes run.
+
+typedef enum {
+    IR_NOP,      // Deleted by a pass; skipped by backends
+    IR_CONST,    // dst = imm(a)
+    IR_COPY,     // dst = a
+    IR_ADD,      // dst = a + b
+    IR_SUB,      // dst = a - b
+    IR_MUL,      // dst = a * b
+    IR_DIV,      // dst = a / b (unsigned)
+    IR_AND,      // dst = a & b
+    IR_OR,       // dst = a | b
+    IR_GET_REG,  // dst = target register `reg`
+    IR_SET_REG,  // target register `reg` = a
+    IR_STORE,    // memory[a] = b, `reg` bytes wide (1/2/4); never removed
+    IR_LABEL,    // Label a (numbered by the caller, bound by the backend)
+    IR_JMP,      // Jump to label a
+    IR_BRANCH_ZERO,  // Jump to label b if a == 0
+    IR_LOOP,     // Decrement the backend's loop counter register, jump to label a unless it hit 0
+    IR_CALL,     // Call label a; b = stack arguments the caller pops afterwards
+    IR_RET,      // Return; a = 1 if the function set up a frame with IR_ENTER, b = 1 if it has slots
+    IR_ENTER,    // Function entry; sets up a frame if b = 1 (stack arguments) or a > 0 (a slots reserved)
+    IR_FRAME,    // Top level: reserve a more slots; b = 1 the first time (sets up the frame pointer)
+    IR_GET_ARG,  // dst = stack argument a (0 = the first argument passed on the stack)
+    IR_PUSH,     // Push a
+    IR_POP,      // Target register `reg` = popped value
+    IR_GET_VAR,  // dst = variable a
+    IR_SET_VAR,  // Variable b = a
+    IR_GET_SLOT, // dst = frame slot a (a spilled variable)
+    IR_SET_SLOT, // Frame slot b = a
+} IrOp;
+
+// IrInsn::pad of an IR_SET_REG written by ir_regalloc: the register holds a variable,
+// so the value is dead at the end of the program unless something reads it
+#define IR_VAR_REG 1
+
+// Variable numbers: top-level variables are numbered by their binding slot (they can stay
+// live across codegen flushes), everything else counts up from IR_TOP_VARS in each flush
+#define IR_TOP_VARS 64
+
+typedef uint32_t IrValue;  // Virtual register number (0 is never defined)
+
+typedef struct {
+    uint8_t op;    // IrOp
+    uint8_t reg;   // Target register (IR_GET_REG / IR_SET_REG), width in bytes (IR_STORE)
+    uint16_t pad;
+    IrValue dst;   // Defined vreg (0 if the instruction defines nothing)
+    uint32_t a;    // First operand: vreg, or the immediate for IR_CONST
+    IrValue b;     // Second operand (binary ops)
+} IrInsn;
+
+_Static_assert(sizeof(IrInsn) == 16, "IrInsn should stay 16 bytes");
+
+typedef struct {
+    IrInsn* insns;
+    size_t count;
+    size_t cap;
+    IrValue next_value;  // Next free vreg number
+    // Working memory of ir_regalloc and the backend within one flush. error() can longjmp
+    // out of either, so nothing they use lives on the C heap only: ir_reset takes it all back.
+    Arena scratch;
+} IrProgram;
+
+void ir_init(IrProgram* ir);
+void ir_free(IrProgram* ir);
+// Drop all instructions and the scratch memory, keep the allocations (vreg numbering starts over)
+void ir_reset(IrProgram* ir);
+
+// Builders; the ones that define a value return its vreg
+IrValue ir_const(IrProgram* ir, uint32_t imm);
+IrValue ir_copy(IrProgram* ir, IrValue a);
+IrValue ir_binary(IrProgram* ir, IrOp op, IrValue a, IrValue b);
+IrValue ir_get_reg(IrProgram* ir, int reg);
+void ir_set_reg(IrProgram* ir, int reg, IrValue a);
+void ir_store(IrProgram* ir, int width, IrValue addr, IrValue value);
+void ir_label(IrProgram* ir, int label);
+void ir_jmp(IrProgram* ir, int label);
+void ir_branch_zero(IrProgram* ir, IrValue a, int label);
+void ir_loop(IrProgram* ir, int label);
+void ir_call(IrProgram* ir, int label, int stack_args);
+void ir_ret(IrProgram* ir, int has_frame);
+void ir_enter(IrProgram* ir, int has_frame);
+IrValue ir_get_arg(IrProgram* ir, int index);
+void ir_push(IrProgram* ir, IrValue a);
+void ir_pop(IrProgram* ir, int reg);
+IrValue ir_get_var(IrProgram* ir, uint32_t var);
+void ir_set_var(IrProgram* ir, uint32_t var, IrValue a);
+
+// -------------------------- Passes (ir_opt.c) --------------------------
+// Fold a binary op on two constants; returns 0 if it cannot be folded (division by zero)
+int ir_fold(int op, uint32_t a, uint32_t b, uint32_t* out);
+
+// Constant propagation and folding, copy propagation, and forwarding of
+// IR_SET_REG values to later IR_GET_REG of the same register
+void ir_propagate(IrProgram* ir);
+
+// Backward sweep: deletes register stores overwritten before they are read and
+// value definitions that are never used. Target registers are live at the end.
+void ir_dead_store_elim(IrProgram* ir);
+
+// A call directly followed by a frameless return becomes a jump (tail call);
+// calls that pass arguments on the stack are kept, the caller has to pop them
+void ir_tail_calls(IrProgram* ir);
+
+// Deletes everything between an unconditional jump or return and the next label
+void ir_drop_unreachable(IrProgram* ir);
+
+// Run all passes and compact out IR_NOP; returns the number of instructions removed.
+// pass_seconds (NULL = not timed) accumulates the time of each pass, in the order above
+// from ir_propagate (--stats; the compaction counts towards the last pass)
+size_t ir_optimize(IrProgram* ir, double* pass_seconds);
+
+// -------------------------- Register allocation (ir_regalloc.c) --------------------------
+#define IR_MAX_ALLOC_REGS 32  // Target registers are tracked in 32-bit masks
+
+// What the allocator needs to know about the target
+typedef struct {
+    const int* regs;      // Registers variables may live in, in order of preference
+    int reg_count;
+    int frame_reg;        // Base register of frame slots (never allocated)
+    int max_slots;        // Frame slots a region can address
+    const int* arg_regs;  // Read by a call (register arguments)
+    int arg_reg_count;
+    int loop_reg;         // Read and written by IR_LOOP
+} IrRegFile;
+
+// Where one variable ended up (debug dump)
+typedef struct {
+    uint32_t var;
+    int reg;              // Target register, -1 if spilled
+    int slot;             // Frame slot when spilled (or its home at top level), -1 otherwise
+    uint32_t first, last; // Live range, as instruction indices of the flushed IR
+    uint32_t uses;        // Reads and writes
+    int loop_depth;       // Deepest loop one of them is in
+} IrVarLoc;
+
+// Allocator state kept across flushes
+typedef struct {
+    int home[IR_TOP_VARS];  // Frame slot holding a top-level variable between flushes, -1 if none
+    int homes;              // Top-level slots given out as homes
+    int top_slots;          // Slots reserved in the top-level frame so far
+    uint32_t written;       // Registers the program has assigned (observable at the end)
+    IrVarLoc* locs;         // Decisions of the last ir_regalloc call
+    size_t loc_count;
+    size_t loc_cap;
+} IrRegAlloc;
+
+void ir_regalloc_init(IrRegAlloc* ra);
+void ir_regalloc_free(IrRegAlloc* ra);
+// Back to the initial state, keeping the allocation of locs for the next compilation
+void ir_regalloc_reset(IrRegAlloc* ra);
+
+// Linear-scan allocation of the variables in ir: live ranges come from a liveness analysis
+// over the control-flow graph; a variable gets a register free of other variables and of the
+// target registers the program uses over its whole range, or a frame slot when none is left
+// (the variable with the lowest loop-weighted use count is spilled). IR_GET_VAR / IR_SET_VAR
+// become IR_GET_REG / IR_SET_REG or IR_GET_SLOT / IR_SET_SLOT. Unless final, top-level
+// variables stay live after ir and are saved to their home slots at the end.
+void ir_regalloc(IrProgram* ir, const IrRegFile* rf, IrRegAlloc* ra, int final);
+
+// Print the program, one instruction per line (debugging)
+void ir_dump(const IrProgram* ir, FILE* fp, const char* (*reg_name)(int reg));
+
+#endif // IR_H
@@ -0,0 +1,305 @@
+#include "ir.h"
+#include "../common/utils.h"
+#include "../common/stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define IR_MAX_REGS 256  // IrInsn::reg is a byte
+
+static int ir_is_binary(int op) {
+    return op >= IR_ADD && op <= IR_OR;
+}
+
+// Control enters or leaves here: nothing is known about target registers across it
+static int ir_is_barrier(int op) {
+    return op >= IR_LABEL && op <= IR_ENTER;
+}
+
+int ir_fold(int op, uint32_t a, uint32_t b, uint32_t* out) {
+    switch (op) {
+        case IR_ADD: *out = a + b; return 1;
+        case IR_SUB: *out = a - b; return 1;
+        case IR_MUL: *out = a * b; return 1;
+        case IR_DIV: if (b == 0) return 0; *out = a / b; return 1;
+        case IR_AND: *out = a & b; return 1;
+        case IR_OR:  *out = a | b; return 1;
+        default:     return 0;
+    }
+}
+
+// -------------------------- Push / pop pairs --------------------------
+// A register read, pushed and popped straight back into the same register, unchanged in
+// between, is a copy of the register to itself. Pairs cancel from the inside out, so a
+// call passing parameters on in the registers they arrived in shuffles nothing.
+
+// Register `reg` still holds vreg v: v was read from it, and neither a write to it nor a
+// barrier came since
+static int ir_holds(const uint32_t* read_at, const uint8_t* read_reg, const uint32_t* written_at,
+                    uint32_t barrier_at, IrValue v, int reg) {
+    uint32_t at = read_at[v];
+    return at && read_reg[v] == reg && written_at[reg] <= at && barrier_at <= at;
+}
+
+static void ir_cancel_push_pop(IrProgram* ir) {
+    uint32_t* read_at = calloc(ir->next_value, sizeof(uint32_t));  // Clock of an IR_GET_REG read, 0 otherwise
+    uint8_t* read_reg = calloc(ir->next_value, 1);
+    size_t* pushes = safe_malloc((ir->count + 1) * sizeof(size_t));  // Not yet popped, innermost last
+    if (!read_at || !read_reg) error("Memory allocation failed (ir_cancel_push_pop)");
+    uint32_t written_at[IR_MAX_REGS] = {0};
+    uint32_t clock = 1, barrier_at = 0;
+    size_t depth = 0;
+
+    for (size_t i = 0; i < ir->count; i++) {
+        IrInsn* insn = &ir->insns[i];
+        switch (insn->op) {
+            case IR_NOP:
+            case IR_CONST:
+            case IR_GET_ARG:
+            case IR_GET_SLOT:
+                break;
+            case IR_GET_REG:
+                read_at[insn->dst] = clock;
+                read_reg[insn->dst] = insn->reg;
+                break;
+            case IR_PUSH:
+                pushes[depth++] = i;
+                break;
+            case IR_POP: {
+                IrInsn* push = depth ? &ir->insns[pushes[--depth]] : NULL;
+                if (push && ir_holds(read_at, read_reg, written_at, barrier_at, push->a, insn->reg)) {
+                    push->op = insn->op = IR_NOP;
+                    break;
+                }
+                written_at[insn->reg] = ++clock;
+                break;
+            }
+            default:
+                // Anything else in between keeps the pairs (loop counters saved around a body).
+                // A register set to its own content (a parameter's variable) is not changed.
+                if (insn->op == IR_SET_REG && !ir_holds(read_at, read_reg, written_at, barrier_at, insn->a, insn->reg)) {
+                    written_at[insn->reg] = ++clock;
+                }
+                if (ir_is_barrier(insn->op)) barrier_at = ++clock;
+                if (!ir_is_binary(insn->op)) depth = 0;
+                break;
+        }
+    }
+    free(read_at);
+    free(read_reg);
+    free(pushes);
+}
+
+// -------------------------- Constant / copy propagation --------------------------
+// A register's stored value is forwarded to later reads only while it can still be
+// recomputed there: constants, stack arguments, and the content of another register
+// until that register is written (an expression may read registers that changed since).
+void ir_propagate(IrProgram* ir) {
+    size_t values = ir->next_value;
+    IrValue* repl = safe_malloc(values * sizeof(IrValue));  // Canonical vreg for each vreg
+    uint32_t* imm = safe_malloc(values * sizeof(uint32_t));
+    uint8_t* is_const = calloc(values, 1);
+    uint8_t* def_op = calloc(values, 1);   // IR_CONST, IR_GET_REG or IR_GET_ARG for forwardable vregs
+    uint8_t* def_reg = calloc(values, 1);  // Register an IR_GET_REG vreg was read from
+    if (!is_const || !def_op || !def_reg) error("Memory allocation failed (ir_propagate)");
+    for (size_t v = 0; v < values; v++) repl[v] = (IrValue)v;
+    IrValue reg_value[IR_MAX_REGS] = {0};  // Vreg last stored to each target register (0 = unknown)
+    int from_regs = 0;  // Entries of reg_value that are another register's content
+
+    for (size_t i = 0; i < ir->count; i++) {
+        IrInsn* insn = &ir->insns[i];
+        int written = -1;  // Target register this instruction overwrites
+        switch (insn->op) {
+            case IR_CONST:
+                is_const[insn->dst] = 1;
+                imm[insn->dst] = insn->a;
+                def_op[insn->dst] = IR_CONST;
+                break;
+            case IR_COPY:
+                repl[insn->dst] = repl[insn->a];
+                insn->op = IR_NOP;  // Every use is rewritten to the source
+                break;
+            case IR_GET_REG:
+                if (reg_value[insn->reg]) {
+                    repl[insn->dst] = reg_value[insn->reg];  // Forward the stored value
+                    insn->op = IR_NOP;
+                } else {
+                    def_op[insn->dst] = IR_GET_REG;
+                    def_reg[insn->dst] = insn->reg;
+                }
+                break;
+            case IR_GET_ARG:
+                def_op[insn->dst] = IR_GET_ARG;
+                break;
+            case IR_SET_REG:
+                insn->a = repl[insn->a];
+                written = insn->reg;
+                break;
+            case IR_STORE:
+                insn->a = repl[insn->a];
+                insn->b = repl[insn->b];
+                break;
+            case IR_PUSH:
+            case IR_SET_SLOT:
+                insn->a = repl[insn->a];
+                break;
+            case IR_POP:
+                written = insn->reg;
+                break;
+            case IR_BRANCH_ZERO:
+                insn->a = repl[insn->a];
+                if (is_const[insn->a]) {  // Decided at compile time
+                    if (imm[insn->a] == 0) *insn = (IrInsn){IR_JMP, 0, 0, 0, insn->b, 0};
+                    else insn->op = IR_NOP;
+                }
+                memset(reg_value, 0, sizeof(reg_value));
+                from_regs = 0;
+                break;
+            default:
+                if (ir_is_barrier(insn->op)) {
+                    memset(reg_value, 0, sizeof(reg_value));
+                    from_regs = 0;
+                } else if (ir_is_binary(insn->op)) {
+                    insn->a = repl[insn->a];
+                    insn->b = repl[insn->b];
+                    uint32_t folded;
+                    if (is_const[insn->a] && is_const[insn->b] &&
+                        ir_fold(insn->op, imm[insn->a], imm[insn->b], &folded)) {
+                        *insn = (IrInsn){IR_CONST, 0, 0, insn->dst, folded, 0};
+                        is_const[insn->dst] = 1;
+                        imm[insn->dst] = folded;
+                        def_op[insn->dst] = IR_CONST;
+                    }
+                }
+                break;
+        }
+        if (written < 0) continue;
+
+        // Values read from the overwritten register can no longer be forwarded
+        for (int r = 0; from_regs && r < IR_MAX_REGS; r++) {
+            IrValue v = reg_value[r];
+            if (v && def_op[v] == IR_GET_REG && def_reg[v] == written) {
+                reg_value[r] = 0;
+                from_regs--;
+            }
+        }
+        IrValue v = reg_value[written];
+        if (v && def_op[v] == IR_GET_REG) from_regs--;
+        v = insn->op == IR_SET_REG ? insn->a : 0;
+        reg_value[written] = def_op[v] ? v : 0;
+        if (reg_value[written] && def_op[v] == IR_GET_REG) from_regs++;
+    }
+
+    free(repl);
+    free(imm);
+    free(is_const);
+    free(def_op);
+    free(def_reg);
+    ir_cancel_push_pop(ir);
+}
+
+// -------------------------- Dead store / dead value elimination --------------------------
+void ir_dead_store_elim(IrProgram* ir) {
+    uint8_t* used = calloc(ir->next_value, 1);
+    if (!used) error("Memory allocation failed (ir_dead_store_elim)");
+    uint8_t live_reg[IR_MAX_REGS];
+    memset(live_reg, 1, sizeof(live_reg));  // Observable after the program
+    uint8_t var_live[IR_MAX_REGS] = {0};    // Read before the next write (variables are not observable)
+
+    for (size_t i = ir->count; i-- > 0;) {
+        IrInsn* insn = &ir->insns[i];
+        switch (insn->op) {
+            case IR_NOP:
+                break;
+            case IR_SET_REG:
+                if (!(insn->pad & IR_VAR_REG ? var_live : live_reg)[insn->reg]) {
+                    insn->op = IR_NOP;  // Overwritten before anything reads it
+                    break;
+                }
+                live_reg[insn->reg] = var_live[insn->reg] = 0;
+                used[insn->a] = 1;
+                break;
+            case IR_STORE:
+                used[insn->a] = used[insn->b] = 1;  // Memory is observable, stores always stay
+                break;
+            case IR_GET_REG:
+                if (!used[insn->dst]) {
+                    insn->op = IR_NOP;
+                    break;
+                }
+                live_reg[insn->reg] = var_live[insn->reg] = 1;
+                break;
+            case IR_PUSH:
+            case IR_SET_SLOT:  // Spilled variables are kept like memory stores
+                used[insn->a] = 1;
+                break;
+            case IR_POP:
+                live_reg[insn->reg] = var_live[insn->reg] = 0;  // Kept anyway: it balances the stack
+                break;
+            case IR_FRAME:
+                break;
+            default:
+                if (ir_is_barrier(insn->op)) {
+                    // Whatever runs on the other side may read them
+                    memset(live_reg, 1, sizeof(live_reg));
+                    memset(var_live, 1, sizeof(var_live));
+                    if (insn->op == IR_BRANCH_ZERO) used[insn->a] = 1;
+                    break;
+                }
+                if (!used[insn->dst]) {
+                    insn->op = IR_NOP;
+                    break;
+                }
+                if (insn->op == IR_COPY) used[insn->a] = 1;
+                if (ir_is_binary(insn->op)) used[insn->a] = used[insn->b] = 1;
+                break;
+        }
+    }
+    free(used);
+}
+
+// -------------------------- Tail calls --------------------------
+void ir_tail_calls(IrProgram* ir) {
+    IrInsn* call = NULL;  // Last call with nothing but NOPs after it so far
+    for (size_t i = 0; i < ir->count; i++) {
+        IrInsn* insn = &ir->insns[i];
+        if (insn->op == IR_NOP) continue;
+        if (call && insn->op == IR_RET && insn->a == 0) {
+            call->op = IR_JMP;  // The callee's ret returns straight to our caller
+            insn->op = IR_NOP;
+        }
+        call = (insn->op == IR_CALL && insn->b == 0) ? insn : NULL;
+    }
+}
+
+// -------------------------- Unreachable code --------------------------
+void ir_drop_unreachable(IrProgram* ir) {
+    int reachable = 1;
+    for (size_t i = 0; i < ir->count; i++) {
+        IrInsn* insn = &ir->insns[i];
+        if (insn->op == IR_LABEL) reachable = 1;
+        else if (!reachable) insn->op = IR_NOP;
+        else if (insn->op == IR_JMP || insn->op == IR_RET) reachable = 0;
+    }
+}
+
+// Deletes the IR_NOP the passes left behind
+static void ir_compact(IrProgram* ir) {
+    size_t kept = 0;
+    for (size_t i = 0; i < ir->count; i++) {
+        if (ir->insns[i].op != IR_NOP) ir->insns[kept++] = ir->insns[i];
+    }
+    ir->count = kept;
+}
+
+size_t ir_optimize(IrProgram* ir, double* pass_seconds) {
+    static void (*const passes[])(IrProgram*) = {ir_propagate, ir_tail_calls, ir_drop_unreachable, ir_dead_store_elim};
+    const size_t pass_count = sizeof(passes) / sizeof(passes[0]);
+    size_t count = ir->count;
+    for (size_t pass = 0; pass < pass_count; pass++) {
+        double start = pass_seconds ? stats_now() : 0;
+        passes[pass](ir);
+        if (pass == pass_count - 1) ir_compact(ir);
+        if (pass_seconds) pass_seconds[pass] += stats_now() - start;
+    }
+    return count - ir->count;
+}
@@ -0,0 +1,674 @@
+#include "ir.h"
+#include "../common/utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+// -------------------------- Linear-scan register allocation --------------------------
+// Every instruction i has two points: 2i where it reads its operands and 2i + 1 where it
+// writes its result. A variable occupies its location at the points where it is live; a
+// target register is occupied where a value the program put there is live, and where
+// an instruction writes it. Values are trees of vregs, and their leaves (IR_GET_REG,
+// IR_GET_VAR) are read where the tree is consumed (IR_SET_REG, IR_STORE, ...), which is
+// where the backend evaluates them.
+// A live range is the hull of the points a variable occupies; the scan assigns them in
+// order of their start, so two variables share a register only if their ranges do not
+// overlap.
+
+#define IR_BIT(r) ((r) < IR_MAX_ALLOC_REGS ? 1u << (r) : 0u)
+#define IR_MAX_LOOP_WEIGHT 6  // Loops nested deeper than this weigh the same
+
+typedef struct {
+    uint32_t var;
+    uint32_t start, end;   // Hull of the occupied points, start > end if never live
+    uint32_t uses;
+    uint64_t weight;       // Uses weighted by 8^loop depth
+    int loop_depth;
+    int region;            // -1 = top level, else the function (index of its IR_ENTER)
+    int hint;              // Register a copy to or from the variable would use, -1 none
+    int hint_var;          // Variable whose register to prefer (defined from it), -1 none
+    int reg;
+    int slot;
+    uint8_t live_in;       // Live where the flushed IR starts
+    uint8_t live_out;      // Live where it ends (top-level variables before another flush)
+} IrInterval;
+
+typedef struct {
+    uint32_t start, end;   // Instruction range [start, end)
+    int succ[2];           // Successor blocks, -1 none
+    int exit;              // Falls out of the IR: 1 = at the end, 2 = by a return
+    int region;
+    uint32_t reg_gen, reg_kill, reg_in, reg_out;
+} IrBlock;
+
+typedef struct {
+    IrProgram* ir;
+    const IrRegFile* rf;
+    IrRegAlloc* ra;
+    size_t n;
+    uint32_t* def_at;      // Instruction defining each vreg
+    int32_t* local;        // Interval index of each variable number, -1 if not used here
+    uint32_t var_limit;
+    IrInterval* iv;
+    uint32_t nvars;
+    size_t words;          // Words in a variable bitset
+    uint32_t* reads;       // Target registers read by each instruction
+    uint32_t* writes;      // Target registers written by each instruction
+    uint32_t* use_off;     // Variables read by instruction i: use_var[use_off[i] .. use_off[i + 1])
+    uint32_t* use_var;
+    size_t use_count, use_cap;
+    int32_t* region;       // Function of each instruction, -1 at top level
+} IrAlloc;
+
+// The tables of one call live in the IR's scratch arena: released when it returns, or by
+// ir_reset when an error ends the compilation in the middle
+static void* ra_alloc(const IrAlloc* a, size_t size) {
+    return arena_alloc(&a->ir->scratch, size);
+}
+
+static void* ra_calloc(const IrAlloc* a, size_t size) {
+    return arena_calloc(&a->ir->scratch, size);
+}
+
+static void ra_add_use(IrAlloc* a, uint32_t var) {
+    if (a->use_count == a->use_cap) {
+        size_t cap = a->use_cap ? a->use_cap * 2 : 64;
+        a->use_var = arena_grow(&a->ir->scratch, a->use_var, a->use_cap * sizeof(uint32_t), cap * sizeof(uint32_t));
+        a->use_cap = cap;
+    }
+    a->use_var[a->use_count++] = var;
+}
+
+// Leaves of the tree rooted at v (depth is bounded by the source's parentheses)
+static void ra_tree(IrAlloc* a, IrValue v, uint32_t* regs) {
+    const IrInsn* def = &a->ir->insns[a->def_at[v]];
+    switch (def->op) {
+        case IR_GET_REG: *regs |= IR_BIT(def->reg); break;
+        case IR_GET_VAR: ra_add_use(a, (uint32_t)a->local[def->a]); break;
+        case IR_COPY:    ra_tree(a, def->a, regs); break;
+        default:
+            if (def->op >= IR_ADD && def->op <= IR_OR) {
+                ra_tree(a, def->a, regs);
+                ra_tree(a, def->b, regs);
+            }
+            break;
+    }
+}
+
+// Leaf an expression is evaluated from (its leftmost operand)
+static const IrInsn* ra_leftmost(const IrAlloc* a, IrValue v) {
+    const IrInsn* def = &a->ir->insns[a->def_at[v]];
+    while (def->op == IR_COPY || (def->op >= IR_ADD && def->op <= IR_OR)) def = &a->ir->insns[a->def_at[def->a]];
+    return def;
+}
+
+static uint32_t ra_mask(const int* regs, int count) {
+    uint32_t mask = 0;
+    for (int i = 0; i < count; i++) mask |= IR_BIT(regs[i]);
+    return mask;
+}
+
+// -------------------------- Effects of each instruction --------------------------
+// Returns the registers the program itself assigns (observable after it ends)
+static uint32_t ra_effects(IrAlloc* a) {
+    const IrRegFile* rf = a->rf;
+    uint32_t clobber = ra_mask(rf->regs, rf->reg_count) | ra_mask(rf->arg_regs, rf->arg_reg_count) | IR_BIT(rf->loop_reg);
+    uint32_t assigned = 0;
+    int region = -1;
+    for (size_t i = 0; i < a->n; i++) {
+        const IrInsn* insn = &a->ir->insns[i];
+        a->use_off[i] = (uint32_t)a->use_count;
+        uint32_t reads = 0, writes = 0;
+        if (insn->op == IR_ENTER) region = (int)i;
+        a->region[i] = region;
+        switch (insn->op) {
+            case IR_SET_REG:
+                ra_tree(a, insn->a, &reads);
+                writes = IR_BIT(insn->reg);
+                assigned |= writes;
+                break;
+            case IR_SET_VAR:
+            case IR_PUSH:
+            case IR_BRANCH_ZERO:
+                ra_tree(a, insn->a, &reads);
+                break;
+            case IR_STORE:
+                ra_tree(a, insn->a, &reads);
+                ra_tree(a, insn->b, &reads);
+                break;
+            case IR_POP:
+                writes = IR_BIT(insn->reg);
+                assigned |= writes;
+                break;
+            case IR_LOOP:
+                reads = writes = IR_BIT(rf->loop_reg);
+                assigned |= writes;
+                break;
+            case IR_CALL:
+                // The callee may change any register a variable could be in; what it reads
+                // is only known once every register the program assigns is (see below)
+                reads = ra_mask(rf->arg_regs, rf->arg_reg_count);
+                writes = clobber;
+                break;
+            case IR_RET:
+                region = -1;
+                break;
+            default:
+                break;
+        }
+        a->reads[i] = reads;
+        a->writes[i] = writes;
+    }
+    a->use_off[a->n] = (uint32_t)a->use_count;
+
+    // A called function may read any register the program assigns
+    for (size_t i = 0; i < a->n; i++) {
+        if (a->ir->insns[i].op == IR_CALL) a->reads[i] |= assigned | a->ra->written;
+    }
+    return assigned;
+}
+
+// -------------------------- Control-flow graph and liveness --------------------------
+static int ra_is_block_end(int op) {
+    return op == IR_JMP || op == IR_BRANCH_ZERO || op == IR_LOOP || op == IR_RET;
+}
+
+static size_t ra_blocks(IrAlloc* a, IrBlock** out) {
+    const IrInsn* insns = a->ir->insns;
+    uint32_t min_label = UINT32_MAX, max_label = 0;
+    for (size_t i = 0; i < a->n; i++) {
+        if (insns[i].op != IR_LABEL) continue;
+        if (insns[i].a < min_label) min_label = insns[i].a;
+        if (insns[i].a > max_label) max_label = insns[i].a;
+    }
+    size_t label_span = min_label <= max_label ? max_label - min_label + 1 : 1;
+    int32_t* label_block = ra_alloc(a, label_span * sizeof(int32_t));
+    for (size_t l = 0; l < label_span; l++) label_block[l] = -1;
+
+    IrBlock* blocks = ra_alloc(a, (a->n + 1) * sizeof(IrBlock));
+    size_t count = 0;
+    for (size_t i = 0; i < a->n; i++) {
+        if (i == 0 || insns[i].op == IR_LABEL || ra_is_block_end(insns[i - 1].op)) {
+            if (count) blocks[count - 1].end = (uint32_t)i;
+            blocks[count++] = (IrBlock){(uint32_t)i, 0, {-1, -1}, 0, a->region[i], 0, 0, 0, 0};
+        }
+        if (insns[i].op == IR_LABEL) label_block[insns[i].a - min_label] = (int32_t)count - 1;
+    }
+    if (count) blocks[count - 1].end = (uint32_t)a->n;
+
+    for (size_t b = 0; b < count; b++) {
+        IrBlock* block = &blocks[b];
+        const IrInsn* last = &insns[block->end - 1];
+        int falls = b + 1 < count ? (int)b + 1 : -1;
+        uint32_t target = last->op == IR_BRANCH_ZERO ? last->b : last->a;
+        int jumps = -1;
+        if (last->op == IR_JMP || last->op == IR_BRANCH_ZERO || last->op == IR_LOOP) {
+            if (target >= min_label && target <= max_label) jumps = label_block[target - min_label];
+            if (jumps < 0) error("ir_regalloc: jump to label L%u outside the flushed IR", target);
+        }
+        switch (last->op) {
+            case IR_JMP:  block->succ[0] = jumps; break;
+            case IR_RET:  block->exit = 2; break;
+            case IR_BRANCH_ZERO:
+            case IR_LOOP: block->succ[0] = jumps; block->succ[1] = falls; break;
+            default:      block->succ[0] = falls; break;
+        }
+        if (!block->exit && block->succ[0] < 0 && block->succ[1] < 0) block->exit = 1;
+    }
+    *out = blocks;
+    return count;
+}
+
+static void ra_set(uint64_t* set, uint32_t bit) { set[bit / 64] |= 1ull << (bit % 64); }
+static void ra_clear(uint64_t* set, uint32_t bit) { set[bit / 64] &= ~(1ull << (bit % 64)); }
+static int ra_test(const uint64_t* set, uint32_t bit) { return (set[bit / 64] >> (bit % 64)) & 1; }
+
+// Variable written by instruction i, -1 if none
+static int ra_def(const IrAlloc* a, size_t i) {
+    const IrInsn* insn = &a->ir->insns[i];
+    return insn->op == IR_SET_VAR ? a->local[insn->b] : -1;
+}
+
+// Iterate live_in = gen | (live_out & ~kill) to a fixpoint, registers and variables together.
+// Where the IR ends, exit_regs and exit_vars are live; nothing is live after a return.
+static void ra_liveness(IrAlloc* a, IrBlock* blocks, size_t count, uint64_t* var_in, uint64_t* var_out,
+                        uint32_t exit_regs, const uint64_t* exit_vars) {
+    size_t words = a->words;
+    uint64_t* gen = ra_calloc(a, (count * words + 1) * sizeof(uint64_t));
+    uint64_t* kill = ra_calloc(a, (count * words + 1) * sizeof(uint64_t));
+    for (size_t b = 0; b < count; b++) {
+        IrBlock* block = &blocks[b];
+        uint64_t* g = gen + b * words;
+        uint64_t* k = kill + b * words;
+        for (uint32_t i = block->end; i-- > block->start;) {
+            block->reg_gen = a->reads[i] | (block->reg_gen & ~a->writes[i]);
+            block->reg_kill |= a->writes[i];
+            int def = ra_def(a, i);
+            if (def >= 0) {
+                ra_clear(g, (uint32_t)def);
+                ra_set(k, (uint32_t)def);
+            }
+            for (uint32_t u = a->use_off[i]; u < a->use_off[i + 1]; u++) ra_set(g, a->use_var[u]);
+        }
+    }
+
+    int changed;
+    do {
+        changed = 0;
+        for (size_t b = count; b-- > 0;) {
+            IrBlock* block = &blocks[b];
+            uint64_t* out = var_out + b * words;
+            uint32_t reg_out = block->exit == 1 ? exit_regs : 0;
+            const uint64_t* exit = block->exit == 1 ? exit_vars : NULL;
+            for (size_t w = 0; w < words; w++) out[w] = exit ? exit[w] : 0;
+            for (int s = 0; s < 2; s++) {
+                int succ = block->succ[s];
+                if (succ < 0) continue;
+                reg_out |= blocks[succ].reg_in;
+                for (size_t w = 0; w < words; w++) out[w] |= var_in[succ * words + w];
+            }
+            block->reg_out = reg_out;
+            uint32_t reg_in = block->reg_gen | (reg_out & ~block->reg_kill);
+            if (reg_in != block->reg_in) changed = 1;
+            block->reg_in = reg_in;
+            for (size_t w = 0; w < words; w++) {
+                uint64_t in = gen[b * words + w] | (out[w] & ~kill[b * words + w]);
+                if (in != var_in[b * words + w]) changed = 1;
+                var_in[b * words + w] = in;
+            }
+        }
+    } while (changed);
+}
+
+static void ra_occupy(IrInterval* iv, uint32_t point) {
+    if (point < iv->start) iv->start = point;
+    if (point > iv->end) iv->end = point;
+}
+
+static void ra_occupy_live(IrAlloc* a, const uint64_t* live, uint32_t point) {
+    for (size_t w = 0; w < a->words; w++) {
+        for (uint64_t bits = live[w]; bits; bits &= bits - 1) {
+            ra_occupy(&a->iv[w * 64 + (size_t)__builtin_ctzll(bits)], point);
+        }
+    }
+}
+
+// Walk every block backwards from its live-out set: live ranges, dead variable writes
+// (marked in dead) and the points each target register is occupied at
+static void ra_ranges(IrAlloc* a, const IrBlock* blocks, size_t count, const uint64_t* var_out,
+                      uint32_t* occupied, uint8_t* dead) {
+    uint64_t* live = ra_alloc(a, a->words * sizeof(uint64_t) + 1);
+    for (size_t b = 0; b < count; b++) {
+        const IrBlock* block = &blocks[b];
+        memcpy(live, var_out + b * a->words, a->words * sizeof(uint64_t));
+        uint32_t regs = block->reg_out;
+        for (uint32_t i = block->end; i-- > block->start;) {
+            occupied[2 * i + 1] = regs | a->writes[i];
+            int def = ra_def(a, i);
+            if (def >= 0) {
+                dead[i] = !ra_test(live, (uint32_t)def);
+                ra_clear(live, (uint32_t)def);
+                if (!dead[i]) ra_occupy(&a->iv[def], 2 * i + 1);
+            }
+            ra_occupy_live(a, live, 2 * i + 1);
+            for (uint32_t u = a->use_off[i]; u < a->use_off[i + 1]; u++) ra_set(live, a->use_var[u]);
+            regs = a->reads[i] | (regs & ~a->writes[i]);
+            occupied[2 * i] = regs;
+            ra_occupy_live(a, live, 2 * i);
+        }
+        if (b == 0) {
+            for (uint32_t v = 0; v < a->nvars; v++) a->iv[v].live_in = (uint8_t)ra_test(live, v);
+        }
+    }
+}
+
+// Loop nesting depth of each instruction: a backward jump closes a loop
+static int* ra_loop_depths(const IrAlloc* a) {
+    const IrInsn* insns = a->ir->insns;
+    int* depth = ra_calloc(a, (a->n + 1) * sizeof(int));
+    uint32_t min_label = UINT32_MAX, max_label = 0;
+    for (size_t i = 0; i < a->n; i++) {
+        if (insns[i].op != IR_LABEL) continue;
+        if (insns[i].a < min_label) min_label = insns[i].a;
+        if (insns[i].a > max_label) max_label = insns[i].a;
+    }
+    if (min_label > max_label) return depth;
+    uint32_t* label_at = ra_alloc(a, (max_label - min_label + 1) * sizeof(uint32_t));
+    memset(label_at, 0xFF, (max_label - min_label + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < a->n; i++) {
+        const IrInsn* insn = &insns[i];
+        if (insn->op == IR_LABEL) label_at[insn->a - min_label] = (uint32_t)i;
+        if (insn->op != IR_JMP && insn->op != IR_LOOP && insn->op != IR_BRANCH_ZERO) continue;
+        uint32_t target = insn->op == IR_BRANCH_ZERO ? insn->b : insn->a;
+        if (target < min_label || target > max_label) continue;
+        uint32_t at = label_at[target - min_label];
+        if (at == UINT32_MAX) continue;  // Forward jump
+        depth[at]++;
+        depth[i + 1]--;
+    }
+    for (size_t i = 1; i <= a->n; i++) depth[i] += depth[i - 1];
+    return depth;
+}
+
+static void ra_count_use(IrInterval* iv, int depth, uint64_t weight) {
+    iv->uses++;
+    iv->weight += weight;
+    if (depth > iv->loop_depth) iv->loop_depth = depth;
+}
+
+// -------------------------- The scan --------------------------
+static int ra_start_cmp(const void* x, const void* y) {
+    const IrInterval* p = *(const IrInterval* const*)x;
+    const IrInterval* q = *(const IrInterval* const*)y;
+    if (p->start != q->start) return p->start < q->start ? -1 : 1;
+    return p->var < q->var ? -1 : (p->var > q->var);
+}
+
+// busy[k * stride + p]: points before p at which register k of the pool is occupied
+static int ra_conflicts(const uint32_t* busy, size_t stride, int k, const IrInterval* iv) {
+    const uint32_t* row = busy + (size_t)k * stride;
+    return row[iv->end + 1] != row[iv->start];
+}
+
+static void ra_scan(IrAlloc* a, IrInterval** order, size_t count, const uint32_t* busy, size_t stride) {
+    const IrRegFile* rf = a->rf;
+    IrInterval* holder[IR_MAX_ALLOC_REGS] = {0};
+    for (size_t o = 0; o < count; o++) {
+        IrInterval* cur = order[o];
+        for (int k = 0; k < rf->reg_count; k++) {
+            if (holder[k] && holder[k]->end < cur->start) holder[k] = NULL;  // Expired
+        }
+        int hint = cur->hint;
+        if (cur->hint_var >= 0 && a->iv[cur->hint_var].reg >= 0) hint = a->iv[cur->hint_var].reg;
+
+        int chosen = -1;
+        for (int k = 0; k < rf->reg_count; k++) {
+            if (holder[k] || ra_conflicts(busy, stride, k, cur)) continue;
+            if (chosen < 0 || rf->regs[k] == hint) chosen = k;
+            if (rf->regs[k] == hint) break;
+        }
+        if (chosen < 0) {
+            // Out of registers: the cheapest of the overlapping variables goes to memory
+            for (int k = 0; k < rf->reg_count; k++) {
+                if (!holder[k] || ra_conflicts(busy, stride, k, cur) || holder[k]->weight >= cur->weight) continue;
+                if (chosen < 0 || holder[k]->weight < holder[chosen]->weight) chosen = k;
+            }
+            if (chosen < 0) continue;  // cur itself is spilled
+            holder[chosen]->reg = -1;
+        }
+        holder[chosen] = cur;
+        cur->reg = rf->regs[chosen];
+    }
+}
+
+// Frame slots for the spilled variables of one region; slots whose variable is dead are reused
+static int ra_slots(IrInterval** order, size_t count, int region, int base) {
+    uint32_t slot_end[256];
+    int slots = 0;
+    for (size_t o = 0; o < count; o++) {
+        IrInterval* iv = order[o];
+        if (iv->region != region || iv->reg >= 0 || iv->slot >= 0) continue;
+        int s = 0;
+        while (s < slots && slot_end[s] >= iv->start) s++;
+        if (s == slots) {
+            if (slots == 256) error("Too many variables spilled in one function");
+            slots++;
+        }
+        slot_end[s] = iv->end;
+        iv->slot = base + s;
+    }
+    return slots;
+}
+
+// -------------------------- Entry point --------------------------
+void ir_regalloc_init(IrRegAlloc* ra) {
+    for (int v = 0; v < IR_TOP_VARS; v++) ra->home[v] = -1;
+    ra->homes = ra->top_slots = 0;
+    ra->written = 0;
+    ra->locs = NULL;
+    ra->loc_count = ra->loc_cap = 0;
+}
+
+void ir_regalloc_free(IrRegAlloc* ra) {
+    free(ra->locs);
+    ir_regalloc_init(ra);
+}
+
+void ir_regalloc_reset(IrRegAlloc* ra) {
+    IrVarLoc* locs = ra->locs;
+    size_t cap = ra->loc_cap;
+    ir_regalloc_init(ra);
+    ra->locs = locs;
+    ra->loc_cap = cap;
+}
+
+static void ra_append(IrInsn** out, size_t* count, size_t* cap, IrInsn insn) {
+    if (*count == *cap) {
+        *cap *= 2;
+        *out = realloc(*out, *cap * sizeof(IrInsn));
+        if (!*out) error("Memory allocation failed (ir_regalloc)");
+    }
+    (*out)[(*count)++] = insn;
+}
+
+static void ra_rewrite(IrAlloc* a, const uint8_t* dead, int frame_slots, int first_frame,
+                       const int* function_slots, int final) {
+    IrProgram* ir = a->ir;
+    size_t count = 0, cap = ir->count + 2 * a->nvars + 2;
+    IrInsn* out = safe_malloc(cap * sizeof(IrInsn));
+    if (frame_slots) ra_append(&out, &count, &cap, (IrInsn){IR_FRAME, 0, 0, 0, (uint32_t)frame_slots, (uint32_t)first_frame});
+
+    // Top-level variables from earlier flushes are loaded from their homes
+    for (uint32_t v = 0; v < a->nvars; v++) {
+        IrInterval* iv = &a->iv[v];
+        if (!iv->live_in || iv->reg < 0) continue;
+        IrValue value = ir->next_value++;
+        ra_append(&out, &count, &cap, (IrInsn){IR_GET_SLOT, 0, 0, value, (uint32_t)iv->slot, 0});
+        ra_append(&out, &count, &cap, (IrInsn){IR_SET_REG, (uint8_t)iv->reg, IR_VAR_REG, 0, value, 0});
+    }
+
+    for (size_t i = 0; i < ir->count; i++) {
+        IrInsn insn = ir->insns[i];
+        if (insn.op == IR_GET_VAR) {
+            IrInterval* iv = &a->iv[a->local[insn.a]];
+            insn = iv->reg >= 0 ? (IrInsn){IR_GET_REG, (uint8_t)iv->reg, 0, insn.dst, 0, 0}
+                                : (IrInsn){IR_GET_SLOT, 0, 0, insn.dst, (uint32_t)iv->slot, 0};
+        } else if (insn.op == IR_SET_VAR) {
+            IrInterval* iv = &a->iv[a->local[insn.b]];
+            if (dead[i]) continue;  // Nothing reads it
+            insn = iv->reg >= 0 ? (IrInsn){IR_SET_REG, (uint8_t)iv->reg, IR_VAR_REG, 0, insn.a, 0}
+                                : (IrInsn){IR_SET_SLOT, 0, 0, 0, insn.a, (uint32_t)iv->slot};
+        } else if (insn.op == IR_ENTER && function_slots[i]) {
+            insn.a = (uint32_t)function_slots[i];
+            insn.b = 1;  // Slots are addressed from the frame pointer even without stack arguments
+        } else if (insn.op == IR_RET && a->region[i] >= 0 && function_slots[a->region[i]]) {
+            insn.a = insn.b = 1;
+        }
+        ra_append(&out, &count, &cap, insn);
+    }
+
+    // ... and saved there for the next flush
+    for (uint32_t v = 0; !final && v < a->nvars; v++) {
+        IrInterval* iv = &a->iv[v];
+        if (!iv->live_out || iv->reg < 0) continue;
+        IrValue value = ir->next_value++;
+        ra_append(&out, &count, &cap, (IrInsn){IR_GET_REG, (uint8_t)iv->reg, 0, value, 0, 0});
+        ra_append(&out, &count, &cap, (IrInsn){IR_SET_SLOT, 0, 0, 0, value, (uint32_t)iv->slot});
+    }
+
+    free(ir->insns);
+    ir->insns = out;
+    ir->count = count;
+    ir->cap = cap;
+}
+
+static void ra_record(IrAlloc* a) {
+    IrRegAlloc* ra = a->ra;
+    ra->loc_count = 0;
+    if (ra->loc_cap < a->nvars) {
+        ra->loc_cap = a->nvars;
+        ra->locs = realloc(ra->locs, ra->loc_cap * sizeof(IrVarLoc));
+        if (!ra->locs) error("Memory allocation failed (ir_regalloc)");
+    }
+    for (uint32_t v = 0; v < a->nvars; v++) {
+        const IrInterval* iv = &a->iv[v];
+        if (iv->start > iv->end) continue;  // Never read
+        ra->locs[ra->loc_count++] = (IrVarLoc){iv->var, iv->reg, iv->reg >= 0 ? -1 : iv->slot,
+                                               iv->start / 2, iv->end / 2, iv->uses, iv->loop_depth};
+    }
+}
+
+void ir_regalloc(IrProgram* ir, const IrRegFile* rf, IrRegAlloc* ra, int final) {
+    if (rf->reg_count > IR_MAX_ALLOC_REGS) error("ir_regalloc: at most %d allocatable registers", IR_MAX_ALLOC_REGS);
+    IrAlloc a = {ir, rf, ra, ir->count};
+
+    // Variables used here get dense indices; without any, only keep track of the registers
+    // the program assigns (one pass, this is every chunk of a program without variables)
+    uint32_t var_limit = 0, written = 0;
+    for (size_t i = 0; i < ir->count; i++) {
+        const IrInsn* insn = &ir->insns[i];
+        uint32_t var = insn->op == IR_GET_VAR ? insn->a : insn->op == IR_SET_VAR ? insn->b : UINT32_MAX;
+        if (var != UINT32_MAX && var >= var_limit) var_limit = var + 1;
+        if (insn->op == IR_SET_REG || insn->op == IR_POP) written |= IR_BIT(insn->reg);
+        if (insn->op == IR_LOOP) written |= IR_BIT(rf->loop_reg);
+    }
+    ra->loc_count = 0;
+    if (var_limit == 0) {
+        ra->written |= written;
+        return;
+    }
+
+    ArenaMark mark = arena_mark(&ir->scratch);
+    a.local = ra_alloc(&a, var_limit * sizeof(int32_t));
+    for (uint32_t v = 0; v < var_limit; v++) a.local[v] = -1;
+    a.def_at = ra_alloc(&a, ir->next_value * sizeof(uint32_t));
+    for (size_t i = 0; i < ir->count; i++) {
+        const IrInsn* insn = &ir->insns[i];
+        if (insn->dst) a.def_at[insn->dst] = (uint32_t)i;
+        uint32_t var = insn->op == IR_GET_VAR ? insn->a : insn->op == IR_SET_VAR ? insn->b : UINT32_MAX;
+        if (var != UINT32_MAX && a.local[var] < 0) a.local[var] = (int32_t)a.nvars++;
+    }
+    a.iv = ra_alloc(&a, a.nvars * sizeof(IrInterval));
+    for (uint32_t v = 0; v < var_limit; v++) {
+        if (a.local[v] < 0) continue;
+        a.iv[a.local[v]] = (IrInterval){v, UINT32_MAX, 0, 0, 0, 0, -1, -1, -1, -1, -1, 0, 0};
+    }
+    a.words = (a.nvars + 63) / 64;
+    size_t n = ir->count;
+    a.reads = ra_alloc(&a, (n + 1) * sizeof(uint32_t));
+    a.writes = ra_alloc(&a, (n + 1) * sizeof(uint32_t));
+    a.use_off = ra_alloc(&a, (n + 1) * sizeof(uint32_t));
+    a.region = ra_alloc(&a, (n + 1) * sizeof(int32_t));
+    uint32_t assigned = ra_effects(&a);
+
+    // Registers observable where the IR ends, and where a function returns: whatever the
+    // program assigned (a function that calls others passes on what they assigned)
+    IrBlock* blocks;
+    size_t block_count = ra_blocks(&a, &blocks);
+    written = ra->written | assigned;
+    uint64_t* exit_vars = ra_calloc(&a, (a.words + 1) * sizeof(uint64_t));
+    uint64_t* var_in = ra_calloc(&a, (block_count * a.words + 1) * sizeof(uint64_t));
+    uint64_t* var_out = ra_calloc(&a, (block_count * a.words + 1) * sizeof(uint64_t));
+    for (uint32_t v = 0; v < a.nvars; v++) {
+        if (a.iv[v].var < IR_TOP_VARS && !final) {
+            ra_set(exit_vars, v);
+            a.iv[v].live_out = 1;
+        }
+    }
+    // A return reads what its function leaves for the caller: the registers it assigns,
+    // and everything assigned anywhere if it calls other functions
+    int* function_slots = ra_calloc(&a, (n + 1) * sizeof(int));
+    uint32_t* ret_regs = ra_calloc(&a, (n + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < n; i++) {
+        int region = a.region[i];
+        if (region < 0) continue;
+        const IrInsn* insn = &ir->insns[i];
+        if (insn->op == IR_SET_REG || insn->op == IR_POP) ret_regs[region] |= IR_BIT(insn->reg);
+        if (insn->op == IR_LOOP) ret_regs[region] |= IR_BIT(rf->loop_reg);
+        if (insn->op == IR_CALL) ret_regs[region] |= written;
+        if (insn->op == IR_RET) a.reads[i] |= ret_regs[region];
+    }
+    ra_liveness(&a, blocks, block_count, var_in, var_out, written, exit_vars);
+
+    uint32_t* occupied = ra_alloc(&a, (2 * n + 1) * sizeof(uint32_t));
+    uint8_t* dead = ra_calloc(&a, n + 1);
+    ra_ranges(&a, blocks, block_count, var_out, occupied, dead);
+
+    // Use counts, loop weights, regions and hints
+    int* depth = ra_loop_depths(&a);
+    for (size_t i = 0; i < n; i++) {
+        const IrInsn* insn = &ir->insns[i];
+        int d = depth[i] < IR_MAX_LOOP_WEIGHT ? depth[i] : IR_MAX_LOOP_WEIGHT;
+        uint64_t weight = 1ull << (3 * d);
+        int def = ra_def(&a, i);
+        if (def >= 0 && dead[i]) def = -1;
+        for (uint32_t u = a.use_off[i]; u < a.use_off[i + 1]; u++) ra_count_use(&a.iv[a.use_var[u]], depth[i], weight);
+        if (def >= 0) ra_count_use(&a.iv[def], depth[i], weight);
+        if (def >= 0 && a.iv[def].hint < 0 && a.iv[def].hint_var < 0) {
+            const IrInsn* leaf = ra_leftmost(&a, insn->a);
+            if (leaf->op == IR_GET_REG) a.iv[def].hint = leaf->reg;
+            if (leaf->op == IR_GET_VAR) a.iv[def].hint_var = a.local[leaf->a];
+        }
+        if (insn->op == IR_SET_REG) {
+            const IrInsn* value = &ir->insns[a.def_at[insn->a]];
+            if (value->op == IR_GET_VAR && a.iv[a.local[value->a]].hint < 0) a.iv[a.local[value->a]].hint = insn->reg;
+        }
+    }
+    for (uint32_t v = 0; v < a.nvars; v++) {
+        IrInterval* iv = &a.iv[v];
+        if (iv->start <= iv->end) iv->region = a.region[iv->start / 2];
+    }
+
+    // busy[k][p]: occupied points of pool register k before p
+    size_t stride = 2 * n + 1;
+    uint32_t* busy = ra_alloc(&a, (size_t)rf->reg_count * stride * sizeof(uint32_t));
+    for (int k = 0; k < rf->reg_count; k++) {
+        uint32_t bit = IR_BIT(rf->regs[k]), sum = 0;
+        uint32_t* row = busy + (size_t)k * stride;
+        for (size_t p = 0; p < 2 * n; p++) {
+            row[p] = sum;
+            sum += (occupied[p] & bit) != 0;
+        }
+        row[2 * n] = sum;
+    }
+
+    IrInterval** order = ra_alloc(&a, (a.nvars + 1) * sizeof(IrInterval*));
+    size_t live_count = 0;
+    for (uint32_t v = 0; v < a.nvars; v++) {
+        if (a.iv[v].start <= a.iv[v].end) order[live_count++] = &a.iv[v];
+    }
+    qsort(order, live_count, sizeof(IrInterval*), ra_start_cmp);
+    ra_scan(&a, order, live_count, busy, stride);
+
+    // Top-level variables that outlive this IR, or are spilled, live in a home slot
+    int frame_reg_written = 0;
+    for (size_t o = 0; o < live_count; o++) {
+        IrInterval* iv = order[o];
+        if (iv->var >= IR_TOP_VARS || !(iv->reg < 0 || iv->live_in || iv->live_out)) continue;
+        if (ra->home[iv->var] < 0) ra->home[iv->var] = ra->homes++;
+        iv->slot = ra->home[iv->var];
+    }
+    int top_slots = ra->homes + ra_slots(order, live_count, -1, ra->homes);
+    for (size_t i = 0; i < n; i++) {
+        const IrInsn* insn = &ir->insns[i];
+        int region = a.region[i];
+        if (insn->op == IR_ENTER) function_slots[i] = ra_slots(order, live_count, (int)i, 0);
+        int writes_frame = (insn->op == IR_SET_REG || insn->op == IR_POP) && insn->reg == rf->frame_reg;
+        if (!writes_frame) continue;
+        if (region >= 0 ? function_slots[region] > 0 : top_slots > 0) frame_reg_written = 1;
+    }
+    if (top_slots > 0 && (ra->written & IR_BIT(rf->frame_reg))) frame_reg_written = 1;
+    if (frame_reg_written) error("Variables spilled to the stack need the frame pointer, which the program assigns");
+    for (size_t i = 0; i < n; i++) {
+        if (function_slots[i] > rf->max_slots) error("Too many variables spilled in one function (%d slots)", function_slots[i]);
+    }
+    if (top_slots > rf->max_slots) error("Too many top-level variables spilled (%d slots)", top_slots);
+
+    int grow = top_slots > ra->top_slots ? top_slots - ra->top_slots : 0;
+    int first_frame = ra->top_slots == 0;
+    if (grow) ra->top_slots = top_slots;
+    ra_record(&a);
+    ra_rewrite(&a, dead, grow, first_frame, function_slots, final);
+    ra->written = written;
+
+    arena_release(&ir->scratch, mark);
+}
@@ -0,0 +1,255 @@
+#include "charclass.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+// -------------------------- Character class table --------------------------
+#define CC_LETTER     (CC_IDENT_START | CC_IDENT)
+#define CC_HEX_LETTER (CC_IDENT_START | CC_IDENT | CC_HEX)
+
+const uint8_t lexer_char_class[256] = {
+    [' '] = CC_SPACE, ['\t'] = CC_SPACE, ['\n'] = CC_SPACE,
+    ['\v'] = CC_SPACE, ['\f'] = CC_SPACE, ['\r'] = CC_SPACE,
+    ['0' ... '9'] = CC_IDENT | CC_DIGIT | CC_HEX,
+    ['A' ... 'F'] = CC_HEX_LETTER, ['G' ... 'Z'] = CC_LETTER,
+    ['a' ... 'f'] = CC_HEX_LETTER, ['g' ... 'z'] = CC_LETTER,
+    ['_'] = CC_LETTER,
+};
+
+// -------------------------- Scalar implementation --------------------------
+static const char* scalar_skip_space(const char* p, const char* end, int* lines) {
+    int n = 0;
+    while (p < end && CC_IS(*p, CC_SPACE)) {
+        n += (*p == '\n');
+        p++;
+    }
+    *lines += n;
+    return p;
+}
+
+static const char* scalar_find_newline(const char* p, const char* end) {
+    const char* nl = memchr(p, '\n', end - p);
+    return nl ? nl : end;
+}
+
+static const char* scalar_run(const char* p, const char* end, uint8_t cls) {
+    while (p < end && CC_IS(*p, cls)) p++;
+    return p;
+}
+
+static const char* scalar_ident(const char* p, const char* end) {
+    return scalar_run(p, end, CC_IDENT);
+}
+
+static const char* scalar_hex(const char* p, const char* end) {
+    return scalar_run(p, end, CC_HEX);
+}
+
+#ifdef SCAN_HAVE_X86
+// -------------------------- SSE2 implementation (16 bytes per step) --------------------------
+// Signed byte compares are enough: every class here is pure ASCII, bytes >= 0x80 compare
+// negative and fall out of all ranges.
+static inline __m128i sse2_in_range(__m128i v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+static inline unsigned sse2_space_mask(__m128i v, unsigned* nl_mask) {
+    __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    __m128i sp = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), sse2_in_range(v, '\t', '\r'));
+    *nl_mask = (unsigned)_mm_movemask_epi8(nl);
+    return (unsigned)_mm_movemask_epi8(sp);
+}
+
+static inline unsigned sse2_ident_mask(__m128i v) {
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));  // Fold A-Z onto a-z
+    __m128i m = _mm_or_si128(sse2_in_range(lower, 'a', 'z'), sse2_in_range(v, '0', '9'));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+static inline unsigned sse2_hex_mask(__m128i v) {
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i m = _mm_or_si128(sse2_in_range(lower, 'a', 'f'), sse2_in_range(v, '0', '9'));
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+static const char* sse2_skip_space(const char* p, const char* end, int* lines) {
+    // Single separating spaces are the common case: don't pay for a vector load
+    if (p < end && !CC_IS(*p, CC_SPACE)) return p;
+    while (end - p >= 16) {
+        unsigned nl;
+        unsigned stop = ~sse2_space_mask(_mm_loadu_si128((const __m128i*)p), &nl) & 0xFFFF;
+        if (stop) {
+            unsigned idx = __builtin_ctz(stop);
+            *lines += __builtin_popcount(nl & ((1u << idx) - 1));
+            return p + idx;
+        }
+        *lines += __builtin_popcount(nl);
+        p += 16;
+    }
+    return scalar_skip_space(p, end, lines);
+}
+
+static const char* sse2_find_newline(const char* p, const char* end) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), nl));
+        if (m) return p + __builtin_ctz(m);
+        p += 16;
+    }
+    return scalar_find_newline(p, end);
+}
+
+static const char* sse2_ident(const char* p, const char* end) {
+    while (end - p >= 16) {
+        unsigned stop = ~sse2_ident_mask(_mm_loadu_si128((const __m128i*)p)) & 0xFFFF;
+        if (stop) return p + __builtin_ctz(stop);
+        p += 16;
+    }
+    return scalar_ident(p, end);
+}
+
+static const char* sse2_hex(const char* p, const char* end) {
+    while (end - p >= 16) {
+        unsigned stop = ~sse2_hex_mask(_mm_loadu_si128((const __m128i*)p)) & 0xFFFF;
+        if (stop) return p + __builtin_ctz(stop);
+        p += 16;
+    }
+    return scalar_hex(p, end);
+}
+
+// -------------------------- AVX2 implementation (32 bytes per step) --------------------------
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2_in_range(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+AVX2 static const char* avx2_skip_space(const char* p, const char* end, int* lines) {
+    if (p < end && !CC_IS(*p, CC_SPACE)) return p;
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        unsigned nl = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        __m256i sp = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), avx2_in_range(v, '\t', '\r'));
+        unsigned stop = ~(unsigned)_mm256_movemask_epi8(sp);
+        if (stop) {
+            unsigned idx = __builtin_ctz(stop);
+            *lines += __builtin_popcount(nl & ((1u << idx) - 1));
+            return p + idx;
+        }
+        *lines += __builtin_popcount(nl);
+        p += 32;
+    }
+    return sse2_skip_space(p, end, lines);
+}
+
+AVX2 static const char* avx2_find_newline(const char* p, const char* end) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), nl));
+        if (m) return p + __builtin_ctz(m);
+        p += 32;
+    }
+    return sse2_find_newline(p, end);
+}
+
+AVX2 static const char* avx2_ident(const char* p, const char* end) {
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i m = _mm256_or_si256(avx2_in_range(lower, 'a', 'z'), avx2_in_range(v, '0', '9'));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+        unsigned stop = ~(unsigned)_mm256_movemask_epi8(m);
+        if (stop) return p + __builtin_ctz(stop);
+        p += 32;
+    }
+    return sse2_ident(p, end);
+}
+
+AVX2 static const char* avx2_hex(const char* p, const char* end) {
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i m = _mm256_or_si256(avx2_in_range(lower, 'a', 'f'), avx2_in_range(v, '0', '9'));
+        unsigned stop = ~(unsigned)_mm256_movemask_epi8(m);
+        if (stop) return p + __builtin_ctz(stop);
+        p += 32;
+    }
+    return sse2_hex(p, end);
+}
+#endif // SCAN_HAVE_X86
+
+// -------------------------- Runtime dispatch --------------------------
+typedef struct {
+    const char* name;
+    const char* (*skip_space)(const char*, const char*, int*);
+    const char* (*find_newline)(const char*, const char*);
+    const char* (*ident)(const char*, const char*);
+    const char* (*hex)(const char*, const char*);
+} ScanImpl;
+
+static const ScanImpl scan_impls[] = {
+#ifdef SCAN_HAVE_X86
+    {"avx2", avx2_skip_space, avx2_find_newline, avx2_ident, avx2_hex},
+    {"sse2", sse2_skip_space, sse2_find_newline, sse2_ident, sse2_hex},
+#endif
+    {"scalar", scalar_skip_space, scalar_find_newline, scalar_ident, scalar_hex},
+};
+#define SCAN_IMPL_COUNT (sizeof(scan_impls) / sizeof(scan_impls[0]))
+
+static const ScanImpl* scan_active = &scan_impls[SCAN_IMPL_COUNT - 1];
+
+static int scan_supported(const ScanImpl* impl) {
+#ifdef SCAN_HAVE_X86
+    if (strcmp(impl->name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    if (strcmp(impl->name, "sse2") == 0) return __builtin_cpu_supports("sse2");
+#endif
+    return 1;
+}
+
+// Pick the widest implementation the CPU supports before main() runs
+__attribute__((constructor)) static void scan_select(void) {
+#ifdef SCAN_HAVE_X86
+    __builtin_cpu_init();
+#endif
+    for (size_t i = 0; i < SCAN_IMPL_COUNT; i++) {
+        if (scan_supported(&scan_impls[i])) {
+            scan_active = &scan_impls[i];
+            return;
+        }
+    }
+}
+
+int scan_set_impl(const char* name) {
+    for (size_t i = 0; i < SCAN_IMPL_COUNT; i++) {
+        if (strcmp(scan_impls[i].name, name) == 0 && scan_supported(&scan_impls[i])) {
+            scan_active = &scan_impls[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char* scan_impl_name(void) {
+    return scan_active->name;
+}
+
+const char* scan_skip_space(const char* p, const char* end, int* lines) {
+    return scan_active->skip_space(p, end, lines);
+}
+
+const char* scan_find_newline(const char* p, const char* end) {
+    return scan_active->find_newline(p, end);
+}
+
+const char* scan_ident(const char* p, const char* end) {
+    return scan_active->ident(p, end);
+}
+
+const char* scan_hex(const char* p, const char* end) {
+    return scan_active->hex(p, end);
+}
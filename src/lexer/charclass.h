@@ -0,0 +1,43 @@
+#ifndef CHARCLASS_H
+#define CHARCLASS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// -------------------------- 字符分类表 --------------------------
+// 256项查表代替isspace/isalnum/isxdigit（与locale无关，每字节一次访存）
+enum {
+    CC_SPACE       = 1 << 0,  // 空白：' ' \t \n \v \f \r
+    CC_IDENT_START = 1 << 1,  // 标识符首字符：字母、下划线
+    CC_IDENT       = 1 << 2,  // 标识符后续字符：字母、数字、下划线
+    CC_DIGIT       = 1 << 3,  // 十进制数字
+    CC_HEX         = 1 << 4   // 十六进制数字
+};
+
+extern const uint8_t lexer_char_class[256];
+
+#define CC_IS(c, cls) (lexer_char_class[(unsigned char)(c)] & (cls))
+
+// -------------------------- 批量扫描 --------------------------
+// 以下函数从p开始扫描到end（不越界，不要求'\0'结尾），返回第一个不满足条件的位置。
+// 运行时根据CPU选择AVX2（32字节/次）、SSE2（16字节/次）或标量实现。
+
+// 跳过空白，*lines累加跨过的换行数
+const char* scan_skip_space(const char* p, const char* end, int* lines);
+
+// 查找下一个'\n'（注释体），找不到返回end
+const char* scan_find_newline(const char* p, const char* end);
+
+// 跳过标识符字符 [A-Za-z0-9_]
+const char* scan_ident(const char* p, const char* end);
+
+// 跳过十六进制数字 [0-9A-Fa-f]
+const char* scan_hex(const char* p, const char* end);
+
+// 当前使用的实现（"avx2"、"sse2"、"scalar"）
+const char* scan_impl_name(void);
+
+// 强制切换实现（测试/benchmark用）；CPU不支持时返回0且不切换
+int scan_set_impl(const char* name);
+
+#endif // CHARCLASS_H
@@ -2,7 +2,9 @@
 #define LEXER_H
 
 #include "common/types.h"
+#include "common/utils.h"
 #include <stdio.h>
+#include <stddef.h>
 
 // 模拟fpeek：预览下一个字符（不移动文件指针）
 static inline int fpeek(FILE* fp) {
@@ -11,20 +13,51 @@ static inline int fpeek(FILE* fp) {
     return c;
 }
 
-// lexer状态
+// 输入buffer的来源（决定lexer_free如何释放）
+typedef enum {
+    LEXER_SRC_BORROWED,  // 调用者提供的buffer（lexer不释放）
+    LEXER_SRC_HEAP,      // 从管道等流中read到的malloc buffer
+    LEXER_SRC_MMAP       // mmap映射的普通文件
+} LexerSource;
+
+// module注册的额外关键字表（开放寻址哈希，定义在lexer.c）
+typedef struct LexerKeywordTable LexerKeywordTable;
+
+// lexer状态：整个输入是一段连续的内存，扫描只移动指针
 typedef struct {
-    FILE* fp;       // 输入文件
-    int line;       // currentline
-    int current_char; // current字符
+    FILE* fp;           // 输入文件（buffer模式下为NULL）
+    const char* src;    // 输入起始地址
+    const char* cur;    // current扫描位置
+    const char* end;    // 输入结束位置（不要求以'\0'结尾）
+    size_t size;        // 输入总bytes
+    LexerSource source; // buffer来源
+    int line;           // currentline
+    LexerKeywordTable* extra_keywords;  // module注册的关键字（没有时为NULL，不影响查表速度）
+    ErrorContext* errors;  // 词法错误报告到这里，跳过出错的字符继续扫描（NULL=第一个错误就结束编译）
 } Lexer;
 
-// 初始化lexer
+// 获取Token的文本（指向源码buffer，不以'\0'结尾，长度为tok->len；打印用"%.*s"）
+static inline const char* lexer_token_text(const Lexer* lexer, const Token* tok) {
+    return lexer->src + tok->offset;
+}
+
+// 初始化lexer：普通文件用mmap映射，管道等不可映射的输入一次性read进buffer
 Lexer* lexer_init(FILE* fp);
 
+// 初始化lexer：直接扫描调用者的内存buffer（不复制，buffer需在lexer释放前有效）
+Lexer* lexer_init_buffer(const char* src, size_t len);
+
 // 获取下一个Token
 Token lexer_next_token(Lexer* lexer);
 
-// 释放lexer
+// 关键字分类：内置关键字走编译期生成的完美哈希（O(1)），未命中再查module注册的扩展表
+// 不是关键字时返回TOKEN_ID
+TokenType lexer_classify_word(const Lexer* lexer, const char* word, size_t len);
+
+// module注册额外关键字（如target专用语句）；与内置关键字或已注册关键字重复时报错
+void lexer_add_keyword(Lexer* lexer, const char* word, TokenType type);
+
+// 释放lexer（同时解除映射/释放buffer）
 void lexer_free(Lexer* lexer);
 
-#endif // LEXER_H
\ No newline at end of file
+#endif // LEXER_H
@@ -0,0 +1,120 @@
+#include "ecc.h"
+#include "../common/utils.h"
+#include "../lexer/lexer.h"
+#include "../parser/parser.h"
+#include "../codegen/codegen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Everything a compilation touches lives here, so error() can longjmp out of the middle
+// of one and the next compilation still finds a consistent context
+struct EccContext {
+    EccOptions options;
+    Lexer* lexer;           // Of the compilation in progress
+    Parser* parser;         // Reset for each compilation (arena and symbol tables stay warm)
+    Codegen cg;             // Reset for each compilation (IR, labels, allocator stay warm)
+    Emitter code;           // The caller's buffer while a compilation runs
+    ErrorContext errors;
+    FILE* diagnostics;      // Memory stream over diagnostics_text
+    char* diagnostics_text;
+    size_t diagnostics_len;
+    char message[sizeof(((ErrorTrap*)0)->message)];  // What stopped the last compilation
+};
+
+static const EccOptions ecc_default_options = {1, 0};
+
+// Run one step with errors trapped; returns 1 with ctx->message set if it failed.
+// The caller's own trap (if any) is restored either way.
+static int ecc_trapped(EccContext* ctx, void (*step)(EccContext* ctx, const char* src, size_t len),
+                       const char* src, size_t len) {
+    ErrorTrap* outer = error_trap_get();
+    ErrorTrap trap;
+    if (setjmp(trap.env) != 0) {
+        error_trap_set(outer);
+        memcpy(ctx->message, trap.message, sizeof(ctx->message));
+        return 1;
+    }
+    error_trap_set(&trap);
+    step(ctx, src, len);
+    error_trap_set(outer);
+    return 0;
+}
+
+// The parser and the code generator are created once, on an empty input
+static void ecc_context_setup(EccContext* ctx, const char* src, size_t len) {
+    ctx->lexer = lexer_init_buffer(src, len);
+    ctx->parser = parser_init(ctx->lexer);
+    emitter_init(&ctx->code, 0);
+    codegen_init(&ctx->cg, &ctx->code);
+    ctx->cg.optimize = ctx->options.optimize;
+    ctx->cg.errors = &ctx->errors;
+}
+
+static void ecc_compile_step(EccContext* ctx, const char* src, size_t len) {
+    if (!ctx->code.data) emitter_init(&ctx->code, 0);
+    ctx->lexer = lexer_init_buffer(src, len);
+    ctx->lexer->errors = &ctx->errors;  // The parser takes it from the lexer
+    parser_reset(ctx->parser, ctx->lexer);
+    codegen_reset(&ctx->cg, &ctx->code);
+    AstNode* ast = parser_parse_file(ctx->parser);
+    codegen_generate(&ctx->cg, ast);
+}
+
+EccContext* ecc_context_new(const EccOptions* options) {
+    EccContext* ctx = calloc(1, sizeof(EccContext));
+    if (!ctx) return NULL;
+    ctx->options = options ? *options : ecc_default_options;
+    ctx->diagnostics = open_memstream(&ctx->diagnostics_text, &ctx->diagnostics_len);
+    if (!ctx->diagnostics || ecc_trapped(ctx, ecc_context_setup, "", 0)) {
+        ecc_context_free(ctx);
+        return NULL;
+    }
+    lexer_free(ctx->lexer);
+    ctx->lexer = NULL;
+    emitter_free(&ctx->code);  // Compilations emit into the caller's buffer
+    return ctx;
+}
+
+void ecc_context_free(EccContext* ctx) {
+    if (!ctx) return;
+    if (ctx->cg.bindings) codegen_cleanup(&ctx->cg);
+    emitter_free(&ctx->code);
+    parser_free(ctx->parser);
+    lexer_free(ctx->lexer);
+    if (ctx->diagnostics) fclose(ctx->diagnostics);
+    free(ctx->diagnostics_text);
+    free(ctx);
+}
+
+int ecc_compile(EccContext* ctx, const char* src, size_t len, EccBuffer* out) {
+    rewind(ctx->diagnostics);
+    error_context_init(&ctx->errors, ctx->diagnostics, ctx->options.max_errors);
+    ctx->code = (Emitter){out->data, 0, out->cap};
+
+    int failed = ecc_trapped(ctx, ecc_compile_step, src, len);
+    lexer_free(ctx->lexer);
+    ctx->lexer = NULL;
+    if (failed) {
+        fprintf(ctx->diagnostics, "[ERROR] %s\n", ctx->message);
+        ctx->code.len = 0;
+    }
+    fputc('\0', ctx->diagnostics);  // The stream is rewound, not truncated: terminate here
+    fflush(ctx->diagnostics);
+
+    out->data = ctx->code.data;
+    out->len = ctx->code.len;
+    out->cap = ctx->code.cap;
+    ctx->code = (Emitter){NULL, 0, 0};  // The buffer is the caller's again
+    return failed ? -1 : 0;
+}
+
+const char* ecc_diagnostics(const EccContext* ctx) {
+    return ctx->diagnostics_len ? ctx->diagnostics_text : "";
+}
+
+void ecc_buffer_free(EccBuffer* buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->len = buf->cap = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef ECC_H
+#define ECC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// In-process compiler (libecc): ELFCOST source in memory to machine code in memory,
+// without files, processes or exit(). A context keeps the parser's arena and symbol
+// tables, the code generator's IR, label and allocator buffers and the diagnostics
+// buffer from one compilation to the next, so a warm context compiles without going
+// back to malloc (module tables are static and shared by all contexts).
+// Use one context per thread; contexts are independent of each other.
+
+typedef struct EccContext EccContext;
+
+// Machine code output. Start from {0}: ecc_compile replaces the contents and reuses
+// the allocation, ecc_buffer_free releases it.
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+} EccBuffer;
+
+typedef struct {
+    int optimize;    // 1 = IR passes and peephole (the command line default), 0 = off
+    int max_errors;  // Diagnostics reported before a compilation gives up (0 = default)
+} EccOptions;
+
+// options NULL = the command line defaults; returns NULL if out of memory
+EccContext* ecc_context_new(const EccOptions* options);
+void ecc_context_free(EccContext* ctx);
+
+// Compile src[0..len) into out. Returns 0 on success; -1 on errors, with out->len 0
+// and the reasons in ecc_diagnostics.
+int ecc_compile(EccContext* ctx, const char* src, size_t len, EccBuffer* out);
+
+// Diagnostics of the last ecc_compile, one "[ERROR] ..." line each ("" after a
+// success); valid until the next call on ctx
+const char* ecc_diagnostics(const EccContext* ctx);
+
+void ecc_buffer_free(EccBuffer* buf);
+
+#endif // ECC_H
@@ -1,13 +1,21 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
 #include "common/utils.h"
+#include "common/stats.h"
+#include "common/pool.h"
 #include "lexer/lexer.h"
 #include "parser/parser.h"
 #include "codegen/codegen.h"
+#include "codegen/output_cache.h"
 #include "cli/cli.h"  // Added cli header file
+#include "server/server.h"
 // Helper function: Print AST (for debugging, verify parsing results)
-void ast_print(AstNode* root, int indent) {
-    if (!root || root->type == AST_EOF) return;
+// Visitor callback for ast_walk, the depth (plus the caller's base indent in ctx) drives the indentation
+static void ast_print_visit(AstVisitor* visitor, AstNode* root, int depth) {
+    int indent = *(int*)visitor->ctx + depth;
 
     // Print indentation (for hierarchy visualization)
     for (int i = 0; i < indent; i++) printf("  ");
@@ -24,6 +32,17 @@ void ast_print(AstNode* root, int indent) {
             }
             break;
         }
+        case AST_MEM_ASSIGN: {
+            MemAssignNode* node = (MemAssignNode*)root;
+            static const char* const widths[] = {[1] = "byte", [2] = "word", [4] = "dword"};
+            printf("Memory assignment: mem.%s[0x%x] = ", widths[node->width], node->addr.value.num_val);
+            if (node->value.type == CONST_NUM) {
+                printf("0x%x\n", node->value.value.num_val);
+            } else if (node->value.type == CONST_CHAR) {
+                printf("'%c'\n", node->value.value.char_val);
+            }
+            break;
+        }
         case AST_CONST_DEF: {
             ConstDefNode* node = (ConstDefNode*)root;
             printf("Constant definition: const %s = ", node->const_name);
@@ -34,19 +53,66 @@ void ast_print(AstNode* root, int indent) {
             }
             break;
         }
-        case AST_BLOCK: {
-            BlockNode* node = (BlockNode*)root;
-            printf("Code block (line: %d):\n", root->line);
-            ast_print(node->statements, indent + 1);  // Recursively print statements in block
+        case AST_VAR_DEF:
+        case AST_VAR_ASSIGN: {
+            VarAssignNode* node = (VarAssignNode*)root;
+            printf(root->type == AST_VAR_DEF ? "Variable definition: var %s = " : "Variable assignment: %s = ",
+                   node->var_name);
+            if (node->value.type == CONST_EXPR) {
+                printf("<expr>\n");
+            } else if (node->value.type == CONST_CHAR) {
+                printf("'%c'\n", node->value.value.char_val);
+            } else {
+                printf("0x%x\n", node->value.value.num_val);
+            }
+            break;
+        }
+        case AST_USE:
+            printf("Module: use %s\n", ((UseNode*)root)->module->name);
+            break;
+        case AST_BLOCK:
+            printf("Code block (line: %d):\n", root->line);  // Statements follow one level deeper
+            break;
+        case AST_FUNC_DEF: {
+            FuncDefNode* node = (FuncDefNode*)root;
+            printf("Function definition: func %s(", node->func_name);
+            for (int i = 0; i < node->param_count; i++) printf(i ? ", %s" : "%s", node->params[i]);
+            printf(") (%d statements%s)\n", node->stmt_count, node->is_leaf ? ", leaf" : "");
+            break;
+        }
+        case AST_FUNC_CALL: {
+            FuncCallNode* node = (FuncCallNode*)root;
+            printf("Function call: %s(", node->func_name);
+            for (int i = 0; i < node->arg_count; i++) {
+                if (i) printf(", ");
+                if (node->args[i].type == CONST_EXPR) printf("<expr>");
+                else printf("0x%x", node->args[i].value.num_val);
+            }
+            printf(")\n");
+            break;
+        }
+        case AST_IF: {
+            IfNode* node = (IfNode*)root;
+            printf("If statement%s (branches follow)\n", node->else_block ? " with else" : "");
+            break;
+        }
+        case AST_WHILE:
+            printf("While loop (body follows)\n");
+            break;
+        case AST_FOR: {
+            ForNode* node = (ForNode*)root;
+            printf("For loop: %s (%d statements in body)\n", node->var_name, node->stmt_count);
             break;
         }
         default:
             printf("Unsupported node type: %d\n", root->type);
             break;
     }
+}
 
-    // Print next node (linked list)
-    ast_print(root->next, indent);
+void ast_print(AstNode* root, int indent) {
+    AstVisitor visitor = {ast_print_visit, NULL, &indent};
+    ast_walk(root, &visitor);
 }
 // ------- Deprecated main function, replaced with cli module for command line parsing -------
 /*int main(int argc, char* argv[]) {
@@ -85,48 +151,448 @@ void ast_print(AstNode* root, int indent) {
  *  printf("Parsing completed (machine code not generated yet)\n");
  *  return 0;
 }*/
+// -------------------------- Streaming mode helpers -------------------------
+// Output is written in chunks once this many IR instructions are pending, so streaming mode
+// keeps the AST, the IR and the code buffer bounded (optimization sees one chunk at a time)
+#define STREAM_FLUSH_INSNS (16 * 1024)
+
+typedef struct {
+    Codegen* cg;
+    FILE* out_fp;
+    size_t flushed;           // Bytes already written to out_fp
+    const char* output_file;  // For error messages
+} StreamState;
+
+// Write out the code generated so far (timed as the write phase with --stats)
+static void compile_write(const Emitter* code, FILE* out_fp, const char* output_file, CompileStats* stats) {
+    double start = stats ? stats_now() : 0;
+    if (emitter_write(code, out_fp) != 0) error("Cannot write output file: %s", output_file);
+    if (stats) stats->seconds[STATS_WRITE] += stats_now() - start;
+}
+
+// The final flush also ends the lifetime of the top-level variables
+static void stream_flush(StreamState* state, int final) {
+    Emitter* code = state->cg->out;
+    if (final) codegen_finish(state->cg);
+    else codegen_flush(state->cg);
+    compile_write(code, state->out_fp, state->output_file, state->cg->stats);
+    state->flushed += code->len;
+    emitter_reset(code);
+}
+
+// Parser sink: emit one statement; its AST memory is reclaimed right after this returns
+static void stream_statement(void* ctx, AstNode* stmt) {
+    StreamState* state = ctx;
+    codegen_statement(state->cg, stmt);
+    if (state->cg->ir.count >= STREAM_FLUSH_INSNS) stream_flush(state, 0);
+}
+
+// -------------------------- Incremental mode helpers -------------------------
+// Code statements are compiled and cached in regions. A region ends before a definition
+// or after a statement whose text hash says so (content-defined: an edit only moves the
+// boundaries next to it, the regions after it line up with the cached ones again).
+// Definitions (const, func, var, use) are always compiled, later code depends on them.
+// Each region is flushed on its own, which makes the output about twice as large on
+// typical files: top-level variables are saved to and reloaded from their frame slots around
+// every region, DS is reloaded, and nothing is folded or removed across a boundary.
+#define INCREMENTAL_BOUNDARY_MASK 15  // A region ends after 1 in 16 statements on average
+#define INCREMENTAL_MAX_STMTS 64
+
+typedef struct {
+    Parser* parser;
+    Codegen* cg;
+    const OutputCache* old;  // Loaded from disk
+    OutputCache fresh;       // Regions of this compilation, written back at the end
+    uint64_t defs;           // Text of the definitions so far
+    uint64_t layout;         // Code offsets of the definitions so far (function entries)
+    size_t regions;
+    size_t reused;
+    size_t reused_bytes;     // Source bytes neither lexed nor parsed
+} IncrementalState;
+
+static int incremental_is_definition(TokenType type) {
+    return type == TOKEN_CONST || type == TOKEN_FUNC || type == TOKEN_VAR || type == TOKEN_USE;
+}
+
+// Everything the code of a region depends on besides its own text
+static uint64_t incremental_state(const IncrementalState* st) {
+    const Codegen* cg = st->cg;
+    OutputCacheAlloc alloc;
+    output_cache_save_alloc(&alloc, &cg->alloc);
+    uint64_t h = hash_bytes64(st->defs, cg->backend->name, strlen(cg->backend->name));
+    h = hash_bytes64(h, &cg->optimize, sizeof(cg->optimize));
+    return hash_bytes64(h, &alloc, sizeof(alloc));
+}
+
+// Parse and generate one statement, reclaiming its AST like streaming mode
+static void incremental_statement(Parser* parser, Codegen* cg) {
+    ArenaMark mark = arena_mark(parser->arena);
+    AstNode* stmt = parser_parse_statement_recover(parser);
+    if (!stmt) return;  // Reported and skipped
+    // After an error the rest is only parsed, for its diagnostics
+    if (!(parser->errors && parser->errors->count)) codegen_statement(cg, stmt);
+    if (stmt->type == AST_FUNC_DEF || stmt->type == AST_VAR_DEF) return;
+    arena_release(parser->arena, mark);
+}
+
+static uint32_t incremental_lines(const char* p, size_t len) {
+    uint32_t lines = 0;
+    for (const char* end = p + len; (p = memchr(p, '\n', (size_t)(end - p))) != NULL; p++) lines++;
+    return lines;
+}
+
+// Compile a region that is not in the cache and add it to the fresh cache
+static void incremental_compile_region(IncrementalState* st, size_t start, uint64_t state, uint64_t layout) {
+    Parser* parser = st->parser;
+    Codegen* cg = st->cg;
+    const Lexer* lexer = parser->lexer;
+    size_t symbols = parser->symbols.count + parser->functions.count;
+    size_t code_start = cg->out->len;
+    for (int n = 1;; n++) {
+        size_t stmt = parser->current_tok.offset;
+        incremental_statement(parser, cg);
+        uint64_t h = hash_bytes64(HASH64_INIT, lexer->src + stmt, parser->current_tok.offset - stmt);
+        if (parser->current_tok.type == TOKEN_EOF || incremental_is_definition(parser->current_tok.type) ||
+            ((h >> 32) & INCREMENTAL_BOUNDARY_MASK) == 0 || n == INCREMENTAL_MAX_STMTS) {
+            break;
+        }
+    }
+    int calls = 0;  // Relative calls make the code depend on where it and the functions are
+    for (size_t i = 0; i < cg->ir.count; i++) calls |= cg->ir.insns[i].op == IR_CALL;
+    if (cg->ir.count) codegen_flush(cg);
+    // A const defined in a block outlives its region: such a region cannot be skipped
+    if (parser->symbols.count + parser->functions.count != symbols) return;
+
+    size_t len = parser->current_tok.offset - start;
+    OutputCacheEntry entry = {0};
+    entry.state = state;
+    entry.prefix = output_cache_prefix(lexer->src + start, lexer->size - start);
+    entry.text = hash_bytes64(HASH64_INIT, lexer->src + start, len);
+    entry.layout = calls ? layout : 0;
+    entry.len = (uint32_t)len;
+    entry.lines = incremental_lines(lexer->src + start, len);
+    entry.code_len = (uint32_t)(cg->out->len - code_start);
+    output_cache_save_alloc(&entry.alloc, &cg->alloc);
+    output_cache_add(&st->fresh, &entry, cg->out->data + code_start);
+}
+
+static void incremental_compile(IncrementalState* st) {
+    Parser* parser = st->parser;
+    Codegen* cg = st->cg;
+    const Lexer* lexer = parser->lexer;
+    while (parser->current_tok.type != TOKEN_EOF) {
+        size_t start = parser->current_tok.offset;
+        uint64_t layout = hash_bytes64(st->layout, &cg->labels.base, sizeof(cg->labels.base));
+        if (incremental_is_definition(parser->current_tok.type)) {
+            st->layout = layout;
+            incremental_statement(parser, cg);
+            if (cg->ir.count) codegen_flush(cg);
+            st->defs = hash_bytes64(st->defs, lexer->src + start, parser->current_tok.offset - start);
+            continue;
+        }
+        st->regions++;
+        uint64_t state = incremental_state(st);
+        const OutputCacheEntry* hit = output_cache_find(st->old, state, lexer->src + start, lexer->size - start);
+        if (hit && (!hit->layout || hit->layout == layout)) {
+            const uint8_t* code = st->old->code + hit->code_offset;
+            codegen_splice(cg, code, hit->code_len);
+            output_cache_restore_alloc(&cg->alloc, &hit->alloc);
+            parser_skip_to(parser, start + hit->len, (int)hit->lines);
+            output_cache_add(&st->fresh, hit, code);
+            st->reused++;
+            st->reused_bytes += hit->len;
+            continue;
+        }
+        incremental_compile_region(st, start, state, layout);
+    }
+    error_context_check(parser->errors);  // Before anything of a failed compilation reaches the cache
+    codegen_finish(cg);
+}
+
+// -------------------------- One compilation -------------------------
+// Everything a compilation owns is kept here rather than in locals, so a failed one can be
+// released: in batch mode error() longjmps out of compile_file (ErrorTrap in utils.h)
+typedef struct {
+    const EccConfig* cfg;      // Options; logs only in debug mode
+    const char* input_file;
+    const char* output_file;
+    FILE* diagnostics;         // Where recoverable errors are printed as they are found
+    ErrorContext errors;       // Shared by the lexer, the parser and codegen
+    FILE* in_fp;
+    FILE* out_fp;
+    int created_output;
+    Lexer* lexer;
+    Parser* parser;
+    Emitter code;
+    Codegen cg;
+    int has_codegen;
+    char* cache_path;          // Incremental mode: <output>.ecccache
+    OutputCache cache_old;
+    IncrementalState incremental;
+    size_t code_bytes;
+    CompileStats stats;        // --stats
+} Compilation;
+
+// --stats: fill in what the compilation [start, end) left behind. The parser timed the
+// lexer as it read the tokens; parse is what is left of the window once lexing, code
+// generation and writing are accounted for.
+static void compile_stats(Compilation* c, double start, double front, double end) {
+    CompileStats* stats = &c->stats;
+    double parse = end - front;
+    for (int phase = STATS_LEX; phase < STATS_PHASE_COUNT; phase++) {
+        if (phase != STATS_PARSE) parse -= stats->seconds[phase];
+    }
+    stats->seconds[STATS_PARSE] = parse > 0 ? parse : 0;
+    stats->total = end - start;
+    stats->source_bytes = c->lexer->size;
+    stats->lexed_bytes = c->parser->lexed_bytes;
+    stats->tokens = c->parser->token_count;
+    stats->ast_nodes = c->parser->node_count;
+    stats->ir_insns = c->cg.ir_insns;
+    stats->ir_removed = c->cg.ir_removed;
+    stats->peephole_saved = c->cg.bytes_saved;
+    stats->bytes_emitted = c->code_bytes;
+    stats->arena_peak = c->parser->arena->peak;
+    stats->arena_reserved = c->parser->arena->reserved + c->parser->symbols.arena.reserved +
+                            c->parser->functions.arena.reserved;
+    stats_record_rss(stats);
+}
+
+static void compile_file(Compilation* c) {
+    const EccConfig* cfg = c->cfg;
+    double start = stats_now();
+
+    // Open input file (with debug logging)
+    c->in_fp = fopen(c->input_file, "r");
+    if (!c->in_fp) error("Cannot open input file: %s", c->input_file);
+    cli_debug_log(cfg, "Successfully opened input file");
+
+    // Lexical analysis (original logic with new logging)
+    c->lexer = lexer_init(c->in_fp);
+    error_context_init(&c->errors, c->diagnostics, cfg->max_errors);
+    c->lexer->errors = &c->errors;  // The parser takes it from the lexer
+    cli_debug_log(cfg, "Lexer initialization completed");
+
+    // Syntax analysis and code generation into an in-memory buffer
+    c->out_fp = fopen(c->output_file, "wb");
+    if (!c->out_fp) error("Cannot create output file: %s", c->output_file);
+    c->created_output = 1;
+    emitter_init(&c->code, 0);
+    codegen_init(&c->cg, &c->code);
+    c->has_codegen = 1;
+    c->cg.alloc_log = cfg->is_debug ? stdout : NULL;  // Register allocation decisions
+    c->cg.errors = &c->errors;
+    c->parser = parser_init(c->lexer);
+    Codegen* cg = &c->cg;
+    if (cfg->stats) {
+        cg->stats = &c->stats;
+        parser_time_lexer(c->parser, &c->stats.seconds[STATS_LEX]);
+    }
+    double front = stats_now();
+
+    if (cfg->incremental) {
+        // Incremental: unchanged regions are spliced from the cache next to the output
+        size_t path_len = strlen(c->output_file);
+        c->cache_path = safe_malloc(path_len + sizeof(OUTPUT_CACHE_SUFFIX));
+        memcpy(c->cache_path, c->output_file, path_len);
+        memcpy(c->cache_path + path_len, OUTPUT_CACHE_SUFFIX, sizeof(OUTPUT_CACHE_SUFFIX));
+        int loaded = output_cache_load(&c->cache_old, c->cache_path);
+        if (loaded > 0) cli_debug_log(cfg, "Incremental cache: %zu regions in %s", c->cache_old.count, c->cache_path);
+        else if (loaded < 0) cli_debug_log(cfg, "Incremental cache: %s is from another compiler build, ignored", c->cache_path);
+        else cli_debug_log(cfg, "Incremental cache: %s does not exist yet", c->cache_path);
+
+        IncrementalState* state = &c->incremental;
+        state->parser = c->parser;
+        state->cg = cg;
+        state->old = &c->cache_old;
+        state->defs = state->layout = HASH64_INIT;
+        cli_debug_log(cfg, "Starting incremental parse and machine code generation...");
+        incremental_compile(state);
+        compile_write(&c->code, c->out_fp, c->output_file, cg->stats);
+        c->code_bytes = c->code.len;
+        double save_start = stats_now();
+        if (output_cache_save(&state->fresh, c->cache_path) != 0) error("Cannot write cache file: %s", c->cache_path);
+        c->stats.seconds[STATS_WRITE] += stats_now() - save_start;
+        cli_debug_log(cfg, "Incremental cache: %zu of %zu regions reused (%.1f%% hit rate), "
+                      "%zu of %zu source bytes not re-lexed",
+                      state->reused, state->regions, state->regions ? 100.0 * state->reused / state->regions : 0.0,
+                      state->reused_bytes, c->lexer->size);
+    } else if (cfg->stream) {
+        // Streaming: each statement is emitted and freed as soon as it is parsed
+        StreamState state = {cg, c->out_fp, 0, c->output_file};
+        cli_debug_log(cfg, "Starting streaming parse and machine code generation...");
+        parser_parse_stream(c->parser, stream_statement, &state);
+        stream_flush(&state, 1);
+        c->code_bytes = state.flushed;
+    } else {
+        cli_debug_log(cfg, "Starting source code parsing...");
+        AstNode* ast = parser_parse_file(c->parser);
+        cli_debug_log(cfg, "Source code parsing completed, AST generated");
+
+        // Code generation, written out with a single write
+        cli_debug_log(cfg, "Starting machine code generation...");
+        codegen_generate(cg, ast);
+        compile_write(&c->code, c->out_fp, c->output_file, cg->stats);
+        c->code_bytes = c->code.len;
+    }
+    FILE* out_fp = c->out_fp;
+    c->out_fp = NULL;
+    double close_start = stats_now();
+    if (fclose(out_fp) != 0) error("Cannot write output file: %s", c->output_file);
+    c->stats.seconds[STATS_WRITE] += stats_now() - close_start;
+    if (cfg->stats) compile_stats(c, start, front, stats_now());
+    cli_debug_log(cfg, "Machine code generation completed (%zu bytes)", c->code_bytes);
+    cli_debug_log(cfg, "IR: %zu instructions, %zu removed by constant propagation and dead-store elimination",
+                  cg->ir_insns, cg->ir_removed);
+    cli_debug_log(cfg, "Peephole: %zu bytes saved", cg->bytes_saved);
+    cli_debug_log(cfg, "AST arena: %zu bytes peak, %zu bytes reserved",
+                  c->parser->arena->peak, c->parser->arena->reserved);
+    cli_debug_log(cfg, "Symbols: %zu constants (%zu slots, %zu bytes reserved)",
+                  c->parser->symbols.count, c->parser->symbols.cap, c->parser->symbols.arena.reserved);
+}
+
+// Free resources (the AST lives in the parser's arena and goes with it); a failed
+// compilation also removes its partial output
+static void compilation_free(Compilation* c, int failed) {
+    if (c->out_fp) fclose(c->out_fp);
+    if (failed && c->created_output) remove(c->output_file);
+    if (c->has_codegen) codegen_cleanup(&c->cg);
+    emitter_free(&c->code);
+    output_cache_free(&c->incremental.fresh);
+    output_cache_free(&c->cache_old);
+    free(c->cache_path);
+    parser_free(c->parser);
+    lexer_free(c->lexer);
+    if (c->in_fp) fclose(c->in_fp);
+}
+
+// -------------------------- Batch mode -------------------------
+// Files are compiled concurrently on the work-stealing pool. Each compilation is
+// independent (codegen keeps no global state) and traps its own errors, so a bad file
+// is reported instead of ending the process.
+typedef struct {
+    int failed;
+    int worker;
+    char* diagnostics;         // Everything the compilation reported before it failed
+    size_t diagnostics_len;
+    size_t code_bytes;
+    double seconds;            // Wall time of this file
+    char message[sizeof(((ErrorTrap*)0)->message)];
+} BatchResult;
+
+typedef struct {
+    const EccConfig* cfg;
+    BatchResult* results;
+} Batch;
+
+static double batch_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Compile with errors trapped: returns 1 with the message that stopped the compilation.
+// The trap lives in its own frame: nothing this function modifies is read after longjmp
+static int compile_trapped(Compilation* c, char message[sizeof(((ErrorTrap*)0)->message)]) {
+    ErrorTrap trap;
+    if (setjmp(trap.env) != 0) {
+        memcpy(message, trap.message, sizeof(trap.message));
+        return 1;
+    }
+    error_trap_set(&trap);
+    compile_file(c);
+    error_trap_set(NULL);
+    return 0;
+}
+
+static void batch_compile(void* ctx, size_t job, int worker) {
+    Batch* batch = ctx;
+    const EccFile* file = &batch->cfg->files[job];
+    BatchResult* result = &batch->results[job];
+    double start = batch_clock();
+    Compilation c = {0};
+    c.cfg = batch->cfg;
+    c.input_file = file->input_file;
+    c.output_file = file->output_file;
+    // Diagnostics are collected per file and printed with its result (workers would interleave)
+    c.diagnostics = open_memstream(&result->diagnostics, &result->diagnostics_len);
+    result->failed = compile_trapped(&c, result->message);
+    result->code_bytes = c.code_bytes;
+    compilation_free(&c, result->failed);
+    if (c.diagnostics) fclose(c.diagnostics);
+    result->worker = worker;
+    result->seconds = batch_clock() - start;
+}
+
+static int batch_run(const EccConfig* cfg) {
+    Batch batch = {cfg, calloc(cfg->file_count, sizeof(BatchResult))};
+    if (!batch.results) error("Memory allocation failed (batch of %zu files)", cfg->file_count);
+    int threads = cfg->jobs > 0 ? cfg->jobs : pool_cpu_count();
+    if ((size_t)threads > cfg->file_count) threads = (int)cfg->file_count;
+
+    double start = batch_clock();
+    size_t stolen = pool_run(cfg->file_count, threads, batch_compile, &batch);
+    double wall = batch_clock() - start;
+
+    size_t failed = 0;
+    double busy = 0;
+    for (size_t i = 0; i < cfg->file_count; i++) {
+        const BatchResult* r = &batch.results[i];
+        busy += r->seconds;
+        if (r->failed) {
+            failed++;
+            printf("[FAIL] %s: %s (%.2f ms)\n", cfg->files[i].input_file, r->message, r->seconds * 1e3);
+            if (r->diagnostics_len) printf("%s", r->diagnostics);
+        } else {
+            printf("[OK]   %s -> %s: %zu bytes, %.2f ms (worker %d)\n", cfg->files[i].input_file,
+                   cfg->files[i].output_file, r->code_bytes, r->seconds * 1e3, r->worker);
+        }
+    }
+    printf("Batch: %zu of %zu files compiled, %zu failed; %d workers, %zu files stolen\n",
+           cfg->file_count - failed, cfg->file_count, failed, threads, stolen);
+    printf("Wall time: %.2f ms (%.2f ms compiling, %.1fx parallel speedup)\n",
+           wall * 1e3, busy * 1e3, wall > 0 ? busy / wall : 1.0);
+    for (size_t i = 0; i < cfg->file_count; i++) free(batch.results[i].diagnostics);
+    free(batch.results);
+    return failed ? 1 : 0;
+}
+
 // -------------------------- New main function using cli module -------------------------
 int main(int argc, char* argv[]) {
     // 1. Parse command line arguments with new module
     EccConfig cfg = cli_parse_args(argc, argv);
+    if (cfg.batch) {
+        int status = batch_run(&cfg);
+        cli_free_config(&cfg);
+        return status;
+    }
+    if (cfg.serve) {
+        EccOptions options = {1, cfg.max_errors};
+        return server_run(cfg.socket_path, cfg.jobs, &options);
+    }
 
     // 2. Debug mode: print welcome message
     cli_print_welcome(&cfg);
 
-    // 3. Open input file (with debug logging)
-    FILE* in_fp = fopen(cfg.input_file, "r");
-    if (!in_fp) error("Cannot open input file: %s", cfg.input_file);
-    cli_debug_log(&cfg, "Successfully opened input file");
-
-    // 4. Lexical analysis (original logic with new logging)
-    Lexer* lexer = lexer_init(in_fp);
-    cli_debug_log(&cfg, "Lexer initialization completed");
-
-    // 5. Syntax analysis (original logic with new logging)
-    Parser* parser = parser_init(lexer);
-    cli_debug_log(&cfg, "Starting source code parsing...");
-    AstNode* ast = parser_parse_file(parser);
-    cli_debug_log(&cfg, "Source code parsing completed, AST generated");
-
-    // 6. Code generation (original logic with new logging)
-    FILE* out_fp = fopen(cfg.output_file, "wb");
-    if (!out_fp) error("Cannot create output file: %s", cfg.output_file);
-    codegen_init(out_fp);
-    cli_debug_log(&cfg, "Starting machine code generation...");
-    codegen_generate(ast);
-    codegen_cleanup();
-    fclose(out_fp);
-    cli_debug_log(&cfg, "Machine code generation completed");
-
-    // 7. Free resources (original logic)
-    ast_free(ast);
-    parser_free(parser);
-    lexer_free(lexer);
-    fclose(in_fp);
+    // 3. Compile: every recoverable error is reported, then the compilation fails
+    Compilation c = {0};
+    c.cfg = &cfg;
+    c.input_file = cfg.input_file;
+    c.output_file = cfg.output_file;
+    c.diagnostics = stderr;
+    char message[sizeof(((ErrorTrap*)0)->message)];
+    if (compile_trapped(&c, message)) {
+        fprintf(stderr, "[ERROR] %s\n", message);
+        compilation_free(&c, 1);
+        return 1;
+    }
+    if (cfg.stats == 1) stats_print_table(&c.stats, cfg.input_file, stdout);
+    else if (cfg.stats == 2) stats_print_json(&c.stats, cfg.input_file, stdout);
+    compilation_free(&c, 0);
 
     if (cfg.is_debug) {
         printf("----------------------------------------\n");
         printf("Debug session ended\n");
     }
     return 0;
-}
\ No newline at end of file
+}
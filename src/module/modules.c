@@ -2,32 +2,59 @@
 #include "../common/utils.h"
 #include <string.h>
 
-// x86实modemoduledefinition（support的16位register）
-static Module x86_real_module = {
-    .name = "x86_real",
-    .reg_count = 8,
-    .registers = {
-        {"ax", 16}, {"bx", 16}, {"cx", 16}, {"dx", 16},
-        {"sp", 16}, {"bp", 16}, {"si", 16}, {"di", 16}
+// 完美哈希：名字的第1个、第2个、最后1个字符和长度（register名至少2个字符）
+#define MODULE_SLOT(c0, c1, cl, len) (((c0) * 5 + (c1) * 12 + (cl) * 23 + (len) * 7) & (MODULE_SLOTS - 1))
+
+// 每个module一张哈希表：{[slot] = {名字, 长度, 位数, 编号}, ...}
+#define MODULE_REG(reg, c0, c1, cl, bits, number) \
+    [MODULE_SLOT(c0, c1, cl, sizeof(#reg) - 1)] = {#reg, sizeof(#reg) - 1, bits, number},
+#define MODULE_REG_COUNT(reg, c0, c1, cl, bits, number) +1
+#define MODULE(name, bits, regs) static const ModuleRegister name##_regs[MODULE_SLOTS] = {regs(MODULE_REG)};
+#include "modules.def"
+#undef MODULE
+
+// 编译期证明哈希是完美的：冲突会变成重复的case label
+#define MODULE_CASE(reg, c0, c1, cl, bits, number) case MODULE_SLOT(c0, c1, cl, sizeof(#reg) - 1):
+#define MODULE(name, bits, regs)                          \
+    static inline void name##_hash_is_perfect(int slot) { \
+        switch (slot) {                                   \
+            regs(MODULE_CASE) break;                      \
+        }                                                 \
     }
+#include "modules.def"
+#undef MODULE
+
+const Module module_table[] = {
+#define MODULE(name, bits, regs) {#name, bits, name##_regs, 0 regs(MODULE_REG_COUNT)},
+#include "modules.def"
+#undef MODULE
 };
 
-// loadmodule（目前onlysupportx86_real）
-Module* module_load(const char* name) {
-    if (strcmp(name, "x86_real") == 0) {
-        return &x86_real_module;
-    } else {
-        error("Unknownmodule：%s（currentonlysupportx86_real）", name);
-        return NULL;
+const int module_count = sizeof(module_table) / sizeof(module_table[0]);
+
+const Module* module_find(const char* name, size_t len) {
+    for (int i = 0; i < module_count; i++) {
+        const Module* module = &module_table[i];
+        if (strlen(module->name) == len && memcmp(module->name, name, len) == 0) return module;
     }
+    return NULL;
+}
+
+// loadmodule：表是静态的，load只是查找
+const Module* module_load(const char* name) {
+    const Module* module = module_find(name, strlen(name));
+    if (!module) error("Unknown module: %s", name);
+    return module;
+}
+
+const ModuleRegister* module_find_reg(const Module* module, const char* name, size_t len) {
+    if (len < 2) return NULL;
+    const ModuleRegister* reg = &module->regs[MODULE_SLOT((unsigned char)name[0], (unsigned char)name[1],
+                                                          (unsigned char)name[len - 1], len)];
+    return reg->name && reg->len == len && memcmp(reg->name, name, len) == 0 ? reg : NULL;
 }
 
 // checkmodulewhethersupportcertainregister
-int module_has_reg(Module* module, const char* reg_name) {
-    for (int i = 0; i < module->reg_count; i++) {
-        if (strcmp(reg_name, module->registers[i].name) == 0) {
-            return 1;  // support
-        }
-    }
-    return 0;  // 不support
-}
\ No newline at end of file
+int module_has_reg(const Module* module, const char* reg_name) {
+    return module_find_reg(module, reg_name, strlen(reg_name)) != NULL;
+}
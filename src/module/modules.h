@@ -1,23 +1,45 @@
 #ifndef MODULES_H
 #define MODULES_H
 
-// module中的registermessage
+#include <stddef.h>
+#include <stdint.h>
+
+// module表在modules.def里（X-macro），编译期生成，不需要运行时加载或初始化
+// 每个module的register放在一张完美哈希表里：register验证是一次slot计算加一次memcmp，
+// 与module数量和register数量都无关
+
+#define MODULE_SLOTS 128  // 每张哈希表的slot数（2的幂，不小于最大module的register数）
+
+// module中的registermessage（name为NULL的是空slot）
 typedef struct {
-    char name[32];  // register名（如ax）
-    int bits;       // 位数（16/32/64）
+    const char* name;  // register名（如ax）
+    uint8_t len;       // 名字长度
+    uint8_t bits;      // 位数（16/32/64）
+    uint8_t number;    // backend的register编号
 } ModuleRegister;
 
 // module结构体
 typedef struct {
-    char name[32];  // module名（如x86_real）
-    ModuleRegister registers[64];  // support的register
-    int reg_count;  // register数量
+    const char* name;                // module名（如x86_real），也是backend名
+    int bits;                        // 通用register位数
+    const ModuleRegister* regs;      // 完美哈希表（MODULE_SLOTS个slot）
+    int reg_count;                   // register数量
 } Module;
 
-// loadmodule（如use x86_real）
-Module* module_load(const char* name);
+// 按名字查找module（名字是span，不需要'\0'结尾），不存在返回NULL
+const Module* module_find(const char* name, size_t len);
+
+// loadmodule（如use x86_real），不存在时报错
+const Module* module_load(const char* name);
+
+// 按名字查找module中的register（span），不support返回NULL；O(1)
+const ModuleRegister* module_find_reg(const Module* module, const char* name, size_t len);
 
 // checkmodulewhethersupportcertainregister
-int module_has_reg(Module* module, const char* reg_name);
+int module_has_reg(const Module* module, const char* reg_name);
+
+// 所有module（module_count个），按modules.def的顺序
+extern const Module module_table[];
+extern const int module_count;
 
-#endif // MODULES_H
\ No newline at end of file
+#endif // MODULES_H
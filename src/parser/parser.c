@@ -1,25 +1,99 @@
 #include "parser.h"
+#include "../common/stats.h"
 #include "../common/utils.h"
 #include <string.h>
 #include <stdlib.h>
 
-// -------------------------- Helperfunction：初始化基础AST节点 --------------------------
-static AstNode* ast_node_init(AstNodeType type, int line) {
-    AstNode* node = malloc(sizeof(AstNode));
-    if (!node) error("memoryallocationfailed（ast_node_init）");
+// -------------------------- Helperfunction：从arena分配并初始化AST节点 --------------------------
+// size是具体节点结构体的大小（RegAssignNode等），基础字段在这里一次初始化，不再额外分配
+static void* ast_node_new(Parser* parser, size_t size, AstNodeType type, int line) {
+    AstNode* node = arena_calloc(parser->arena, size);
+    parser->node_count++;
     node->type = type;
     node->next = NULL;
     node->line = line;
     return node;
 }
 
+// -------------------------- Helperfunction：复制标识符到arena --------------------------
+// Token只是源码span，节点需要以'\0'结尾的名字；副本放在arena里，长度不受限制
+static const char* parser_intern_name(Parser* parser, const Token* tok) {
+    return arena_strndup(parser->arena, lexer_token_text(parser->lexer, tok), tok->len);
+}
+
+// -------------------------- Helperfunction：读下一个Token --------------------------
+static void parser_refill(Parser* parser) {
+    const char* from = parser->lexer->cur;
+    double start = stats_now();
+    int n = 0;
+    TokenType type;
+    do {
+        Token tok = lexer_next_token(parser->lexer);
+        parser->batch[n++] = tok;
+        type = tok.type;
+    } while (n < PARSER_TOKEN_BATCH && type != TOKEN_EOF && type != TOKEN_SEMICOLON && type != TOKEN_LBRACE &&
+             type != TOKEN_RBRACE);
+    *parser->lex_seconds += stats_now() - start;
+    parser->token_count += (size_t)(n - (type == TOKEN_EOF));
+    parser->lexed_bytes += (size_t)(parser->lexer->cur - from);
+    parser->batch_pos = 0;
+    parser->batch_len = n;
+}
+
+static Token parser_next_token(Parser* parser) {
+    if (!parser->lex_seconds) return lexer_next_token(parser->lexer);
+    if (parser->batch_pos == parser->batch_len) parser_refill(parser);
+    return parser->batch[parser->batch_pos++];
+}
+
+void parser_time_lexer(Parser* parser, double* seconds) {
+    parser->lex_seconds = seconds;
+    parser->token_count = parser->current_tok.type != TOKEN_EOF;  // Read by parser_start, not timed
+    parser->lexed_bytes = (size_t)(parser->lexer->cur - parser->lexer->src);
+}
+
 // -------------------------- 1. 解析器初始化 --------------------------
-Parser* parser_init(Lexer* lexer) {
-    Parser* parser = malloc(sizeof(Parser));
-    if (!parser) error("memoryallocationfailed（parser_init）");
+// 一个编译单元开始时的状态（parser_init_arena和parser_reset共用）
+static void parser_start(Parser* parser, Lexer* lexer) {
     parser->lexer = lexer;
+    parser->current_func = NULL;
+    parser->binding_count = 0;
+    parser->scope_base = 0;
+    parser->block_depth = 0;
+    parser->stmt_total = 0;
+    parser->node_count = 0;
+    parser->module = &module_table[0];
+    parser->errors = lexer->errors;
+    parser->lex_seconds = NULL;
+    parser->token_count = parser->lexed_bytes = 0;
+    parser->batch_pos = parser->batch_len = 0;
     // 预读第一个Token（语法分析的关键：通过currentToken判断下一步解析逻辑）
     parser->current_tok = lexer_next_token(lexer);
+}
+
+Parser* parser_init_arena(Lexer* lexer, Arena* arena) {
+    Parser* parser = malloc(sizeof(Parser));
+    if (!parser) error("memoryallocationfailed（parser_init）");
+    parser->arena = arena;
+    parser->owns_arena = 0;
+    symtab_init(&parser->symbols);
+    symtab_init(&parser->functions);
+    parser_start(parser, lexer);
+    return parser;
+}
+
+void parser_reset(Parser* parser, Lexer* lexer) {
+    if (parser->owns_arena) arena_reset(parser->arena);
+    symtab_reset(&parser->symbols);
+    symtab_reset(&parser->functions);
+    parser_start(parser, lexer);
+}
+
+Parser* parser_init(Lexer* lexer) {
+    Arena* arena = safe_malloc(sizeof(Arena));
+    arena_init(arena, 0);
+    Parser* parser = parser_init_arena(lexer, arena);
+    parser->owns_arena = 1;
     return parser;
 }
 
@@ -27,47 +101,182 @@ Parser* parser_init(Lexer* lexer) {
 void parser_match(Parser* parser, TokenType expected_type) {
     if (parser->current_tok.type == expected_type) {
         // 匹配successfully：消耗currentToken，读下一个
-        parser->current_tok = lexer_next_token(parser->lexer);
+        parser->current_tok = parser_next_token(parser);
     } else {
         // 匹配failed：报Syntax error（带上line，方便定位）
-        error("Syntax error（line：%d）：Expected%s，Actual%s（值：%s）",
+        error("Syntax error（line：%d）：Expected%s，Actual%s（值：%.*s）",
               parser->current_tok.line,
               token_type_to_str(expected_type),
               token_type_to_str(parser->current_tok.type),
-              parser->current_tok.value);
+              parser->current_tok.len,
+              lexer_token_text(parser->lexer, &parser->current_tok));
     }
 }
 
-// -------------------------- 3. 解析constant表达式（比如0x1234、'A'） --------------------------
-// Temporarily只support“直接constant”（后续再加变量引用，比如VIDEO_MEM）
-ConstExpr parser_parse_const_expr(Parser* parser) {
-    ConstExpr expr;
+// -------------------------- 3. 解析constant表达式（比如0x1234、'A'、VIDEO_MEM + 0xA0） --------------------------
+// 递归下降，每一层直接返回折叠后的值，不生成表达式节点；递归深度只与括号嵌套有关
+// 只有引用functionparameter的子表达式才在arena里建Expr树
+typedef struct {
+    Expr* expr;    // NULL=编译期constant
+    uint32_t num;  // constant值（expr为NULL时有效）
+} ParsedValue;
+
+static ParsedValue parser_fold_or(Parser* parser);
+
+static void parser_expect_constant(Parser* parser) {
     Token tok = parser->current_tok;
+    error("Syntax error（line：%d）：Expectedconstant，Actual%s（值：%.*s）",
+          tok.line, token_type_to_str(tok.type), tok.len, lexer_token_text(parser->lexer, &tok));
+}
+
+static Expr* expr_new(Parser* parser, ExprKind kind) {
+    Expr* expr = arena_calloc(parser->arena, sizeof(Expr));
+    parser->node_count++;
+    expr->kind = kind;
+    return expr;
+}
+
+static Expr* parsed_to_expr(Parser* parser, ParsedValue v) {
+    if (v.expr) return v.expr;
+    Expr* expr = expr_new(parser, EXPR_CONST);
+    expr->value = v.num;
+    return expr;
+}
+
+// lhs op rhs：两边都是constant时直接折叠
+static ParsedValue parser_combine(Parser* parser, TokenType op, ParsedValue lhs, ParsedValue rhs, int line) {
+    if (!lhs.expr && !rhs.expr) {
+        uint32_t a = lhs.num, b = rhs.num;
+        switch (op) {
+            case TOKEN_PLUS:      return (ParsedValue){NULL, a + b};
+            case TOKEN_MINUS:     return (ParsedValue){NULL, a - b};
+            case TOKEN_ASTERISK:  return (ParsedValue){NULL, a * b};
+            case TOKEN_AMPERSAND: return (ParsedValue){NULL, a & b};
+            case TOKEN_PIPE:      return (ParsedValue){NULL, a | b};
+            default:
+                if (b == 0) error("Division by zero in constant expression（line：%d）", line);
+                return (ParsedValue){NULL, a / b};
+        }
+    }
+    Expr* expr = expr_new(parser, EXPR_BINARY);
+    expr->op = (uint8_t)op;
+    expr->lhs = parsed_to_expr(parser, lhs);
+    expr->rhs = parsed_to_expr(parser, rhs);
+    return (ParsedValue){expr, 0};
+}
+
+// 名字的绑定序号（parameter、循环变量或变量，内层优先），不是绑定返回-1
+static int parser_find_binding(Parser* parser, const char* name, size_t len) {
+    for (int i = parser->binding_count; i-- > parser->scope_base;) {
+        if (strlen(parser->bindings[i]) == len && memcmp(parser->bindings[i], name, len) == 0) return i;
+    }
+    return -1;
+}
+
+static void parser_bind(Parser* parser, const char* name, int is_var, int line) {
+    if (parser->binding_count == PARSER_MAX_BINDINGS) {
+        error("Too many parameters and variables in scope（line：%d）：%s", line, name);
+    }
+    parser->binding_is_var[parser->binding_count] = (uint8_t)is_var;
+    parser->bindings[parser->binding_count++] = name;
+}
 
+// primary := number | 字符 | constant名 | parameter/循环变量名 | '(' expr ')' | '-' primary
+static ParsedValue parser_fold_primary(Parser* parser) {
+    Token tok = parser->current_tok;
     switch (tok.type) {
-        // 十六basenumber：0x1234
         case TOKEN_NUM_HEX:
-            expr.type = CONST_NUM;
-            expr.value.num_val = str_to_hex(tok.value);  // 用common里的工具function转数值
-            parser_match(parser, TOKEN_NUM_HEX);
-            break;
-        // 十basenumber：123
         case TOKEN_NUM_DEC:
-            expr.type = CONST_NUM;
-            expr.value.num_val = str_to_dec(tok.value);
-            parser_match(parser, TOKEN_NUM_DEC);
-            break;
-        // 字符：'A'
         case TOKEN_CHAR:
-            expr.type = CONST_CHAR;
-            expr.value.char_val = tok.value[0];  // tok.value存储的是字符本身（比如"A"）
-            parser_match(parser, TOKEN_CHAR);
-            break;
-        // 其他type（比如标识符，后续扩展变量引用）
+            parser_match(parser, tok.type);
+            return (ParsedValue){NULL, tok.num};  // lexer已经解码好数值（字符constant是字符本身）
+        case TOKEN_ID: {
+            const char* name = lexer_token_text(parser->lexer, &tok);
+            int param = parser_find_binding(parser, name, tok.len);
+            parser_match(parser, TOKEN_ID);
+            if (param >= 0) {
+                Expr* expr = expr_new(parser, EXPR_PARAM);
+                expr->param = (uint16_t)param;
+                return (ParsedValue){expr, 0};
+            }
+            Symbol* sym = symtab_lookup(&parser->symbols, name, tok.len);
+            if (!sym) error("Undefined constant（line：%d）：%.*s", tok.line, tok.len, name);
+            return (ParsedValue){NULL, sym->value};
+        }
+        case TOKEN_LPAREN: {
+            parser_match(parser, TOKEN_LPAREN);
+            ParsedValue value = parser_fold_or(parser);
+            parser_match(parser, TOKEN_RPAREN);
+            return value;
+        }
+        case TOKEN_MINUS:
+            parser_match(parser, TOKEN_MINUS);
+            return parser_combine(parser, TOKEN_MINUS, (ParsedValue){NULL, 0}, parser_fold_primary(parser), tok.line);
         default:
-            error("Syntax error（line：%d）：Expectedconstant，Actual%s（值：%s）",
-                  tok.line, token_type_to_str(tok.type), tok.value);
+            parser_expect_constant(parser);
+    }
+    return (ParsedValue){NULL, 0};  // unreachable
+}
+
+static ParsedValue parser_fold_mul(Parser* parser) {
+    ParsedValue value = parser_fold_primary(parser);
+    while (parser->current_tok.type == TOKEN_ASTERISK || parser->current_tok.type == TOKEN_SLASH) {
+        Token op = parser->current_tok;
+        parser_match(parser, op.type);
+        value = parser_combine(parser, op.type, value, parser_fold_primary(parser), op.line);
+    }
+    return value;
+}
+
+static ParsedValue parser_fold_add(Parser* parser) {
+    ParsedValue value = parser_fold_mul(parser);
+    while (parser->current_tok.type == TOKEN_PLUS || parser->current_tok.type == TOKEN_MINUS) {
+        Token op = parser->current_tok;
+        parser_match(parser, op.type);
+        value = parser_combine(parser, op.type, value, parser_fold_mul(parser), op.line);
+    }
+    return value;
+}
+
+static ParsedValue parser_fold_and(Parser* parser) {
+    ParsedValue value = parser_fold_add(parser);
+    while (parser->current_tok.type == TOKEN_AMPERSAND) {
+        Token op = parser->current_tok;
+        parser_match(parser, TOKEN_AMPERSAND);
+        value = parser_combine(parser, TOKEN_AMPERSAND, value, parser_fold_add(parser), op.line);
+    }
+    return value;
+}
+
+static ParsedValue parser_fold_or(Parser* parser) {
+    ParsedValue value = parser_fold_and(parser);
+    while (parser->current_tok.type == TOKEN_PIPE) {
+        Token op = parser->current_tok;
+        parser_match(parser, TOKEN_PIPE);
+        value = parser_combine(parser, TOKEN_PIPE, value, parser_fold_and(parser), op.line);
+    }
+    return value;
+}
+
+ConstExpr parser_parse_const_expr(Parser* parser) {
+    ConstExpr expr;
+    Token first = parser->current_tok;
+    Symbol* sym = NULL;
+    if (first.type == TOKEN_ID) {
+        sym = symtab_lookup(&parser->symbols, lexer_token_text(parser->lexer, &first), first.len);
+    }
+
+    ParsedValue value = parser_fold_or(parser);
+    if (value.expr) {
+        expr.type = CONST_EXPR;
+        expr.value.expr = value.expr;
+        return expr;
     }
+    expr.value.num_val = value.num;
+
+    // 以字符开头（'A'、'A' + 1或者definition为字符的constant）且结果仍是一个byte时保留CONST_CHAR
+    int is_char = first.type == TOKEN_CHAR || (sym && sym->is_char);
+    expr.type = (is_char && expr.value.num_val <= 0xFF) ? CONST_CHAR : CONST_NUM;
     return expr;
 }
 
@@ -83,8 +292,13 @@ static AstNode* parser_parse_reg_assign(Parser* parser) {
     Token reg_tok = parser->current_tok;
     parser_match(parser, TOKEN_ID);
 
-    // Temporarily跳过register验证，后续可以加入module验证
-    // TODO: 使用module_has_reg验证register
+    // register必须属于current module（完美哈希，一次查表）
+    const char* reg_text = lexer_token_text(parser->lexer, &reg_tok);
+    const ModuleRegister* reg = module_find_reg(parser->module, reg_text, reg_tok.len);
+    if (!reg) {
+        error("Unknown register（line：%d）：%.*s（module %s不support）", reg_tok.line, reg_tok.len, reg_text,
+              parser->module->name);
+    }
 
     // 步骤3：匹配"="
     parser_match(parser, TOKEN_EQUALS);
@@ -95,16 +309,49 @@ static AstNode* parser_parse_reg_assign(Parser* parser) {
     // 步骤5：匹配";"（语句结束）
     parser_match(parser, TOKEN_SEMICOLON);
 
-    // 步骤6：构建registerassignmentAST节点
-    node = malloc(sizeof(RegAssignNode));
-    if (!node) error("memoryallocationfailed（parser_parse_reg_assign）");
-    node->base = *ast_node_init(AST_REG_ASSIGN, line);  // 初始化基础节点
-    strncpy(node->reg_name, reg_tok.value, sizeof(node->reg_name)-1);
+    // 步骤6：构建registerassignmentAST节点（一次arena分配）
+    node = ast_node_new(parser, sizeof(RegAssignNode), AST_REG_ASSIGN, line);
+    node->reg_name = parser_intern_name(parser, &reg_tok);
+    node->reg = reg->number;
     node->value = value;
 
     return (AstNode*)node;  // 向上转型为基础AstNode
 }
 
+// -------------------------- 4.1 解析memoryassignment语句（mem.byte[0xb8000] = 'A';） --------------------------
+static AstNode* parser_parse_mem_assign(Parser* parser) {
+    int line = parser->current_tok.line;
+
+    // 步骤1：匹配"mem."
+    parser_match(parser, TOKEN_MEM);
+
+    // 步骤2：匹配宽度（byte/word/dword）
+    Token width_tok = parser->current_tok;
+    const char* width_text = lexer_token_text(parser->lexer, &width_tok);
+    parser_match(parser, TOKEN_ID);
+    uint8_t width = 0;
+    if (width_tok.len == 4 && memcmp(width_text, "byte", 4) == 0) width = 1;
+    else if (width_tok.len == 4 && memcmp(width_text, "word", 4) == 0) width = 2;
+    else if (width_tok.len == 5 && memcmp(width_text, "dword", 5) == 0) width = 4;
+    else error("Syntax error（line：%d）：Unknownmemory宽度%.*s（byte/word/dword）", line, width_tok.len, width_text);
+
+    // 步骤3：[地址]（constant表达式，编译期折叠）
+    parser_match(parser, TOKEN_LBRACKET);
+    ConstExpr addr = parser_parse_const_expr(parser);
+    parser_match(parser, TOKEN_RBRACKET);
+
+    // 步骤4：= 值;
+    parser_match(parser, TOKEN_EQUALS);
+    ConstExpr value = parser_parse_const_expr(parser);
+    parser_match(parser, TOKEN_SEMICOLON);
+
+    MemAssignNode* node = ast_node_new(parser, sizeof(MemAssignNode), AST_MEM_ASSIGN, line);
+    node->width = width;
+    node->addr = addr;
+    node->value = value;
+    return (AstNode*)node;
+}
+
 // -------------------------- 5. 解析constantdefinition语句（const VIDEO_MEM = 0xb8000;） --------------------------
 static AstNode* parser_parse_const_def(Parser* parser) {
     int line = parser->current_tok.line;
@@ -120,33 +367,255 @@ static AstNode* parser_parse_const_def(Parser* parser) {
     // 步骤3：匹配"="
     parser_match(parser, TOKEN_EQUALS);
 
-    // 步骤4：解析constant值（比如0xb8000）
+    // 步骤4：解析constant值（比如0xb8000），必须能在编译期求值
     ConstExpr value = parser_parse_const_expr(parser);
+    if (value.type == CONST_EXPR) {
+        error("Constant %.*s depends on a function parameter（line：%d）", const_tok.len,
+              lexer_token_text(parser->lexer, &const_tok), line);
+    }
 
     // 步骤5：匹配";"
     parser_match(parser, TOKEN_SEMICOLON);
 
-    // 步骤6：构建constantdefinitionAST节点
-    node = malloc(sizeof(ConstDefNode));
-    if (!node) error("memoryallocationfailed（parser_parse_const_def）");
-    node->base = *ast_node_init(AST_CONST_DEF, line);
-    strncpy(node->const_name, const_tok.value, sizeof(node->const_name)-1);
+    // 步骤6：记录到符号表，后面的表达式可以引用（重复definition报错）
+    const char* name = lexer_token_text(parser->lexer, &const_tok);
+    if (!symtab_define(&parser->symbols, name, const_tok.len, value.value.num_val, value.type == CONST_CHAR, line)) {
+        error("Constant redefined（line：%d）：%.*s（first defined at line %d）", line, const_tok.len, name,
+              symtab_lookup(&parser->symbols, name, const_tok.len)->line);
+    }
+
+    // 步骤7：构建constantdefinitionAST节点
+    node = ast_node_new(parser, sizeof(ConstDefNode), AST_CONST_DEF, line);
+    node->const_name = parser_intern_name(parser, &const_tok);
     node->value = value;
 
     return (AstNode*)node;
 }
 
+// -------------------------- 5.1 解析code block（{ 语句... }），返回语句链表 --------------------------
+// 块里definition的变量在}之后不再可见
+static AstNode* parser_parse_block(Parser* parser, const char* what, int line) {
+    parser_match(parser, TOKEN_LBRACE);
+    int bindings = parser->binding_count;
+    parser->block_depth++;
+    AstNode* head = NULL;
+    AstNode* last = NULL;
+    while (parser->current_tok.type != TOKEN_RBRACE) {
+        if (parser->current_tok.type == TOKEN_EOF) error("Syntax error（line：%d）：%s缺少}", line, what);
+        AstNode* stmt = parser_parse_statement_recover(parser);
+        if (!stmt) continue;
+        if (last) last->next = stmt;
+        else head = stmt;
+        last = stmt;
+    }
+    parser_match(parser, TOKEN_RBRACE);
+    parser->block_depth--;
+    parser->binding_count = bindings;
+    return head;
+}
+
+// -------------------------- 5.2 解析functiondefinition（func print_char(c, x, y) { ... }） --------------------------
+static AstNode* parser_parse_func_def(Parser* parser) {
+    int line = parser->current_tok.line;
+    if (parser->current_func || parser->block_depth) {
+        error("Syntax error（line：%d）：function只能definition在顶层", line);
+    }
+
+    // 步骤1：func 名字
+    parser_match(parser, TOKEN_FUNC);
+    Token name_tok = parser->current_tok;
+    parser_match(parser, TOKEN_ID);
+
+    FuncDefNode* node = ast_node_new(parser, sizeof(FuncDefNode), AST_FUNC_DEF, line);
+    node->func_name = parser_intern_name(parser, &name_tok);
+    node->is_leaf = 1;
+    node->label = -1;
+
+    // 步骤2：(parameter列表)，parameter是顶层变量之后的param_count个绑定，function体看不到顶层变量
+    node->slot = parser->scope_base = parser->binding_count;
+    parser_match(parser, TOKEN_LPAREN);
+    while (parser->current_tok.type != TOKEN_RPAREN) {
+        if (parser->binding_count > node->slot) parser_match(parser, TOKEN_COMMA);
+        Token param_tok = parser->current_tok;
+        parser_match(parser, TOKEN_ID);
+        parser_bind(parser, parser_intern_name(parser, &param_tok), 0, line);
+    }
+    parser_match(parser, TOKEN_RPAREN);
+    int count = parser->binding_count - node->slot;
+    node->params = arena_alloc(parser->arena, (count ? count : 1) * sizeof(const char*));
+    memcpy(node->params, parser->bindings + node->slot, count * sizeof(const char*));
+    node->param_count = count;
+
+    // 步骤3：先登记function名，function体里可以递归调用自己
+    Symbol* sym = symtab_define(&parser->functions, node->func_name, strlen(node->func_name), 0, 0, line);
+    if (!sym) {
+        error("Function redefined（line：%d）：%s（first defined at line %d）", line, node->func_name,
+              symtab_lookup(&parser->functions, node->func_name, strlen(node->func_name))->line);
+    }
+    sym->node = node;
+
+    // 步骤4：{ 语句... }
+    parser->current_func = node;
+    int before = parser->stmt_total;
+    node->body = parser_parse_block(parser, node->func_name, line);
+    node->stmt_count = parser->stmt_total - before;
+    parser->current_func = NULL;
+    parser->binding_count = node->slot;
+    parser->scope_base = 0;  // function只在顶层definition
+    return (AstNode*)node;
+}
+
+// -------------------------- 5.3 解析function调用语句（print_char('E', 0, 0);） --------------------------
+static AstNode* parser_parse_func_call(Parser* parser) {
+    int line = parser->current_tok.line;
+    Token name_tok = parser->current_tok;
+    const char* name = lexer_token_text(parser->lexer, &name_tok);
+    Symbol* sym = symtab_lookup(&parser->functions, name, name_tok.len);
+    if (!sym) error("Undefined function（line：%d）：%.*s", line, name_tok.len, name);
+    FuncDefNode* target = sym->node;
+    parser_match(parser, TOKEN_ID);
+
+    // (实参列表);
+    parser_match(parser, TOKEN_LPAREN);
+    FuncCallNode* node = ast_node_new(parser, sizeof(FuncCallNode), AST_FUNC_CALL, line);
+    node->func_name = target->func_name;
+    node->target = target;
+    node->args = arena_alloc(parser->arena, (target->param_count ? target->param_count : 1) * sizeof(ConstExpr));
+    while (parser->current_tok.type != TOKEN_RPAREN) {
+        if (node->arg_count > 0) parser_match(parser, TOKEN_COMMA);
+        if (node->arg_count == target->param_count) {
+            error("Too many arguments（line：%d）：%s takes %d", line, target->func_name, target->param_count);
+        }
+        node->args[node->arg_count++] = parser_parse_const_expr(parser);
+    }
+    parser_match(parser, TOKEN_RPAREN);
+    parser_match(parser, TOKEN_SEMICOLON);
+    if (node->arg_count != target->param_count) {
+        error("Too few arguments（line：%d）：%s takes %d, got %d", line, target->func_name,
+              target->param_count, node->arg_count);
+    }
+
+    if (parser->current_func) parser->current_func->is_leaf = 0;
+    return (AstNode*)node;
+}
+
+// -------------------------- 5.4 解析if语句（if x { ... } else if y { ... } else { ... }） --------------------------
+static BlockNode* parser_block_node(Parser* parser, int line, AstNode* statements) {
+    BlockNode* block = ast_node_new(parser, sizeof(BlockNode), AST_BLOCK, line);
+    block->statements = statements;
+    return block;
+}
+
+static AstNode* parser_parse_if(Parser* parser) {
+    int line = parser->current_tok.line;
+    parser_match(parser, TOKEN_IF);
+    IfNode* node = ast_node_new(parser, sizeof(IfNode), AST_IF, line);
+    node->cond = parser_parse_const_expr(parser);
+    node->then_block = parser_block_node(parser, line, parser_parse_block(parser, "if", line));
+
+    if (parser->current_tok.type == TOKEN_ELSE) {
+        int else_line = parser->current_tok.line;
+        parser_match(parser, TOKEN_ELSE);
+        // else if：else分支只有一条if语句
+        AstNode* statements = parser->current_tok.type == TOKEN_IF ? parser_parse_statement(parser)
+                                                                   : parser_parse_block(parser, "else", else_line);
+        node->else_block = parser_block_node(parser, else_line, statements);
+        node->then_block->base.next = (AstNode*)node->else_block;
+    }
+    return (AstNode*)node;
+}
+
+// -------------------------- 5.5 解析while语句（while x { ... }） --------------------------
+static AstNode* parser_parse_while(Parser* parser) {
+    int line = parser->current_tok.line;
+    parser_match(parser, TOKEN_WHILE);
+    WhileNode* node = ast_node_new(parser, sizeof(WhileNode), AST_WHILE, line);
+    node->cond = parser_parse_const_expr(parser);
+    node->body = parser_parse_block(parser, "while", line);
+    return (AstNode*)node;
+}
+
+// -------------------------- 5.6 解析for语句（for i in 0..8 { ... }） --------------------------
+static AstNode* parser_parse_for(Parser* parser) {
+    int line = parser->current_tok.line;
+    parser_match(parser, TOKEN_FOR);
+    Token var_tok = parser->current_tok;
+    parser_match(parser, TOKEN_ID);
+    parser_match(parser, TOKEN_IN);
+
+    ForNode* node = ast_node_new(parser, sizeof(ForNode), AST_FOR, line);
+    node->var_name = parser_intern_name(parser, &var_tok);
+    node->start = parser_parse_const_expr(parser);  // 范围里还不能引用循环变量自己
+    parser_match(parser, TOKEN_DOTDOT);
+    node->end = parser_parse_const_expr(parser);
+
+    // 循环变量只在循环体里可见
+    node->slot = parser->binding_count;
+    parser_bind(parser, node->var_name, 0, line);
+    int before = parser->stmt_total;
+    node->body = parser_parse_block(parser, "for", line);
+    node->stmt_count = parser->stmt_total - before;
+    parser->binding_count--;
+    return (AstNode*)node;
+}
+
+// -------------------------- 5.7 解析变量definition（var x = 0;）和assignment（x = x + 1;） --------------------------
+static AstNode* parser_parse_var_def(Parser* parser) {
+    int line = parser->current_tok.line;
+    parser_match(parser, TOKEN_VAR);
+    Token name_tok = parser->current_tok;
+    parser_match(parser, TOKEN_ID);
+    parser_match(parser, TOKEN_EQUALS);
+    ConstExpr value = parser_parse_const_expr(parser);  // 还不能引用正在definition的变量自己
+    parser_match(parser, TOKEN_SEMICOLON);
+
+    VarAssignNode* node = ast_node_new(parser, sizeof(VarAssignNode), AST_VAR_DEF, line);
+    node->var_name = parser_intern_name(parser, &name_tok);
+    node->slot = parser->binding_count;
+    node->value = value;
+    parser_bind(parser, node->var_name, 1, line);
+    return (AstNode*)node;
+}
+
+static AstNode* parser_parse_var_assign(Parser* parser, int slot) {
+    int line = parser->current_tok.line;
+    if (!parser->binding_is_var[slot]) {
+        error("Cannot assign to parameter or loop variable（line：%d）：%s", line, parser->bindings[slot]);
+    }
+    parser_match(parser, TOKEN_ID);
+    parser_match(parser, TOKEN_EQUALS);
+    VarAssignNode* node = ast_node_new(parser, sizeof(VarAssignNode), AST_VAR_ASSIGN, line);
+    node->var_name = parser->bindings[slot];
+    node->slot = slot;
+    node->value = parser_parse_const_expr(parser);
+    parser_match(parser, TOKEN_SEMICOLON);
+    return (AstNode*)node;
+}
+
+// -------------------------- 5.1 解析module选择语句（use x86_real;） --------------------------
+// 之后的register名按这个module验证；不算语句（stmt_total），只能出现在顶层
+static AstNode* parser_parse_use(Parser* parser) {
+    int line = parser->current_tok.line;
+    if (parser->current_func || parser->block_depth) error("use只能出现在顶层（line：%d）", line);
+    parser_match(parser, TOKEN_USE);
+    Token name_tok = parser->current_tok;
+    parser_match(parser, TOKEN_ID);
+    const Module* module = module_find(lexer_token_text(parser->lexer, &name_tok), name_tok.len);
+    if (!module) {
+        error("Unknown module（line：%d）：%.*s", line, name_tok.len, lexer_token_text(parser->lexer, &name_tok));
+    }
+    parser_match(parser, TOKEN_SEMICOLON);
+    UseNode* node = ast_node_new(parser, sizeof(UseNode), AST_USE, line);
+    node->module = parser->module = module;
+    return (AstNode*)node;
+}
+
 // -------------------------- 6. 解析单个语句（根据currentToken判断语句type） --------------------------
 AstNode* parser_parse_statement(Parser* parser) {
+    if (parser->current_tok.type == TOKEN_USE) return parser_parse_use(parser);
+
+    if (parser->current_tok.type != TOKEN_EOF) parser->stmt_total++;
     switch (parser->current_tok.type) {
-        // 如果currentToken是"use"，跳过module引入语句
-        case TOKEN_USE: {
-            // 简单跳过use语句，不生成AST节点
-            parser_match(parser, TOKEN_USE);
-            parser_match(parser, TOKEN_ID);  // module名
-            parser_match(parser, TOKEN_SEMICOLON);
-            return parser_parse_statement(parser);  // 继续解析下一个语句
-        }
         // 如果currentToken是"reg."，解析registerassignment
         case TOKEN_REG:
             return parser_parse_reg_assign(parser);
@@ -154,26 +623,90 @@ AstNode* parser_parse_statement(Parser* parser) {
         case TOKEN_CONST:
             return parser_parse_const_def(parser);
         // 其他语句type（memassignment、function调用等）后续补充
+        // 如果currentToken是"mem."，解析memoryassignment
         case TOKEN_MEM:
-            error("暂未implementationmemoryassignment解析（line：%d）", parser->current_tok.line);
-            break;
-        case TOKEN_ID:  // 可能是function调用（比如print_char(...)）
-            error("暂未implementationfunction调用解析（line：%d，标识符：%s）",
-                  parser->current_tok.line, parser->current_tok.value);
-            break;
+            return parser_parse_mem_assign(parser);
+        // 如果currentToken是"func"，解析functiondefinition
+        case TOKEN_FUNC:
+            return parser_parse_func_def(parser);
+        case TOKEN_VAR:
+            return parser_parse_var_def(parser);
+        case TOKEN_ID: {  // 变量assignment（x = ...）或function调用（比如print_char(...)）
+            int slot = parser_find_binding(parser, lexer_token_text(parser->lexer, &parser->current_tok),
+                                           parser->current_tok.len);
+            return slot >= 0 ? parser_parse_var_assign(parser, slot) : parser_parse_func_call(parser);
+        }
+        // 控制流
+        case TOKEN_IF:
+            return parser_parse_if(parser);
+        case TOKEN_WHILE:
+            return parser_parse_while(parser);
+        case TOKEN_FOR:
+            return parser_parse_for(parser);
         // 结束节点
         case TOKEN_EOF:
-            return ast_node_init(AST_EOF, parser->current_tok.line);
+            return ast_node_new(parser, sizeof(AstNode), AST_EOF, parser->current_tok.line);
         // Unknown语句type
         default:
-            error("Syntax error（line：%d）：Unknown语句type，Token：%s（值：%s）",
+            error("Syntax error（line：%d）：Unknown语句type，Token：%s（值：%.*s）",
                   parser->current_tok.line,
                   token_type_to_str(parser->current_tok.type),
-                  parser->current_tok.value);
+                  parser->current_tok.len,
+                  lexer_token_text(parser->lexer, &parser->current_tok));
     }
     return NULL;
 }
 
+// -------------------------- 6.1 错误恢复 --------------------------
+// 出错时正在解析的作用域（出错的语句可能已经进了function或者绑定了parameter）
+typedef struct {
+    FuncDefNode* current_func;
+    int binding_count;
+    int scope_base;
+    int block_depth;
+} ParserScope;
+
+// 跳过出错语句剩下的Token：停在同层的;之后、闭合的{...}之后（后面跟着else时连else一起），
+// 或者外层块的}之前（顶层没有外层块，多余的}一起跳过）。出错时current_tok可能是已经
+// 消耗过的Token（词法错误发生在读下一个Token时），从它开始跳同样正确
+static void parser_resync(Parser* parser, int in_block) {
+    int depth = 0;
+    for (;;) {
+        TokenType type = parser->current_tok.type;
+        if (type == TOKEN_EOF || (type == TOKEN_RBRACE && depth == 0 && in_block)) return;
+        parser->current_tok = parser_next_token(parser);
+        if (type == TOKEN_LBRACE) {
+            depth++;
+        } else if (type == TOKEN_RBRACE && depth > 0) {
+            if (--depth == 0 && parser->current_tok.type != TOKEN_ELSE) return;
+        } else if (type == TOKEN_SEMICOLON && depth == 0) {
+            return;
+        }
+    }
+}
+
+AstNode* parser_parse_statement_recover(Parser* parser) {
+    if (!parser->errors) return parser_parse_statement(parser);
+    ErrorTrap* outer = error_trap_get();
+    ParserScope scope = {parser->current_func, parser->binding_count, parser->scope_base, parser->block_depth};
+    ErrorTrap trap;
+    if (setjmp(trap.env) != 0) {
+        // 陷阱已经清除：再出错（比如达到上限）交给外层的陷阱
+        error_trap_set(outer);
+        parser->current_func = scope.current_func;
+        parser->binding_count = scope.binding_count;
+        parser->scope_base = scope.scope_base;
+        parser->block_depth = scope.block_depth;
+        error_report(parser->errors, "%s", trap.message);
+        parser_resync(parser, scope.block_depth > 0);
+        return NULL;
+    }
+    error_trap_set(&trap);
+    AstNode* stmt = parser_parse_statement(parser);
+    error_trap_set(outer);
+    return stmt;
+}
+
 // -------------------------- 7. 解析整个文件（串联所有语句） --------------------------
 /*AstNode* parser_parse_file(Parser* parser) {
     AstNode* root = ast_node_init(AST_BLOCK, 1);  // 根节点是code block
@@ -195,15 +728,15 @@ AstNode* parser_parse_statement(Parser* parser) {
 
 AstNode* parser_parse_file(Parser* parser) {
     // 根节点是BlockNode，显式allocation并初始化
-    BlockNode* root_block = safe_malloc(sizeof(BlockNode));
-    root_block->base = *ast_node_init(AST_BLOCK, 1);
+    BlockNode* root_block = ast_node_new(parser, sizeof(BlockNode), AST_BLOCK, 1);
     root_block->statements = NULL;  // 初始化语句链表
 
     AstNode* current_stmt = NULL;
 
-    // 循环解析所有语句
+    // 循环解析所有语句（出错的语句跳过，继续找后面的错误）
     while (parser->current_tok.type != TOKEN_EOF) {
-        AstNode* stmt = parser_parse_statement(parser);
+        AstNode* stmt = parser_parse_statement_recover(parser);
+        if (!stmt) continue;
         if (!root_block->statements) {
             root_block->statements = stmt;  // 第一个语句
             current_stmt = stmt;
@@ -212,47 +745,96 @@ AstNode* parser_parse_file(Parser* parser) {
             current_stmt = stmt;
         }
     }
+    error_context_check(parser->errors);
 
     return (AstNode*)root_block;  // 转型为基类指针返回
 }
 
-// -------------------------- 8. 释放AST（递归释放所有节点，避免memory泄漏） --------------------------
-void ast_free(AstNode* root) {
-    if (!root) return;
+// -------------------------- 7.1 流式解析（语句用完即回收） --------------------------
+void parser_parse_stream(Parser* parser, ParserSink sink, void* ctx) {
+    while (parser->current_tok.type != TOKEN_EOF) {
+        ArenaMark mark = arena_mark(parser->arena);
+        AstNode* stmt = parser_parse_statement_recover(parser);
+        // 有错误之后只解析（报告后面的错误），不再交给sink
+        if (stmt && stmt->type != AST_EOF && !(parser->errors && parser->errors->count)) sink(ctx, stmt);
+        // function体留给后面的调用（inline）；顶层变量的名字到文件结束都可以引用
+        if (stmt && (stmt->type == AST_FUNC_DEF || stmt->type == AST_VAR_DEF)) continue;
+        arena_release(parser->arena, mark);  // 这条语句的节点和名字全部作废
+    }
+    error_context_check(parser->errors);
+}
+
+void parser_skip_to(Parser* parser, size_t offset, int lines) {
+    Lexer* lexer = parser->lexer;
+    if (offset > lexer->size) error("Incremental skip past the end of the input (%zu > %zu)", offset, lexer->size);
+    lexer->cur = lexer->src + offset;
+    lexer->line = parser->current_tok.line + lines;
+    parser->batch_pos = parser->batch_len = 0;  // Read ahead from before the skip
+    parser->current_tok = parser_next_token(parser);
+}
+
+// -------------------------- 8. 遍历AST（显式栈，栈深度只与嵌套层数有关） --------------------------
+typedef struct {
+    AstNode* node;
+    int depth;
+    int leaving;  // 1=子节点已处理完，调用leave
+} AstWalkFrame;
+
+// 返回节点的子语句链表（没有子节点时返回NULL）
+static AstNode* ast_children(AstNode* node) {
+    switch (node->type) {
+        case AST_BLOCK:    return ((BlockNode*)node)->statements;
+        case AST_FUNC_DEF: return ((FuncDefNode*)node)->body;
+        case AST_IF:       return (AstNode*)((IfNode*)node)->then_block;  // else_block紧跟其后
+        case AST_WHILE:    return ((WhileNode*)node)->body;
+        case AST_FOR:      return ((ForNode*)node)->body;
+        default:           return NULL;
+    }
+}
 
-    // 递归释放链表下一个节点
-    ast_free(root->next);
+void ast_walk(AstNode* root, AstVisitor* visitor) {
+    size_t cap = 64, top = 0;
+    AstWalkFrame* stack = safe_malloc(cap * sizeof(AstWalkFrame));
+    stack[top++] = (AstWalkFrame){root, 0, 0};
 
-    // 根据节点type释放具体内容（如果有动态allocation的字段）
-    switch (root->type) {
-        case AST_FUNC_CALL: {
-            FuncCallNode* call_node = (FuncCallNode*)root;
-            if (call_node->args) free(call_node->args);  // 释放parameter列表
-            break;
-        }
-        case AST_FUNC_DEF: {
-            FuncDefNode* def_node = (FuncDefNode*)root;
-            if (def_node->params) free(def_node->params);  // 释放parameter名
-            ast_free(def_node->body);                      // 递归释放function体
-            break;
+    while (top > 0) {
+        AstWalkFrame frame = stack[--top];
+        if (frame.leaving) {
+            if (visitor->leave) visitor->leave(visitor, frame.node, frame.depth);
+            continue;
         }
-        case AST_BLOCK: {
-            BlockNode* block_node = (BlockNode*)root;
-            ast_free(block_node->statements);  // 释放code block里的语句
-            break;
+        AstNode* node = frame.node;
+        if (!node || node->type == AST_EOF) continue;  // EOF节点结束当前链表
+
+        visitor->skip_children = 0;
+        if (visitor->enter) visitor->enter(visitor, node, frame.depth);
+
+        // 压栈顺序与执行顺序相反：兄弟节点 → leave → 子节点
+        if (top + 3 > cap) {
+            cap *= 2;
+            AstWalkFrame* grown = realloc(stack, cap * sizeof(AstWalkFrame));
+            if (!grown) error("memoryallocationfailed（ast_walk）");
+            stack = grown;
         }
-        // 其他节点（reg/memassignment、constdefinition）没有额外动态字段，直接free即可
-        default:
-            break;
+        if (node->next) stack[top++] = (AstWalkFrame){node->next, frame.depth, 0};
+        stack[top++] = (AstWalkFrame){node, frame.depth, 1};
+        AstNode* children = visitor->skip_children ? NULL : ast_children(node);
+        if (children) stack[top++] = (AstWalkFrame){children, frame.depth + 1, 0};
     }
 
-    // 释放current节点
-    free(root);
+    free(stack);
 }
 
 // -------------------------- 9. 释放解析器 --------------------------
 void parser_free(Parser* parser) {
-    if (parser) free(parser);
+    if (!parser) return;
+    symtab_free(&parser->symbols);
+    symtab_free(&parser->functions);
+    if (parser->owns_arena) {
+        arena_destroy(parser->arena);  // 整棵AST一次性回收
+        free(parser->arena);
+    }
+    free(parser);
 }
 
 // -------------------------- Helperfunction：TokenType转string（报错用，Temporarily复制lexer的implementation） --------------------------
@@ -3,6 +3,9 @@
 
 #include "common/types.h"  // 依赖TokenType
 #include "lexer/lexer.h"   // 依赖Lexer和Token
+#include "common/arena.h"  // AST节点从arena分配
+#include "parser/symtab.h" // const符号表
+#include "module/modules.h" // use选择的module（register验证）
 
 // -------------------------- AST节点type --------------------------
 // 对应ELFCOST的核心语法单元
@@ -13,6 +16,12 @@ typedef enum {
     AST_FUNC_CALL,     // function调用：print_char('E', 0, 0)
     AST_FUNC_DEF,      // functiondefinition：func print_char(c,x,y) { ... }
     AST_BLOCK,         // code block：{ ... }（function体、if体等）
+    AST_IF,            // 条件：if x { ... } else { ... }
+    AST_WHILE,         // 循环：while x { ... }
+    AST_FOR,           // 计数循环：for i in 0..8 { ... }
+    AST_VAR_DEF,       // 变量definition：var x = 0
+    AST_VAR_ASSIGN,    // 变量assignment：x = x + 1
+    AST_USE,           // module选择：use x86_real（之后的代码由该module的backend生成）
     AST_EOF            // 结束节点
 } AstNodeType;
 
@@ -24,26 +33,47 @@ typedef struct AstNode {
 } AstNode;
 
 // -------------------------- constant表达式（用于存储值，比如0x1234、'A'） --------------------------
-// 存储constant的值（supportnumber、字符）
+// 存储constant的值（supportnumber、字符）；表达式在解析时就折叠成一个值，
+// 字符constant的num_val同样有效（高位为0），代码生成统一读num_val
+// function体里引用了parameter的表达式不能折叠，保留成Expr树（CONST_EXPR），运行时求值
 typedef struct {
-    enum { CONST_NUM, CONST_CHAR } type;  // constanttype
+    enum { CONST_NUM, CONST_CHAR, CONST_EXPR } type;  // constanttype
     union {
         unsigned int num_val;             // number值（十base/十六base）
         char char_val;                    // 字符值
+        struct Expr* expr;                // CONST_EXPR：表达式树（arena分配）
     } value;
 } ConstExpr;
 
+// -------------------------- 运行时表达式（引用functionparameter/循环变量） --------------------------
+// 只有引用了parameter的部分才是树，其余子表达式已经折叠成EXPR_CONST
+typedef enum {
+    EXPR_CONST,    // value
+    EXPR_PARAM,    // 第param个绑定：functionparameter、for循环变量或var变量（外层在前）
+    EXPR_BINARY,   // lhs op rhs（op是运算符的TokenType：TOKEN_PLUS等）
+} ExprKind;
+
+typedef struct Expr {
+    uint8_t kind;        // ExprKind
+    uint8_t op;          // EXPR_BINARY的运算符
+    uint16_t param;      // EXPR_PARAM的绑定序号
+    uint32_t value;      // EXPR_CONST的值
+    struct Expr* lhs;
+    struct Expr* rhs;
+} Expr;
+
 // -------------------------- registerassignment节点 --------------------------
 typedef struct {
     AstNode base;               // 继承基础节点
-    char reg_name[32];          // register名：ax、bx等
+    const char* reg_name;       // register名：ax、bx等（arena中的副本）
+    int reg;                    // register编号（解析时由current module验证，backend的编号）
     ConstExpr value;            // assignment内容（比如0x1234）
 } RegAssignNode;
 
 // -------------------------- memoryassignment节点 --------------------------
 typedef struct {
     AstNode base;               // 继承基础节点
-    char mem_width[16];         // memory宽度：byte、word、dword
+    uint8_t width;              // memory宽度（bytes）：byte=1、word=2、dword=4
     ConstExpr addr;             // memory地址（比如0xb8000）
     ConstExpr value;            // assignment内容（比如'A'）
 } MemAssignNode;
@@ -51,25 +81,30 @@ typedef struct {
 // -------------------------- constantdefinition节点 --------------------------
 typedef struct {
     AstNode base;               // 继承基础节点
-    char const_name[32];        // constant名：VIDEO_MEM、MBR_SIG等
+    const char* const_name;     // constant名：VIDEO_MEM、MBR_SIG等（arena中的副本）
     ConstExpr value;            // constant值（比如0xb8000）
 } ConstDefNode;
 
 // -------------------------- function调用节点 --------------------------
 typedef struct {
     AstNode base;               // 继承基础节点
-    char func_name[32];         // function名：print_char、uart_init等
-    ConstExpr* args;            // functionparameter列表（比如['E', 0, 0]）
+    const char* func_name;      // function名：print_char、uart_init等
+    ConstExpr* args;            // functionparameter列表（比如['E', 0, 0]，arena分配）
     int arg_count;              // parameter个数
+    struct FuncDefNode* target; // 被调用的function（解析时已经确定，必须先definition后调用）
 } FuncCallNode;
 
 // -------------------------- functiondefinition节点 --------------------------
-typedef struct {
+typedef struct FuncDefNode {
     AstNode base;               // 继承基础节点
-    char func_name[32];         // function名：print_char等
-    char* params;               // parameter列表（比如"c,x,y"，Temporarily简化存储）
+    const char* func_name;      // function名：print_char等
+    const char** params;        // parameter名列表（比如{"c","x","y"}，arena分配）
     int param_count;            // parameter个数
+    int slot;                   // 第一个parameter的绑定序号（前面是顶层的var变量）
     AstNode* body;              // function体（code block，多条语句的链表）
+    int stmt_count;             // function体的语句数（包括嵌套的，inline判断用）
+    int is_leaf;                // 1=function体里没有调用其他function（包括自己）
+    int label;                  // 代码生成分配的入口label（-1=还没有生成out-of-line代码）
 } FuncDefNode;
 
 // -------------------------- code block节点（存储多条语句） --------------------------
@@ -78,32 +113,141 @@ typedef struct {
     AstNode* statements;        // 语句链表（比如function体里的registerassignment、function调用）
 } BlockNode;
 
+// -------------------------- if节点 --------------------------
+// then_block->base.next就是else_block，遍历时两个分支依次作为子节点出现
+typedef struct {
+    AstNode base;               // 继承基础节点
+    ConstExpr cond;             // 条件（非0为真）
+    BlockNode* then_block;
+    BlockNode* else_block;      // 没有else时为NULL
+} IfNode;
+
+// -------------------------- while节点 --------------------------
+typedef struct {
+    AstNode base;               // 继承基础节点
+    ConstExpr cond;             // 每次循环前求值，非0继续
+    AstNode* body;              // 循环体语句链表
+} WhileNode;
+
+// -------------------------- for节点（for i in start..end，不包含end） --------------------------
+typedef struct {
+    AstNode base;               // 继承基础节点
+    const char* var_name;       // 循环变量名（arena中的副本）
+    int slot;                   // 循环变量的绑定序号（Expr::param）
+    ConstExpr start;
+    ConstExpr end;
+    AstNode* body;              // 循环体语句链表
+    int stmt_count;             // 循环体语句数（包括嵌套的，展开判断用）
+} ForNode;
+
+// -------------------------- var节点（definition和assignment共用） --------------------------
+// 变量住在register里（由register allocator决定），只在definition所在的code block里可见
+typedef struct {
+    AstNode base;               // 继承基础节点：AST_VAR_DEF或AST_VAR_ASSIGN
+    const char* var_name;       // 变量名（arena中的副本）
+    int slot;                   // 变量的绑定序号（Expr::param）
+    ConstExpr value;            // 新的值
+} VarAssignNode;
+
+// -------------------------- use节点 --------------------------
+typedef struct {
+    AstNode base;               // 继承基础节点
+    const Module* module;       // 静态module表中的条目
+} UseNode;
+
 // -------------------------- 解析器状态 --------------------------
+#define PARSER_MAX_BINDINGS 64  // 同时可见的functionparameter、for循环变量和var变量的上限
+#define PARSER_TOKEN_BATCH 64   // --stats：一次计时向lexer要的Token数上限
+
 typedef struct {
     Lexer* lexer;       // 关联的lexer（用于获取Token）
     Token current_tok;  // currentToken（预读一个Token，用于语法判断）
+    Arena* arena;       // AST节点和名字string的来源（整个编译单元共用）
+    int owns_arena;     // 1=arena由parser_init创建，parser_free时销毁
+    Symtab symbols;     // const definition（自己的arena，流式解析回收AST时保留）
+    Symtab functions;   // function definition（Symbol::node指向FuncDefNode）
+    FuncDefNode* current_func;  // 正在解析的function，NULL=顶层
+    const char* bindings[PARSER_MAX_BINDINGS];  // 可以在表达式里引用的名字（parameter、循环变量、变量），内层在后
+    uint8_t binding_is_var[PARSER_MAX_BINDINGS];  // 1=var变量（可以assignment）
+    int binding_count;
+    int scope_base;     // 当前function里第一个可见的绑定（function看不到顶层的变量）
+    int block_depth;    // 嵌套的code block层数，0=顶层
+    int stmt_total;     // 到目前为止解析的语句数（包括嵌套的），function/循环用差值统计自己的语句数
+    const Module* module;  // current module（最近的use，默认是module表的第一个：x86_real）
+    size_t node_count;  // 分配过的AST节点数（语句和表达式，--stats）
+    ErrorContext* errors;  // 语句里的错误报告到这里，跳到下一条语句继续解析（parser_init时取lexer的；NULL=第一个错误就结束编译）
+    double* lex_seconds;   // --stats：lexer的耗时累加到这里（NULL=不计时，逐个读Token）
+    size_t token_count;    // --stats：lexer扫描出的Token数（不含EOF）
+    size_t lexed_bytes;    // --stats：lexer扫描过的源码bytes
+    Token batch[PARSER_TOKEN_BATCH];  // --stats：已扫描、还没读到的Token
+    int batch_pos;
+    int batch_len;
 } Parser;
 
 // -------------------------- 解析器核心接口 --------------------------
-// 1. 初始化解析器：传入lexer，预读第一个Token
+// 1. 初始化解析器：传入lexer，预读第一个Token（自带一个arena）
 Parser* parser_init(Lexer* lexer);
 
+// 1.1 初始化解析器，AST分配到调用者提供的arena（arena由调用者reset/destroy）
+Parser* parser_init_arena(Lexer* lexer, Arena* arena);
+
+// 1.2 复用解析器解析下一个编译单元（lexer换成新的）：清空符号表、绑定和module，
+//     自带的arena整体回收但保留block，符号表也一样，warm的parser不再向系统申请memory
+//     （调用者提供的arena由调用者reset）
+void parser_reset(Parser* parser, Lexer* lexer);
+
+// 1.3 --stats：之后的Token成批向lexer要（一批到语句结尾的; { }为止），每批读两次时钟，
+//     lexer的耗时累加到*seconds；逐个Token读时钟的开销比扫描本身还大。lexer最多领先一条语句
+//     （同一条语句里的词法错误因此先于它前面的语法错误报告）
+void parser_time_lexer(Parser* parser, double* seconds);
+
 // 2. 匹配specifiedToken：如果currentToken是目标type，消耗并读下一个；否则报错
 void parser_match(Parser* parser, TokenType expected_type);
 
 // 3. 解析整个ELFCOST文件，生成AST根节点
 AstNode* parser_parse_file(Parser* parser);
 
+// 3.1 流式解析：每解析完一条语句就交给sink处理（比如立即生成机器码），
+//     sink返回后该语句占用的arena memory立即回收，memory占用与语句数量无关
+//     （function definition除外：后面的调用还要用到function体，保留到parser_free）
+//     sink中不能保存语句节点的指针；需要全局message的pass请使用parser_parse_file
+typedef void (*ParserSink)(void* ctx, AstNode* stmt);
+void parser_parse_stream(Parser* parser, ParserSink sink, void* ctx);
+// 3.2 增量编译：不做词法分析，直接跳到源码的offset处（offset落在两条顶层语句之间），
+//     lines是跳过的这段源码里的换行数（保持后面报错的line正确）
+void parser_skip_to(Parser* parser, size_t offset, int lines);
+
 // 4. 解析单个语句（比如regassignment、memassignment、function调用）
 AstNode* parser_parse_statement(Parser* parser);
 
-// 5. 解析constant表达式（比如0x1234、'A'、VIDEO_MEM）
+// 4.1 错误恢复：parser->errors不为NULL时，语句里的错误报告给它，然后跳过这条语句剩下的
+//     Token（到同层的;之后、闭合的{...}之后，或者外层块的}之前），返回NULL；
+//     errors为NULL时等于parser_parse_statement。code block、parser_parse_file和
+//     parser_parse_stream都逐条语句这样解析，后两者结束时有错误就让编译失败
+AstNode* parser_parse_statement_recover(Parser* parser);
+
+// 5. 解析constant表达式并在编译期折叠（比如0x1234、'A'、VIDEO_MEM、(VIDEO_MEM + 0xA0) & 0xFFFF）
+//    运算符优先级从低到高：|  &  + -  * /  一元-，都按32位无符号运算
+//    引用的constant必须在前面已经definition；function体里可以引用parameter，循环体里可以引用循环变量（结果是CONST_EXPR）
 ConstExpr parser_parse_const_expr(Parser* parser);
 
-// 6. 释放AST（避免memory泄漏）
-void ast_free(AstNode* root);
+// 6. AST没有单独的释放function：所有节点都在parser->arena中，
+//    parser_free（自带arena时）或调用者的arena_reset/arena_destroy一次性回收
+
+// 7. 遍历AST：所有pass（代码生成、打印等）共用的visitor
+//    用显式栈代替递归，栈深度只与嵌套层数有关，与语句数量无关
+//    enter在访问子节点前调用（先序），leave在子节点处理完后调用（后序），都可以为NULL
+//    enter中把skip_children设为1可以跳过该节点的子节点（leave仍然调用）
+typedef struct AstVisitor {
+    void (*enter)(struct AstVisitor* visitor, AstNode* node, int depth);
+    void (*leave)(struct AstVisitor* visitor, AstNode* node, int depth);
+    void* ctx;  // pass自己的状态
+    int skip_children;
+} AstVisitor;
+
+void ast_walk(AstNode* root, AstVisitor* visitor);
 
-// 7. 释放解析器
+// 8. 释放解析器（自带的arena连同整棵AST一起释放）
 void parser_free(Parser* parser);
 
 #endif // PARSER_H
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "symtab.h"
+#include "../common/utils.h"
+#include <string.h>
+
+#define SYMTAB_MIN_CAP 64
+
+void symtab_init(Symtab* table) {
+    arena_init(&table->arena, 0);
+    table->slots = NULL;
+    table->cap = 0;
+    table->count = 0;
+}
+
+// Linear probe for name; returns the matching slot or the empty slot where it belongs
+static Symbol* symtab_probe(Symbol* slots, size_t cap, const char* name, size_t len, uint32_t hash) {
+    size_t mask = cap - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Symbol* slot = &slots[i];
+        if (!slot->name) return slot;
+        if (slot->hash == hash && slot->len == len && memcmp(slot->name, name, len) == 0) return slot;
+    }
+}
+
+// Double the slot array once the table is half full. The old array stays in the
+// arena until symtab_free; across all resizes that is less than one final array.
+static void symtab_grow(Symtab* table) {
+    size_t cap = table->cap ? table->cap * 2 : SYMTAB_MIN_CAP;
+    Symbol* slots = arena_calloc(&table->arena, cap * sizeof(Symbol));
+    for (size_t i = 0; i < table->cap; i++) {
+        Symbol* old = &table->slots[i];
+        if (old->name) *symtab_probe(slots, cap, old->name, old->len, old->hash) = *old;
+    }
+    table->slots = slots;
+    table->cap = cap;
+}
+
+Symbol* symtab_lookup(const Symtab* table, const char* name, size_t len) {
+    if (table->count == 0) return NULL;
+    Symbol* slot = symtab_probe(table->slots, table->cap, name, len, hash_bytes(name, len));
+    return slot->name ? slot : NULL;
+}
+
+Symbol* symtab_define(Symtab* table, const char* name, size_t len, uint32_t value, int is_char, int line) {
+    if ((table->count + 1) * 2 > table->cap) symtab_grow(table);
+    uint32_t hash = hash_bytes(name, len);
+    Symbol* slot = symtab_probe(table->slots, table->cap, name, len, hash);
+    if (slot->name) return NULL;  // Already defined
+
+    slot->name = arena_strndup(&table->arena, name, len);
+    slot->len = (uint32_t)len;
+    slot->hash = hash;
+    slot->value = value;
+    slot->is_char = is_char;
+    slot->line = line;
+    slot->node = NULL;
+    table->count++;
+    return slot;
+}
+
+void symtab_reset(Symtab* table) {
+    arena_reset(&table->arena);  // The slot array goes with it and is allocated again on the first define
+    table->slots = NULL;
+    table->cap = table->count = 0;
+}
+
+void symtab_free(Symtab* table) {
+    arena_destroy(&table->arena);
+    table->slots = NULL;
+    table->cap = table->count = 0;
+}
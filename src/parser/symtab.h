@@ -0,0 +1,45 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include "common/types.h"
+#include "common/arena.h"
+#include <stddef.h>
+
+// -------------------------- 符号表（const definition） --------------------------
+// 开放寻址哈希表（线性探测），键是名字，值是编译期已经求出的constant值
+// 名字和槽数组都分配在符号表自己的arena里：流式解析回收AST时符号不受影响
+// 查找直接用Token的源码span，不需要先复制名字
+
+typedef struct {
+    const char* name;   // 名字（arena中的副本，NULL=空槽）
+    uint32_t len;       // 名字长度
+    uint32_t hash;      // hash_bytes(name, len)，扩容时不必重新计算
+    uint32_t value;     // constant值（已折叠）
+    int is_char;        // 1=值来自字符constant（'A'）
+    int line;           // definition所在line（重复definition报错用）
+    void* node;         // 附带的AST节点（function表：FuncDefNode）
+} Symbol;
+
+typedef struct {
+    Arena arena;        // 名字和槽数组的来源
+    Symbol* slots;      // 槽数组（容量是2的幂）
+    size_t cap;         // 槽数
+    size_t count;       // 已definition的符号数
+} Symtab;
+
+// 初始化空符号表（第一次definition时才分配槽）
+void symtab_init(Symtab* table);
+
+// 查找名字，找不到返回NULL
+Symbol* symtab_lookup(const Symtab* table, const char* name, size_t len);
+
+// definition新符号；名字已存在时不修改，返回NULL（由调用者报错）
+Symbol* symtab_define(Symtab* table, const char* name, size_t len, uint32_t value, int is_char, int line);
+
+// 清空符号表，保留arena的block（下一个编译单元定义符号时不再向系统申请memory）
+void symtab_reset(Symtab* table);
+
+// 释放符号表的全部memory
+void symtab_free(Symtab* table);
+
+#endif // SYMTAB_H
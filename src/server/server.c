@@ -0,0 +1,356 @@
+#define _GNU_SOURCE  // accept4
+#include "server.h"
+#include "../common/utils.h"
+
+#if SERVER_AVAILABLE
+#include "../common/pool.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVER_MAX_EVENTS 64
+#define SERVER_READ_CHUNK (64 * 1024)
+
+// One client. While busy a worker owns in and out, and the connection is not in the
+// epoll set (a hangup would otherwise be reported over and over until the job is done)
+typedef struct ServerConn {
+    int fd;
+    EccBuffer in;              // The request being compiled, then whatever the client sent after it
+    EccBuffer out;             // Response being sent
+    size_t out_pos;
+    size_t request_len;        // Bytes of in taken by the request the worker compiled
+    int busy;
+    int eof;                   // Peer closed (or failed): close once nothing is left to do
+    uint32_t events;           // Current epoll interest, 0 = not in the epoll set
+    struct ServerConn* queue;  // Next in the job or done queue (under Server.lock)
+    struct ServerConn* prev;   // All connections (event loop only)
+    struct ServerConn* next;
+} ServerConn;
+
+typedef struct {
+    int listen_fd;
+    int wake_fd;               // eventfd: a worker finished a job
+    int signal_fd;             // SIGINT/SIGTERM
+    int epoll_fd;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    ServerConn* jobs;          // FIFO, under lock
+    ServerConn** jobs_tail;
+    ServerConn* done;          // Under lock
+    int stopping;              // Under lock
+    ServerConn* conns;
+    size_t requests;
+    size_t failed;
+    size_t connections;
+} Server;
+
+typedef struct {
+    Server* server;
+    EccContext* ctx;           // One per worker: contexts are not shared between threads
+    pthread_t tid;
+} ServerWorker;
+
+static uint32_t server_get_u32(const uint8_t* p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void server_put_u32(uint8_t* p, uint32_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static void server_reserve(EccBuffer* buf, size_t size) {
+    if (size <= buf->cap) return;
+    size_t cap = buf->cap ? buf->cap : 4096;
+    while (cap < size) cap *= 2;
+    buf->data = realloc(buf->data, cap);
+    if (!buf->data) error("Memory allocation failed (%zu bytes of server buffer)", cap);
+    buf->cap = cap;
+}
+
+// -------------------------- workers --------------------------
+
+static void* server_worker(void* arg) {
+    ServerWorker* worker = arg;
+    Server* s = worker->server;
+    EccBuffer code = {0};
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        while (!s->jobs && !s->stopping) pthread_cond_wait(&s->work, &s->lock);
+        ServerConn* c = s->jobs;
+        if (c && !(s->jobs = c->queue)) s->jobs_tail = &s->jobs;
+        pthread_mutex_unlock(&s->lock);
+        if (!c) break;
+
+        uint32_t len = server_get_u32(c->in.data);
+        int failed = ecc_compile(worker->ctx, (const char*)c->in.data + SERVER_REQUEST_HEADER, len, &code) != 0;
+        const char* diagnostics = ecc_diagnostics(worker->ctx);
+        size_t diagnostics_len = strlen(diagnostics);
+        server_reserve(&c->out, SERVER_RESPONSE_HEADER + code.len + diagnostics_len);
+        server_put_u32(c->out.data, failed);
+        server_put_u32(c->out.data + 4, (uint32_t)code.len);
+        server_put_u32(c->out.data + 8, (uint32_t)diagnostics_len);
+        if (code.len) memcpy(c->out.data + SERVER_RESPONSE_HEADER, code.data, code.len);
+        memcpy(c->out.data + SERVER_RESPONSE_HEADER + code.len, diagnostics, diagnostics_len);
+        c->out.len = SERVER_RESPONSE_HEADER + code.len + diagnostics_len;
+        c->out_pos = 0;
+        c->request_len = SERVER_REQUEST_HEADER + len;
+
+        pthread_mutex_lock(&s->lock);
+        c->queue = s->done;
+        s->done = c;
+        pthread_mutex_unlock(&s->lock);
+        uint64_t one = 1;
+        write(s->wake_fd, &one, sizeof(one));
+    }
+    ecc_buffer_free(&code);
+    return NULL;
+}
+
+// -------------------------- event loop --------------------------
+
+static void server_watch(Server* s, ServerConn* c, uint32_t events) {
+    if (c->events == events) return;
+    struct epoll_event ev = {.events = events, .data.ptr = c};
+    int op = !events ? EPOLL_CTL_DEL : c->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(s->epoll_fd, op, c->fd, &ev) != 0) error("epoll_ctl failed: %s", strerror(errno));
+    c->events = events;
+}
+
+static void server_close(Server* s, ServerConn* c) {
+    if (c->events) epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    if (c->prev) c->prev->next = c->next;
+    else s->conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    ecc_buffer_free(&c->in);
+    ecc_buffer_free(&c->out);
+    free(c);
+}
+
+// Move an idle connection on: finish sending the response, then hand the next complete
+// request to a worker, wait for more of it, or close
+static void server_advance(Server* s, ServerConn* c) {
+    while (c->out_pos < c->out.len) {
+        ssize_t n = send(c->fd, c->out.data + c->out_pos, c->out.len - c->out_pos, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            server_watch(s, c, EPOLLOUT);
+            return;
+        }
+        if (n <= 0) {
+            server_close(s, c);  // The client is gone
+            return;
+        }
+        c->out_pos += n;
+    }
+    c->out.len = c->out_pos = 0;
+
+    if (c->in.len >= SERVER_REQUEST_HEADER && c->in.len - SERVER_REQUEST_HEADER >= server_get_u32(c->in.data)) {
+        server_watch(s, c, 0);
+        c->busy = 1;
+        c->queue = NULL;
+        pthread_mutex_lock(&s->lock);
+        *s->jobs_tail = c;
+        s->jobs_tail = &c->queue;
+        pthread_cond_signal(&s->work);
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+    if (c->eof) {
+        server_close(s, c);
+        return;
+    }
+    server_watch(s, c, EPOLLIN);
+}
+
+// Level-triggered: one recv per readiness event, epoll reports the rest
+static void server_read(Server* s, ServerConn* c) {
+    server_reserve(&c->in, c->in.len + SERVER_READ_CHUNK);
+    ssize_t n = recv(c->fd, c->in.data + c->in.len, c->in.cap - c->in.len, 0);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) return;
+    if (n <= 0) c->eof = 1;
+    else c->in.len += n;
+    if (c->in.len >= SERVER_REQUEST_HEADER && server_get_u32(c->in.data) > SERVER_MAX_SOURCE) {
+        fprintf(stderr, "[ERROR] Request of %u bytes exceeds the %u byte limit, connection closed\n",
+                server_get_u32(c->in.data), SERVER_MAX_SOURCE);
+        c->in.len = 0;
+        c->eof = 1;
+    }
+    server_advance(s, c);
+}
+
+static void server_accept(Server* s) {
+    for (;;) {
+        int fd = accept4(s->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0 && (errno == EINTR || errno == ECONNABORTED)) continue;
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) fprintf(stderr, "[ERROR] accept failed: %s\n", strerror(errno));
+            return;
+        }
+        ServerConn* c = calloc(1, sizeof(ServerConn));
+        if (!c) error("Memory allocation failed (server connection)");
+        c->fd = fd;
+        c->next = s->conns;
+        if (s->conns) s->conns->prev = c;
+        s->conns = c;
+        s->connections++;
+        server_watch(s, c, EPOLLIN);
+    }
+}
+
+// Workers are done with these connections: drop the compiled requests and go on
+static void server_finish(Server* s) {
+    uint64_t count;
+    read(s->wake_fd, &count, sizeof(count));
+    pthread_mutex_lock(&s->lock);
+    ServerConn* c = s->done;
+    s->done = NULL;
+    pthread_mutex_unlock(&s->lock);
+    while (c) {
+        ServerConn* next = c->queue;
+        c->busy = 0;
+        s->requests++;
+        s->failed += c->out.data[0] != 0;
+        c->in.len -= c->request_len;
+        memmove(c->in.data, c->in.data + c->request_len, c->in.len);
+        server_advance(s, c);
+        c = next;
+    }
+}
+
+// A socket file left behind by a server that is gone is replaced; a live server's
+// socket, or a file that is not a socket, is an error
+static int server_listen(const char* path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        error("Socket path too long (at most %zu bytes): %s", sizeof(addr.sun_path) - 1, path);
+    }
+    strcpy(addr.sun_path, path);
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) error("%s exists and is not a socket", path);
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int live = probe >= 0 && connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (live) error("Another server is listening on %s", path);
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) error("Cannot create socket: %s", strerror(errno));
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) error("Cannot bind %s: %s", path, strerror(errno));
+    if (listen(fd, SOMAXCONN) != 0) error("Cannot listen on %s: %s", path, strerror(errno));
+    return fd;
+}
+
+static void server_poll(Server* s, int fd, int* tag) {
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = tag};
+    if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) error("epoll_ctl failed: %s", strerror(errno));
+}
+
+int server_run(const char* socket_path, int threads, const EccOptions* options) {
+    if (threads <= 0) threads = pool_cpu_count();
+    Server s = {0};
+    s.jobs_tail = &s.jobs;
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.work, NULL);
+
+    // Contexts first: a server that cannot compile should not start listening
+    ServerWorker* workers = safe_malloc(threads * sizeof(ServerWorker));
+    for (int w = 0; w < threads; w++) {
+        workers[w].server = &s;
+        workers[w].ctx = ecc_context_new(options);
+        if (!workers[w].ctx) error("Memory allocation failed (compiler context)");
+    }
+
+    // SIGINT/SIGTERM arrive through a signalfd; the workers inherit the blocked mask
+    sigset_t signals, old_mask;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &old_mask);
+    s.signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+    s.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    s.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (s.signal_fd < 0 || s.wake_fd < 0 || s.epoll_fd < 0) error("Cannot set up the event loop: %s", strerror(errno));
+    s.listen_fd = server_listen(socket_path);
+    server_poll(&s, s.listen_fd, &s.listen_fd);
+    server_poll(&s, s.wake_fd, &s.wake_fd);
+    server_poll(&s, s.signal_fd, &s.signal_fd);
+
+    int started = 0;
+    while (started < threads && pthread_create(&workers[started].tid, NULL, server_worker, &workers[started]) == 0) {
+        started++;
+    }
+    if (!started) error("Cannot start server workers");
+    printf("Serving on %s with %d workers\n", socket_path, started);
+    fflush(stdout);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    for (int stop = 0; !stop;) {
+        int n = epoll_wait(s.epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) error("epoll_wait failed: %s", strerror(errno));
+        // Busy connections are not in the epoll set, so server_finish never frees one
+        // that still has an event further down this array
+        for (int i = 0; i < n; i++) {
+            void* tag = events[i].data.ptr;
+            if (tag == &s.listen_fd) {
+                server_accept(&s);
+            } else if (tag == &s.wake_fd) {
+                server_finish(&s);
+            } else if (tag == &s.signal_fd) {
+                struct signalfd_siginfo info;  // Consumed, or it fires when the mask is restored
+                read(s.signal_fd, &info, sizeof(info));
+                stop = 1;
+            } else if (events[i].events & EPOLLOUT) {
+                server_advance(&s, tag);
+            } else {
+                server_read(&s, tag);  // Input, or a hangup/error that recv reports
+            }
+        }
+    }
+
+    // Requests still queued are dropped, the ones being compiled finish
+    pthread_mutex_lock(&s.lock);
+    s.stopping = 1;
+    s.jobs = NULL;
+    pthread_cond_broadcast(&s.work);
+    pthread_mutex_unlock(&s.lock);
+    for (int w = 0; w < started; w++) pthread_join(workers[w].tid, NULL);
+    for (int w = 0; w < threads; w++) ecc_context_free(workers[w].ctx);
+    free(workers);
+    while (s.conns) server_close(&s, s.conns);
+    close(s.listen_fd);
+    unlink(socket_path);
+    close(s.epoll_fd);
+    close(s.wake_fd);
+    close(s.signal_fd);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    pthread_cond_destroy(&s.work);
+    pthread_mutex_destroy(&s.lock);
+
+    printf("Served %zu compilations (%zu failed) on %zu connections\n", s.requests, s.failed, s.connections);
+    return 0;
+}
+
+#else
+
+int server_run(const char* socket_path, int threads, const EccOptions* options) {
+    error("Serve mode needs Linux (epoll, signalfd and eventfd): cannot listen on %s", socket_path);
+    return 1;
+}
+
+#endif // SERVER_AVAILABLE
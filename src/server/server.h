@@ -0,0 +1,35 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "../lib/ecc.h"
+#include <stdint.h>
+
+// -------------------------- 编译服务 --------------------------
+// elfc-compiler serve <socket>：编译器常驻，构建系统通过Unix域socket发源码、收机器码，
+// 不用每个文件起一次进程。主线程用epoll管理所有连接，编译交给worker线程，每个worker
+// 一个libecc context（热的arena、IR和缓冲区在请求之间复用）。
+// 一个连接上的请求按顺序编译、按顺序回复（可以连续发多个）；并发来自多个连接。
+//
+// 帧格式（整数都是u32小端）：
+//   请求：<源码长度> <源码>
+//   回复：<状态 0=成功 1=有错误> <机器码长度> <诊断长度> <机器码> <诊断文本>
+// 诊断文本与ecc_diagnostics相同（每行一个"[ERROR] ..."，成功时为空）。
+// 源码超过SERVER_MAX_SOURCE的请求不编译，连接直接关闭。
+
+// 事件循环用的epoll、signalfd和eventfd只有Linux有：其他平台照常编译，server_run直接报错
+#ifdef __linux__
+#define SERVER_AVAILABLE 1
+#else
+#define SERVER_AVAILABLE 0
+#endif
+
+#define SERVER_REQUEST_HEADER 4
+#define SERVER_RESPONSE_HEADER 12
+#define SERVER_MAX_SOURCE (64u << 20)
+
+// 监听socket_path直到SIGINT/SIGTERM，然后删除socket文件并返回0。
+// threads<=0时每个CPU一个worker；options同ecc_context_new（NULL=命令行默认值）。
+// 启动失败（路径太长、已有服务在监听、不是Linux等）走error()
+int server_run(const char* socket_path, int threads, const EccOptions* options);
+
+#endif // SERVER_H
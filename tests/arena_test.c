@@ -0,0 +1,81 @@
+#include "../src/common/arena.h"
+#include "test_common.h"
+#include <stdalign.h>
+#include <stdio.h>
+
+static void test_alignment_and_growth(void) {
+    Arena arena;
+    arena_init(&arena, 256);
+    for (int i = 1; i < 2000; i++) {
+        char* p = arena_alloc(&arena, (size_t)(i % 37) + 1);
+        assert(((uintptr_t)p % alignof(max_align_t)) == 0);
+        memset(p, 0xAB, (size_t)(i % 37) + 1);  // 写满，ASan/valgrind下可发现越界
+    }
+    // 超过block大小的分配单独成块
+    char* big = arena_alloc(&arena, 10000);
+    memset(big, 0, 10000);
+    assert(arena.peak == arena.used && arena.reserved >= arena.used);
+    arena_destroy(&arena);
+    assert(arena.reserved == 0 && arena.first == NULL);
+    printf("Test alignment_and_growth passed.\n");
+}
+
+static void test_mark_release(void) {
+    Arena arena;
+    arena_init(&arena, 128);
+    char* keep = arena_strndup(&arena, "keep-me", 4);
+    assert(strcmp(keep, "keep") == 0);
+    ArenaMark mark = arena_mark(&arena);
+    size_t used = arena.used;
+    for (int i = 0; i < 100; i++) arena_alloc(&arena, 64);  // 跨多个block
+    size_t reserved = arena.reserved;
+    arena_release(&arena, mark);
+    assert(arena.used == used && strcmp(keep, "keep") == 0);
+    // 回滚后的分配复用已有block，不再向系统申请
+    for (int i = 0; i < 100; i++) arena_alloc(&arena, 64);
+    assert(arena.reserved == reserved);
+    arena_destroy(&arena);
+    printf("Test mark_release passed.\n");
+}
+
+static void test_reset_reuses_blocks(void) {
+    Arena arena;
+    arena_init(&arena, 0);
+    for (int i = 0; i < 10000; i++) arena_calloc(&arena, 48);
+    size_t reserved = arena.reserved, peak = arena.peak;
+    arena_reset(&arena);
+    assert(arena.used == 0 && arena.peak == peak);
+    for (int i = 0; i < 10000; i++) {
+        int* p = arena_calloc(&arena, 48);
+        assert(p[0] == 0 && p[11] == 0);
+    }
+    assert(arena.reserved == reserved);
+    arena_destroy(&arena);
+    printf("Test reset_reuses_blocks passed.\n");
+}
+
+// 最后一次分配原地扩大；不是最后一次或放不下时复制过去
+static void test_grow(void) {
+    Arena arena;
+    arena_init(&arena, 256);
+    char* p = arena_alloc(&arena, 16);
+    memcpy(p, "0123456789abcde", 16);
+    assert(arena_grow(&arena, p, 16, 64) == p && strcmp(p, "0123456789abcde") == 0);
+    char* other = arena_alloc(&arena, 16);
+    char* moved = arena_grow(&arena, p, 64, 128);
+    assert(moved != p && moved != other && strcmp(moved, "0123456789abcde") == 0);
+    char* big = arena_grow(&arena, moved, 128, 1000);  // 超出block：新block
+    assert(big != moved && strcmp(big, "0123456789abcde") == 0);
+    assert(arena_grow(&arena, NULL, 0, 32) != NULL);
+    arena_destroy(&arena);
+    printf("Test grow passed.\n");
+}
+
+int main(void) {
+    test_alignment_and_growth();
+    test_mark_release();
+    test_reset_reuses_blocks();
+    test_grow();
+    printf("All arena tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,588 @@
+#include "../src/codegen/codegen.h"
+#include "../src/codegen/x86.h"
+#include "../src/codegen/output_cache.h"
+#include "test_common.h"
+#include <stdio.h>
+#include <unistd.h>
+
+// 断言生成的机器码与期望完全一致
+static void expect_code_opt(const char* src, int optimize, const uint8_t* expected, size_t len) {
+    Emitter out = compile_source_opt(src, optimize);
+    if (out.len != len || memcmp(out.data, expected, len) != 0) {
+        fprintf(stderr, "Unexpected code for:\n%s\n got:", src);
+        for (size_t i = 0; i < out.len; i++) fprintf(stderr, " %02X", out.data[i]);
+        fprintf(stderr, "\n");
+        assert(0);
+    }
+    emitter_free(&out);
+}
+
+static void expect_code(const char* src, const uint8_t* expected, size_t len) {
+    expect_code_opt(src, 1, expected, len);
+}
+
+static void test_emitter(void) {
+    Emitter em;
+    emitter_init(&em, 1);  // 从1 byte开始，强制多次扩容
+    for (int i = 0; i < 1000; i++) emitter_u8(&em, (uint8_t)i);
+    emitter_u16(&em, 0x1234);
+    emitter_u32(&em, 0xAABBCCDD);
+    assert(em.len == 1006 && emitter_pos(&em) == 1006);
+    assert(em.data[999] == (uint8_t)999 && em.data[1000] == 0x34 && em.data[1001] == 0x12);
+    assert(em.data[1002] == 0xDD && em.data[1005] == 0xAA);
+
+    // 回填
+    emitter_patch_u16(&em, 0, 0xBEEF);
+    emitter_patch_u8(&em, 2, 0x90);
+    assert(em.data[0] == 0xEF && em.data[1] == 0xBE && em.data[2] == 0x90);
+
+    // 一次写出
+    FILE* fp = tmpfile();
+    assert(emitter_write(&em, fp) == 0);
+    assert(fseek(fp, 0, SEEK_END) == 0 && ftell(fp) == 1006);
+    fclose(fp);
+
+    emitter_reset(&em);
+    assert(em.len == 0 && em.cap >= 1006);
+    emitter_free(&em);
+    printf("Test emitter passed.\n");
+}
+
+static void test_reg_assign(void) {
+    static const uint8_t expected[] = {0xB8, 0x34, 0x12, 0xBB, 0x78, 0x56};
+    expect_code("use x86_real;\nreg.ax = 0x1234;\nreg.bx = 0x5678;", expected, sizeof(expected));
+    printf("Test reg_assign passed.\n");
+}
+
+static void test_peephole(void) {
+    // mov r, 0 → xor r, r
+    static const uint8_t zero[] = {0x31, 0xC0};
+    expect_code("reg.ax = 0;", zero, sizeof(zero));
+
+    // 死存储：第一次赋值在被读取前就被覆盖
+    static const uint8_t dead[] = {0xBB, 0x02, 0x00};
+    expect_code("reg.bx = 1; reg.bx = 2;", dead, sizeof(dead));
+
+    // 两次赋相同的值：第一次是死存储
+    static const uint8_t redundant[] = {0xBA, 0x01, 0x00, 0xB9, 0x34, 0x12};
+    expect_code("reg.cx = 0x1234; reg.dx = 1; reg.cx = 0x1234;", redundant, sizeof(redundant));
+
+    // 复用：另一个寄存器已经是这个值 → mov bx, ax
+    static const uint8_t reuse[] = {0xB8, 0x00, 0xB8, 0x89, 0xC3, 0x31, 0xC9};
+    expect_code("reg.ax = 0xB800; reg.bx = 0xB800; reg.cx = 0;", reuse, sizeof(reuse));
+
+    // bx的值是常量而不是"ax的内容"，所以第一次给ax的赋值是死存储
+    static const uint8_t read[] = {0xBB, 0x05, 0x00, 0xB8, 0x06, 0x00};
+    expect_code("reg.ax = 5; reg.bx = 5; reg.ax = 6;", read, sizeof(read));
+
+    // 关闭优化时逐条生成
+    static const uint8_t literal[] = {0xB8, 0x00, 0x00, 0xB8, 0x00, 0x00};
+    expect_code_opt("reg.ax = 0; reg.ax = 0;", 0, literal, sizeof(literal));
+    printf("Test peephole passed.\n");
+}
+
+// IR pass：常量折叠、寄存器值转发、死存储/死值删除，然后由x86 backend lower
+static void test_ir(void) {
+    IrProgram ir;
+    ir_init(&ir);
+    IrValue base = ir_const(&ir, 0xB8000);
+    IrValue cols = ir_const(&ir, 80);
+    IrValue row = ir_binary(&ir, IR_AND, ir_binary(&ir, IR_ADD, base, ir_binary(&ir, IR_MUL, cols, ir_const(&ir, 2))),
+                            ir_const(&ir, 0xFFFF));
+    ir_set_reg(&ir, X86_AX, row);
+    ir_set_reg(&ir, X86_CX, ir_const(&ir, 7));          // 死存储：后面被覆盖
+    ir_set_reg(&ir, X86_BX, ir_get_reg(&ir, X86_AX));   // 转发成ax里的值
+    ir_set_reg(&ir, X86_CX, ir_copy(&ir, ir_get_reg(&ir, X86_BX)));
+    ir_binary(&ir, IR_DIV, base, ir_const(&ir, 0));     // 没有被使用（也不折叠除以0）
+
+    size_t before = ir.count;
+    size_t removed = ir_optimize(&ir, NULL);
+    assert(ir.count == before - removed);
+    // 剩下：v = 0x80A0; ax = v; bx = v; cx = v
+    assert(ir.count == 4 && ir.insns[0].op == IR_CONST && ir.insns[0].a == 0x80A0);
+    for (size_t i = 1; i < 4; i++) assert(ir.insns[i].op == IR_SET_REG && ir.insns[i].a == ir.insns[0].dst);
+
+    Emitter out;
+    emitter_init(&out, 0);
+    BackendLabels labels = {NULL, 0, 0, 0};
+    size_t saved = x86_real_backend.lower(&ir, &labels, &out, 1);
+    static const uint8_t expected[] = {0xB8, 0xA0, 0x80, 0x89, 0xC3, 0x89, 0xC1};  // mov bx, ax; mov cx, ax
+    assert(out.len == sizeof(expected) && memcmp(out.data, expected, sizeof(expected)) == 0 && saved == 2);
+    emitter_free(&out);
+
+    // 读取寄存器原来的值，之后才覆盖：mov bx, ax在mov ax, imm之前
+    ir_reset(&ir);
+    ir_set_reg(&ir, X86_BX, ir_get_reg(&ir, X86_AX));
+    ir_set_reg(&ir, X86_AX, ir_const(&ir, 1));
+    ir_optimize(&ir, NULL);
+    emitter_init(&out, 0);
+    x86_real_backend.lower(&ir, &labels, &out, 1);
+    static const uint8_t ordered[] = {0x89, 0xC3, 0xB8, 0x01, 0x00};
+    assert(out.len == sizeof(ordered) && memcmp(out.data, ordered, sizeof(ordered)) == 0);
+    emitter_free(&out);
+    ir_free(&ir);
+    printf("Test ir passed.\n");
+}
+
+static void test_mem_assign(void) {
+    // 单条store：push 0x10; pop ds; mov byte [0], 'A'; mov word [2], 0x1234
+    static const uint8_t single[] = {0x6A, 0x10, 0x1F, 0xC6, 0x06, 0x00, 0x00, 0x41,
+                                     0xC7, 0x06, 0x02, 0x00, 0x34, 0x12};
+    expect_code("mem.byte[0x100] = 'A'; mem.word[0x102] = 0x1234;", single, sizeof(single));
+
+    // 地址依次相接的store合并成一条dword store
+    static const uint8_t merged[] = {0x6A, 0x10, 0x1F, 0x66, 0xC7, 0x06, 0x00, 0x00, 0x48, 0x07, 0x69, 0x07};
+    expect_code("mem.byte[0x100] = 'H'; mem.byte[0x101] = 0x07; mem.word[0x102] = 0x0769;", merged, sizeof(merged));
+
+    // 其余的store按程序顺序逐条生成：重复写同一地址（UART数据寄存器）每次都写，地址递减也不重排
+    static const uint8_t ordered[] = {
+        0x6A, 0x3F, 0x1F,                    // push 0x3F; pop ds
+        0xC6, 0x06, 0x08, 0x00, 'H',         // mov byte [8], 'H'
+        0xC6, 0x06, 0x08, 0x00, 'i',         // mov byte [8], 'i'
+        0xC7, 0x06, 0x10, 0x1C, 0x01, 0x00,  // mov word [0x1C10], 1（0x2000）
+        0xC7, 0x06, 0x10, 0x0C, 0x02, 0x00,  // mov word [0x0C10], 2（0x1000）
+    };
+    expect_code("mem.byte[0x3F8] = 'H'; mem.byte[0x3F8] = 'i'; mem.word[0x2000] = 1; mem.word[0x1000] = 2;",
+                ordered, sizeof(ordered));
+
+    // 值已经在寄存器里：mov [0], ax（moffs形式，3 bytes）/ mov [0x100], bl
+    // （store run在寄存器赋值之后生成，寄存器赋值不读写memory）
+    static const uint8_t from_reg[] = {0xB8, 0x20, 0x07, 0xBB, 0x41, 0x00, 0x6A, 0x20, 0x1F,
+                                       0xA3, 0x00, 0x00, 0x88, 0x1E, 0x00, 0x01};
+    expect_code("reg.ax = 0x0720; mem.word[0x200] = 0x0720; reg.bx = 'A'; mem.byte[0x300] = 'A';",
+                from_reg, sizeof(from_reg));
+
+    // 重复的word：rep stosw写到ES:DI（保存用到的寄存器）
+    char src[4096];
+    size_t len = 0;
+    for (int i = 0; i < 40; i++) len += sprintf(src + len, "mem.word[0x%x] = 0x0720;", 0x1000 + 2 * i);
+    static const uint8_t fill[] = {
+        0x68, 0x00, 0x01, 0x07, 0x57, 0x51, 0x50,  // push 0x100; pop es; push di; push cx; push ax
+        0x31, 0xFF, 0xB9, 0x28, 0x00, 0xB8, 0x20, 0x07,  // xor di, di; mov cx, 40; mov ax, 0x0720
+        0xFC, 0xF3, 0xAB,                    // cld; rep stosw
+        0x58, 0x59, 0x5F,                    // pop ax; pop cx; pop di
+    };
+    expect_code(src, fill, sizeof(fill));
+
+    // 不重复的数据：嵌入代码的blob + cs rep movsw
+    len = 0;
+    for (int i = 0; i < 31; i++) len += sprintf(src + len, "mem.byte[0x%x] = %d;", 0x2000 + i, i + 1);
+    Emitter out = compile_source(src);
+    static const uint8_t head[] = {0x68, 0x00, 0x02, 0x07, 0x56, 0x57, 0x51, 0xE8, 31, 0x00};
+    static const uint8_t tail[] = {0x5E, 0x31, 0xFF, 0xB9, 15, 0x00, 0xFC, 0x2E, 0xF3, 0xA5, 0x2E, 0xA4,
+                                   0x59, 0x5F, 0x5E};
+    assert(out.len == sizeof(head) + 31 + sizeof(tail));
+    assert(memcmp(out.data, head, sizeof(head)) == 0 && memcmp(out.data + sizeof(head) + 31, tail, sizeof(tail)) == 0);
+    for (int i = 0; i < 31; i++) assert(out.data[sizeof(head) + i] == i + 1);
+    assert(out.len < 31 * 5 / 2);  // 逐条byte store要5 bytes/byte
+    emitter_free(&out);
+
+    // 关闭优化时逐条生成（段寄存器仍然缓存）
+    static const uint8_t literal[] = {0x6A, 0x10, 0x1F, 0xC6, 0x06, 0x00, 0x00, 0x41,
+                                      0xC6, 0x06, 0x01, 0x00, 0x42};
+    expect_code_opt("mem.byte[0x100] = 'A'; mem.byte[0x101] = 'B';", 0, literal, sizeof(literal));
+    printf("Test mem_assign passed.\n");
+}
+
+// 20位线性地址 → segment:offset
+static void test_segments(void) {
+    // VGA文本缓冲区：只加载一次DS（0xB800），之后的store都在同一个64 KiB窗口内
+    static const uint8_t vga[] = {0x68, 0x00, 0xB8, 0x1F, 0xC7, 0x06, 0x00, 0x00, 0x41, 0x07,
+                                  0xC7, 0x06, 0x9E, 0x0F, 0x42, 0x07};
+    expect_code("const VGA = 0xB8000; mem.word[VGA] = 0x0741; mem.word[VGA + 0xF9E] = 0x0742;", vga, sizeof(vga));
+
+    // 超出当前窗口才重新加载
+    static const uint8_t reload[] = {0x68, 0x00, 0x20, 0x1F, 0xC6, 0x06, 0x00, 0x00, 0x02,
+                                     0x68, 0x00, 0x10, 0x1F, 0xC6, 0x06, 0x00, 0x00, 0x01};
+    expect_code("mem.byte[0x20000] = 2; mem.byte[0x10000] = 1;", reload, sizeof(reload));
+
+    // rep stosw加载了ES之后，ES窗口内的单条store用es:前缀（1 byte）而不是重新加载DS（4 bytes）
+    char src[4096];
+    size_t len = 0;
+    for (int i = 0; i < 40; i++) len += sprintf(src + len, "mem.word[0x%x] = 0x0720;", 0xB8000 + 2 * i);
+    len += sprintf(src + len, "mem.byte[0xB8100] = 'x';");
+    Emitter out = compile_source(src);
+    static const uint8_t es_store[] = {0x26, 0xC6, 0x06, 0x00, 0x01, 'x'};
+    assert(out.len > sizeof(es_store) && out.data[0] == 0x68 && out.data[3] == 0x07);  // push 0xB800; pop es
+    assert(memcmp(out.data + out.len - sizeof(es_store), es_store, sizeof(es_store)) == 0);
+    emitter_free(&out);
+
+    // 运行时才知道的地址：偏移算进bx（先保存），常量部分减去段基址之后放进disp
+    static const uint8_t indexed[] = {
+        0xB9, 0x64, 0x00, 0x51, 0xBE, 0x64, 0x00, 0x29, 0xCE,  // mov cx, 100; push cx; si = 100 - cx
+        0x68, 0x00, 0xB8, 0x1F,                                // push 0xB800; pop ds
+        0x53, 0x89, 0xF3, 0xD1, 0xE3, 0xC6, 0x07, 0x41, 0x5B,  // push bx; bx = si * 2; mov byte [bx], 'A'; pop bx
+        0x53, 0x89, 0xF3, 0xD1, 0xE3, 0xC6, 0x47, 0x01, 0x07, 0x5B,  // ...; mov byte [bx+1], 7; ...
+        0x59, 0xE2, 0xE0,                                      // pop cx; loop
+    };
+    expect_code("const VGA = 0xB8000; func put(c, x) { mem.byte[VGA + x * 2] = c; mem.byte[VGA + x * 2 + 1] = 0x07; }"
+                "for i in 0..100 { put('A', i); }",
+                indexed, sizeof(indexed));
+
+    // 1 MB边界内的最高地址
+    static const uint8_t top[] = {0x6A, 0xFF, 0x1F, 0xC6, 0x06, 0x0F, 0x00, 0x5A};
+    expect_code("mem.byte[0xFFFFF] = 'Z';", top, sizeof(top));
+    printf("Test segments passed.\n");
+}
+
+// function：小的叶子function内联，其余按寄存器约定调用（ax/bx/cx/dx，之后的parameter入栈）
+static void test_functions(void) {
+    // 内联：常量实参折叠进function体，和直接写store完全一样
+    Emitter inlined = compile_source("const VGA = 0xB8000; func put(c, x) { mem.byte[VGA + x * 2] = c; }"
+                                     "put('A', 0); put('B', 1);");
+    Emitter direct = compile_source("mem.byte[0xB8000] = 'A'; mem.byte[0xB8002] = 'B';");
+    assert(inlined.len == direct.len && memcmp(inlined.data, direct.data, direct.len) == 0);
+    emitter_free(&inlined);
+    emitter_free(&direct);
+    // 关闭优化时也能lower（backend折叠常量运算）
+    static const uint8_t unopt[] = {0x68, 0x00, 0xB8, 0x1F, 0xC6, 0x06, 0x04, 0x00, 0x43};
+    expect_code_opt("func put(c, x) { mem.byte[0xB8000 + x * 2] = c; } put('C', 2);", 0, unopt, sizeof(unopt));
+
+    // 超过内联上限的function有自己的body；wrap的调用在ret之前，变成jmp（尾调用）
+    // 交换的实参经过栈：push bx; push ax; pop bx; pop ax
+    static const uint8_t calls[] = {
+        0xEB, 0x08,                                      // jmp short over spin
+        0x31, 0xED, 0xBE, 0x05, 0x00, 0x89, 0xDF, 0xC3,  // spin: xor bp, bp; mov si, 5; mov di, bx; ret
+        0xEB, 0x06,                                      // jmp short over wrap
+        0x53, 0x50, 0x5B, 0x58, 0xEB, 0xF0,              // wrap: ...; jmp spin
+        0xB8, 0x01, 0x00, 0xBB, 0x02, 0x00, 0xE8, 0xF1, 0xFF,  // mov ax, 1; mov bx, 2; call wrap
+    };
+    expect_code("func spin(a, b) { reg.si = a; reg.di = b; reg.bp = 0; reg.si = 1; reg.di = 2;"
+                "  reg.si = 3; reg.di = 4; reg.si = 5; reg.di = b; }"
+                "func wrap(a, b) { spin(b, a); }"
+                "wrap(1, 2);", calls, sizeof(calls));
+
+    // 第五个parameter在栈上：push bp; mov bp, sp; mov si, [bp+4]，调用者add sp, 2清栈；
+    // 原样传下去的寄存器parameter不需要移动
+    static const uint8_t stack[] = {
+        0xEB, 0x14,
+        0x55, 0x89, 0xE5, 0x8B, 0x76, 0x04,              // five: push bp; mov bp, sp; mov si, [bp+4]
+        0xFF, 0x76, 0x04, 0xE8, 0xF4, 0xFF, 0x83, 0xC4, 0x02,  // push word [bp+4]; call five; add sp, 2
+        0x8B, 0x76, 0x04, 0x5D, 0xC3,                    // mov si, [bp+4]; pop bp; ret
+        0x6A, 0x05, 0xB8, 0x01, 0x00, 0xBB, 0x02, 0x00, 0xB9, 0x03, 0x00, 0xBA, 0x04, 0x00,
+        0xE8, 0xDB, 0xFF, 0x83, 0xC4, 0x02,
+    };
+    expect_code("func five(a, b, c, d, e) { reg.si = e; five(a, b, c, d, e); reg.si = e; }"
+                "five(1, 2, 3, 4, 5);", stack, sizeof(stack));
+
+    // 寄存器parameter在入口复制到变量：之后写参数寄存器、调用别的function都不影响它
+    // （g超过内联上限；f的a在si里，跨调用时溢出到[bp-2]）
+#define G_BODY "func g() { reg.ax = 1; reg.dx = 2; reg.ax = 3; reg.dx = 4; reg.ax = 5; reg.dx = 6;" \
+               "  reg.ax = 7; reg.dx = 8; reg.ax = 9; }"
+    static const uint8_t swap[] = {
+        0xEB, 0x07, 0xBA, 0x08, 0x00, 0xB8, 0x09, 0x00, 0xC3,  // g
+        0xEB, 0x08,
+        0x89, 0xC6, 0x89, 0xD8, 0x89, 0xF3, 0xEB, 0xEF,  // f: mov si, ax; mov ax, bx; mov bx, si; jmp g
+        0xB8, 0x05, 0x00, 0xBB, 0x06, 0x00, 0xE8, 0xEF, 0xFF,
+        0xB8, 0x07, 0x00, 0xBB, 0x08, 0x00, 0xE8, 0xE6, 0xFF,
+    };
+    expect_code(G_BODY "func f(a, b) { reg.ax = b; reg.bx = a; g(); } f(5, 6); f(7, 8);", swap, sizeof(swap));
+    static const uint8_t across_call[] = {
+        0xEB, 0x07, 0xBA, 0x08, 0x00, 0xB8, 0x09, 0x00, 0xC3,  // g
+        0xEB, 0x16,
+        0x55, 0x89, 0xE5, 0x83, 0xEC, 0x02, 0x89, 0x46, 0xFE,  // f: push bp; mov bp, sp; sub sp, 2; mov [bp-2], ax
+        0xE8, 0xEB, 0xFF, 0x8B, 0x5E, 0xFE, 0xE8, 0xE5, 0xFF,  // call g; mov bx, [bp-2]; call g
+        0x89, 0xEC, 0x5D, 0xC3,
+        0xB8, 0x05, 0x00, 0xE8, 0xE4, 0xFF,
+    };
+    expect_code(G_BODY "func f(a) { g(); reg.bx = a; g(); } f(5);", across_call, sizeof(across_call));
+#undef G_BODY
+    printf("Test functions passed.\n");
+}
+
+// 控制流：常量条件在编译期选出分支，小循环展开，其余用cx计数的loop；跳转先用短格式，放不下再加宽
+static void test_control_flow(void) {
+    static const uint8_t folded[] = {0xBB, 0x02, 0x00};
+    expect_code("if 0 { reg.ax = 1; } else if 2 - 2 { reg.cx = 1; } else { reg.bx = 2; }", folded, sizeof(folded));
+
+    // 展开：循环变量变成常量，和直接写store完全一样
+    Emitter unrolled = compile_source("for i in 0..3 { mem.byte[0xB8000 + i * 2] = 'A' + i; }");
+    Emitter direct = compile_source("mem.byte[0xB8000] = 'A'; mem.byte[0xB8002] = 'B'; mem.byte[0xB8004] = 'C';");
+    assert(unrolled.len == direct.len && memcmp(unrolled.data, direct.data, direct.len) == 0);
+    emitter_free(&unrolled);
+    emitter_free(&direct);
+
+    // mov cx, 100; top: push cx; mov ax, 7; pop cx; loop top; jmp $（死循环之后的代码被删除）
+    static const uint8_t loops[] = {0xB9, 0x64, 0x00, 0x51, 0xB8, 0x07, 0x00, 0x59, 0xE2, 0xF9, 0xEB, 0xFE};
+    expect_code("for k in 0..100 { reg.ax = 7; } while 1 { } reg.bx = 5;", loops, sizeof(loops));
+    // 关闭优化：一律用near格式（loop变成dec cx; jnz near），不展开，不删除死代码
+    static const uint8_t near[] = {0xB9, 0x64, 0x00, 0x51, 0xB8, 0x07, 0x00, 0x59, 0x49, 0x0F, 0x85, 0xF6, 0xFF,
+                                   0xE9, 0xFD, 0xFF, 0xBB, 0x05, 0x00};
+    expect_code_opt("for k in 0..100 { reg.ax = 7; } while 1 { } reg.bx = 5;", 0, near, sizeof(near));
+
+    // 运行时条件：test bx, bx; jz else；两个分支汇合之后ax仍然是c
+    static const uint8_t branch[] = {
+        0xEB, 0x0E,
+        0x85, 0xDB, 0x74, 0x04, 0x89, 0xC6, 0xEB, 0x02, 0x89, 0xC7,  // test bx, bx; jz; mov si, ax; jmp; mov di, ax
+        0xBD, 0x07, 0x00, 0xC3,                                      // mov bp, 7; ret
+        0xB8, 0x01, 0x00, 0x31, 0xDB, 0xE8, 0xEA, 0xFF,
+    };
+    expect_code("func show(c, big) { if big { reg.si = c; } else { reg.di = c; } reg.bp = 1; reg.bp = 2;"
+                "  reg.bp = 3; reg.bp = 4; reg.bp = 5; reg.bp = 6; reg.bp = 7; }"
+                "show(1, 0);", branch, sizeof(branch));
+
+    // 循环体超过127 bytes：loop放不下，变成dec cx; jnz near top（0F 85，386）
+    char src[4096];
+    size_t len = sprintf(src, "for k in 0..100 {");
+    for (int i = 0; i < 40; i++) len += sprintf(src + len, " mem.byte[0x%x] = %d;", 0x100 + 3 * i, i + 1);
+    sprintf(src + len, " }");
+    Emitter out = compile_source(src);
+    int32_t back = (int16_t)(out.data[out.len - 2] | out.data[out.len - 1] << 8);
+    assert(out.data[0] == 0xB9 && out.data[3] == 0x51);  // mov cx, 100; push cx
+    assert(memcmp(out.data + out.len - 5, "\x49\x0F\x85", 3) == 0 && back == 3 - (int32_t)out.len);
+    emitter_free(&out);
+
+    // 条件跳转放不下rel8：jz rel16（0F 84，386），跳过整个if
+    len = sprintf(src, "func f(c) { if c {");
+    for (int i = 0; i < 40; i++) len += sprintf(src + len, " mem.byte[0x%x] = %d;", 0x100 + 3 * i, i + 1);
+    sprintf(src + len, " } reg.bp = 1; reg.bp = 2; reg.bp = 3; reg.bp = 4; reg.bp = 5; reg.bp = 6; reg.bp = 7;"
+                       " reg.bp = 8; } f(1);");
+    out = compile_source(src);
+    int32_t skip = (int16_t)(out.data[7] | out.data[8] << 8);
+    assert(memcmp(out.data + 3, "\x85\xC0\x0F\x84", 4) == 0);  // test ax, ax; jz
+    assert(memcmp(out.data + 9 + skip, "\xBD\x08\x00", 3) == 0);  // mov bp, 8（之前的被覆盖）
+    emitter_free(&out);
+    printf("Test control_flow passed.\n");
+}
+
+// 变量：线性扫描分配到寄存器，循环里不碰内存；寄存器不够时权重最低的溢出到[bp-2-2*slot]
+static void test_variables(void) {
+    static const uint8_t direct[] = {0xB8, 0x05, 0x00};  // 分配到ax（被reg.ax = x提示），mov直接写进去
+    expect_code("var x = 5; reg.ax = x;", direct, sizeof(direct));
+
+    // sum -> ax, i -> si：xor ax, ax; xor si, si; top: （条件经过ax）; je end; add ax, si; add si, 1; jmp top
+    static const uint8_t loop[] = {
+        0x31, 0xC0, 0x31, 0xF6,
+        0x50, 0x89, 0xF0, 0x83, 0xE8, 0x0A, 0x85, 0xC0, 0x58, 0x74, 0x07,
+        0x01, 0xF0, 0x83, 0xC6, 0x01, 0xEB, 0xEE,
+    };
+    static const char sum[] = "var sum = 0; var i = 0; while i - 10 { sum = sum + i; i = i + 1; } reg.ax = sum;";
+    expect_code(sum, loop, sizeof(loop));
+    Emitter unopt = compile_source_opt(sum, 0);
+    assert(unopt.len > 0);
+    emitter_free(&unopt);
+
+    // 运行时for：循环变量是 100 - cx，acc留在si里
+    static const uint8_t counted[] = {
+        0x31, 0xF6, 0xB9, 0x64, 0x00,                     // xor si, si; mov cx, 100
+        0x51, 0xBF, 0x64, 0x00, 0x29, 0xCF, 0x01, 0xFE,   // push cx; mov di, 100; sub di, cx; add si, di
+        0x59, 0xE2, 0xF5,                                 // pop cx; loop
+    };
+    Emitter out = compile_source("var acc = 0; for i in 0..100 { acc = acc + i; } mem.word[0x10] = acc;");
+    assert(out.len > sizeof(counted) && memcmp(out.data, counted, sizeof(counted)) == 0);
+    emitter_free(&out);
+
+    // 八个同时活跃的变量，六个寄存器：g和h溢出，开头mov bp, sp; sub sp, 4
+    out = compile_source("var a = 1; var b = 2; var c = 3; var d = 4; var e = 5; var f = 6; var g = 7; var h = 8;"
+                         "while h { a = a + 1; b = b + a; c = c + b; d = d + c; e = e + d; f = f + e; g = g + f;"
+                         "  h = h - 1; }"
+                         "mem.word[0x100] = a + b; mem.word[0x102] = c + d; mem.word[0x104] = e + f + g;");
+    assert(memcmp(out.data, "\x89\xE5\x83\xEC\x04\xBE\x01\x00", 8) == 0);
+    assert(memcmp(out.data + 0x17, "\xC7\x46\xFE\x07\x00\xC7\x46\xFC\x08\x00", 10) == 0);
+    emitter_free(&out);
+
+    // 函数里溢出：没有栈上parameter也要push bp; mov bp, sp
+    out = compile_source("func f(x) { var a = x; var b = 2; var c = 3; var d = 4; var e = 5; var g = 6; var h = 7;"
+                         "  var k = 8; while k { a = a + h; b = b + a; c = c + b; d = d + c; e = e + d; g = g + e;"
+                         "  h = h + g; k = k - 1; } mem.word[0x100] = a + b + c + d + e + g + h; } f(1); f(2);");
+    assert(memcmp(out.data + 2, "\x55\x89\xE5\x83\xEC", 5) == 0);
+    emitter_free(&out);
+    printf("Test variables passed.\n");
+}
+
+// 范围检查报告后跳过那条语句，后面的语句照常检查；全部生成完再失败
+static void test_error_recovery(void) {
+    static const char src[] = "reg.ax = 0x10000; reg.bx = 1; mem.word[0x10] = 0x12345; var x = 0x20000; reg.cx = x;"
+                              "for i in 0..70000 { reg.dx = i; } mem.byte[0x100000] = 1;";
+    ErrorContext errors;
+    error_context_init(&errors, NULL, 0);
+    Lexer* lexer = lexer_init_buffer(src, strlen(src));
+    lexer->errors = &errors;
+    Parser* parser = parser_init(lexer);
+    AstNode* ast = parser_parse_file(parser);
+    assert(errors.count == 0);
+    Emitter out;
+    emitter_init(&out, 0);
+    Codegen cg;
+    codegen_init(&cg, &out);
+    cg.errors = &errors;
+    ErrorTrap trap;
+    if (setjmp(trap.env) == 0) {
+        error_trap_set(&trap);
+        codegen_generate(&cg, ast);
+        assert(0);
+    }
+    assert(errors.count == 5 && strcmp(trap.message, "Compilation failed with 5 errors") == 0);
+    codegen_cleanup(&cg);
+    emitter_free(&out);
+    parser_free(parser);
+    lexer_free(lexer);
+    printf("Test error_recovery passed.\n");
+}
+
+// 32位保护模式：同样的指令，imm/disp/rel都是32位，不需要段寄存器（平坦模型）；
+// 16位内存操作数加0x66，能符号扩展的立即数用imm8格式
+static void test_protected_mode(void) {
+    static const uint8_t stores[] = {
+        0xB8, 0x78, 0x56, 0x34, 0x12,                                // mov eax, 0x12345678
+        0xC7, 0x05, 0x00, 0x00, 0x10, 0x00, 0x44, 0x33, 0x22, 0x11,  // mov dword [0x100000], ...
+        0x66, 0xC7, 0x05, 0x00, 0x00, 0x20, 0x00, 0x66, 0x55,        // mov word [0x200000], 0x5566
+        0xC6, 0x05, 0x00, 0x00, 0x30, 0x00, 0x07,                    // mov byte [0x300000], 7
+    };
+    expect_code("use x86_pm32; reg.eax = 0x12345678; mem.dword[0x100000] = 0x11223344;"
+                "mem.word[0x200000] = 0x5566; mem.byte[0x300000] = 7;", stores, sizeof(stores));
+
+    // 第五个parameter在[ebp+8]，调用者add esp, 4；push imm8
+    static const uint8_t calls[] = {
+        0xEB, 0x13,
+        0x55, 0x89, 0xE5, 0x8B, 0x75, 0x08,              // five: push ebp; mov ebp, esp; mov esi, [ebp+8]
+        0xFF, 0x75, 0x08, 0xE8, 0xF2, 0xFF, 0xFF, 0xFF,  // push dword [ebp+8]; call five
+        0x83, 0xC4, 0x04, 0x5D, 0xC3,                    // add esp, 4; pop ebp; ret
+        0x6A, 0x05, 0xB8, 0x01, 0x00, 0x00, 0x00, 0xBB, 0x02, 0x00, 0x00, 0x00,
+        0xB9, 0x03, 0x00, 0x00, 0x00, 0xBA, 0x04, 0x00, 0x00, 0x00,
+        0xE8, 0xD2, 0xFF, 0xFF, 0xFF, 0x83, 0xC4, 0x04,
+    };
+    expect_code("use x86_pm32; func five(a, b, c, d, e) { reg.esi = e; five(a, b, c, d, e); }"
+                "five(1, 2, 3, 4, 5);", calls, sizeof(calls));
+
+    // rep stosd填充28 bytes + 1 byte的尾巴
+    Emitter out = compile_source("use x86_pm32; for i in 0..29 { mem.byte[0x400000 + i] = 'A'; }");
+    assert(memcmp(out.data, "\x57\x51\x50\xBF\x00\x00\x40\x00\xB9\x07\x00\x00\x00", 13) == 0);
+    assert(memcmp(out.data + out.len - 7, "\xC6\x05\x1C\x00\x40\x00\x41", 7) == 0);
+    emitter_free(&out);
+    printf("Test protected_mode passed.\n");
+}
+
+// 增量编译的cache：按状态和源码查找，写盘再读回；splice的代码和编译出来的一样接在后面
+static void test_output_cache(void) {
+    const char* src = "reg.ax = 1; reg.bx = 2;\nmem.byte[0x100] = 3;";
+    size_t first = strlen("reg.ax = 1; reg.bx = 2;\n");
+    static const uint8_t code[] = {0xB8, 0x01, 0x00, 0xBB, 0x02, 0x00};
+
+    OutputCache cache;
+    output_cache_init(&cache);
+    OutputCacheEntry entry = {0};
+    entry.state = 42;
+    entry.prefix = output_cache_prefix(src, strlen(src));
+    entry.text = hash_bytes64(HASH64_INIT, src, first);
+    entry.len = (uint32_t)first;
+    entry.lines = 1;
+    entry.code_len = sizeof(code);
+    entry.alloc.homes = 2;
+    output_cache_add(&cache, &entry, code);
+    for (int i = 0; i < 100; i++) {  // 索引扩容
+        OutputCacheEntry other = entry;
+        other.state = 1000 + (uint64_t)i;
+        output_cache_add(&cache, &other, code);
+    }
+
+    const OutputCacheEntry* hit = output_cache_find(&cache, 42, src, strlen(src));
+    assert(hit && hit->len == first && hit->alloc.homes == 2);
+    assert(memcmp(cache.code + hit->code_offset, code, sizeof(code)) == 0);
+    assert(output_cache_find(&cache, 43, src, strlen(src)) == NULL);           // 状态不同
+    assert(output_cache_find(&cache, 42, "reg.ax = 1; reg.bx = 9;", 23) == NULL);  // 源码不同
+    assert(output_cache_find(&cache, 42, src, first - 1) == NULL);           // 输入太短
+
+    char path[] = "/tmp/ecc_cache_testXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    assert(output_cache_save(&cache, path) == 0);
+    OutputCache loaded;
+    output_cache_init(&loaded);
+    assert(output_cache_load(&loaded, path) == 1 && loaded.count == cache.count);
+    hit = output_cache_find(&loaded, 1099, src, strlen(src));
+    assert(hit && memcmp(loaded.code + hit->code_offset, code, sizeof(code)) == 0);
+    output_cache_free(&loaded);
+
+    // 损坏的文件当作不同版本的cache忽略
+    FILE* fp = fopen(path, "r+b");
+    assert(fp && fputs("NOTCACHE", fp) >= 0);
+    fclose(fp);
+    assert(output_cache_load(&loaded, path) == -1 && loaded.count == 0);
+    remove(path);
+    assert(output_cache_load(&loaded, path) == 0);
+
+    // splice：后面语句的label仍然按拼接后的位置计算
+    Emitter out;
+    emitter_init(&out, 0);
+    Codegen cg;
+    codegen_init(&cg, &out);
+    codegen_splice(&cg, code, sizeof(code));
+    assert(out.len == sizeof(code) && cg.labels.base == sizeof(code));
+    codegen_cleanup(&cg);
+    emitter_free(&out);
+    output_cache_free(&cache);
+    printf("Test output_cache passed.\n");
+}
+
+// --stats：计时不改变生成的代码；parser成批读Token时给lexer计时，codegen只记自己的阶段
+// （parse和写文件由main.c计时）；JSON是一行，文件名转义
+static void test_stats(void) {
+    static const char src[] = "use x86_real;\nconst VGA = 0xB8000;\nfunc put(c, x) { mem.byte[VGA + x * 2] = c; }\n"
+                              "put('A', 0); put('B', 1);\nuse riscv32c;\nreg.a0 = 1; mem.word[0x100] = 0x4141;\n";
+    Lexer* lexer = lexer_init_buffer(src, strlen(src));
+    Parser* parser = parser_init(lexer);
+    CompileStats stats = {0};
+    parser_time_lexer(parser, &stats.seconds[STATS_LEX]);
+    AstNode* ast = parser_parse_file(parser);
+    assert(parser->node_count >= 8);
+    Lexer* scan = lexer_init_buffer(src, strlen(src));
+    size_t tokens = 0;
+    while (lexer_next_token(scan).type != TOKEN_EOF) tokens++;
+    lexer_free(scan);
+    assert(parser->token_count == tokens && parser->lexed_bytes == strlen(src));
+    Emitter out;
+    emitter_init(&out, 0);
+    Codegen cg;
+    codegen_init(&cg, &out);
+    cg.stats = &stats;
+    codegen_generate(&cg, ast);  // use riscv32c在遍历中间flush一次
+    Emitter expected = compile_source(src);
+    assert(out.len == expected.len && memcmp(out.data, expected.data, out.len) == 0);
+    double flushes = 0;
+    for (int phase = STATS_IR_GEN; phase <= STATS_LOWER; phase++) {
+        assert(stats.seconds[phase] >= 0);
+        if (phase != STATS_IR_GEN) flushes += stats.seconds[phase];
+    }
+    assert(stats.seconds[STATS_IR_GEN] > 0 && flushes > 0);
+    assert(stats.seconds[STATS_LEX] > 0 && stats.seconds[STATS_PARSE] == 0 && stats.seconds[STATS_WRITE] == 0);
+    emitter_free(&expected);
+    emitter_free(&out);
+    codegen_cleanup(&cg);
+    parser_free(parser);
+    lexer_free(lexer);
+
+    stats.seconds[STATS_LEX] = 0;
+    stats.total = 1.0;
+    stats.tokens = 7;
+    char* text = NULL;
+    size_t len = 0;
+    FILE* fp = open_memstream(&text, &len);
+    stats_print_json(&stats, "a\"b\\c.elfc", fp);
+    fclose(fp);
+    static const char prefix[] = "{\"file\":\"a\\\"b\\\\c.elfc\",\"phases_ms\":{\"lex\":0.000000,\"parse\":0.000000,";
+    assert(strncmp(text, prefix, sizeof(prefix) - 1) == 0);
+    assert(strstr(text, ",\"total_ms\":1000.000000,") && strstr(text, ",\"tokens\":7,"));
+    assert(strchr(text, '\n') == text + len - 1 && text[len - 2] == '}');
+    free(text);
+    printf("Test stats passed.\n");
+}
+
+int main(void) {
+    test_emitter();
+    test_reg_assign();
+    test_peephole();
+    test_ir();
+    test_mem_assign();
+    test_segments();
+    test_functions();
+    test_control_flow();
+    test_variables();
+    test_protected_mode();
+    test_error_recovery();
+    test_output_cache();
+    test_stats();
+    printf("All codegen tests passed.\n");
+    return 0;
+}
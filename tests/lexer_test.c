@@ -1,4 +1,203 @@
-
 #include "../src/lexer/lexer.h"  // 从tests/目录到src/lexer/lexer.h的相对路径
 #include "../src/common/types.h"  // 顺带确认types.h也正确包含（Token类型依赖它）
-#include "test_common.h"
\ No newline at end of file
+#include "../src/lexer/charclass.h"
+#include "test_common.h"
+#include <stdio.h>
+#include <unistd.h>
+
+static const char* sample_src =
+    "use x86_real;  // 加载x86实模式模块\n"
+    "reg.ax = 0x1234;  // 预期机器码：B8 34 12\n"
+    "\n"
+    "const VIDEO_MEM = 753664;\n"
+    "mem.byte register ..'A'";
+
+static const TokenType sample_types[] = {
+    TOKEN_USE, TOKEN_ID, TOKEN_SEMICOLON,
+    TOKEN_REG, TOKEN_ID, TOKEN_EQUALS, TOKEN_NUM_HEX, TOKEN_SEMICOLON,
+    TOKEN_CONST, TOKEN_ID, TOKEN_EQUALS, TOKEN_NUM_DEC, TOKEN_SEMICOLON,
+    TOKEN_MEM, TOKEN_ID, TOKEN_ID, TOKEN_DOTDOT, TOKEN_CHAR, TOKEN_EOF
+};
+
+// 对比Token文本（Token只是源码span）
+static int text_is(const Lexer* lexer, const Token* tok, const char* text) {
+    return tok->len == strlen(text) && memcmp(lexer_token_text(lexer, tok), text, tok->len) == 0;
+}
+
+// 逐个对比Token类型，返回读到的Token数
+static size_t expect_types(Lexer* lexer, const TokenType* types, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        Token tok = lexer_next_token(lexer);
+        assert(tok.type == types[i]);
+    }
+    return count;
+}
+
+static void test_buffer_tokens(void) {
+    Lexer* lexer = lexer_init_buffer(sample_src, strlen(sample_src));
+    expect_types(lexer, sample_types, sizeof(sample_types) / sizeof(sample_types[0]));
+    // EOF是粘滞的
+    assert(lexer_next_token(lexer).type == TOKEN_EOF);
+    lexer_free(lexer);
+    printf("Test buffer_tokens passed.\n");
+}
+
+static void test_values_and_lines(void) {
+    Lexer* lexer = lexer_init_buffer(sample_src, strlen(sample_src));
+    Token tok;
+    for (int i = 0; i < 4; i++) tok = lexer_next_token(lexer);
+    assert(tok.type == TOKEN_REG && text_is(lexer, &tok, "reg.") && tok.line == 2);
+    tok = lexer_next_token(lexer);
+    assert(text_is(lexer, &tok, "ax"));
+    lexer_next_token(lexer);
+    tok = lexer_next_token(lexer);
+    assert(text_is(lexer, &tok, "0x1234") && tok.num == 0x1234 && tok.line == 2);
+    lexer_next_token(lexer);
+    tok = lexer_next_token(lexer);
+    assert(tok.type == TOKEN_CONST && tok.line == 4);
+    lexer_next_token(lexer);
+    lexer_next_token(lexer);
+    tok = lexer_next_token(lexer);
+    assert(tok.type == TOKEN_NUM_DEC && tok.num == 753664);
+    lexer_free(lexer);
+    printf("Test values_and_lines passed.\n");
+}
+
+// 输入不以'\0'结尾时，扫描不能越过buffer末尾
+static void test_unterminated_buffer(void) {
+    char buf[8];
+    memcpy(buf, "reg.axZZ", 8);
+    Lexer* lexer = lexer_init_buffer(buf, 6);
+    assert(lexer_next_token(lexer).type == TOKEN_REG);
+    Token tok = lexer_next_token(lexer);
+    assert(tok.type == TOKEN_ID && text_is(lexer, &tok, "ax"));
+    assert(lexer_next_token(lexer).type == TOKEN_EOF);
+    lexer_free(lexer);
+    printf("Test unterminated_buffer passed.\n");
+}
+
+// 普通文件走mmap路径
+static void test_mapped_file(void) {
+    FILE* fp = tmpfile();
+    assert(fp);
+    fputs(sample_src, fp);
+    rewind(fp);
+    Lexer* lexer = lexer_init(fp);
+    assert(lexer->source == LEXER_SRC_MMAP);
+    expect_types(lexer, sample_types, sizeof(sample_types) / sizeof(sample_types[0]));
+    lexer_free(lexer);
+    fclose(fp);
+    printf("Test mapped_file passed.\n");
+}
+
+// 管道无法映射，回退为一次性read
+static void test_pipe_fallback(void) {
+    int fds[2];
+    assert(pipe(fds) == 0);
+    size_t len = strlen(sample_src);
+    assert(write(fds[1], sample_src, len) == (ssize_t)len);
+    close(fds[1]);
+    FILE* fp = fdopen(fds[0], "r");
+    Lexer* lexer = lexer_init(fp);
+    assert(lexer->source == LEXER_SRC_HEAP && lexer->size == len);
+    expect_types(lexer, sample_types, sizeof(sample_types) / sizeof(sample_types[0]));
+    lexer_free(lexer);
+    fclose(fp);
+    printf("Test pipe_fallback passed.\n");
+}
+
+// Token是源码span：长标识符不截断，字符constant预解码
+static void test_spans(void) {
+    char src[200];
+    memset(src, 'a', 100);
+    strcpy(src + 100, " 'Z' 0XfF");
+    Lexer* lexer = lexer_init_buffer(src, strlen(src));
+    Token tok = lexer_next_token(lexer);
+    assert(tok.type == TOKEN_ID && tok.offset == 0 && tok.len == 100);
+    tok = lexer_next_token(lexer);
+    assert(tok.type == TOKEN_CHAR && tok.num == 'Z' && text_is(lexer, &tok, "'Z'"));
+    tok = lexer_next_token(lexer);
+    assert(tok.type == TOKEN_NUM_HEX && tok.num == 0xFF && text_is(lexer, &tok, "0XfF"));
+    tok = lexer_next_token(lexer);
+    assert(tok.type == TOKEN_EOF && tok.offset == strlen(src) && tok.len == 0);
+    lexer_free(lexer);
+    printf("Test spans passed.\n");
+}
+
+// 完美哈希关键字表：关键字全部命中，近似词全部落到TOKEN_ID
+static void test_keywords(void) {
+    static const struct { const char* word; TokenType type; } cases[] = {
+        {"use", TOKEN_USE}, {"const", TOKEN_CONST}, {"var", TOKEN_VAR}, {"func", TOKEN_FUNC},
+        {"if", TOKEN_IF}, {"else", TOKEN_ELSE}, {"while", TOKEN_WHILE}, {"for", TOKEN_FOR},
+        {"in", TOKEN_IN}, {"hlt", TOKEN_ID}, {"i", TOKEN_ID}, {"iff", TOKEN_ID}, {"fo", TOKEN_ID},
+        {"uses", TOKEN_ID}, {"whilex", TOKEN_ID}, {"elsa", TOKEN_ID}, {"fnuc", TOKEN_ID},
+        {"ax", TOKEN_ID}, {"VIDEO_MEM", TOKEN_ID},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        assert(lexer_classify_word(NULL, cases[i].word, strlen(cases[i].word)) == cases[i].type);
+    }
+
+    // module注册的关键字
+    const char* src = "loop in repeat";
+    Lexer* lexer = lexer_init_buffer(src, strlen(src));
+    lexer_add_keyword(lexer, "repeat", TOKEN_WHILE);
+    for (int i = 0; i < 40; i++) {  // 触发扩展表扩容
+        char word[16];
+        snprintf(word, sizeof(word), "kw%d", i);
+        lexer_add_keyword(lexer, word, TOKEN_FOR);
+    }
+    assert(lexer_next_token(lexer).type == TOKEN_ID);
+    assert(lexer_next_token(lexer).type == TOKEN_IN);
+    assert(lexer_next_token(lexer).type == TOKEN_WHILE);
+    assert(lexer_classify_word(lexer, "kw39", 4) == TOKEN_FOR);
+    assert(lexer_classify_word(lexer, "kw40", 4) == TOKEN_ID);
+    lexer_free(lexer);
+    printf("Test keywords passed.\n");
+}
+
+// 每种SIMD实现都必须与标量实现逐位置一致（含跨16/32字节边界和buffer末尾）
+static void test_scan_impls(void) {
+    static const char alphabet[] = " \t\n\r\vaZ_09fFgG/;.x\x80\xff";
+    char buf[300];
+    srand(1234);
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        // 先生成长段同类字符，再混入随机字符，保证各种run长度都出现
+        buf[i] = (i / 37) % 3 == 0 ? " \n"[i % 2] : (i / 37) % 3 == 1 ? "a_Z9"[i % 4]
+                                                                   : alphabet[rand() % (sizeof(alphabet) - 1)];
+    }
+    const char* default_impl = scan_impl_name();
+    static const char* impls[] = {"avx2", "sse2"};
+    for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]); k++) {
+        for (size_t start = 0; start < sizeof(buf); start++) {
+            for (size_t stop = start; stop <= sizeof(buf); stop += 7) {
+                const char *b = buf + start, *e = buf + stop;
+                int lines_ref = 0, lines_simd = 0;
+                assert(scan_set_impl("scalar"));
+                const char* sp = scan_skip_space(b, e, &lines_ref);
+                const char* nl = scan_find_newline(b, e);
+                const char* id = scan_ident(b, e);
+                const char* hx = scan_hex(b, e);
+                if (!scan_set_impl(impls[k])) break;  // CPU不支持就跳过
+                assert(scan_skip_space(b, e, &lines_simd) == sp && lines_simd == lines_ref);
+                assert(scan_find_newline(b, e) == nl);
+                assert(scan_ident(b, e) == id);
+                assert(scan_hex(b, e) == hx);
+            }
+        }
+    }
+    assert(scan_set_impl(default_impl));
+    printf("Test scan_impls passed (default: %s).\n", default_impl);
+}
+
+int main(void) {
+    test_buffer_tokens();
+    test_values_and_lines();
+    test_unterminated_buffer();
+    test_spans();
+    test_keywords();
+    test_scan_impls();
+    test_mapped_file();
+    test_pipe_fallback();
+    printf("All lexer tests passed.\n");
+    return 0;
+}
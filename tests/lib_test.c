@@ -0,0 +1,115 @@
+// libecc：内存里编译，context在多次编译之间复用
+#include "../src/lib/ecc.h"
+#include "../src/codegen/codegen.h"
+#include "test_common.h"
+#include <stdio.h>
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)  // mallinfo2
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#endif
+
+static const char boot[] =
+    "use x86_real;\n"
+    "const VGA = 0xB8000;\n"
+    "func put(c, x) { mem.byte[VGA + x * 2] = c; mem.byte[VGA + x * 2 + 1] = 0x07; }\n"
+    "put('O', 0); put('K', 1);\n"
+    "var n = 3; while n { n = n - 1; reg.ax = n; }\n";
+
+static void test_compile_reuse(void) {
+    static const char* sources[] = {
+        boot,
+        "use riscv32c; reg.a0 = 5; mem.word[0x100] = 0x4141;",  // 上一次的module不会带过来
+        "reg.ax = 1; const VGA = 0xA0000; mem.byte[VGA] = 1;",  // 上一次的const也不会
+        boot,
+    };
+    EccContext* ctx = ecc_context_new(NULL);
+    assert(ctx && strcmp(ecc_diagnostics(ctx), "") == 0);
+    EccBuffer out = {0};
+    for (int round = 0; round < 50; round++) {
+        const char* src = sources[round % 4];
+        assert(ecc_compile(ctx, src, strlen(src), &out) == 0);
+        assert(strcmp(ecc_diagnostics(ctx), "") == 0);
+        Emitter expected = compile_source(src);
+        assert(out.len == expected.len && memcmp(out.data, expected.data, out.len) == 0);
+        emitter_free(&expected);
+    }
+    // 缓冲区被复用：热的context和缓冲区不再扩容
+    uint8_t* data = out.data;
+    assert(ecc_compile(ctx, boot, strlen(boot), &out) == 0 && out.data == data);
+    ecc_buffer_free(&out);
+    ecc_context_free(ctx);
+    printf("Test compile_reuse passed.\n");
+}
+
+static void test_errors(void) {
+    EccOptions options = {1, 2};
+    EccContext* ctx = ecc_context_new(&options);
+    EccBuffer out = {0};
+    static const char bad[] = "reg.zz = 1;\nreg.ax = 0x10000;\nreg.bx = ;\n";
+    assert(ecc_compile(ctx, bad, strlen(bad), &out) == -1 && out.len == 0);
+    const char* text = ecc_diagnostics(ctx);
+    assert(strstr(text, "[ERROR] Unknown register（line：1）") == text);
+    assert(strstr(text, "（line：3）") && strstr(text, "[ERROR] Too many errors (2), compilation stopped\n"));
+
+    // 失败之后context照常可用，诊断只属于最近一次编译
+    assert(ecc_compile(ctx, boot, strlen(boot), &out) == 0 && out.len > 0);
+    assert(strcmp(ecc_diagnostics(ctx), "") == 0);
+    static const char range[] = "reg.ax = 0x10000;";
+    assert(ecc_compile(ctx, range, strlen(range), &out) == -1);
+    assert(strcmp(ecc_diagnostics(ctx), "[ERROR] Register assignment exceeds 16-bit range (value: 0x10000, line: 1)\n"
+                                        "[ERROR] Compilation failed with 1 error\n") == 0);
+    ecc_buffer_free(&out);
+    ecc_context_free(ctx);
+    printf("Test errors passed.\n");
+}
+
+// 当前已分配的堆内存bytes（glibc和macOS；其他平台返回0，只剩ASan那一遍检查）
+static size_t heap_in_use(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#elif defined(__APPLE__)
+    malloc_statistics_t stats;
+    malloc_zone_statistics(NULL, &stats);
+    return stats.size_in_use;
+#else
+    return 0;
+#endif
+}
+
+// error()从寄存器分配和lowering中间longjmp出去，跳过了它们的收尾：工作内存在IR的scratch arena里，
+// 下一次编译reset时收回。热的context反复编译失败，堆不再增长（make test_asan在ASan下再检查一遍）
+static void test_errors_release_memory(void) {
+    static const char* failing[] = {
+        // 寄存器分配：变量溢出到栈上，但程序写了bp
+        "reg.bp = 1; var a = 1; var b = 2; var c = 3; var d = 4; var e = 5; var f = 6; var g = 7; var h = 8;"
+        " while a { a = a + b + c + d + e + f + g + h; b = a; c = b; d = c; e = d; f = e; g = f; h = g; }",
+        // x86 lowering
+        "var v = 5; while v { v = v - 1; } mem.dword[0x100] = v;",
+        // RISC-V lowering
+        "use riscv32; var v = 5; var w = 3; while v { v = v - 1; w = w * v; } reg.a0 = w;",
+    };
+    EccContext* ctx = ecc_context_new(NULL);
+    EccBuffer out = {0};
+    size_t before = 0;
+    for (int round = 0; round < 110; round++) {
+        if (round == 10) before = heap_in_use();  // 先把context的缓冲区用热
+        for (int i = 0; i < 3; i++) {
+            assert(ecc_compile(ctx, failing[i], strlen(failing[i]), &out) == -1);
+            assert(strstr(ecc_diagnostics(ctx), "[ERROR] ") == ecc_diagnostics(ctx));
+        }
+    }
+    assert(heap_in_use() <= before);
+    assert(ecc_compile(ctx, boot, strlen(boot), &out) == 0 && out.len > 0);
+    ecc_buffer_free(&out);
+    ecc_context_free(ctx);
+    printf("Test errors_release_memory passed.\n");
+}
+
+int main(void) {
+    test_compile_reuse();
+    test_errors();
+    test_errors_release_memory();
+    printf("All lib tests passed.\n");
+    return 0;
+}
@@ -2,10 +2,11 @@
 #include <stdlib.h>
 #include <string.h>
 
-// 假设 parser.h 是解析器的头文件
+// parser.h 是解析器的头文件
 #include "../src/parser/parser.h"
+#include "test_common.h"
 
-// 测试用例结构体
+// 测试用例结构体：输入源码，期望解析出的语句数
 typedef struct {
     const char *input;
     int expected_result;
@@ -13,11 +14,284 @@ typedef struct {
 
 // 简单的测试用例数组
 ParserTestCase test_cases[] = {
-    {"test input 1", 0},
-    {"test input 2", 1},
-    // 可以根据实际 parser 支持的语法添加更多测试用例
+    {"", 0},
+    {"use x86_real;", 0},
+    {"use x86_real;\nreg.ax = 0x1234;\nreg.bx = 0x5678;", 2},
+    {"const VIDEO_MEM = 0xb8000; reg.ax = 'A'; // comment\n", 2},
+    {"reg.ax = 1; use x86_real; reg.bx = 2;", 2},
+    {"const VGA = 0x8000; mem.byte[VGA] = 'A'; mem.word[VGA + 2] = 0x0741; mem.dword[0x10] = 0;", 4},
+    {"func put(c, x) { mem.byte[0xB8000 + x * 2] = c; } put('A', 0); put('B', 1);", 3},
+    {"if 1 { reg.ax = 1; } else { reg.bx = 2; } while 0 { } for i in 0..3 { reg.ax = i; }", 3},
+    {"var x = 1; x = x + 1; if x { var y = x; reg.ax = y; } func f(a) { var x = a; } f(x);", 5},
 };
 
+// 解析一段源码，返回语句数（use不算语句；AST随parser一起释放）
+static int parser_parse(const char* input) {
+    Lexer* lexer = lexer_init_buffer(input, strlen(input));
+    Parser* parser = parser_init(lexer);
+    BlockNode* root = (BlockNode*)parser_parse_file(parser);
+    int count = 0;
+    for (AstNode* stmt = root->statements; stmt; stmt = stmt->next) {
+        if (stmt->type != AST_EOF && stmt->type != AST_USE) count++;
+    }
+    parser_free(parser);
+    lexer_free(lexer);
+    return count;
+}
+
+// AST内容：名字来自arena副本，长度不受限制
+static int test_ast_contents(void) {
+    static const char src[] =
+        "const A_VERY_LONG_CONSTANT_NAME_THAT_USED_TO_BE_TRUNCATED_AT_32 = 0xb8000;\n"
+        "reg.ax = 0x1234;";
+    Lexer* lexer = lexer_init_buffer(src, strlen(src));
+    Arena arena;
+    arena_init(&arena, 0);
+    Parser* parser = parser_init_arena(lexer, &arena);
+    BlockNode* root = (BlockNode*)parser_parse_file(parser);
+
+    ConstDefNode* def = (ConstDefNode*)root->statements;
+    assert(def->base.type == AST_CONST_DEF && def->base.line == 1);
+    assert(strcmp(def->const_name, "A_VERY_LONG_CONSTANT_NAME_THAT_USED_TO_BE_TRUNCATED_AT_32") == 0);
+    assert(def->value.type == CONST_NUM && def->value.value.num_val == 0xb8000);
+
+    RegAssignNode* reg = (RegAssignNode*)def->base.next;
+    assert(reg->base.type == AST_REG_ASSIGN && reg->base.line == 2);
+    assert(strcmp(reg->reg_name, "ax") == 0 && reg->value.value.num_val == 0x1234);
+
+    // 名字指向arena，不指向源码buffer
+    assert(def->const_name < src || def->const_name >= src + sizeof(src));
+    assert(arena.peak > 0 && arena.used <= arena.reserved);
+
+    parser_free(parser);  // 借用的arena不随parser释放
+    assert(strcmp(reg->reg_name, "ax") == 0);
+    arena_destroy(&arena);
+    lexer_free(lexer);
+    return 1;
+}
+
+// 流式解析：arena峰值与语句数量无关
+static void count_sink(void* ctx, AstNode* stmt) {
+    assert(stmt->next == NULL && stmt->type == AST_REG_ASSIGN);
+    assert(strcmp(((RegAssignNode*)stmt)->reg_name, "cx") == 0);
+    (*(int*)ctx)++;
+}
+
+static size_t stream_peak(int statements) {
+    size_t len = (size_t)statements * 16;
+    char* src = malloc(len + 1);
+    for (int i = 0; i < statements; i++) memcpy(src + i * 16, "reg.cx = 0x10;\n ", 16);
+    Lexer* lexer = lexer_init_buffer(src, len);
+    Parser* parser = parser_init(lexer);
+    int count = 0;
+    parser_parse_stream(parser, count_sink, &count);
+    assert(count == statements);
+    size_t peak = parser->arena->peak;
+    parser_free(parser);
+    lexer_free(lexer);
+    free(src);
+    return peak;
+}
+
+static int test_stream(void) {
+    size_t small = stream_peak(10);
+    size_t large = stream_peak(100000);
+    return small > 0 && small == large;
+}
+
+// constant折叠：引用、运算符优先级、括号、字符constant
+static uint32_t fold_value(const char* src, int* type) {
+    Lexer* lexer = lexer_init_buffer(src, strlen(src));
+    Parser* parser = parser_init(lexer);
+    BlockNode* root = (BlockNode*)parser_parse_file(parser);
+    AstNode* last = root->statements;
+    while (last->next) last = last->next;
+    assert(last->type == AST_REG_ASSIGN);
+    ConstExpr value = ((RegAssignNode*)last)->value;
+    parser_free(parser);
+    lexer_free(lexer);
+    if (type) *type = value.type;
+    return value.value.num_val;
+}
+
+static int test_const_folding(void) {
+    int type;
+    assert(fold_value("const VIDEO_MEM = 0xb8000; reg.ax = VIDEO_MEM + 0xA0;", &type) == 0xb80A0 && type == CONST_NUM);
+    assert(fold_value("reg.ax = 2 + 3 * 4 - 10 / 5;", NULL) == 12);
+    assert(fold_value("reg.ax = (2 + 3) * 4;", NULL) == 20);
+    assert(fold_value("reg.ax = 0xF0 | 0x0F & 0x3C;", NULL) == 0xFC);
+    assert(fold_value("reg.ax = -1 & 0xFFFF;", NULL) == 0xFFFF);
+    assert(fold_value("const A = 1; const B = A + 1; const C = B * B; reg.ax = C - A;", NULL) == 3);
+    // 字符constant：num_val的高位也是干净的
+    assert(fold_value("reg.ax = 'A';", &type) == 'A' && type == CONST_CHAR);
+    assert(fold_value("const L = 'A'; reg.ax = L + 1;", &type) == 'B' && type == CONST_CHAR);
+    assert(fold_value("reg.ax = 'A' * 0x100;", &type) == 0x4100 && type == CONST_NUM);
+    return 1;
+}
+
+// function：parameter引用保留成表达式树，调用绑定到definition
+static int test_functions(void) {
+    static const char src[] =
+        "const BASE = 0xB8000;\n"
+        "func put(c, x) { mem.byte[BASE + x * 2] = c; reg.ax = 1 + 2; }\n"
+        "func twice(c) { put(c, 0); put(c, 1); }\n"
+        "twice('A');";
+    Lexer* lexer = lexer_init_buffer(src, strlen(src));
+    Parser* parser = parser_init(lexer);
+    BlockNode* root = (BlockNode*)parser_parse_file(parser);
+
+    FuncDefNode* put = (FuncDefNode*)root->statements->next;
+    assert(put->base.type == AST_FUNC_DEF && strcmp(put->func_name, "put") == 0);
+    assert(put->param_count == 2 && strcmp(put->params[1], "x") == 0);
+    assert(put->stmt_count == 2 && put->is_leaf && put->label == -1);
+
+    // BASE + x * 2：BASE折叠成常量，x是第1个parameter
+    MemAssignNode* store = (MemAssignNode*)put->body;
+    assert(store->addr.type == CONST_EXPR && store->value.type == CONST_EXPR);
+    Expr* addr = store->addr.value.expr;
+    assert(addr->kind == EXPR_BINARY && addr->op == TOKEN_PLUS);
+    assert(addr->lhs->kind == EXPR_CONST && addr->lhs->value == 0xB8000);
+    assert(addr->rhs->kind == EXPR_BINARY && addr->rhs->lhs->kind == EXPR_PARAM && addr->rhs->lhs->param == 1);
+    assert(store->value.value.expr->kind == EXPR_PARAM && store->value.value.expr->param == 0);
+    RegAssignNode* reg = (RegAssignNode*)store->base.next;
+    assert(reg->value.type == CONST_NUM && reg->value.value.num_val == 3);  // 不引用parameter的照常折叠
+
+    FuncDefNode* twice = (FuncDefNode*)put->base.next;
+    assert(!twice->is_leaf && twice->stmt_count == 2);
+    FuncCallNode* call = (FuncCallNode*)twice->base.next;
+    assert(call->base.type == AST_FUNC_CALL && call->target == twice && call->arg_count == 1);
+    assert(call->args[0].type == CONST_CHAR && call->args[0].value.num_val == 'A');
+    assert(((FuncCallNode*)twice->body)->target == put);
+
+    parser_free(parser);
+    lexer_free(lexer);
+    return 1;
+}
+
+// 错误恢复：每条出错的语句报告一次，跳到下一条语句继续；词法错误跳过出错的字符
+static int test_error_recovery(void) {
+    static const char src[] =
+        "reg.zz = 1;\n"                                  // Unknown register
+        "reg.ax = ;\n"                                   // 缺少constant
+        "func f(a) { reg.qq = a; reg.bx = a; }\n"        // 块里的错误只跳过那一条语句
+        "reg.cx = 2 @;\n"                                // Unknown character，语句本身正常
+        "if 1 { reg.ax = 1 } reg.dx = 'ab';\n";          // 缺少;（停在}之前），'ab'没有闭合
+    char* text = NULL;
+    size_t text_len = 0;
+    FILE* out = open_memstream(&text, &text_len);
+    ErrorContext errors;
+    error_context_init(&errors, out, 0);
+    Lexer* lexer = lexer_init_buffer(src, strlen(src));
+    lexer->errors = &errors;
+    Parser* parser = parser_init(lexer);
+    assert(parser->errors == &errors);
+
+    AstNode* stmts[8];
+    int count = 0;
+    while (parser->current_tok.type != TOKEN_EOF) {
+        AstNode* stmt = parser_parse_statement_recover(parser);
+        if (stmt) stmts[count++] = stmt;
+    }
+    assert(errors.count == 6 && count == 4);
+    assert(parser->binding_count == 0 && parser->block_depth == 0 && !parser->current_func);
+    FuncDefNode* f = (FuncDefNode*)stmts[0];
+    assert(f->base.type == AST_FUNC_DEF && f->body->type == AST_REG_ASSIGN && !f->body->next);
+    assert(stmts[1]->type == AST_REG_ASSIGN && ((RegAssignNode*)stmts[1])->value.value.num_val == 2);
+    assert(stmts[2]->type == AST_IF && stmts[3]->type == AST_REG_ASSIGN);
+    assert(((RegAssignNode*)stmts[3])->value.value.num_val == 'a');
+    fclose(out);
+    const char* lines[] = {"line：1", "line：2", "line：3", "line: 4", "line：5", "line: 5"};
+    const char* p = text;
+    for (int i = 0; i < 6; i++) {
+        assert(strncmp(p, "[ERROR] ", 8) == 0);
+        const char* end = strchr(p, '\n');
+        char line[256];
+        assert(end && (size_t)(end - p) < sizeof(line));
+        memcpy(line, p, end - p);
+        line[end - p] = '\0';
+        assert(strstr(line, lines[i]));
+        p = end + 1;
+    }
+    assert(*p == '\0');
+    free(text);
+    parser_free(parser);
+    lexer_free(lexer);
+
+    // parser_parse_file解析完再失败；达到上限时立即停止
+    for (int max = 0; max <= 2; max += 2) {
+        error_context_init(&errors, NULL, max);
+        lexer = lexer_init_buffer(src, strlen(src));
+        lexer->errors = &errors;
+        parser = parser_init(lexer);
+        ErrorTrap trap;
+        if (setjmp(trap.env) == 0) {
+            error_trap_set(&trap);
+            parser_parse_file(parser);
+            assert(0);
+        }
+        assert(strcmp(trap.message, max ? "Too many errors (2), compilation stopped"
+                                        : "Compilation failed with 6 errors") == 0);
+        assert(errors.count == (max ? 2 : 6));
+        parser_free(parser);
+        lexer_free(lexer);
+    }
+    return 1;
+}
+
+// 符号表：大量constant，查找和扩容后的内容都正确
+static int test_symtab(void) {
+    Symtab table;
+    symtab_init(&table);
+    char name[32];
+    for (uint32_t i = 0; i < 50000; i++) {
+        int len = snprintf(name, sizeof(name), "CONST_%u", i);
+        assert(symtab_define(&table, name, len, i * 3, 0, (int)i + 1));
+    }
+    assert(table.count == 50000 && table.cap >= 100000);
+    for (uint32_t i = 0; i < 50000; i++) {
+        int len = snprintf(name, sizeof(name), "CONST_%u", i);
+        Symbol* sym = symtab_lookup(&table, name, len);
+        assert(sym && sym->value == i * 3 && sym->line == (int)i + 1);
+    }
+    assert(!symtab_define(&table, "CONST_7", 7, 0, 0, 0));      // 重复definition
+    assert(!symtab_lookup(&table, "CONST_50000", 11));
+    assert(symtab_lookup(&table, "CONST_12345 trailing", 11)->value == 12345 * 3);  // 按span查找
+    symtab_free(&table);
+    return 1;
+}
+
+// module表：每个register都能通过完美哈希找到，名字不对的找不到；reg.<名字>记录backend编号
+static int test_modules(void) {
+    for (int m = 0; m < module_count; m++) {
+        const Module* module = &module_table[m];
+        assert(module_find(module->name, strlen(module->name)) == module);
+        int found = 0;
+        for (int i = 0; i < MODULE_SLOTS; i++) {
+            const ModuleRegister* reg = &module->regs[i];
+            if (!reg->name) continue;
+            assert(module_find_reg(module, reg->name, reg->len) == reg && module_has_reg(module, reg->name));
+            found++;
+        }
+        assert(found == module->reg_count);
+    }
+    const Module* x86 = module_load("x86_real");
+    assert(!module_has_reg(x86, "eax") && !module_has_reg(x86, "a") && !module_has_reg(x86, "xa"));
+    assert(module_find_reg(x86, "six", 2)->number == 6);  // 按span查找
+    assert(!module_find("x86", 3));
+
+    static const char src[] = "use x86_real; reg.di = 1;";
+    Lexer* lexer = lexer_init_buffer(src, strlen(src));
+    Parser* parser = parser_init(lexer);
+    BlockNode* root = (BlockNode*)parser_parse_file(parser);
+    UseNode* use = (UseNode*)root->statements;
+    assert(use->base.type == AST_USE && use->module == x86);
+    RegAssignNode* reg = (RegAssignNode*)use->base.next;
+    assert(reg->base.type == AST_REG_ASSIGN && reg->reg == 7);
+    parser_free(parser);
+    lexer_free(lexer);
+    return 1;
+}
+
 int main(void) {
     int num_tests = sizeof(test_cases) / sizeof(test_cases[0]);
     int passed = 0;
@@ -33,6 +307,48 @@ int main(void) {
         }
     }
 
+    num_tests++;
+    if (test_ast_contents()) {
+        printf("Test ast_contents passed.\n");
+        passed++;
+    }
+
+    num_tests++;
+    if (test_const_folding()) {
+        printf("Test const_folding passed.\n");
+        passed++;
+    }
+
+    num_tests++;
+    if (test_functions()) {
+        printf("Test functions passed.\n");
+        passed++;
+    }
+
+    num_tests++;
+    if (test_symtab()) {
+        printf("Test symtab passed.\n");
+        passed++;
+    }
+
+    num_tests++;
+    if (test_stream()) {
+        printf("Test stream passed.\n");
+        passed++;
+    }
+
+    num_tests++;
+    if (test_error_recovery()) {
+        printf("Test error_recovery passed.\n");
+        passed++;
+    }
+
+    num_tests++;
+    if (test_modules()) {
+        printf("Test modules passed.\n");
+        passed++;
+    }
+
     printf("Passed %d/%d tests.\n", passed, num_tests);
     return (passed == num_tests) ? 0 : 1;
-}
\ No newline at end of file
+}
@@ -0,0 +1,96 @@
+// work-stealing线程池和错误陷阱（批量编译的基础）
+#include "../src/common/pool.h"
+#include "../src/common/utils.h"
+#include "test_common.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define JOB_COUNT 64
+
+typedef struct {
+    int runs[JOB_COUNT];  // 每个job运行的次数（每个job只写自己的格子）
+    int worker[JOB_COUNT];
+    int threads;
+} RunCtx;
+
+static void record_job(void* ctx, size_t job, int worker) {
+    RunCtx* run = ctx;
+    assert(job < JOB_COUNT && worker >= 0 && worker < run->threads);
+    run->runs[job]++;
+    run->worker[job] = worker;
+    // worker 0的块很慢，其它worker做完自己的job后必须去偷
+    if (job < JOB_COUNT / 4) usleep(2000);
+}
+
+static void test_every_job_runs_once(void) {
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        RunCtx run = {{0}, {0}, threads};
+        size_t stolen = pool_run(JOB_COUNT, threads, record_job, &run);
+        for (int i = 0; i < JOB_COUNT; i++) assert(run.runs[i] == 1);
+        if (threads == 1) {
+            assert(stolen == 0);
+        } else {
+            // 慢块的一部分被别的worker偷走了
+            size_t moved = 0;
+            for (int i = 0; i < JOB_COUNT / 4; i++) moved += run.worker[i] != 0;
+            assert(stolen > 0 && moved > 0);
+        }
+    }
+    // threads多于job时按job数算；没有job时直接返回
+    RunCtx run = {{0}, {0}, 3};
+    pool_run(3, 16, record_job, &run);
+    assert(run.runs[0] == 1 && run.runs[1] == 1 && run.runs[2] == 1 && run.runs[3] == 0);
+    assert(pool_run(0, 4, record_job, &run) == 0);
+    assert(pool_cpu_count() >= 1);
+    printf("Test every_job_runs_once passed.\n");
+}
+
+typedef struct {
+    int failed[JOB_COUNT];
+    char message[JOB_COUNT][64];
+} TrapCtx;
+
+// 奇数job在陷阱里报错；陷阱是每个线程各自的
+static void trapped_job(void* ctx, size_t job, int worker) {
+    TrapCtx* traps = ctx;
+    ErrorTrap trap;
+    if (setjmp(trap.env) != 0) {
+        traps->failed[job] = 1;
+        snprintf(traps->message[job], sizeof(traps->message[job]), "%s", trap.message);
+        return;
+    }
+    error_trap_set(&trap);
+    if (job % 2) error("job %zu failed", job);
+    error_trap_set(NULL);
+}
+
+static void test_error_trap(void) {
+    TrapCtx traps = {{0}};
+    pool_run(JOB_COUNT, 4, trapped_job, &traps);
+    for (int i = 0; i < JOB_COUNT; i++) {
+        char expected[64];
+        snprintf(expected, sizeof(expected), "job %d failed", i);
+        assert(traps.failed[i] == i % 2);
+        assert(!traps.failed[i] || strcmp(traps.message[i], expected) == 0);
+    }
+    // 嵌套调用里的错误（safe_malloc → error）同样被截住
+    ErrorTrap trap;
+    volatile int trapped = 0;
+    if (setjmp(trap.env) == 0) {
+        error_trap_set(&trap);
+        safe_malloc(SIZE_MAX);
+        error_trap_set(NULL);
+    } else {
+        trapped = 1;
+    }
+    assert(trapped && strstr(trap.message, "Memory allocation failed") != NULL);
+    printf("Test error_trap passed.\n");
+}
+
+int main(void) {
+    test_every_job_runs_once();
+    test_error_trap();
+    printf("All pool tests passed.\n");
+    return 0;
+}
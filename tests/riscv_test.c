@@ -0,0 +1,392 @@
+#include "../src/codegen/codegen.h"
+#include "test_common.h"
+#include <stdio.h>
+
+// RISC-V backend测试：生成的flat binary用这里独立实现的RV32I + RVC反汇编器解码，
+// 与期望的汇编文本比较（不依赖src/codegen/riscv.c的编码表）
+
+static const char* const abi_names[32] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+};
+
+#define X(n) abi_names[(n) & 31]
+#define CX(n) abi_names[8 + ((n) & 7)]  // RVC的3位register字段：x8..x15
+
+// 取bits[hi:lo]
+static uint32_t bits(uint32_t word, int hi, int lo) {
+    return (word >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+
+// 把n位的值符号扩展
+static int32_t sext(uint32_t value, int n) {
+    return (int32_t)(value << (32 - n)) >> (32 - n);
+}
+
+// 解码一条32位指令，返回0表示不认识
+static int decode32(uint32_t w, uint32_t pc, char* buf, size_t size) {
+    uint32_t rd = bits(w, 11, 7), rs1 = bits(w, 19, 15), rs2 = bits(w, 24, 20), f3 = bits(w, 14, 12);
+    int32_t imm_i = sext(bits(w, 31, 20), 12);
+    int32_t imm_s = sext(bits(w, 31, 25) << 5 | bits(w, 11, 7), 12);
+    int32_t imm_b = sext(bits(w, 31, 31) << 12 | bits(w, 7, 7) << 11 | bits(w, 30, 25) << 5 | bits(w, 11, 8) << 1, 13);
+    int32_t imm_j = sext(bits(w, 31, 31) << 20 | bits(w, 19, 12) << 12 | bits(w, 20, 20) << 11 | bits(w, 30, 21) << 1, 21);
+    switch (bits(w, 6, 0)) {
+        case 0x37:
+            snprintf(buf, size, "lui %s, 0x%x", X(rd), bits(w, 31, 12));
+            return 1;
+        case 0x13: {
+            static const char* const ops[8] = {"addi", "slli", NULL, NULL, NULL, "srli", "ori", "andi"};
+            if (!ops[f3] || ((f3 == 1 || f3 == 5) && bits(w, 31, 25))) return 0;
+            if (f3 == 1 || f3 == 5) snprintf(buf, size, "%s %s, %s, %u", ops[f3], X(rd), X(rs1), rs2);
+            else snprintf(buf, size, "%s %s, %s, %d", ops[f3], X(rd), X(rs1), imm_i);
+            return 1;
+        }
+        case 0x33: {
+            const char* op = NULL;
+            if (bits(w, 31, 25) == 0x00) op = f3 == 0 ? "add" : f3 == 7 ? "and" : f3 == 6 ? "or" : NULL;
+            if (bits(w, 31, 25) == 0x20 && f3 == 0) op = "sub";
+            if (!op) return 0;
+            snprintf(buf, size, "%s %s, %s, %s", op, X(rd), X(rs1), X(rs2));
+            return 1;
+        }
+        case 0x03:
+            if (f3 != 2) return 0;
+            snprintf(buf, size, "lw %s, %d(%s)", X(rd), imm_i, X(rs1));
+            return 1;
+        case 0x23: {
+            static const char* const ops[3] = {"sb", "sh", "sw"};
+            if (f3 > 2) return 0;
+            snprintf(buf, size, "%s %s, %d(%s)", ops[f3], X(rs2), imm_s, X(rs1));
+            return 1;
+        }
+        case 0x67:
+            snprintf(buf, size, "jalr %s, %d(%s)", X(rd), imm_i, X(rs1));
+            return 1;
+        case 0x6F:
+            snprintf(buf, size, "jal %s, 0x%x", X(rd), pc + (uint32_t)imm_j);
+            return 1;
+        case 0x63:
+            if (f3 > 1) return 0;
+            snprintf(buf, size, "%s %s, %s, 0x%x", f3 ? "bne" : "beq", X(rs1), X(rs2), pc + (uint32_t)imm_b);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// 解码一条16位RVC指令（只有RV32C里backend会用到的那些），返回0表示不认识
+static int decode16(uint32_t h, uint32_t pc, char* buf, size_t size) {
+    uint32_t rd = bits(h, 11, 7), rs2 = bits(h, 6, 2), f3 = bits(h, 15, 13);
+    int32_t imm6 = sext(bits(h, 12, 12) << 5 | bits(h, 6, 2), 6);
+    int32_t imm_j = sext(bits(h, 12, 12) << 11 | bits(h, 8, 8) << 10 | bits(h, 10, 9) << 8 | bits(h, 6, 6) << 7 |
+                             bits(h, 7, 7) << 6 | bits(h, 2, 2) << 5 | bits(h, 11, 11) << 4 | bits(h, 5, 3) << 1,
+                         12);
+    int32_t imm_b = sext(bits(h, 12, 12) << 8 | bits(h, 6, 5) << 6 | bits(h, 2, 2) << 5 | bits(h, 11, 10) << 3 |
+                             bits(h, 4, 3) << 1,
+                         9);
+    uint32_t uimm_w = bits(h, 5, 5) << 6 | bits(h, 12, 10) << 3 | bits(h, 6, 6) << 2;  // c.lw / c.sw
+    switch (bits(h, 1, 0) << 3 | f3) {
+        case 0 << 3 | 2:
+            snprintf(buf, size, "c.lw %s, %u(%s)", CX(bits(h, 4, 2)), uimm_w, CX(bits(h, 9, 7)));
+            return 1;
+        case 0 << 3 | 6:
+            snprintf(buf, size, "c.sw %s, %u(%s)", CX(bits(h, 4, 2)), uimm_w, CX(bits(h, 9, 7)));
+            return 1;
+        case 1 << 3 | 0:
+            snprintf(buf, size, "c.addi %s, %d", X(rd), imm6);
+            return 1;
+        case 1 << 3 | 1:
+            snprintf(buf, size, "c.jal 0x%x", pc + (uint32_t)imm_j);
+            return 1;
+        case 1 << 3 | 2:
+            snprintf(buf, size, "c.li %s, %d", X(rd), imm6);
+            return 1;
+        case 1 << 3 | 3:
+            if (rd == 2) {
+                int32_t imm = sext(bits(h, 12, 12) << 9 | bits(h, 4, 3) << 7 | bits(h, 5, 5) << 6 |
+                                       bits(h, 2, 2) << 5 | bits(h, 6, 6) << 4,
+                                   10);
+                snprintf(buf, size, "c.addi16sp sp, %d", imm);
+            } else {
+                snprintf(buf, size, "c.lui %s, 0x%x", X(rd), (uint32_t)imm6 & 0xFFFFF);
+            }
+            return 1;
+        case 1 << 3 | 4: {
+            uint32_t rd3 = bits(h, 9, 7);
+            switch (bits(h, 11, 10)) {
+                case 0: snprintf(buf, size, "c.srli %s, %u", CX(rd3), rs2); return 1;
+                case 2: snprintf(buf, size, "c.andi %s, %d", CX(rd3), imm6); return 1;
+                case 3: {
+                    static const char* const ops[4] = {"c.sub", "c.xor", "c.or", "c.and"};
+                    if (bits(h, 12, 12)) return 0;
+                    snprintf(buf, size, "%s %s, %s", ops[bits(h, 6, 5)], CX(rd3), CX(bits(h, 4, 2)));
+                    return 1;
+                }
+                default: return 0;
+            }
+        }
+        case 1 << 3 | 5:
+            snprintf(buf, size, "c.j 0x%x", pc + (uint32_t)imm_j);
+            return 1;
+        case 1 << 3 | 6:
+        case 1 << 3 | 7:
+            snprintf(buf, size, "%s %s, 0x%x", f3 == 6 ? "c.beqz" : "c.bnez", CX(bits(h, 9, 7)), pc + (uint32_t)imm_b);
+            return 1;
+        case 2 << 3 | 0:
+            snprintf(buf, size, "c.slli %s, %u", X(rd), rs2);
+            return 1;
+        case 2 << 3 | 2:
+            snprintf(buf, size, "c.lwsp %s, %u(sp)", X(rd), bits(h, 3, 2) << 6 | bits(h, 12, 12) << 5 | bits(h, 6, 4) << 2);
+            return 1;
+        case 2 << 3 | 4:
+            if (bits(h, 12, 12) == 0) {
+                if (rs2) snprintf(buf, size, "c.mv %s, %s", X(rd), X(rs2));
+                else snprintf(buf, size, "c.jr %s", X(rd));
+            } else {
+                if (rs2) snprintf(buf, size, "c.add %s, %s", X(rd), X(rs2));
+                else snprintf(buf, size, "c.jalr %s", X(rd));
+            }
+            return 1;
+        case 2 << 3 | 6:
+            snprintf(buf, size, "c.swsp %s, %u(sp)", X(rs2), bits(h, 8, 7) << 6 | bits(h, 12, 9) << 2);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// 反汇编整个flat binary，每条指令一行"地址: 汇编"
+static char* disassemble(const uint8_t* code, size_t len) {
+    size_t cap = len * 48 + 1, used = 0;
+    char* text = malloc(cap);
+    text[0] = '\0';
+    for (uint32_t pc = 0; pc < len;) {
+        char insn[64];
+        uint32_t h = code[pc] | (uint32_t)code[pc + 1] << 8;
+        int ok;
+        if ((h & 3) == 3) {
+            assert(pc + 4 <= len);
+            ok = decode32(h | (uint32_t)code[pc + 2] << 16 | (uint32_t)code[pc + 3] << 24, pc, insn, sizeof(insn));
+        } else {
+            ok = decode16(h, pc, insn, sizeof(insn));
+        }
+        if (!ok) {
+            fprintf(stderr, "Cannot decode at 0x%x: %02X %02X\n", pc, code[pc], code[pc + 1]);
+            assert(0);
+        }
+        used += (size_t)snprintf(text + used, cap - used, "%x: %s\n", pc, insn);
+        pc += (h & 3) == 3 ? 4 : 2;
+    }
+    return text;
+}
+
+// 断言反汇编结果与期望完全一致
+static void expect_asm_opt(const char* src, int optimize, const char* expected) {
+    Emitter out = compile_source_opt(src, optimize);
+    char* text = disassemble(out.data, out.len);
+    if (strcmp(text, expected) != 0) {
+        fprintf(stderr, "Unexpected code for:\n%s\n got:\n%s expected:\n%s", src, text, expected);
+        assert(0);
+    }
+    free(text);
+    emitter_free(&out);
+}
+
+static void expect_asm(const char* src, const char* expected) {
+    expect_asm_opt(src, 1, expected);
+}
+
+static void test_reg_assign(void) {
+    // 12位以内一条addi；否则lui + addi，低12位是负数时高位进1；低12位为0时只要lui
+    expect_asm("use riscv32; reg.a0 = 5; reg.a1 = 0x12345678; reg.a2 = 0x12345FFF; reg.a3 = 0x1000; reg.x5 = -1;",
+               "0: addi a0, zero, 5\n"
+               "4: lui a1, 0x12345\n"
+               "8: addi a1, a1, 1656\n"
+               "c: lui a2, 0x12346\n"
+               "10: addi a2, a2, -1\n"
+               "14: lui a3, 0x1\n"
+               "18: addi t0, zero, -1\n");
+    // RVC：c.li / c.lui，放不下时退回32位编码
+    expect_asm("use riscv32c; reg.a0 = 5; reg.s1 = 0x1000; reg.fp = 0x12345678; reg.ra = 31; reg.sp = 32;",
+               "0: c.li a0, 5\n"
+               "2: c.lui s1, 0x1\n"
+               "4: lui s0, 0x12345\n"
+               "8: addi s0, s0, 1656\n"
+               "c: c.li ra, 31\n"
+               "e: addi sp, zero, 32\n");
+    printf("Test reg_assign passed.\n");
+}
+
+static void test_stores(void) {
+    // 低2 KiB用zero作基址；t5只在地址离开当前窗口时重新lui；t6里的值被后面的store复用
+    expect_asm("use riscv32; mem.dword[0x100] = 0x11223344; mem.byte[0x10000000] = 7; mem.byte[0x10000004] = 7;"
+               "mem.word[0x10000800] = 0; reg.a0 = 1;",
+               "0: lui t6, 0x11223\n"
+               "4: addi t6, t6, 836\n"
+               "8: sw t6, 256(zero)\n"
+               "c: addi t6, zero, 7\n"
+               "10: lui t5, 0x10000\n"
+               "14: sb t6, 0(t5)\n"
+               "18: sb t6, 4(t5)\n"
+               "1c: addi a0, zero, 1\n"  // 最后一段store还在攒着，寄存器赋值不读写memory
+               "20: lui t5, 0x10001\n"
+               "24: sh zero, -2048(t5)\n");
+    // 相邻的常量store合并成对齐的sw / sh / sb
+    expect_asm("use riscv32c; for i in 0..7 { mem.byte[0x10000001 + i] = 'A'; }",
+               "0: addi t6, zero, 65\n"
+               "4: lui t5, 0x10000\n"
+               "8: sb t6, 1(t5)\n"
+               "c: c.lui t6, 0x4\n"
+               "e: addi t6, t6, 321\n"
+               "12: sh t6, 2(t5)\n"
+               "16: lui t6, 0x41414\n"
+               "1a: addi t6, t6, 321\n"
+               "1e: sw t6, 4(t5)\n");
+    // 其余的store按程序顺序逐条生成：重复写同一地址（UART数据寄存器）每次都写，地址递减也不重排
+    expect_asm("use riscv32c; mem.byte[0x10000000] = 'H'; mem.byte[0x10000000] = 'i'; mem.byte[0x10000000] = 10;"
+               "mem.word[0x10000010] = 1; mem.word[0x10000008] = 2;",
+               "0: addi t6, zero, 72\n"
+               "4: lui t5, 0x10000\n"
+               "8: sb t6, 0(t5)\n"
+               "c: addi t6, zero, 105\n"
+               "10: sb t6, 0(t5)\n"
+               "14: c.li t6, 10\n"
+               "16: sb t6, 0(t5)\n"
+               "1a: c.li t6, 1\n"
+               "1c: sh t6, 16(t5)\n"
+               "20: c.li t6, 2\n"
+               "22: sh t6, 8(t5)\n");
+    // 运行时才知道的地址：常量部分放进disp，超过12位时先加到t5里；算出来的偏移放在临时保存的s2
+    expect_asm("use riscv32c; func put(c, x) { mem.byte[0x10000000 + x * 2] = c; mem.byte[0x1000 + x] = 7;"
+               "mem.word[x + 0x10] = c; } for i in 0..100 { put(0x41, i); }",
+               "0: addi s1, zero, 100\n"
+               "4: c.addi sp, -4\n"
+               "6: c.swsp s1, 0(sp)\n"
+               "8: addi t6, zero, 100\n"
+               "c: sub s1, t6, s1\n"
+               "10: c.addi sp, -4\n"
+               "12: c.swsp s2, 0(sp)\n"
+               "14: slli s2, s1, 1\n"
+               "18: addi t6, zero, 65\n"
+               "1c: lui t5, 0x10000\n"
+               "20: c.add t5, s2\n"
+               "22: sb t6, 0(t5)\n"
+               "26: c.lwsp s2, 0(sp)\n"
+               "28: c.addi sp, 4\n"
+               "2a: c.li t6, 7\n"
+               "2c: c.lui t5, 0x1\n"
+               "2e: c.add t5, s1\n"
+               "30: sb t6, 0(t5)\n"
+               "34: addi t6, zero, 65\n"
+               "38: sh t6, 16(s1)\n"
+               "3c: c.lwsp s1, 0(sp)\n"
+               "3e: c.addi sp, 4\n"
+               "40: c.addi s1, -1\n"
+               "42: c.bnez s1, 0x4\n");
+    printf("Test stores passed.\n");
+}
+
+static void test_functions(void) {
+    // 调用别的函数才保存ra；最后一个调用变成尾调用，先恢复ra
+    expect_asm("use riscv32c; func a(x) { reg.s3 = x; a(x); } func b(y) { a(y); a(2); } b(4);",
+               "0: c.j 0x6\n"
+               "2: c.mv s3, a0\n"
+               "4: c.j 0x2\n"
+               "6: c.j 0x16\n"
+               "8: c.addi sp, -4\n"
+               "a: c.swsp ra, 0(sp)\n"
+               "c: c.jal 0x2\n"
+               "e: c.li a0, 2\n"
+               "10: c.lwsp ra, 0(sp)\n"
+               "12: c.addi sp, 4\n"
+               "14: c.j 0x2\n"
+               "16: c.li a0, 4\n"
+               "18: c.jal 0x8\n");
+    // 第9个parameter在栈上：s0帧，参数在[s0+8]（上面是保存的s0和ra）
+    expect_asm("use riscv32; func g(a, b, c, d, e, f, g2, h, i) { reg.s3 = i; g(a, b, c, d, e, f, g2, h, i); reg.s4 = 0; }",
+               "0: jal zero, 0x40\n"
+               "4: addi sp, sp, -8\n"
+               "8: sw ra, 4(sp)\n"
+               "c: sw s0, 0(sp)\n"
+               "10: addi s0, sp, 0\n"
+               "14: lw s3, 8(s0)\n"
+               "18: lw t6, 8(s0)\n"
+               "1c: addi sp, sp, -4\n"
+               "20: sw t6, 0(sp)\n"
+               "24: jal ra, 0x4\n"
+               "28: addi sp, sp, 4\n"
+               "2c: addi s4, zero, 0\n"
+               "30: lw s0, 0(sp)\n"
+               "34: lw ra, 4(sp)\n"
+               "38: addi sp, sp, 8\n"
+               "3c: jalr zero, 0(ra)\n");
+    // 寄存器parameter在入口复制到变量：写a0和调用g之后读到的仍是实参（跨调用，溢出到[s0-4]）
+    expect_asm("use riscv32c; func g() { reg.a0 = 1; reg.a1 = 2; reg.a0 = 3; reg.a1 = 4; reg.a0 = 5; reg.a1 = 6;"
+               "  reg.a0 = 7; reg.a1 = 8; reg.a0 = 9; }"
+               "func f(a) { reg.a0 = 3; reg.t0 = a; g(); reg.t1 = a; } f(5);",
+               "0: c.j 0x8\n"
+               "2: c.li a1, 8\n"
+               "4: c.li a0, 9\n"
+               "6: c.jr ra\n"
+               "8: c.j 0x2e\n"
+               "a: c.addi sp, -8\n"
+               "c: c.swsp ra, 4(sp)\n"
+               "e: c.swsp s0, 0(sp)\n"
+               "10: c.mv s0, sp\n"
+               "12: c.addi sp, -4\n"
+               "14: sw a0, -4(s0)\n"
+               "18: c.li a0, 3\n"
+               "1a: lw t0, -4(s0)\n"
+               "1e: c.jal 0x2\n"
+               "20: lw t1, -4(s0)\n"
+               "24: c.mv sp, s0\n"
+               "26: c.lwsp s0, 0(sp)\n"
+               "28: c.lwsp ra, 4(sp)\n"
+               "2a: c.addi sp, 8\n"
+               "2c: c.jr ra\n"
+               "2e: c.li a0, 5\n"
+               "30: c.jal 0xa\n");
+    printf("Test functions passed.\n");
+}
+
+static void test_control_flow(void) {
+    // 循环计数器s1：c.addi + c.bnez；var运算用三操作数形式和移位
+    expect_asm("use riscv32c; var s = 0; for k in 0..100 { s = s + k; } reg.a0 = s * 8;",
+               "0: c.li s2, 0\n"
+               "2: addi s1, zero, 100\n"
+               "6: c.addi sp, -4\n"
+               "8: c.swsp s1, 0(sp)\n"
+               "a: addi t6, zero, 100\n"
+               "e: sub s1, t6, s1\n"
+               "12: c.add s2, s1\n"
+               "14: c.lwsp s1, 0(sp)\n"
+               "16: c.addi sp, 4\n"
+               "18: c.addi s1, -1\n"
+               "1a: c.bnez s1, 0x6\n"
+               "1c: slli a0, s2, 3\n");
+
+    // 分支放不下13位时变成反向分支跳过jal
+    char src[32768] = "use riscv32c; func f(c) { if c { ";
+    for (int i = 0; i < 600; i++) {
+        sprintf(src + strlen(src), "mem.dword[0x%x] = 0x12345678; ", 0x1000000 + 4096 * i);
+    }
+    strcat(src, "} reg.s3 = 1; } f(1);");
+    Emitter out = compile_source(src);
+    char* text = disassemble(out.data, out.len);
+    assert(strncmp(text, "0: jal zero, 0x12d8\n4: bne a0, zero, 0xc\n8: jal zero, 0x12d4\n", 60) == 0);
+    free(text);
+    emitter_free(&out);
+
+    // 不优化时跳转一开始就是32位的
+    expect_asm_opt("use riscv32c; while 1 { reg.a0 = 1; }", 0, "0: c.li a0, 1\n2: jal zero, 0x0\n");
+    printf("Test control_flow passed.\n");
+}
+
+int main(void) {
+    test_reg_assign();
+    test_stores();
+    test_functions();
+    test_control_flow();
+    printf("All riscv tests passed.\n");
+    return 0;
+}
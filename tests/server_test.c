@@ -0,0 +1,142 @@
+// 编译服务：子进程里跑server_run，通过Unix域socket发请求，和进程内的ecc_compile对比
+#include "../src/server/server.h"
+#include "test_common.h"
+#include <signal.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const char* sources[] = {
+    "use x86_real;\nconst VGA = 0xB8000;\n"
+    "func put(c, x) { mem.byte[VGA + x * 2] = c; }\nput('O', 0); put('K', 1);\n",
+    "use riscv32c; reg.a0 = 5; mem.word[0x100] = 0x4141;",
+    "reg.zz = 1;\nreg.ax = 0x10000;\n",  // 两个错误
+    "",
+};
+#define SOURCE_COUNT (sizeof(sources) / sizeof(sources[0]))
+
+static char socket_path[64];
+
+static void put_u32(uint8_t* p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = value >> (8 * i);
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int connect_server(void) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, socket_path);
+    for (int tries = 0; tries < 200; tries++) {  // 等子进程开始监听
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        assert(fd >= 0);
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) return fd;
+        close(fd);
+        usleep(10000);
+    }
+    assert(!"server did not start");
+    return -1;
+}
+
+static void send_request(int fd, const char* src) {
+    uint8_t header[SERVER_REQUEST_HEADER];
+    put_u32(header, (uint32_t)strlen(src));
+    assert(write(fd, header, sizeof(header)) == sizeof(header));
+    assert(write(fd, src, strlen(src)) == (ssize_t)strlen(src));
+}
+
+static void read_exact(int fd, uint8_t* buf, size_t len) {
+    for (size_t got = 0; got < len;) {
+        ssize_t n = read(fd, buf + got, len - got);
+        assert(n > 0);
+        got += n;
+    }
+}
+
+// 回复必须和同样选项的ecc_compile逐字节相同（机器码和诊断）
+static void check_response(int fd, EccContext* ctx, const char* src) {
+    uint8_t header[SERVER_RESPONSE_HEADER];
+    read_exact(fd, header, sizeof(header));
+    uint32_t code_len = get_u32(header + 4), diagnostics_len = get_u32(header + 8);
+    uint8_t* body = malloc(code_len + diagnostics_len + 1);
+    read_exact(fd, body, code_len + diagnostics_len);
+
+    EccBuffer expected = {0};
+    int status = ecc_compile(ctx, src, strlen(src), &expected) != 0;
+    assert(get_u32(header) == (uint32_t)status && code_len == expected.len);
+    assert(code_len == 0 || memcmp(body, expected.data, code_len) == 0);
+    assert(diagnostics_len == strlen(ecc_diagnostics(ctx)));
+    assert(memcmp(body + code_len, ecc_diagnostics(ctx), diagnostics_len) == 0);
+    ecc_buffer_free(&expected);
+    free(body);
+}
+
+static void test_serve(void) {
+    snprintf(socket_path, sizeof(socket_path), "/tmp/ecc_server_test_%d.sock", (int)getpid());
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        // 启动、统计和超限请求的信息不混进测试输出
+        freopen("/dev/null", "w", stdout);
+        freopen("/dev/null", "w", stderr);
+        alarm(60);  // 测试失败时服务不会一直留着
+        exit(server_run(socket_path, 2, NULL));
+    }
+
+    EccContext* ctx = ecc_context_new(NULL);
+    // 多个连接同时在编译；每个连接上连续发完所有请求再读，回复按请求顺序
+    int fds[4];
+    for (int i = 0; i < 4; i++) fds[i] = connect_server();
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 4; i++) {
+            for (size_t j = 0; j < SOURCE_COUNT; j++) send_request(fds[i], sources[(i + j) % SOURCE_COUNT]);
+        }
+        for (int i = 0; i < 4; i++) {
+            for (size_t j = 0; j < SOURCE_COUNT; j++) check_response(fds[i], ctx, sources[(i + j) % SOURCE_COUNT]);
+        }
+    }
+    // 请求分几次到达也一样
+    const char* src = sources[0];
+    uint8_t header[SERVER_REQUEST_HEADER];
+    put_u32(header, (uint32_t)strlen(src));
+    assert(write(fds[0], header, 3) == 3);
+    usleep(20000);
+    assert(write(fds[0], header + 3, 1) == 1 && write(fds[0], src, 10) == 10);
+    usleep(20000);
+    assert(write(fds[0], src + 10, strlen(src) - 10) == (ssize_t)(strlen(src) - 10));
+    check_response(fds[0], ctx, src);
+    for (int i = 0; i < 4; i++) close(fds[i]);
+
+    // 超过上限的请求：连接被关闭，服务继续
+    int fd = connect_server();
+    put_u32(header, SERVER_MAX_SOURCE + 1);
+    assert(write(fd, header, sizeof(header)) == sizeof(header));
+    uint8_t byte;
+    assert(read(fd, &byte, 1) == 0);
+    close(fd);
+    fd = connect_server();
+    send_request(fd, sources[1]);
+    check_response(fd, ctx, sources[1]);
+    close(fd);
+
+    // SIGTERM：正常退出并删除socket文件
+    int status;
+    assert(kill(pid, SIGTERM) == 0 && waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    assert(access(socket_path, F_OK) != 0);
+    ecc_context_free(ctx);
+    printf("Test serve passed.\n");
+}
+
+int main(void) {
+#if SERVER_AVAILABLE
+    test_serve();
+#else
+    printf("Test serve skipped (the server needs Linux).\n");
+#endif
+    printf("All server tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,57 @@
+// 回归测试：一百万条语句的文件在固定的小栈上完成解析和代码生成
+// 遍历是迭代的，栈深度不随语句数量增长
+#include "../src/parser/parser.h"
+#include "../src/codegen/codegen.h"
+#include "test_common.h"
+#include <pthread.h>
+#include <stdio.h>
+
+#define STATEMENT_COUNT 1000000
+#define STACK_BUDGET (256 * 1024)  // 远小于默认的8MB线程栈
+
+typedef struct {
+    const char* src;
+    size_t len;
+    size_t statements;  // ast_walk访问到的语句数
+    long bytes;         // 生成的机器码bytes
+    size_t removed;     // IR pass删除的指令数
+} StackJob;
+
+static void count_visit(AstVisitor* visitor, AstNode* node, int depth) {
+    if (node->type == AST_REG_ASSIGN) (*(size_t*)visitor->ctx)++;
+}
+
+static void* compile_job(void* arg) {
+    StackJob* job = arg;
+    AstVisitor counter = {count_visit, NULL, &job->statements};
+    Emitter out = compile_source_ex(job->src, job->len, 1, &counter, &job->removed);
+    job->bytes = (long)out.len;
+    emitter_free(&out);
+    return NULL;
+}
+
+int main(void) {
+    static const char stmt[] = "reg.ax = 0x1234;\n";
+    size_t stmt_len = sizeof(stmt) - 1;
+    size_t len = stmt_len * STATEMENT_COUNT;
+    char* src = malloc(len);
+    assert(src);
+    for (size_t i = 0; i < STATEMENT_COUNT; i++) memcpy(src + i * stmt_len, stmt, stmt_len);
+
+    StackJob job = {src, len, 0, 0, 0};
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    assert(pthread_attr_setstacksize(&attr, STACK_BUDGET) == 0);
+    pthread_t thread;
+    assert(pthread_create(&thread, &attr, compile_job, &job) == 0);
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+
+    assert(job.statements == STATEMENT_COUNT);
+    // 每条语句是两条IR（vN = 0x1234; ax = vN）；同一个值重复赋给ax，只留下最后一条mov r16, imm16（3 bytes）
+    assert(job.bytes == 3 && job.removed == 2 * (size_t)(STATEMENT_COUNT - 1));
+    free(src);
+    printf("Test million_statements passed (%zu statements, %ld bytes, %d KiB stack).\n",
+           job.statements, job.bytes, STACK_BUDGET / 1024);
+    return 0;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "../src/codegen/codegen.h"
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -17,4 +18,31 @@ static inline void fill_random_bytes(uint8_t* buf, size_t len) {
     }
 }
 
-// 你可以根据仓库实际的 ECC 相关实现，添加更多通用测试工具
\ No newline at end of file
+// 按命令行编译器的路径编译一段源码（新的lexer、parser和codegen），返回机器码（调用者emitter_free）。
+// visitor非NULL时先用它遍历AST，removed非NULL时返回IR pass删除的指令数
+static inline Emitter compile_source_ex(const char* src, size_t len, int optimize, AstVisitor* visitor,
+                                        size_t* removed) {
+    Lexer* lexer = lexer_init_buffer(src, len);
+    Parser* parser = parser_init(lexer);
+    AstNode* ast = parser_parse_file(parser);
+    if (visitor) ast_walk(ast, visitor);
+    Emitter out;
+    emitter_init(&out, 0);
+    Codegen cg;
+    codegen_init(&cg, &out);
+    cg.optimize = optimize;
+    codegen_generate(&cg, ast);
+    if (removed) *removed = cg.ir_removed;
+    codegen_cleanup(&cg);
+    parser_free(parser);
+    lexer_free(lexer);
+    return out;
+}
+
+static inline Emitter compile_source_opt(const char* src, int optimize) {
+    return compile_source_ex(src, strlen(src), optimize, NULL, NULL);
+}
+
+static inline Emitter compile_source(const char* src) {
+    return compile_source_opt(src, 1);
+}
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+"""Client for the ECC compile server (elfc-compiler serve <socket>).
+
+Compile files through a running server:
+    tools/ecc_client.py /tmp/ecc.sock boot.elfc -o boot.bin kernel.elfc -o kernel.bin
+
+Measure request latency (each file is compiled --repeat times, outputs not written):
+    tools/ecc_client.py /tmp/ecc.sock examples/*.elfc --repeat 1000
+
+Frames (src/server/server.h), all integers u32 little-endian:
+    request:  <source length> <source>
+    response: <status 0=ok 1=errors> <code length> <diagnostics length> <code> <diagnostics>
+"""
+import socket
+import struct
+import sys
+import time
+
+
+class EccClient:
+    def __init__(self, path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path)
+
+    def close(self):
+        self.sock.close()
+
+    def _recv_exact(self, size):
+        data = bytearray()
+        while len(data) < size:
+            chunk = self.sock.recv(size - len(data))
+            if not chunk:
+                raise ConnectionError("server closed the connection")
+            data += chunk
+        return bytes(data)
+
+    def compile(self, source):
+        """Returns (ok, machine code, diagnostics text)."""
+        self.sock.sendall(struct.pack("<I", len(source)) + source)
+        status, code_len, diag_len = struct.unpack("<III", self._recv_exact(12))
+        body = self._recv_exact(code_len + diag_len)
+        return status == 0, body[:code_len], body[code_len:].decode("utf-8", "replace")
+
+
+USAGE = "usage: ecc_client.py <socket> <input.elfc> [-o <output.bin>] ... [--repeat N]"
+
+
+def parse_args(argv):
+    """Returns (socket path, [(input, output)], repeat); -o belongs to the input before it."""
+    positional, files, repeat = [], [], 0
+    i = 0
+    while i < len(argv):
+        arg = argv[i]
+        if arg in ("-o", "--repeat"):
+            if i + 1 >= len(argv):
+                sys.exit("%s: missing value after %s" % (USAGE, arg))
+            if arg == "--repeat":
+                repeat = int(argv[i + 1])
+            elif len(positional) < 2 or files[-1][1] is not None:
+                sys.exit("%s: -o must follow an input file" % USAGE)
+            else:
+                files[-1][1] = argv[i + 1]
+            i += 2
+            continue
+        if arg in ("-h", "--help") or arg.startswith("-"):
+            sys.exit(USAGE)
+        positional.append(arg)
+        if len(positional) > 1:
+            files.append([arg, None])
+        i += 1
+    if not files:
+        sys.exit(USAGE)
+    files = [(path, output or path.rsplit(".", 1)[0] + ".bin") for path, output in files]
+    return positional[0], files, repeat
+
+
+def main(argv):
+    socket_path, files, repeat = parse_args(argv)
+    sources = []
+    for path, _ in files:
+        with open(path, "rb") as f:
+            sources.append(f.read())
+    client = EccClient(socket_path)
+    failed = 0
+    try:
+        if repeat > 0:
+            latencies = []
+            for _ in range(repeat):
+                for source in sources:
+                    start = time.perf_counter()
+                    ok, _, _ = client.compile(source)
+                    latencies.append(time.perf_counter() - start)
+                    failed += not ok
+            latencies.sort()
+            count = len(latencies)
+            print("%d compilations, %d failed: mean %.3f ms, p50 %.3f ms, p99 %.3f ms, %.0f compilations/s" % (
+                count, failed, sum(latencies) / count * 1e3, latencies[count // 2] * 1e3,
+                latencies[min(count - 1, count * 99 // 100)] * 1e3, count / sum(latencies)))
+        else:
+            for (path, output), source in zip(files, sources):
+                ok, code, diagnostics = client.compile(source)
+                if ok:
+                    with open(output, "wb") as f:
+                        f.write(code)
+                    print("[OK]   %s -> %s: %d bytes" % (path, output, len(code)))
+                else:
+                    failed += 1
+                    print("[FAIL] %s" % path)
+                    sys.stdout.write(diagnostics)
+    finally:
+        client.close()
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))